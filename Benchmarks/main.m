@@ -0,0 +1,605 @@
+//
+//  main.m
+//  SwiftypeTouch Benchmarks
+//
+//  Headless benchmarks of the Foundation-only core of SwiftypeTouch. Run against stub_server.py,
+//  see README.md.
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#include <sys/resource.h>
+#ifdef GNUSTEP
+#import <Foundation/NSDebug.h>
+#endif
+
+#import "STAPIClient.h"
+#import "STAPIBatch.h"
+#import "STAPIMetrics.h"
+#import "STAPIRequestTimeline.h"
+#import "STDecodePipeline.h"
+#import "STQueryCache.h"
+#import "STPagedResultStore.h"
+#import "STRequestBuilder.h"
+#import "STStreamingResultParser.h"
+#import "NSDictionary+STUtils.h"
+#import "NSString+STUtils.h"
+
+static NSTimeInterval STBenchmarkNow(void) {
+    return [NSDate timeIntervalSinceReferenceDate];
+}
+
+static unsigned long long STBenchmarkPeakMemory(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return (unsigned long long)usage.ru_maxrss;
+#else
+    // Linux reports kilobytes
+    return (unsigned long long)usage.ru_maxrss * 1024ULL;
+#endif
+}
+
+static BOOL STBenchmarkCountsAllocations(void) {
+#ifdef GNUSTEP
+    return YES;
+#else
+    return NO;
+#endif
+}
+
+// Objects allocated since counting was switched on, GNUstep's allocation debugging keeps a total per class
+static unsigned long long STBenchmarkAllocatedObjects(void) {
+    unsigned long long total = 0;
+#ifdef GNUSTEP
+    Class *classes = GSDebugAllocationClassList();
+    for (Class *cls = classes; cls && *cls; cls++) {
+        total += GSDebugAllocationTotal(*cls);
+    }
+#endif
+    return total;
+}
+
+static void STBenchmarkCountAllocations(BOOL active) {
+#ifdef GNUSTEP
+    GSDebugAllocationActive(active);
+#endif
+}
+
+// The parameters STAPIClient builds for every request, both serialization paths start from them
+static NSDictionary *STBenchmarkRequestParams(NSDictionary *delegateParams, NSString *engineKey, NSString *query) {
+    NSMutableDictionary *params = [NSMutableDictionary dictionaryWithDictionary:delegateParams];
+    [params setObject:engineKey forKey:@"engine_key"];
+    [params setObject:query forKey:@"q"];
+    [params setObject:@20 forKey:@"per_page"];
+    [params setObject:@1 forKey:@"page"];
+    return params;
+}
+
+// How STAPIClient built requests before canonical JSON and STRequestBuilder, as a reference point. The response
+// was cached by NSURLCache under the request, so there was no key to build
+static NSURLRequest *STBenchmarkLegacyURLRequest(NSString *endpoint, NSDictionary *params) {
+    NSData *requestData = [NSJSONSerialization dataWithJSONObject:params options:NSJSONWritingPrettyPrinted error:NULL];
+
+    NSMutableURLRequest *URLRequest = [[NSMutableURLRequest alloc] initWithURL:[NSURL URLWithString:endpoint]];
+    [URLRequest setHTTPMethod:@"POST"];
+    [URLRequest setHTTPBody:requestData];
+    [URLRequest setValue:@"application/json" forHTTPHeaderField:@"Content-Type"];
+    [URLRequest setValue:@"gzip, deflate" forHTTPHeaderField:@"Accept-Encoding"];
+    [URLRequest setValue:@"1.0" forHTTPHeaderField:@"X-SwiftypeAPI-ClientVersion"];
+    [URLRequest setValue:@"iOS" forHTTPHeaderField:@"X-SwiftypeAPI-Platform"];
+    return URLRequest;
+}
+
+// The appendFormat: per byte URL encoding NSString+STUtils used before its encoding table
+static NSString *STBenchmarkLegacyURLEncodedString(NSString *string) {
+    NSMutableString *output = [NSMutableString string];
+    const unsigned char *source = (const unsigned char *)[string UTF8String];
+    size_t sourceLength = strlen((const char *)source);
+    for (size_t i = 0; i < sourceLength; i++) {
+        const unsigned char c = source[i];
+        if (c == ' ') {
+            [output appendString:@"+"];
+        }
+        else if (c == '.' || c == '-' || c == '_' || c == '~' ||
+                 (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) {
+            [output appendFormat:@"%c", c];
+        }
+        else {
+            [output appendFormat:@"%%%02X", c];
+        }
+    }
+    return output;
+}
+
+static NSString *STBenchmarkLegacyQueryString(NSDictionary *params) {
+    NSMutableArray *result = [NSMutableArray array];
+    for (NSString *key in params) {
+        NSString *value = [params objectForKey:key];
+        [result addObject:[NSString stringWithFormat:@"%@=%@", STBenchmarkLegacyURLEncodedString(key), STBenchmarkLegacyURLEncodedString(value)]];
+    }
+    return [result componentsJoinedByString:@"&"];
+}
+
+#pragma mark - STBenchmarkDelegate
+
+@interface STBenchmarkDelegate : NSObject <STAPIClientDelegate>
+
+@property (nonatomic, assign) NSUInteger finishedCount;
+@property (nonatomic, assign) NSUInteger failedCount;
+
+@end
+
+@implementation STBenchmarkDelegate
+
+- (NSDictionary *)clientRequestParameters:(STAPIClient *)client forQuery:(NSString *)query withType:(STSearchType)type {
+    return @{ @"search_fields" : @{ @"page" : @[ @"title^3", @"sections^2", @"body" ] } };
+}
+
+- (void)client:(STAPIClient *)client didFinishRequest:(STAPIRequest *)request withResult:(NSDictionary *)result {
+    self.finishedCount++;
+}
+
+- (void)client:(STAPIClient *)client didFailRequest:(STAPIRequest *)request error:(NSError *)error {
+    self.failedCount++;
+    fprintf(stderr, "request %s failed: %s\n", [[request description] UTF8String], [[error description] UTF8String]);
+}
+
+@end
+
+#pragma mark - STBenchmark
+
+@interface STBenchmark : NSObject
+
+@property (nonatomic, copy) NSString *serverURL;
+@property (nonatomic, copy) NSString *fixturesPath;
+@property (nonatomic, assign) NSUInteger requestCount;
+@property (nonatomic, assign) NSUInteger concurrency;
+@property (nonatomic, assign) NSUInteger iterations;
+@property (nonatomic, assign) NSUInteger pageCount;
+@property (nonatomic, strong) NSMutableDictionary *report;
+
+- (void)run;
+- (void)_runClientWithType:(STSearchType)type cached:(BOOL)cached name:(NSString *)name;
+- (void)_runBatch;
+- (void)_runDecode;
+- (void)_runPaging;
+- (void)_runCategories;
+- (void)_runRequestBuilding;
+- (void)_report:(NSString *)name values:(NSDictionary *)values;
+
+@end
+
+@implementation STBenchmark
+
+- (void)run {
+    self.report = [NSMutableDictionary dictionary];
+
+    [self _runDecode];
+    [self _runPaging];
+    [self _runCategories];
+    [self _runRequestBuilding];
+    if (self.serverURL.length > 0) {
+        [self _runClientWithType:STSearchTypeSuggest cached:NO name:@"client.suggest"];
+        [self _runClientWithType:STSearchTypeSearch cached:NO name:@"client.search"];
+        [self _runClientWithType:STSearchTypeSearch cached:YES name:@"client.search.cached"];
+        [self _runBatch];
+    }
+
+    [self _report:@"process" values:@{ @"peak_memory_bytes" : @(STBenchmarkPeakMemory()) }];
+}
+
+- (void)_runClientWithType:(STSearchType)type cached:(BOOL)cached name:(NSString *)name {
+    STBenchmarkDelegate *delegate = [[STBenchmarkDelegate alloc] init];
+    STAPIClient *client = [[STAPIClient alloc] initWithApiKey:@"benchmark"];
+    client.baseURL = [self.serverURL stringByAppendingString:@"/api/v1/public"];
+    client.delegate = delegate;
+    client.maxConcurrentRequests = self.concurrency;
+    client.queryCache = cached ? [[STQueryCache alloc] init] : nil;
+    client.suggestCache = nil;
+    // Results persisted by an earlier run would turn network measurements into cache hits
+    client.persistentStore = nil;
+    [client.decodePipeline resetStatistics];
+
+    // A cached run first fills the cache with the queries it measures
+    NSUInteger distinctQueries = cached ? MAX(self.requestCount / 10, 1) : self.requestCount;
+    if (cached) {
+        for (NSUInteger i = 0; i < distinctQueries; i++) {
+            NSString *query = [NSString stringWithFormat:@"benchmark query %lu", (unsigned long)i];
+            (type == STSearchTypeSuggest) ? [client suggestQuery:query] : [client searchQuery:query];
+        }
+        while (delegate.finishedCount + delegate.failedCount < distinctQueries) {
+            [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+        }
+        delegate.finishedCount = 0;
+        delegate.failedCount = 0;
+        [client.metrics reset];
+    }
+
+    NSTimeInterval start = STBenchmarkNow();
+    for (NSUInteger i = 0; i < self.requestCount; i++) {
+        NSString *query = [NSString stringWithFormat:@"benchmark query %lu", (unsigned long)(i % distinctQueries)];
+        (type == STSearchTypeSuggest) ? [client suggestQuery:query] : [client searchQuery:query];
+    }
+
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:300.0];
+    while (delegate.finishedCount + delegate.failedCount < self.requestCount && [deadline timeIntervalSinceNow] > 0) {
+        [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    }
+    NSTimeInterval elapsed = STBenchmarkNow() - start;
+
+    STAPIMetrics *metrics = client.metrics;
+    [self _report:name values:@{
+        @"requests" : @(self.requestCount),
+        @"finished" : @(delegate.finishedCount),
+        @"failed" : @(delegate.failedCount),
+        @"concurrency" : @(self.concurrency),
+        @"throughput_per_s" : @(delegate.finishedCount / MAX(elapsed, 1e-9)),
+        @"latency_p50_ms" : @([metrics percentile:50 forStage:STAPIMetricsStageTotal type:type] * 1000.0),
+        @"latency_p95_ms" : @([metrics percentile:95 forStage:STAPIMetricsStageTotal type:type] * 1000.0),
+        @"latency_p99_ms" : @([metrics percentile:99 forStage:STAPIMetricsStageTotal type:type] * 1000.0),
+        @"first_byte_p50_ms" : @([metrics percentile:50 forStage:STAPIMetricsStageFirstByte type:type] * 1000.0),
+        @"decode_p50_ms" : @([metrics percentile:50 forStage:STAPIMetricsStageDecode type:type] * 1000.0),
+        @"decode_p95_ms" : @([metrics percentile:95 forStage:STAPIMetricsStageDecode type:type] * 1000.0),
+        @"decode_cpu_avg_ms" : @(client.decodePipeline.averageDecodeTime * 1000.0),
+        @"payload_bytes" : @([metrics payloadBytesForType:type]),
+        @"saved_bytes" : @([metrics savedBytesForType:type]),
+        @"peak_memory_bytes" : @(STBenchmarkPeakMemory())
+    }];
+}
+
+- (void)_runBatch {
+    STAPIClient *client = [[STAPIClient alloc] initWithApiKey:@"benchmark"];
+    client.baseURL = [self.serverURL stringByAppendingString:@"/api/v1/public"];
+
+    NSMutableArray *queries = [NSMutableArray arrayWithCapacity:self.requestCount];
+    for (NSUInteger i = 0; i < self.requestCount; i++) {
+        [queries addObject:[NSString stringWithFormat:@"batch query %lu", (unsigned long)i]];
+    }
+
+    // The batch runs on its own thread, so waiting here doesn't need the main run loop
+    STAPIBatch *batch = [[STAPIBatch alloc] initWithClient:client queries:queries type:STSearchTypeSearch];
+    batch.maxConcurrentRequests = self.concurrency;
+    [batch startWithCompletion:nil];
+    [batch waitUntilFinished];
+
+    NSUInteger failed = 0;
+    for (STAPIBatchResult *batchResult in batch.results) {
+        if (batchResult.result == nil) {
+            failed++;
+        }
+    }
+
+    STAPIMetrics *metrics = batch.metrics;
+    [self _report:@"client.batch" values:@{
+        @"requests" : @(self.requestCount),
+        @"failed" : @(failed),
+        @"concurrency" : @(self.concurrency),
+        @"throughput_per_s" : @(batch.queriesPerSecond),
+        @"latency_p50_ms" : @([metrics percentile:50 forStage:STAPIMetricsStageTotal type:STSearchTypeSearch] * 1000.0),
+        @"latency_p95_ms" : @([metrics percentile:95 forStage:STAPIMetricsStageTotal type:STSearchTypeSearch] * 1000.0),
+        @"latency_p99_ms" : @([metrics percentile:99 forStage:STAPIMetricsStageTotal type:STSearchTypeSearch] * 1000.0),
+        @"peak_memory_bytes" : @(STBenchmarkPeakMemory())
+    }];
+}
+
+- (void)_runDecode {
+    for (NSString *fixture in @[ @"search", @"suggest" ]) {
+        NSData *payload = [NSData dataWithContentsOfFile:[self.fixturesPath stringByAppendingPathComponent:[fixture stringByAppendingPathExtension:@"json"]]];
+        if (payload == nil) {
+            fprintf(stderr, "missing fixture %s in %s\n", [fixture UTF8String], [self.fixturesPath UTF8String]);
+            exit(1);
+        }
+
+        NSTimeInterval start = STBenchmarkNow();
+        for (NSUInteger i = 0; i < self.iterations; i++) {
+            @autoreleasepool {
+                [NSJSONSerialization JSONObjectWithData:payload options:0 error:NULL];
+            }
+        }
+        NSTimeInterval jsonElapsed = STBenchmarkNow() - start;
+
+        // Fed in network sized chunks the way the client does while a response downloads
+        const NSUInteger chunkSize = 16 * 1024;
+        start = STBenchmarkNow();
+        for (NSUInteger i = 0; i < self.iterations; i++) {
+            @autoreleasepool {
+                STStreamingResultParser *parser = [[STStreamingResultParser alloc] init];
+                for (NSUInteger offset = 0; offset < payload.length; offset += chunkSize) {
+                    [parser appendData:[payload subdataWithRange:NSMakeRange(offset, MIN(chunkSize, payload.length - offset))]];
+                }
+            }
+        }
+        NSTimeInterval streamingElapsed = STBenchmarkNow() - start;
+
+        double megabytes = (double)payload.length * self.iterations / (1024.0 * 1024.0);
+        [self _report:[@"decode." stringByAppendingString:fixture] values:@{
+            @"payload_bytes" : @(payload.length),
+            @"json_us_per_op" : @(jsonElapsed / self.iterations * 1e6),
+            @"json_mb_per_s" : @(megabytes / MAX(jsonElapsed, 1e-9)),
+            @"streaming_us_per_op" : @(streamingElapsed / self.iterations * 1e6),
+            @"streaming_mb_per_s" : @(megabytes / MAX(streamingElapsed, 1e-9))
+        }];
+    }
+}
+
+- (void)_runPaging {
+    NSData *payload = [NSData dataWithContentsOfFile:[self.fixturesPath stringByAppendingPathComponent:@"search.json"]];
+    NSDictionary *fixture = [NSJSONSerialization JSONObjectWithData:payload options:0 error:NULL];
+    NSArray *fixtureRecords = [[fixture objectForKey:@"records"] objectForKey:@"page"];
+
+    NSMutableArray *pages = [NSMutableArray arrayWithCapacity:self.pageCount];
+    for (NSUInteger page = 1; page <= self.pageCount; page++) {
+        NSMutableArray *records = [NSMutableArray arrayWithCapacity:fixtureRecords.count];
+        for (NSDictionary *record in fixtureRecords) {
+            NSMutableDictionary *copy = [record mutableCopy];
+            [copy setObject:[NSString stringWithFormat:@"%@-%lu", [record objectForKey:@"id"], (unsigned long)page] forKey:@"id"];
+            [records addObject:copy];
+        }
+        [pages addObject:@{ @"records" : @{ @"page" : records }, @"info" : [fixture objectForKey:@"info"] }];
+    }
+
+    STPagedResultStore *store = [[STPagedResultStore alloc] init];
+    NSTimeInterval start = STBenchmarkNow();
+    for (NSDictionary *page in pages) {
+        [store appendResult:page];
+    }
+    NSTimeInterval storeElapsed = STBenchmarkNow() - start;
+
+    // The array-copying merge STPagingSearchResultsObject used before the store, as a reference point
+    start = STBenchmarkNow();
+    NSArray *merged = @[];
+    for (NSDictionary *page in pages) {
+        merged = [merged arrayByAddingObjectsFromArray:[[page objectForKey:@"records"] objectForKey:@"page"]];
+    }
+    NSTimeInterval copyElapsed = STBenchmarkNow() - start;
+
+    NSUInteger lookups = 0;
+    NSUInteger recordCount = [store countForType:@"page"];
+    start = STBenchmarkNow();
+    for (NSUInteger i = 0; i < self.iterations; i++) {
+        for (NSUInteger index = 0; index < recordCount; index++) {
+            if ([store recordForType:@"page" atIndex:index]) {
+                lookups++;
+            }
+        }
+    }
+    NSTimeInterval lookupElapsed = STBenchmarkNow() - start;
+
+    [self _report:@"paging" values:@{
+        @"pages" : @(self.pageCount),
+        @"records" : @(recordCount),
+        @"store_append_us_per_page" : @(storeElapsed / MAX(self.pageCount, 1) * 1e6),
+        @"copy_merge_us_per_page" : @(copyElapsed / MAX(self.pageCount, 1) * 1e6),
+        @"lookup_ns_per_op" : @(lookupElapsed / MAX(lookups, 1) * 1e9),
+        @"merged_records" : @(merged.count)
+    }];
+}
+
+- (void)_runCategories {
+    NSDictionary *params = @{
+        @"engine_key" : @"benchmark",
+        @"q" : @"search engine \"mobile\" résumé & more",
+        @"page" : @1,
+        @"per_page" : @20,
+        @"search_fields" : @{ @"page" : @[ @"title^3", @"sections^2", @"body" ] },
+        @"fetch_fields" : @{ @"page" : @[ @"title", @"url", @"id" ] },
+        @"filters" : @{ @"page" : @{ @"type" : @[ @"article", @"guide" ], @"popularity" : @{ @"type" : @"range", @"from" : @10 } } }
+    };
+    NSDictionary *analyticsParams = @{ @"engine_key" : @"benchmark", @"doc_id" : @"5213ab0f8d2a4c6e9b7f0011", @"q" : @"search engine résumé & more" };
+    NSString *text = @"search engine \"mobile\" résumé & more / 100% ?=#";
+
+    NSTimeInterval start = STBenchmarkNow();
+    for (NSUInteger i = 0; i < self.iterations; i++) {
+        @autoreleasepool {
+            [params STCanonicalJSONString];
+        }
+    }
+    NSTimeInterval canonicalElapsed = STBenchmarkNow() - start;
+
+    start = STBenchmarkNow();
+    for (NSUInteger i = 0; i < self.iterations; i++) {
+        @autoreleasepool {
+            [analyticsParams STqueryString];
+        }
+    }
+    NSTimeInterval queryStringElapsed = STBenchmarkNow() - start;
+
+    start = STBenchmarkNow();
+    for (NSUInteger i = 0; i < self.iterations; i++) {
+        @autoreleasepool {
+            [text STURLEncodedString];
+        }
+    }
+    NSTimeInterval encodeElapsed = STBenchmarkNow() - start;
+
+    start = STBenchmarkNow();
+    for (NSUInteger i = 0; i < self.iterations; i++) {
+        @autoreleasepool {
+            [STQueryCache keyForEndpoint:@"http://127.0.0.1/api/v1/public/engines/search.json" params:params];
+        }
+    }
+    NSTimeInterval cacheKeyElapsed = STBenchmarkNow() - start;
+
+    [self _report:@"categories" values:@{
+        @"canonical_json_us_per_op" : @(canonicalElapsed / self.iterations * 1e6),
+        @"query_string_us_per_op" : @(queryStringElapsed / self.iterations * 1e6),
+        @"url_encode_us_per_op" : @(encodeElapsed / self.iterations * 1e6),
+        @"cache_key_us_per_op" : @(cacheKeyElapsed / self.iterations * 1e6)
+    }];
+}
+
+- (void)_runRequestBuilding {
+    NSString *baseURL = @"http://127.0.0.1/api/v1/public";
+    NSString *path = @"/engines/search.json";
+    NSString *endpoint = [baseURL stringByAppendingString:path];
+    NSString *engineKey = @"benchmark";
+    NSDictionary *delegateParams = @{
+        @"search_fields" : @{ @"page" : @[ @"title^3", @"sections^2", @"body" ] },
+        @"fetch_fields" : @{ @"page" : @[ @"title", @"url", @"id" ] },
+        @"filters" : @{ @"page" : @{ @"type" : @[ @"article", @"guide" ] } }
+    };
+    NSDictionary *headerFields = @{
+        @"Content-Type" : @"application/json",
+        @"Accept-Encoding" : @"gzip, deflate",
+        @"X-SwiftypeAPI-ClientVersion" : @"1.0",
+        @"X-SwiftypeAPI-Platform" : @"iOS"
+    };
+    STRequestBuilder *builder = [[STRequestBuilder alloc] initWithBaseURL:baseURL engineKey:engineKey HTTPHeaderFields:headerFields];
+
+    // Keystroke traffic: every request is the previous query with one more character
+    NSString *text = @"search engine \"mobile\" résumé & more";
+    NSMutableArray *queries = [NSMutableArray arrayWithCapacity:text.length];
+    for (NSUInteger length = 1; length <= text.length; length++) {
+        [queries addObject:[text substringToIndex:length]];
+    }
+    NSMutableArray *analyticsParams = [NSMutableArray arrayWithCapacity:queries.count];
+    for (NSString *query in queries) {
+        [analyticsParams addObject:@{ @"engine_key" : engineKey, @"doc_id" : @"5213ab0f8d2a4c6e9b7f0011", @"q" : query }];
+    }
+
+    // Both paths have to send the same parameters, and the builder has to find the entries of STQueryCache
+    NSUInteger mismatches = 0;
+    for (NSString *query in queries) {
+        NSDictionary *params = STBenchmarkRequestParams(delegateParams, engineKey, query);
+        NSString *builderKey = nil;
+        NSURLRequest *legacyRequest = STBenchmarkLegacyURLRequest(endpoint, params);
+        NSURLRequest *builderRequest = [builder URLRequestForPath:path params:params cacheKey:&builderKey];
+        id legacyBody = [NSJSONSerialization JSONObjectWithData:legacyRequest.HTTPBody options:0 error:NULL];
+        id builderBody = builderRequest.HTTPBody ? [NSJSONSerialization JSONObjectWithData:builderRequest.HTTPBody options:0 error:NULL] : nil;
+        if (![legacyBody isEqual:builderBody] || ![[STQueryCache keyForEndpoint:endpoint params:params] isEqualToString:builderKey] ||
+            ![legacyRequest.allHTTPHeaderFields isEqualToDictionary:builderRequest.allHTTPHeaderFields]) {
+            mismatches++;
+            fprintf(stderr, "request for \"%s\" differs from the legacy request\n", [query UTF8String]);
+        }
+    }
+
+    NSUInteger requestCount = self.iterations * queries.count;
+    NSUInteger countedRequests = MIN(requestCount, 100 * queries.count);
+    NSString *cacheKey = nil;
+
+    // Timed with allocation counting off, it slows every allocation down. Then a shorter counted run
+    NSTimeInterval start = STBenchmarkNow();
+    for (NSUInteger i = 0; i < requestCount; i++) {
+        @autoreleasepool {
+            NSDictionary *params = STBenchmarkRequestParams(delegateParams, engineKey, [queries objectAtIndex:i % queries.count]);
+            STBenchmarkLegacyURLRequest(endpoint, params);
+        }
+    }
+    NSTimeInterval legacyElapsed = STBenchmarkNow() - start;
+
+    STBenchmarkCountAllocations(YES);
+    unsigned long long allocated = STBenchmarkAllocatedObjects();
+    for (NSUInteger i = 0; i < countedRequests; i++) {
+        @autoreleasepool {
+            NSDictionary *params = STBenchmarkRequestParams(delegateParams, engineKey, [queries objectAtIndex:i % queries.count]);
+            STBenchmarkLegacyURLRequest(endpoint, params);
+        }
+    }
+    unsigned long long legacyAllocated = STBenchmarkAllocatedObjects() - allocated;
+    STBenchmarkCountAllocations(NO);
+
+    start = STBenchmarkNow();
+    for (NSUInteger i = 0; i < requestCount; i++) {
+        @autoreleasepool {
+            NSDictionary *params = STBenchmarkRequestParams(delegateParams, engineKey, [queries objectAtIndex:i % queries.count]);
+            [builder URLRequestForPath:path params:params cacheKey:&cacheKey];
+        }
+    }
+    NSTimeInterval builderElapsed = STBenchmarkNow() - start;
+
+    STBenchmarkCountAllocations(YES);
+    allocated = STBenchmarkAllocatedObjects();
+    for (NSUInteger i = 0; i < countedRequests; i++) {
+        @autoreleasepool {
+            NSDictionary *params = STBenchmarkRequestParams(delegateParams, engineKey, [queries objectAtIndex:i % queries.count]);
+            [builder URLRequestForPath:path params:params cacheKey:&cacheKey];
+        }
+    }
+    unsigned long long builderAllocated = STBenchmarkAllocatedObjects() - allocated;
+    STBenchmarkCountAllocations(NO);
+
+    start = STBenchmarkNow();
+    for (NSUInteger i = 0; i < requestCount; i++) {
+        @autoreleasepool {
+            STBenchmarkLegacyQueryString([analyticsParams objectAtIndex:i % analyticsParams.count]);
+        }
+    }
+    NSTimeInterval legacyQueryStringElapsed = STBenchmarkNow() - start;
+
+    start = STBenchmarkNow();
+    for (NSUInteger i = 0; i < requestCount; i++) {
+        @autoreleasepool {
+            [[analyticsParams objectAtIndex:i % analyticsParams.count] STqueryString];
+        }
+    }
+    NSTimeInterval queryStringElapsed = STBenchmarkNow() - start;
+
+    NSMutableDictionary *values = [NSMutableDictionary dictionaryWithDictionary:@{
+        @"requests" : @(requestCount),
+        @"failed" : @(mismatches),
+        @"legacy_requests_per_s" : @(requestCount / MAX(legacyElapsed, 1e-9)),
+        @"builder_requests_per_s" : @(requestCount / MAX(builderElapsed, 1e-9)),
+        @"legacy_query_string_us_per_op" : @(legacyQueryStringElapsed / requestCount * 1e6),
+        @"query_string_us_per_op" : @(queryStringElapsed / requestCount * 1e6)
+    }];
+    if (STBenchmarkCountsAllocations()) {
+        [values setObject:@((double)legacyAllocated / countedRequests) forKey:@"legacy_objects_per_request"];
+        [values setObject:@((double)builderAllocated / countedRequests) forKey:@"builder_objects_per_request"];
+    }
+    [self _report:@"requests" values:values];
+}
+
+- (void)_report:(NSString *)name values:(NSDictionary *)values {
+    [self.report setObject:values forKey:name];
+
+    printf("%s\n", [name UTF8String]);
+    for (NSString *key in [[values allKeys] sortedArrayUsingSelector:@selector(compare:)]) {
+        printf("  %-28s %14.3f\n", [key UTF8String], [[values objectForKey:key] doubleValue]);
+    }
+    fflush(stdout);
+}
+
+@end
+
+#pragma mark - main
+
+int main(int argc, const char *argv[]) {
+    @autoreleasepool {
+        // Options are read from the argument domain, e.g. -requests 500 -concurrency 8
+        NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+        [defaults registerDefaults:@{
+            @"server" : @"http://127.0.0.1:8765",
+            @"fixtures" : @"Fixtures",
+            @"requests" : @200,
+            @"concurrency" : @4,
+            @"iterations" : @1000,
+            @"pages" : @50
+        }];
+
+        STBenchmark *benchmark = [[STBenchmark alloc] init];
+        benchmark.serverURL = [defaults stringForKey:@"server"];
+        benchmark.fixturesPath = [defaults stringForKey:@"fixtures"];
+        benchmark.requestCount = MAX([defaults integerForKey:@"requests"], 1);
+        benchmark.concurrency = MAX([defaults integerForKey:@"concurrency"], 1);
+        benchmark.iterations = MAX([defaults integerForKey:@"iterations"], 1);
+        benchmark.pageCount = MAX([defaults integerForKey:@"pages"], 1);
+        [benchmark run];
+
+        NSString *jsonPath = [defaults stringForKey:@"json"];
+        if (jsonPath.length > 0) {
+            NSData *json = [NSJSONSerialization dataWithJSONObject:benchmark.report options:NSJSONWritingPrettyPrinted error:NULL];
+            if (![json writeToFile:jsonPath atomically:YES]) {
+                fprintf(stderr, "could not write %s\n", [jsonPath UTF8String]);
+                return 1;
+            }
+        }
+
+        NSUInteger failed = 0;
+        for (NSDictionary *values in [benchmark.report allValues]) {
+            failed += [[values objectForKey:@"failed"] unsignedIntegerValue];
+        }
+        return failed > 0 ? 1 : 0;
+    }
+}
@@ -0,0 +1,33 @@
+#!/bin/sh
+#
+#  run-benchmarks.sh
+#  SwiftypeTouch Benchmarks
+#
+#  Starts the stub server, runs the benchmark tool against it and stops the server again.
+#  Options after -- are passed to the benchmark tool, for example:
+#
+#    LATENCY=100 RECORDS=50 ./run-benchmarks.sh -- -requests 500 -concurrency 8 -json results.json
+#
+
+set -e
+cd "$(dirname "$0")"
+
+PORT=${PORT:-8765}
+LATENCY=${LATENCY:-50}
+JITTER=${JITTER:-10}
+
+SERVER_ARGS="--port $PORT --latency $LATENCY --jitter $JITTER"
+if [ -n "$RECORDS" ]; then
+    SERVER_ARGS="$SERVER_ARGS --records $RECORDS"
+fi
+
+if [ "$1" = "--" ]; then
+    shift
+fi
+
+python3 stub_server.py $SERVER_ARGS &
+SERVER_PID=$!
+trap 'kill $SERVER_PID 2>/dev/null' EXIT INT TERM
+sleep 1
+
+./obj/SwiftypeBenchmarks -server "http://127.0.0.1:$PORT" -fixtures Fixtures "$@"
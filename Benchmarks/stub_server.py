@@ -0,0 +1,158 @@
+#!/usr/bin/env python3
+#
+#  stub_server.py
+#  SwiftypeTouch
+#
+#  Local stand-in for the Swiftype public API used by the benchmarks. Replays the payloads in
+#  Fixtures/ for the search and suggest endpoints, resized to the requested number of records
+#  and delayed by a configurable latency. Analytics endpoints answer with an empty 200.
+#
+#  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+#
+
+import argparse
+import copy
+import gzip
+import json
+import os
+import random
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+QUERY_PLACEHOLDER = "__STUB_QUERY__"
+
+
+class Payloads(object):
+    def __init__(self, fixtures, records, pages):
+        self.records = records
+        self.pages = pages
+        self.fixtures = {}
+        for name in ("search", "suggest"):
+            with open(os.path.join(fixtures, name + ".json")) as f:
+                self.fixtures[name] = json.load(f)
+        self.templates = {}
+        self.lock = threading.Lock()
+
+    def body(self, endpoint, query, page, per_page, fetch_fields=None):
+        key = (endpoint, page, per_page, json.dumps(fetch_fields, sort_keys=True))
+        with self.lock:
+            template = self.templates.get(key)
+            if template is None:
+                template = self._template(endpoint, page, per_page, fetch_fields)
+                self.templates[key] = template
+        return template.replace(QUERY_PLACEHOLDER.encode(), json.dumps(query)[1:-1].encode())
+
+    def _template(self, endpoint, page, per_page, fetch_fields):
+        fixture = self.fixtures[endpoint]
+        count = self.records if self.records is not None else per_page
+        result = copy.deepcopy(fixture)
+        for doc_type, recorded in fixture["records"].items():
+            records = []
+            for i in range(count):
+                record = copy.deepcopy(recorded[i % len(recorded)])
+                # Unique per page so paging de-duplication doesn't drop anything
+                record["id"] = "%s-%d-%d" % (record["id"], page, i)
+                if fetch_fields and doc_type in fetch_fields:
+                    # Like the real API, fetch_fields keeps the id and the listed fields only
+                    record = dict((k, v) for k, v in record.items() if k == "id" or k in fetch_fields[doc_type])
+                records.append(record)
+            result["records"][doc_type] = records
+            info = result["info"][doc_type]
+            info.update({
+                "query": QUERY_PLACEHOLDER,
+                "current_page": page,
+                "num_pages": self.pages,
+                "per_page": count,
+                "total_result_count": count * self.pages,
+            })
+        result["record_count"] = count * len(fixture["records"])
+        return json.dumps(result, separators=(",", ":")).encode()
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def log_message(self, format, *args):
+        if self.server.verbose:
+            BaseHTTPRequestHandler.log_message(self, format, *args)
+
+    def _delay(self):
+        latency = self.server.latency + random.uniform(0.0, self.server.jitter)
+        if latency > 0:
+            time.sleep(latency)
+
+    def _respond(self, status, body=b"", content_type="application/json"):
+        self.send_response(status)
+        self.send_header("Content-Type", content_type)
+        if body and self.server.compress and "gzip" in self.headers.get("Accept-Encoding", ""):
+            body = gzip.compress(body, 6)
+            self.send_header("Content-Encoding", "gzip")
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def do_POST(self):
+        length = int(self.headers.get("Content-Length", 0))
+        raw = self.rfile.read(length) if length else b"{}"
+        endpoint = None
+        if self.path.endswith("/engines/search.json"):
+            endpoint = "search"
+        elif self.path.endswith("/engines/suggest.json"):
+            endpoint = "suggest"
+        if endpoint is None:
+            self._respond(404)
+            return
+
+        try:
+            params = json.loads(raw.decode("utf-8"))
+        except ValueError:
+            self._respond(400)
+            return
+
+        self._delay()
+        body = self.server.payloads.body(endpoint,
+                                         params.get("q", ""),
+                                         int(params.get("page", 1)),
+                                         int(params.get("per_page", 20)),
+                                         params.get("fetch_fields"))
+        self._respond(200, body)
+
+    def do_GET(self):
+        if "/analytics/" in self.path:
+            self._delay()
+            self._respond(200, b"", "text/plain")
+        else:
+            self._respond(404)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Stub Swiftype API server for the SwiftypeTouch benchmarks")
+    parser.add_argument("--port", type=int, default=8765)
+    parser.add_argument("--latency", type=float, default=50.0, help="milliseconds added to every response")
+    parser.add_argument("--jitter", type=float, default=0.0, help="up to this many extra random milliseconds")
+    parser.add_argument("--records", type=int, default=None,
+                        help="records per page, defaults to the per_page of each request")
+    parser.add_argument("--pages", type=int, default=10, help="num_pages reported for every query")
+    parser.add_argument("--no-gzip", dest="compress", action="store_false",
+                        help="ignore Accept-Encoding and always send plain JSON")
+    parser.add_argument("--fixtures", default=os.path.join(os.path.dirname(os.path.abspath(__file__)), "Fixtures"))
+    parser.add_argument("--verbose", action="store_true")
+    args = parser.parse_args()
+
+    server = ThreadingHTTPServer(("127.0.0.1", args.port), Handler)
+    server.daemon_threads = True
+    server.payloads = Payloads(args.fixtures, args.records, args.pages)
+    server.latency = args.latency / 1000.0
+    server.jitter = args.jitter / 1000.0
+    server.verbose = args.verbose
+    server.compress = args.compress
+    print("stub server listening on http://127.0.0.1:%d" % args.port, flush=True)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
@@ -17,4 +17,15 @@
  */
 - (NSString *)STqueryString;
 
+/**
+ JSON representation of the dictionary with the keys of every nested dictionary sorted and
+ no insignificant whitespace. Two dictionaries with equal contents always produce the
+ same string, which makes it suitable as a cache key. Written by
+ `[STRequestBuilder canonicalJSONDataWithObject:]`.
+ 
+ @return canonical JSON representation of `NSDictionary` instance, or nil if it contains a number
+ JSON can't represent such as NaN or infinity
+ */
+- (NSString *)STCanonicalJSONString;
+
 @end
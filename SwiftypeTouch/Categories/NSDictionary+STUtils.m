@@ -8,22 +8,32 @@
 
 #import "NSDictionary+STUtils.h"
 #import "NSString+STUtils.h"
+#import "STRequestBuilder.h"
 
 @implementation NSDictionary (STUtils)
 
 - (NSString *)STqueryString {
-    NSMutableArray *result = [NSMutableArray array];
+    NSMutableString *result = [NSMutableString string];
     for (NSString *key in self) {
         if ([key isKindOfClass:[NSString class]]) {
             NSString *value = [self objectForKey:key];
             if ([value isKindOfClass:[NSString class]]) {
-                NSString *encodedKey = [key STURLEncodedString];
-                NSString *encodedValue = [value STURLEncodedString];
-                [result addObject:[NSString stringWithFormat:@"%@=%@", encodedKey, encodedValue]];
+                if (result.length > 0) {
+                    [result appendString:@"&"];
+                }
+                [result appendString:[key STURLEncodedString]];
+                [result appendString:@"="];
+                [result appendString:[value STURLEncodedString]];
             }
         }
     }
-    return [result componentsJoinedByString:@"&"];
+    return result;
+}
+
+- (NSString *)STCanonicalJSONString {
+    // Request bodies and cache keys have to agree byte for byte, so both come from the writer of STRequestBuilder
+    NSData *JSONData = [STRequestBuilder canonicalJSONDataWithObject:self];
+    return JSONData ? [[NSString alloc] initWithData:JSONData encoding:NSUTF8StringEncoding] : nil;
 }
 
 @end
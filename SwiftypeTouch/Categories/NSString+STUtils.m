@@ -8,29 +8,65 @@
 
 #import "NSString+STUtils.h"
 
+enum {
+    STURLEncodingEscape = 0,
+    STURLEncodingKeep,
+    STURLEncodingPlus
+};
+
 @implementation NSString (STUtils)
 
 - (NSString *)STURLEncodedString {
-    /** Dave DeLong's URLEncodedString from stackoverflow
+    /** Same output as Dave DeLong's URLEncodedString from stackoverflow
      http://stackoverflow.com/questions/3423545/objective-c-iphone-percent-encode-a-string/3426140#3426140
+     but every byte is looked up in a table and written straight into the result
      */
-    NSMutableString * output = [NSMutableString string];
+    static char encodingTable[256];
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        for (int c = 0; c < 256; c++) {
+            if (c == '.' || c == '-' || c == '_' || c == '~' ||
+                (c >= 'a' && c <= 'z') ||
+                (c >= 'A' && c <= 'Z') ||
+                (c >= '0' && c <= '9')) {
+                encodingTable[c] = STURLEncodingKeep;
+            }
+            else {
+                encodingTable[c] = STURLEncodingEscape;
+            }
+        }
+        encodingTable[' '] = STURLEncodingPlus;
+    });
+    static const char hexDigits[] = "0123456789ABCDEF";
+
     const unsigned char * source = (const unsigned char *)[self UTF8String];
-    int sourceLen = strlen((const char *)source);
-    for (int i = 0; i < sourceLen; ++i) {
+    if (source == NULL) {
+        return @"";
+    }
+    size_t sourceLen = strlen((const char *)source);
+    // A byte takes at most three characters
+    char * output = malloc(sourceLen * 3 + 1);
+    if (output == NULL) {
+        return nil;
+    }
+    size_t outputLen = 0;
+    for (size_t i = 0; i < sourceLen; ++i) {
         const unsigned char thisChar = source[i];
-        if (thisChar == ' '){
-            [output appendString:@"+"];
-        } else if (thisChar == '.' || thisChar == '-' || thisChar == '_' || thisChar == '~' ||
-                   (thisChar >= 'a' && thisChar <= 'z') ||
-                   (thisChar >= 'A' && thisChar <= 'Z') ||
-                   (thisChar >= '0' && thisChar <= '9')) {
-            [output appendFormat:@"%c", thisChar];
-        } else {
-            [output appendFormat:@"%%%02X", thisChar];
+        switch (encodingTable[thisChar]) {
+            case STURLEncodingKeep:
+                output[outputLen++] = thisChar;
+                break;
+            case STURLEncodingPlus:
+                output[outputLen++] = '+';
+                break;
+            default:
+                output[outputLen++] = '%';
+                output[outputLen++] = hexDigits[thisChar >> 4];
+                output[outputLen++] = hexDigits[thisChar & 0xF];
+                break;
         }
     }
-    return output;
+    return [[NSString alloc] initWithBytesNoCopy:output length:outputLen encoding:NSASCIIStringEncoding freeWhenDone:YES];
 }
 
 @end
@@ -0,0 +1,146 @@
+//
+//  STAPIBatch.h
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "STAPIClient.h"
+
+@class STAPIRequestTimeline;
+
+/**
+ Outcome of a single query of an `STAPIBatch`
+ */
+@interface STAPIBatchResult : NSObject
+
+/**
+ The query as it was passed to the batch
+ */
+@property (nonatomic, readonly, copy) NSString *query;
+
+/**
+ The decoded result, nil if the query failed, was blank or the batch was canceled before it finished
+ */
+@property (nonatomic, readonly, strong) NSDictionary *result;
+
+/**
+ Cause of the failure, nil unless the query failed
+ */
+@property (nonatomic, readonly, strong) NSError *error;
+
+/**
+ Timing of the query, nil if it was never sent
+ */
+@property (nonatomic, readonly, strong) STAPIRequestTimeline *timeline;
+
+@end
+
+/**
+ Runs a list of saved queries against an engine as fast as the connections allow, for example to check a
+ change in relevance against thousands of known queries.
+
+ The batch uses a client of its own that takes the engine, base URL, fetch fields, timeouts and retry settings
+ of the client it was created with, but bypasses every cache, never hedges and never joins identical queries of
+ other clients. Its work happens in the background through `delegateQueue` of that client, so a batch neither
+ needs nor blocks the main run loop.
+ At most `maxConcurrentRequests` queries are waiting on the server at any time and the next query is sent as
+ soon as one finishes. Decoding runs in parallel on the client's decode pipeline.
+
+ Keep a reference to the batch until it has finished.
+ */
+@interface STAPIBatch : NSObject
+
+/**
+ Initializes a batch. No query is sent before `startWithCompletion:` is called.
+
+ @param client Client whose engine and settings are used
+ @param queries The query strings to run, in order
+ @param type Whether the queries are search or suggest queries
+ */
+- (id)initWithClient:(STAPIClient *)client queries:(NSArray *)queries type:(STSearchType)type;
+
+/**
+ The query strings of the batch
+ */
+@property (nonatomic, readonly, copy) NSArray *queries;
+
+/**
+ The type of every query of the batch
+ */
+@property (nonatomic, readonly, assign) STSearchType searchType;
+
+/**
+ Parameters sent with every query, as `clientRequestParameters:forQuery:withType:` would return them. The
+ delegate of the client is not asked.
+
+ The default value is nil.
+ */
+@property (nonatomic, copy) NSDictionary *parameters;
+
+/**
+ Maximum number of results per document type requested for every query.
+
+ The default value is 20.
+ */
+@property (nonatomic, assign) NSUInteger perPage;
+
+/**
+ Maximum number of queries waiting on the server at the same time.
+
+ The default value is twice the number of active processors, but at least 4.
+ */
+@property (nonatomic, assign) NSUInteger maxConcurrentRequests;
+
+/**
+ Queue the completion block is called on.
+
+ The default value is `[NSOperationQueue mainQueue]`.
+ */
+@property (nonatomic, strong) NSOperationQueue *completionQueue;
+
+/**
+ One `STAPIBatchResult` per query in the order of `queries`, nil until the batch has finished
+ */
+@property (nonatomic, readonly, copy) NSArray *results;
+
+/**
+ Latency percentiles of the queries of the batch
+ */
+@property (nonatomic, readonly, strong) STAPIMetrics *metrics;
+
+/**
+ Number of seconds from the start of the batch until its last query finished
+ */
+@property (nonatomic, readonly, assign) NSTimeInterval duration;
+
+/**
+ Number of queries that finished successfully per second of `duration`
+ */
+@property (nonatomic, readonly) double queriesPerSecond;
+
+/**
+ `YES` once every query finished or the batch was canceled
+ */
+@property (nonatomic, readonly, getter = isFinished) BOOL finished;
+
+/**
+ Starts sending the queries. Calling it more than once has no effect.
+
+ @param completion Called on `completionQueue` with the batch once it has finished, may be nil
+ */
+- (void)startWithCompletion:(void (^)(STAPIBatch *batch))completion;
+
+/**
+ Blocks the calling thread until the batch has finished. Does not wait for the completion block.
+ */
+- (void)waitUntilFinished;
+
+/**
+ Cancels the queries that are still running and finishes the batch with the results so far
+ */
+- (void)cancel;
+
+@end
@@ -0,0 +1,255 @@
+//
+//  STAPIBatch.m
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import "STAPIBatch.h"
+#import "STAPIRequest.h"
+#import "STAPIRequestTimeline.h"
+#import "STAPIMetrics.h"
+
+@interface STAPIBatchResult ()
+
+@property (nonatomic, copy) NSString *query;
+@property (nonatomic, strong) NSDictionary *result;
+@property (nonatomic, strong) NSError *error;
+@property (nonatomic, strong) STAPIRequestTimeline *timeline;
+
+@end
+
+@implementation STAPIBatchResult
+
+#pragma mark - NSObject
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@: %p query=%@ finished=%d error=%@>",
+            NSStringFromClass([self class]), self, self.query, self.result != nil, self.error];
+}
+
+@end
+
+@interface STAPIBatch () <STAPIClientDelegate>
+
+@property (nonatomic, strong) STAPIClient *sourceClient;
+@property (nonatomic, copy) NSArray *queries;
+@property (nonatomic, assign) STSearchType searchType;
+@property (nonatomic, copy) NSArray *results;
+@property (nonatomic, strong) STAPIMetrics *metrics;
+@property (nonatomic, assign) NSTimeInterval duration;
+@property (nonatomic, assign) BOOL finished;
+
+@property (nonatomic, strong) STAPIClient *client;
+@property (nonatomic, strong) NSOperationQueue *workQueue;
+@property (nonatomic, strong) NSCondition *finishCondition;
+@property (nonatomic, copy) void (^completion)(STAPIBatch *batch);
+@property (nonatomic, strong) NSMutableArray *pendingResults;
+@property (nonatomic, strong) NSMutableDictionary *indexesByRequestId;
+@property (nonatomic, assign) NSUInteger nextIndex;
+@property (nonatomic, assign) NSUInteger runningCount;
+@property (nonatomic, strong) NSDate *startDate;
+@property (nonatomic, assign) BOOL started;
+
+- (STAPIClient *)_workerClient;
+- (void)_startNextQueries;
+- (void)_recordRequest:(STAPIRequest *)request result:(NSDictionary *)result error:(NSError *)error;
+- (void)_finish;
+
+@end
+
+@implementation STAPIBatch
+
+#pragma mark - NSObject
+
+- (id)init {
+    return [self initWithClient:nil queries:@[] type:STSearchTypeSearch];
+}
+
+#pragma mark - STAPIBatch
+
+- (id)initWithClient:(STAPIClient *)client queries:(NSArray *)queries type:(STSearchType)type {
+    self = [super init];
+    if (self) {
+        self.sourceClient = client;
+        self.queries = queries;
+        self.searchType = type;
+        self.perPage = 20;
+        self.maxConcurrentRequests = MAX([[NSProcessInfo processInfo] activeProcessorCount] * 2, 4);
+        self.completionQueue = [NSOperationQueue mainQueue];
+        self.metrics = [[STAPIMetrics alloc] init];
+        self.finishCondition = [[NSCondition alloc] init];
+        self.indexesByRequestId = [NSMutableDictionary dictionary];
+
+        // All state of the batch is only touched on this queue, which is also the delegate queue of its client
+        self.workQueue = [[NSOperationQueue alloc] init];
+        self.workQueue.name = @"com.swiftype.api.batch";
+        self.workQueue.maxConcurrentOperationCount = 1;
+
+        self.pendingResults = [NSMutableArray arrayWithCapacity:queries.count];
+        for (NSString *query in queries) {
+            STAPIBatchResult *batchResult = [[STAPIBatchResult alloc] init];
+            batchResult.query = query;
+            [self.pendingResults addObject:batchResult];
+        }
+    }
+    return self;
+}
+
+- (double)queriesPerSecond {
+    if (self.duration <= 0.0) {
+        return 0.0;
+    }
+
+    NSUInteger finishedCount = 0;
+    for (STAPIBatchResult *batchResult in self.results) {
+        if (batchResult.result) {
+            finishedCount++;
+        }
+    }
+    return finishedCount / self.duration;
+}
+
+- (void)startWithCompletion:(void (^)(STAPIBatch *batch))completion {
+    [self.workQueue addOperationWithBlock:^{
+        if (self.started) {
+            return;
+        }
+
+        self.started = YES;
+        self.completion = completion;
+        self.startDate = [NSDate date];
+        self.client = [self _workerClient];
+        [self _startNextQueries];
+    }];
+}
+
+- (void)waitUntilFinished {
+    [self.finishCondition lock];
+    while (!self.finished) {
+        [self.finishCondition wait];
+    }
+    [self.finishCondition unlock];
+}
+
+- (void)cancel {
+    [self.workQueue addOperationWithBlock:^{
+        if (self.finished) {
+            return;
+        }
+
+        // Finishing first makes the batch ignore the cancel callbacks
+        STAPIClient *client = self.client;
+        self.started = YES;
+        [self _finish];
+        [client cancelQuery];
+    }];
+}
+
+#pragma mark - STAPIClientDelegate
+
+- (NSDictionary *)clientRequestParameters:(STAPIClient *)client forQuery:(NSString *)query withType:(STSearchType)type {
+    return self.parameters ? self.parameters : @{};
+}
+
+- (void)client:(STAPIClient *)client didFinishRequest:(STAPIRequest *)request withResult:(NSDictionary *)result {
+    [self _recordRequest:request result:result error:nil];
+}
+
+- (void)client:(STAPIClient *)client didFailRequest:(STAPIRequest *)request error:(NSError *)error {
+    [self _recordRequest:request result:nil error:error];
+}
+
+- (void)client:(STAPIClient *)client didCancelRequest:(STAPIRequest *)request {
+    [self _recordRequest:request result:nil error:nil];
+}
+
+#pragma mark - Private
+
+- (STAPIClient *)_workerClient {
+    // Saved queries are measured against the server, a cached or hedged answer would skew the run
+    STAPIClient *client = [[STAPIClient alloc] initWithApiKey:self.sourceClient.engineKey];
+    if (self.sourceClient) {
+        client.baseURL = self.sourceClient.baseURL;
+        client.fetchFields = self.sourceClient.fetchFields;
+        client.suggestTimeout = self.sourceClient.suggestTimeout;
+        client.searchTimeout = self.sourceClient.searchTimeout;
+        client.maxRetryCount = self.sourceClient.maxRetryCount;
+        client.retryBudget = self.sourceClient.retryBudget;
+        client.decodePipeline = self.sourceClient.decodePipeline;
+    }
+    client.hedgesRequests = NO;
+    client.queryCache = nil;
+    client.persistentStore = nil;
+    client.singleFlight = nil;
+    client.suggestCache = nil;
+    client.maxConcurrentRequests = self.maxConcurrentRequests;
+    client.metrics = self.metrics;
+    client.delegate = self;
+    client.delegateQueue = self.workQueue;
+    return client;
+}
+
+- (void)_startNextQueries {
+    NSUInteger maxConcurrentRequests = MAX(self.maxConcurrentRequests, 1);
+    while (!self.finished && self.runningCount < maxConcurrentRequests && self.nextIndex < self.queries.count) {
+        NSUInteger index = self.nextIndex++;
+        NSString *query = [self.queries objectAtIndex:index];
+        STAPIRequest *request = nil;
+        if (self.searchType == STSearchTypeSuggest) {
+            request = [self.client suggestQuery:query page:1 perPage:self.perPage];
+        }
+        else {
+            request = [self.client searchQuery:query page:1 perPage:self.perPage];
+        }
+
+        // Blank queries are never sent and keep an empty result
+        if (request == nil) {
+            continue;
+        }
+        [self.indexesByRequestId setObject:@(index) forKey:@(request.requestId)];
+        self.runningCount++;
+    }
+
+    if (!self.finished && self.runningCount == 0 && self.nextIndex >= self.queries.count) {
+        [self _finish];
+    }
+}
+
+- (void)_recordRequest:(STAPIRequest *)request result:(NSDictionary *)result error:(NSError *)error {
+    NSNumber *index = [self.indexesByRequestId objectForKey:@(request.requestId)];
+    if (self.finished || index == nil) {
+        return;
+    }
+
+    [self.indexesByRequestId removeObjectForKey:@(request.requestId)];
+    STAPIBatchResult *batchResult = [self.pendingResults objectAtIndex:[index unsignedIntegerValue]];
+    batchResult.result = result;
+    batchResult.error = error;
+    batchResult.timeline = request.timeline;
+    self.runningCount--;
+    [self _startNextQueries];
+}
+
+- (void)_finish {
+    self.duration = self.startDate ? [[NSDate date] timeIntervalSinceDate:self.startDate] : 0.0;
+    self.results = self.pendingResults;
+    self.client.delegate = nil;
+    self.client = nil;
+
+    [self.finishCondition lock];
+    self.finished = YES;
+    [self.finishCondition broadcast];
+    [self.finishCondition unlock];
+
+    void (^completion)(STAPIBatch *batch) = self.completion;
+    self.completion = nil;
+    if (completion) {
+        [self.completionQueue addOperationWithBlock:^{
+            completion(self);
+        }];
+    }
+}
+
+@end
@@ -0,0 +1,28 @@
+//
+//  STAPIClient+Private.h
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import "STAPIClient.h"
+
+/*
+ Delegate plumbing of `STAPIClient` shared with its subclasses. Not part of the public headers.
+ */
+@interface STAPIClient ()
+
+- (void)_recordTimelineForRequest:(STAPIRequest *)request;
+- (void)_delegateDidStartRequest:(STAPIRequest *)request;
+- (void)_delegateDidFinishRequest:(STAPIRequest *)request withResult:(NSDictionary *)result;
+- (BOOL)_delegateWantsPartialResultsForRequest:(STAPIRequest *)request;
+- (void)_delegateDidReceivePartialResult:(NSDictionary *)result forRequest:(STAPIRequest *)request;
+- (void)_delegateDidUpdateRequest:(STAPIRequest *)request withResult:(NSDictionary *)result;
+- (void)_delegateDidCancelRequest:(STAPIRequest *)request;
+- (void)_delegateDidFailRequest:(STAPIRequest *)request error:(NSError *)error;
+
+// Possible to page suggest requests but don't want to expose that. UI would be tricky
+- (STAPIRequest *)suggestQuery:(NSString *)query page:(NSUInteger)page perPage:(NSUInteger)perPage;
+
+@end
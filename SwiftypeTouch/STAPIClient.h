@@ -33,6 +33,11 @@ extern const NSInteger STHTTPErrorCode;
  */
 extern const NSInteger STTimeoutErrorCode;
 
+/**
+ Query parameters could not be encoded into a request
+ */
+extern const NSInteger STRequestEncodingErrorCode;
+
 /** Type of search the API has performed.
 
  `STSearchTypeUndefined` - API hasn't performed any type of search.
@@ -47,7 +52,43 @@ typedef enum {
     STSearchTypeSearch
 } STSearchType;
 
+/** How the client treats queries that are already running when a new query is issued.
+
+ `STAPIRequestPolicyConcurrent` - Every query runs independently and must be canceled through its `STAPIRequest`
+ handle or with `cancelQuery`.
+
+ `STAPIRequestPolicyLatestWins` - Starting a query cancels every query that is still pending. Only the latest
+ query will be delivered to the delegate.
+ */
+typedef enum {
+    STAPIRequestPolicyConcurrent,
+    STAPIRequestPolicyLatestWins
+} STAPIRequestPolicy;
+
+/** How the client uses cached results.
+
+ `STAPICachePolicyUseCache` - A cached result is delivered and no request is sent to the server.
+
+ `STAPICachePolicyStaleWhileRevalidate` - A cached result is delivered right away and the query is sent to the
+ server in the background. If the fresh result differs from the cached one the delegate is told through
+ `client:didUpdateQuery:withResult:withType:`.
+ */
+typedef enum {
+    STAPICachePolicyUseCache,
+    STAPICachePolicyStaleWhileRevalidate
+} STAPICachePolicy;
+
 @class STAPIClient;
+@class STAPIRequest;
+@class STSuggestPrefixCache;
+@class STSuggestIndex;
+@class STQueryCache;
+@class STPersistentResultStore;
+@class STSingleFlight;
+@class STDecodePipeline;
+@class STAnalyticsQueue;
+@class STAPIRequestTimeline;
+@class STAPIMetrics;
 
 /**
  Used by STAPIClient to keep delegate informed of the status of the query.
@@ -109,6 +150,125 @@ typedef enum {
  */
 - (void)client:(STAPIClient *)client didFailQuery:(NSString *)query withType:(STSearchType)type error:(NSError *)error;
 
+/**
+ Part of the response for a query has arrived. The response is decoded while it downloads and this
+ method is called whenever more records have been completed, so the first rows can be displayed before
+ a large page has finished loading. It may be called any number of times before the query finishes.
+ 
+ @param client Instance of `STAPIClient` making the request
+ @param result Dictionary with a single `records` key holding, for every document type, all records received so far
+ @param query The query string entered by the user
+ @param type The type of search to be performed. Either a search or a suggest
+ */
+- (void)client:(STAPIClient *)client didReceivePartialResult:(NSDictionary *)result forQuery:(NSString *)query withType:(STSearchType)type;
+
+/**
+ A query that was answered from the cache has been revalidated with the server and the server's result
+ differs from the cached one. Only called when the client's `cachePolicy` is `STAPICachePolicyStaleWhileRevalidate`,
+ always after `client:didFinishQuery:withResult:withType:` was called for the same query.
+ 
+ @param client Instance of `STAPIClient` making the request
+ @param query The query string entered by the user
+ @param result The fresh `NSDictionary` representation of the search results
+ @param type The type of search to be performed. Either a search or a suggest
+ */
+- (void)client:(STAPIClient *)client didUpdateQuery:(NSString *)query withResult:(NSDictionary *)result withType:(STSearchType)type;
+
+/**
+ Same as `client:didStartQuery:withType:` but identifies the query by its `STAPIRequest` handle. When both
+ methods are implemented this one is called first.
+
+ @param client Instance of `STAPIClient` making the request
+ @param request Handle of the query that started
+ */
+- (void)client:(STAPIClient *)client didStartRequest:(STAPIRequest *)request;
+
+/**
+ Same as `client:didFinishQuery:withResult:withType:` but identifies the query by its `STAPIRequest` handle.
+ When both methods are implemented this one is called first.
+
+ @param client Instance of `STAPIClient` making the request
+ @param request Handle of the query that finished
+ @param result The `NSDictionary` representation of the search results
+ */
+- (void)client:(STAPIClient *)client didFinishRequest:(STAPIRequest *)request withResult:(NSDictionary *)result;
+
+/**
+ Same as `client:didReceivePartialResult:forQuery:withType:` but identifies the query by its `STAPIRequest` handle.
+ When both methods are implemented this one is called first.
+ 
+ @param client Instance of `STAPIClient` making the request
+ @param result Dictionary with a single `records` key holding, for every document type, all records received so far.
+ The records of each array start with those of the partial result before, in the same order
+ @param request Handle of the query that is loading
+ */
+- (void)client:(STAPIClient *)client didReceivePartialResult:(NSDictionary *)result forRequest:(STAPIRequest *)request;
+
+/**
+ Asked when a query starts whether its records should be decoded while the response downloads. Streamed responses
+ are decoded twice, once chunk by chunk and once as a whole, so partial results are best kept to the queries that
+ are shown while they load. Only asked if one of the partial result methods is implemented.
+ 
+ When this method is not implemented partial results are delivered for the first page of search queries.
+ 
+ @param client Instance of `STAPIClient` making the request
+ @param request Handle of the query that is starting
+ 
+ @return `YES` to receive partial results for the query
+ */
+- (BOOL)client:(STAPIClient *)client shouldReceivePartialResultsForRequest:(STAPIRequest *)request;
+
+/**
+ Same as `client:didUpdateQuery:withResult:withType:` but identifies the query by its `STAPIRequest` handle.
+ When both methods are implemented this one is called first. The request has already finished.
+
+ @param client Instance of `STAPIClient` making the request
+ @param request Handle of the query whose result changed
+ @param result The fresh `NSDictionary` representation of the search results
+ */
+- (void)client:(STAPIClient *)client didUpdateRequest:(STAPIRequest *)request withResult:(NSDictionary *)result;
+
+/**
+ Same as `client:didCancelQuery:withType:` but identifies the query by its `STAPIRequest` handle. When both
+ methods are implemented this one is called first.
+
+ @param client Instance of `STAPIClient` making the request
+ @param request Handle of the query that was canceled
+ */
+- (void)client:(STAPIClient *)client didCancelRequest:(STAPIRequest *)request;
+
+/**
+ Same as `client:didFailQuery:withType:error:` but identifies the query by its `STAPIRequest` handle. When both
+ methods are implemented this one is called first.
+
+ @param client Instance of `STAPIClient` making the request
+ @param request Handle of the query that failed
+ @param error Stores more detailed information about the cause of the failure.
+ */
+- (void)client:(STAPIClient *)client didFailRequest:(STAPIRequest *)request error:(NSError *)error;
+
+/**
+ A response of the server was decoded. Called on a background thread before the result is delivered, so work
+ that only depends on the result such as building an `STResultSnapshot` stays off the thread the delegate is
+ called on. Not called for results answered from a cache, nor for partial results, each of which only adds a few
+ records to the one before.
+
+ @param client Instance of `STAPIClient` making the request
+ @param result The decoded `NSDictionary`, exactly as it will be delivered
+ @param request Handle of the query the result belongs to
+ */
+- (void)client:(STAPIClient *)client prepareResult:(NSDictionary *)result forRequest:(STAPIRequest *)request;
+
+/**
+ Called after a request delivered its result, once its timeline is complete and was added to `metrics`.
+ Useful for exporting the timing of individual requests to telemetry.
+
+ @param client Instance of `STAPIClient` making the request
+ @param timeline Timing of the request's stages
+ @param request Handle of the query that finished
+ */
+- (void)client:(STAPIClient *)client didCollectTimeline:(STAPIRequestTimeline *)timeline forRequest:(STAPIRequest *)request;
+
 @end
 
 /**
@@ -117,9 +277,15 @@ typedef enum {
  parameters can be found here: `http://swiftype.com/documentation/searching`. An search engine's key can be
  found within the account's dashboard: `http://swiftype.com/home`.
  
- The `STAPIClient` client is meant to run exactly 1 query at a time. If a query is pending (waiting for
- the server to respond) when another query is issued then that first query is canceled. A query will start
- and then finish or be canceled or fail. A query cannot for example fail and be canceled for the same request.
+ Every query returns a `STAPIRequest` handle. By default queries run concurrently: starting a new query does not
+ affect queries that are already pending, and each one can be canceled through its handle. At most
+ `maxConcurrentRequests` queries talk to the server at the same time, the rest wait in order of their
+ `priority`. All queries of a client are sent to the same API host so the underlying keep-alive connections
+ are reused between requests. Setting `requestPolicy` to `STAPIRequestPolicyLatestWins` restores the behavior
+ of running exactly 1 query at a time, where a pending query is canceled as soon as another one is issued.
+
+ A query will start and then finish or be canceled or fail. A query cannot for example fail and be canceled
+ for the same request.
  
  The client offers two types of queries: search and suggest. More detailed information on suggest queries
  can be found here `http://swiftype.com/documentation/autocomplete`.
@@ -134,13 +300,215 @@ typedef enum {
  */
 @property (nonatomic, copy) NSString *engineKey;
 
+/**
+ URL the API endpoints are appended to, without a trailing slash. Can point to a proxy or a local
+ test server.
+ 
+ The default value is `http://api.swiftype.com/api/v1/public`.
+ */
+@property (nonatomic, copy) NSString *baseURL;
+
+/**
+ Fields to download per document type, for example `@{ @"page" : @[ @"title", @"url" ] }`. Sent as
+ `fetch_fields` with every query unless the parameters from the delegate already contain `fetch_fields`.
+ Set to nil to download every field.
+ 
+ The default value is nil.
+ */
+@property (nonatomic, copy) NSDictionary *fetchFields;
+
 /**
  The delegate which will provide parameter data and receive messages related to the query
  */
 @property (nonatomic, weak) id <STAPIClientDelegate> delegate;
 
 /**
- Clear the cache that is used by all instance of STAPIClient
+ Queue the delegate is called on. When set, the client keeps its connections and timers on a shared background
+ thread with its own run loop and all of its methods are safe to call from any thread, so it also works in
+ background workers and command line tools without a main run loop. `clientRequestParameters:forQuery:withType:`
+ is then called on that background thread and should return quickly. Use a queue with a
+ `maxConcurrentOperationCount` of 1 to receive the callbacks of every query in order.
+
+ When nil the client works on the main thread and calls its delegate there. Set before the first query is started.
+
+ The default value is nil.
+ */
+@property (nonatomic, strong) NSOperationQueue *delegateQueue;
+
+/**
+ Determines what happens to pending queries when a new query is issued.
+
+ The default value is `STAPIRequestPolicyConcurrent`.
+ */
+@property (nonatomic, assign) STAPIRequestPolicy requestPolicy;
+
+/**
+ Maximum number of queries waiting on the server at the same time. Additional queries are held by the
+ client until a slot frees up.
+
+ The default value is 4.
+ */
+@property (nonatomic, assign) NSUInteger maxConcurrentRequests;
+
+/**
+ Number of seconds a suggest query may take, including retries, before it fails with `STTimeoutErrorCode`.
+ Suggestions are useless once the user typed on, so this is much shorter than `searchTimeout`.
+
+ The default value is 3 seconds.
+ */
+@property (nonatomic, assign) NSTimeInterval suggestTimeout;
+
+/**
+ Number of seconds a search query may take, including retries, before it fails with `STTimeoutErrorCode`.
+
+ The default value is 20 seconds.
+ */
+@property (nonatomic, assign) NSTimeInterval searchTimeout;
+
+/**
+ Whether a duplicate of a query is sent when its response headers take longer than the p95 time to first
+ byte `metrics` measured for its type. The first of the two to respond is used and the other is canceled.
+ Queries are only hedged once enough latencies were measured, while a connection slot is free and nothing
+ is queued, and within `hedgeBudget`. Revalidations in the background are never hedged.
+
+ The default value is `YES`.
+ */
+@property (nonatomic, assign) BOOL hedgesRequests;
+
+/**
+ Maximum number of hedged duplicates as a fraction of the connections this client opened recently.
+
+ The default value is 0.05.
+ */
+@property (nonatomic, assign) double hedgeBudget;
+
+/**
+ Maximum number of times a query is sent again after a failure that is safe to retry: the connection timed
+ out or was lost, the host could not be reached, or the server answered 502, 503 or 504. Other failures
+ are delivered right away. A retry waits a random time of up to `roundTripTime`, but at least 0.1 seconds,
+ doubled for every earlier retry. It is given up when that wait would pass the query's timeout.
+
+ The default value is 2.
+ */
+@property (nonatomic, assign) NSUInteger maxRetryCount;
+
+/**
+ Maximum number of retries as a fraction of the connections this client opened recently, so an outage
+ doesn't multiply the load on the server.
+
+ The default value is 0.1.
+ */
+@property (nonatomic, assign) double retryBudget;
+
+/**
+ Cache of decoded results consulted before a query is sent to the server and filled with every
+ successful response. Set to nil to disable caching for this client.
+ 
+ The default value is `[STQueryCache sharedCache]`.
+ */
+@property (nonatomic, strong) STQueryCache *queryCache;
+
+/**
+ Determines whether a cached result is final or revalidated with the server in the background.
+ Revalidation requests are sent with `STAPIRequestPriorityLow` and don't trigger the start, finish,
+ cancel or fail callbacks.
+ 
+ The default value is `STAPICachePolicyUseCache`.
+ */
+@property (nonatomic, assign) STAPICachePolicy cachePolicy;
+
+/**
+ On-disk store consulted after `queryCache` and filled with every successful response, so the first
+ queries of a new session can be answered without a round trip. Stored results are parsed on `decodePipeline`
+ and revalidated in the background according to `cachePolicy` and `persistentResultMaxAge`. Set to nil to keep
+ results in memory only.
+ 
+ The default value is `[STPersistentResultStore sharedStore]`.
+ */
+@property (nonatomic, strong) STPersistentResultStore *persistentStore;
+
+/**
+ Number of seconds after which a result from `persistentStore` is revalidated in the background even when
+ `cachePolicy` is `STAPICachePolicyUseCache`. Younger results are final unless the policy is
+ `STAPICachePolicyStaleWhileRevalidate`.
+ 
+ The default value is 3600 seconds.
+ */
+@property (nonatomic, assign) NSTimeInterval persistentResultMaxAge;
+
+/**
+ Registry of the queries on their way to the server. A query identical to one that is already in flight, down to
+ its parameters, waits for that query's response instead of being sent as well, even when the other query belongs
+ to another client. Both then receive the same decoded result or failure. Canceling either query only detaches its
+ own caller. Partial results are only delivered for the query that was sent. Set to nil to send every query.
+ 
+ The default value is `[STSingleFlight sharedSingleFlight]`.
+ */
+@property (nonatomic, strong) STSingleFlight *singleFlight;
+
+/**
+ Cache used to answer suggest queries that extend a prefix whose complete results are already known,
+ without a round trip to the server. Set to nil to always ask the server.
+ 
+ The default value is `[STSuggestPrefixCache sharedCache]`.
+ */
+@property (nonatomic, strong) STSuggestPrefixCache *suggestCache;
+
+/**
+ Offline index that answers suggest queries on the device, consulted after the caches. Queries with
+ filters and pages past the first are always sent to the server.
+ 
+ The default value is nil.
+ */
+@property (nonatomic, strong) STSuggestIndex *suggestIndex;
+
+/**
+ Whether suggest queries answered by `suggestIndex` are also sent to the server in the background.
+ The revalidation is sent with `STAPIRequestPriorityLow` and the delegate is told about a server result
+ that differs from the offline one like about any other revalidated result.
+ 
+ The default value is `YES`.
+ */
+@property (nonatomic, assign) BOOL reconcilesSuggestIndexResults;
+
+/**
+ Pipeline used to decode responses in the background. Responses of queries that were canceled or
+ superseded by the time their turn comes are skipped.
+ 
+ The default value is `[STDecodePipeline sharedPipeline]`.
+ */
+@property (nonatomic, strong) STDecodePipeline *decodePipeline;
+
+/**
+ Queue that delivers click analytics in the background. Clicks are kept on disk until they
+ were sent, so clicks made while offline are not lost.
+ 
+ The default value is `[STAnalyticsQueue sharedQueue]`.
+ */
+@property (nonatomic, strong) STAnalyticsQueue *analyticsQueue;
+
+/**
+ Latency percentiles and histograms per search type, collected from the timeline of every delivered
+ request. Revalidations in the background are not included.
+ 
+ The default value is a new `STAPIMetrics` for every client.
+ */
+@property (nonatomic, strong) STAPIMetrics *metrics;
+
+/**
+ Smoothed round trip time in seconds of the queries this client sent to the server, measured from
+ opening the connection until the last byte arrived. 0 until the first query finishes.
+ */
+@property (nonatomic, readonly) NSTimeInterval roundTripTime;
+
+/**
+ The `STAPIRequest` objects that have been started but have not yet finished, failed or been canceled.
+ */
+@property (nonatomic, readonly) NSArray *pendingRequests;
+
+/**
+ Clear the caches that are used by all instance of STAPIClient. The persistent result store is kept so
+ the next session still starts warm, use `[[STPersistentResultStore sharedStore] removeAllResults]` to clear it.
  */
 + (void)clearAPICache;
 
@@ -157,11 +525,13 @@ typedef enum {
  
  @param query The query to be used in the search
  
- If an existing suggest or search query is already waiting for a server response then it will
- be canceled in order for the new query to begin. The delegates query cancel method will be called
- for the canceled query.
+ @return Handle for the query or nil if the query was blank
+ 
+ If `requestPolicy` is `STAPIRequestPolicyLatestWins` and an existing suggest or search query is already
+ waiting for a server response then it will be canceled in order for the new query to begin. The delegates
+ query cancel method will be called for the canceled query.
  */
-- (void)searchQuery:(NSString *)query;
+- (STAPIRequest *)searchQuery:(NSString *)query;
 
 /**
  Starts a new search query with the server for a specific page and certain number of results.
@@ -172,11 +542,33 @@ typedef enum {
  
  @param perPage Maximum number of items per page
  
- If an existing suggest or search query is already waiting for a server response then it will
- be canceled in order for the new query to begin. The delegates query cancel method will be called
- for the canceled query.
+ @return Handle for the query or nil if the query was blank
+ 
+ If `requestPolicy` is `STAPIRequestPolicyLatestWins` and an existing suggest or search query is already
+ waiting for a server response then it will be canceled in order for the new query to begin. The delegates
+ query cancel method will be called for the canceled query.
  */
-- (void)searchQuery:(NSString *)query page:(NSUInteger)page perPage:(NSUInteger)perPage;
+- (STAPIRequest *)searchQuery:(NSString *)query page:(NSUInteger)page perPage:(NSUInteger)perPage;
+
+/**
+ Starts a new search query with the server for a page of some document types only. The server neither
+ searches nor returns the other document types of the engine, which keeps paging through a single section
+ cheap for engines with many document types.
+ 
+ @param query The query to be used in the search
+ 
+ @param documentTypes Names of the document types to search, nil for every document type
+ 
+ @param page The page to request
+ 
+ @param perPage Maximum number of items per page
+ 
+ @return Handle for the query or nil if the query was blank
+ 
+ The result only holds `records` and `info` for `documentTypes`. `fetchFields` are sent for those types only.
+ `requestPolicy` applies as it does for `searchQuery:page:perPage:`.
+ */
+- (STAPIRequest *)searchQuery:(NSString *)query documentTypes:(NSArray *)documentTypes page:(NSUInteger)page perPage:(NSUInteger)perPage;
 
 /**
  Starts a new suggest query with the server. By default the query will request only the first 20 results
@@ -184,23 +576,63 @@ typedef enum {
  
  @param query The query to send to the server
  
- If an existing suggest or search query is already waiting for a server response then it will
- be canceled in order for the new query to begin. The delegates query cancel method will be called
- for the canceled query.
+ @return Handle for the query or nil if the query was blank
+ 
+ If `requestPolicy` is `STAPIRequestPolicyLatestWins` and an existing suggest or search query is already
+ waiting for a server response then it will be canceled in order for the new query to begin. The delegates
+ query cancel method will be called for the canceled query.
  */
-- (void)suggestQuery:(NSString *)query;
+- (STAPIRequest *)suggestQuery:(NSString *)query;
+
+/**
+ Tells whether a suggest query would be answered from one of the caches or the offline index without contacting the server.
+ The delegate is asked for the request parameters, but no query is started and no cache statistics change.
+ 
+ @param query The query to check
+ 
+ @return `YES` if `suggestQuery:` would be answered locally
+ */
+- (BOOL)canAnswerSuggestQueryLocally:(NSString *)query;
+
+/**
+ Opens a connection to the server ahead of the first query, so the query does not wait for DNS and the
+ connection setup. Call it when the search UI appears. Nothing is done while a request is loading or when
+ the last warm-up was less than 30 seconds ago. The delegate is not told about the warm-up.
+ */
+- (void)warmUp;
+
+/**
+ Loads the first page of each query into the caches at low priority, so these queries are answered locally
+ once the user types them. The delegate is not told about prefetches. A query the user starts while its
+ prefetch is still loading joins it through `singleFlight` instead of loading again.
+
+ Prefetches are listed in `pendingRequests` and canceled by `cancelQuery`.
+
+ @param queries Array of `NSString` queries, for example the most popular or most recent ones
+ @param type The type of the queries
+ */
+- (void)prefetchQueries:(NSArray *)queries type:(STSearchType)type;
 
 /**
  Cancel any pending requests with the search server
  */
 - (void)cancelQuery;
 
+/**
+ Cancel a single pending request. Other requests are not affected.
+ 
+ @param request Handle returned when the query was started. Requests that already finished are ignored.
+ */
+- (void)cancelRequest:(STAPIRequest *)request;
+
 /**
  Used to log user interaction with the search results. This is typically called by the `STSearchResultObjects`
  postClickAnalyticsWithDocumentId method. 
  
  It is the responsibility of custom UI to call this once a user has selected a search result.
  
+ The click is handed to `analyticsQueue`, which sends it in the background together with other clicks.
+ 
  @param query The query the that was run against the server that found a particular result
  
  @param type The search type. Whether it was a suggest or a search query.
@@ -210,3 +642,5 @@ typedef enum {
 - (void)postClickAnalyticsForQuery:(NSString*)query withType:(STSearchType)type documentId:(NSString *)documentId;
 
 @end
+
+#import "STAPIRequest.h"
@@ -7,47 +7,107 @@
 //
 
 #import "STAPIClient.h"
+#import "STAPIClient+Private.h"
+#import "STAPIRequest+Private.h"
+#import "STSuggestPrefixCache.h"
+#import "STSuggestIndex.h"
+#import "STQueryCache.h"
+#import "STPersistentResultStore.h"
+#import "STSingleFlight.h"
+#import "STStreamingResultParser.h"
+#import "STDecodePipeline.h"
+#import "STAnalyticsQueue.h"
+#import "STAPIMetrics.h"
+#import "STRequestBuilder.h"
 
 #import "NSDictionary+STUtils.h"
 
 NSString * const SWIFTYPE_API_VERSION = @"1.0";
 
-NSString * const BASE_SUGGEST_URL = @"http://api.swiftype.com/api/v1/public/engines/suggest.json";
-NSString * const BASE_SEARCH_URL = @"http://api.swiftype.com/api/v1/public/engines/search.json";
-NSString * const BASE_SUGGEST_ANALYTICS_URL = @"http://api.swiftype.com/api/v1/public/analytics/pas";
-NSString * const BASE_SEARCH_ANALYTICS_URL = @"http://api.swiftype.com/api/v1/public/analytics/pc";
+NSString * const BASE_API_URL = @"http://api.swiftype.com/api/v1/public";
+NSString * const SUGGEST_PATH = @"/engines/suggest.json";
+NSString * const SEARCH_PATH = @"/engines/search.json";
+NSString * const SUGGEST_ANALYTICS_PATH = @"/analytics/pas";
+NSString * const SEARCH_ANALYTICS_PATH = @"/analytics/pc";
 
 NSString * const STErrorDomain = @"STErrorDomain";
 NSString * const STHTTPResponseKey = @"STHTTPResponseKey";
 const NSInteger STHTTPErrorCode = 1;
 const NSInteger STTimeoutErrorCode = 2;
+const NSInteger STRequestEncodingErrorCode = 3;
+
+// A p95 computed from fewer latencies is mostly noise
+#define ST_HEDGE_MINIMUM_SAMPLES 20
+// Attempt counters are halved at this size so the hedge and retry budgets follow recent traffic
+#define ST_BUDGET_WINDOW 1000
+// Seconds a warmed up connection is assumed to stay open, servers commonly keep idle connections longer
+#define ST_WARM_UP_INTERVAL 30.0
+
+// Uniform in (0, 1]. random() is available wherever Foundation is, unlike arc4random_uniform on glibc. It is
+// seeded per process so that clients failing at the same moment don't retry in lockstep
+static double STRandomFraction(void) {
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        srandom((unsigned int)([[NSDate date] timeIntervalSince1970] * 1000.0) ^ (unsigned int)[[NSProcessInfo processInfo] processIdentifier]);
+    });
+    return (random() % 1000 + 1) / 1000.0;
+}
 
 @interface STAPIClient ()
 
-@property (nonatomic, copy) NSString *query;
-@property (nonatomic, strong) NSMutableData *responseData;
-@property (nonatomic, strong) NSURLConnection *connection;
-@property (nonatomic, strong) NSURLRequest *request;
-@property (nonatomic, strong) NSURLResponse *response;
-@property (nonatomic, assign) STSearchType searchType;
-@property (nonatomic, strong) NSTimer *timeoutTimer;
+@property (nonatomic, strong) NSMutableArray *activeRequests;
+@property (nonatomic, strong) NSMutableArray *queuedRequests;
+@property (nonatomic, strong) NSMutableSet *revalidatingKeys;
+@property (atomic, assign) NSUInteger generation;
+@property (nonatomic, assign) NSTimeInterval roundTripTime;
+@property (nonatomic, assign) NSUInteger attemptCount;
+@property (nonatomic, assign) NSUInteger hedgeCount;
+@property (nonatomic, assign) NSUInteger retryCount;
+@property (nonatomic, strong) STRequestBuilder *requestBuilder;
+@property (nonatomic, strong) NSURLConnection *warmUpConnection;
+@property (nonatomic, strong) NSDate *warmUpDate;
 
-+ (NSURLCache *)_sharedAPICache;
-+ (dispatch_queue_t)_jsonDecodeQueue;
 
-- (NSDictionary *)_requestParamsForPage:(NSUInteger)page perPage:(NSUInteger)perPage;
++ (NSThread *)_networkThread;
++ (void)_networkThreadMain:(id)object;
+- (void)_performOnClientThread:(dispatch_block_t)block waitUntilDone:(BOOL)wait;
+- (void)_performBlock:(dispatch_block_t)block;
+- (void)_performOnDelegateQueue:(dispatch_block_t)block;
+- (NSDictionary *)_requestParamsForQuery:(NSString *)query type:(STSearchType)type documentTypes:(NSArray *)documentTypes page:(NSUInteger)page perPage:(NSUInteger)perPage;
 - (void)_addTrackingHeaders:(NSMutableURLRequest *)request;
-- (void)_doRequestForPage:(NSUInteger)page perPage:(NSUInteger)perPage;
+- (STRequestBuilder *)_requestBuilder;
+- (NSUInteger)_wireBytesForResponse:(NSURLResponse *)response payloadBytes:(NSUInteger)payloadBytes;
+- (STAPIRequest *)_doRequestForQuery:(NSString *)query type:(STSearchType)type documentTypes:(NSArray *)documentTypes page:(NSUInteger)page perPage:(NSUInteger)perPage prefetch:(BOOL)prefetch;
+- (STDecodeStalenessTest)_stalenessTestForRequest:(STAPIRequest *)request;
+- (void)_delegatePrepareResult:(NSDictionary *)result forRequest:(STAPIRequest *)request;
+- (BOOL)_suggestIndexCanAnswerParams:(NSDictionary *)params page:(NSUInteger)page;
+- (void)_lookUpUncachedRequest:(STAPIRequest *)request;
+- (void)_deliverStoredData:(NSData *)data storedDate:(NSDate *)storedDate forRequest:(STAPIRequest *)request;
+- (void)_deliverLocalResult:(NSDictionary *)result forRequest:(STAPIRequest *)request;
+- (void)_finishRequest:(STAPIRequest *)request withLocalResult:(NSDictionary *)result;
+- (void)_failUnencodableRequest:(STAPIRequest *)request;
+- (void)_revalidateRequest:(STAPIRequest *)request staleResult:(NSDictionary *)staleResult;
+- (BOOL)_orphanRequestIfShared:(STAPIRequest *)request;
+- (void)_settleFlightOfRequest:(STAPIRequest *)request result:(NSDictionary *)result error:(NSError *)error bytes:(NSUInteger)bytes;
+- (void)_finishFollower:(STAPIRequest *)request withResult:(NSDictionary *)result error:(NSError *)error bytes:(NSUInteger)bytes;
+- (void)_finishRevalidation:(STAPIRequest *)revalidation withResult:(NSDictionary *)result bytes:(NSUInteger)bytes;
+- (void)_startQueuedRequests;
+- (void)_recordRoundTripTime:(NSTimeInterval)roundTripTime;
+- (void)_startConnectionForRequest:(STAPIRequest *)request;
+- (NSTimeInterval)_timeoutForType:(STSearchType)type;
+- (NSTimeInterval)_hedgeDelayForRequest:(STAPIRequest *)request;
+- (BOOL)_budget:(double)budget allowsExtraAttemptsAfter:(NSUInteger)extraCount;
+- (void)_hedgeTimerFired:(NSTimer *)timer;
+- (void)_keepConnection:(NSURLConnection *)connection ofRequest:(STAPIRequest *)request;
+- (BOOL)_dropHedgedConnection:(NSURLConnection *)connection ofRequest:(STAPIRequest *)request;
+- (BOOL)_isRetryableError:(NSError *)error;
+- (BOOL)_retryRequest:(STAPIRequest *)request afterError:(NSError *)error;
+- (void)_retryTimerFired:(NSTimer *)timer;
+- (STAPIRequest *)_requestForConnection:(NSURLConnection *)connection;
+- (NSUInteger)_numberOfOpenConnections;
 - (void)_cancelPending;
-- (void)_cleanUp;
-- (void)_connectionTimeout;
-- (void)_delegateDidStartQuery:(NSString *)query withType:(STSearchType)type;
-- (void)_delegateDidFinishQuery:(NSString *)query withResult:(NSDictionary *)result withType:(STSearchType)type;
-- (void)_delegateDidCancelQuery:(NSString *)query withType:(STSearchType)type;
-- (void)_delegateDidFailQuery:(NSString *)query withType:(STSearchType)type error:(NSError *)error;
-
-// Possible to page suggest requests but don't want to expose that. UI would be tricky
-- (void)suggestQuery:(NSString *)query page:(NSUInteger)page perPage:(NSUInteger)perPage;
+- (void)_cleanUpRequest:(STAPIRequest *)request;
+- (void)_connectionTimeout:(NSTimer *)timer;
 
 @end
 
@@ -61,69 +121,166 @@ const NSInteger STTimeoutErrorCode = 2;
 
 #pragma mark - STAPIClient
 
-+ (NSURLCache *)_sharedAPICache {
-    static dispatch_once_t onceToken;
-    static NSURLCache *apiCache = nil;
-    dispatch_once(&onceToken, ^{
-        apiCache = [[NSURLCache alloc] initWithMemoryCapacity:1024*1024*5 diskCapacity:1024*1024*20 diskPath:@"PrivateSwiftypeApiCache"];
-    });
-    return apiCache;
-}
-
-+ (dispatch_queue_t)_jsonDecodeQueue {
-    static dispatch_queue_t jsonDecodeQueue;
-    static dispatch_once_t onceToken;
-    dispatch_once(&onceToken, ^{
-        jsonDecodeQueue = dispatch_queue_create("com.swiftype.api.jsonDecode", NULL);
-    });
-    return jsonDecodeQueue;
-}
-
 + (void)clearAPICache {
-    [[self _sharedAPICache] removeAllCachedResponses];
+    [[STQueryCache sharedCache] removeAllResults];
+    [[STSuggestPrefixCache sharedCache] removeAllResults];
 }
 
 - (id)initWithApiKey:(NSString *)engineKey {
     self = [super init];
     if (self) {
         self.engineKey = engineKey;
-        self.query = @"";
-        self.searchType = STSearchTypeUndefined;
+        self.baseURL = BASE_API_URL;
+        self.requestPolicy = STAPIRequestPolicyConcurrent;
+        self.maxConcurrentRequests = 4;
+        self.suggestTimeout = 3.0;
+        self.searchTimeout = 20.0;
+        self.hedgesRequests = YES;
+        self.hedgeBudget = 0.05;
+        self.maxRetryCount = 2;
+        self.retryBudget = 0.1;
+        self.queryCache = [STQueryCache sharedCache];
+        self.persistentStore = [STPersistentResultStore sharedStore];
+        self.singleFlight = [STSingleFlight sharedSingleFlight];
+        self.suggestCache = [STSuggestPrefixCache sharedCache];
+        self.reconcilesSuggestIndexResults = YES;
+        self.activeRequests = [NSMutableArray array];
+        self.queuedRequests = [NSMutableArray array];
+        self.revalidatingKeys = [NSMutableSet set];
+        self.cachePolicy = STAPICachePolicyUseCache;
+        self.persistentResultMaxAge = 3600.0;
+        self.decodePipeline = [STDecodePipeline sharedPipeline];
+        self.analyticsQueue = [STAnalyticsQueue sharedQueue];
+        self.metrics = [[STAPIMetrics alloc] init];
     }
     return self;
 }
 
-- (void)searchQuery:(NSString *)query {
-    [self searchQuery:query page:1 perPage:20];
+- (NSArray *)pendingRequests {
+    __block NSArray *pendingRequests = nil;
+    [self _performOnClientThread:^{
+        // Requests canceled while others wait on their response are still loading, but no longer pending for the caller
+        NSPredicate *notOrphaned = [NSPredicate predicateWithFormat:@"orphaned == NO"];
+        pendingRequests = [[self.activeRequests arrayByAddingObjectsFromArray:self.queuedRequests] filteredArrayUsingPredicate:notOrphaned];
+    } waitUntilDone:YES];
+    return pendingRequests;
 }
 
-- (void)searchQuery:(NSString *)query page:(NSUInteger)page perPage:(NSUInteger)perPage {
-    [self _cancelPending];
-    self.searchType = STSearchTypeSearch;
-    self.query = query;
-    [self _doRequestForPage:page perPage:perPage];
+- (STAPIRequest *)searchQuery:(NSString *)query {
+    return [self searchQuery:query page:1 perPage:20];
 }
 
-- (void)suggestQuery:(NSString *)query {
-    [self suggestQuery:query page:1 perPage:20];
+- (STAPIRequest *)searchQuery:(NSString *)query page:(NSUInteger)page perPage:(NSUInteger)perPage {
+    return [self searchQuery:query documentTypes:nil page:page perPage:perPage];
+}
+
+- (STAPIRequest *)searchQuery:(NSString *)query documentTypes:(NSArray *)documentTypes page:(NSUInteger)page perPage:(NSUInteger)perPage {
+    __block STAPIRequest *request = nil;
+    [self _performOnClientThread:^{
+        if (self.requestPolicy == STAPIRequestPolicyLatestWins) {
+            [self _cancelPending];
+        }
+        request = [self _doRequestForQuery:query type:STSearchTypeSearch documentTypes:documentTypes page:page perPage:perPage prefetch:NO];
+    } waitUntilDone:YES];
+    return request;
+}
+
+- (STAPIRequest *)suggestQuery:(NSString *)query {
+    return [self suggestQuery:query page:1 perPage:20];
+}
+
+- (STAPIRequest *)suggestQuery:(NSString *)query page:(NSUInteger)page perPage:(NSUInteger)perPage {
+    __block STAPIRequest *request = nil;
+    [self _performOnClientThread:^{
+        if (self.requestPolicy == STAPIRequestPolicyLatestWins) {
+            [self _cancelPending];
+        }
+        request = [self _doRequestForQuery:query type:STSearchTypeSuggest documentTypes:nil page:page perPage:perPage prefetch:NO];
+    } waitUntilDone:YES];
+    return request;
+}
+
+- (BOOL)canAnswerSuggestQueryLocally:(NSString *)query {
+    NSString *strippedString = [query stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
+    if (strippedString.length == 0) {
+        return NO;
+    }
+    
+    NSDictionary *params = [self _requestParamsForQuery:query type:STSearchTypeSuggest documentTypes:nil page:1 perPage:20];
+    NSString *cacheKey = [STQueryCache keyForEndpoint:[self.baseURL stringByAppendingString:SUGGEST_PATH] params:params];
+    if ([self.queryCache containsResultForKey:cacheKey] || [self.persistentStore containsResultForKey:cacheKey]) {
+        return YES;
+    }
+    if ([self.suggestCache canAnswerQuery:query params:params]) {
+        return YES;
+    }
+    return [self _suggestIndexCanAnswerParams:params page:1] && [self.suggestIndex canAnswerQuery:query];
+}
+
+- (void)warmUp {
+    [self _performOnClientThread:^{
+        // A loading request or a recent warm-up already holds a connection open
+        BOOL warm = self.warmUpDate && [[NSDate date] timeIntervalSinceDate:self.warmUpDate] < ST_WARM_UP_INTERVAL;
+        if (self.warmUpConnection || warm || [self _numberOfOpenConnections] > 0) {
+            return;
+        }
+        
+        NSURL *URL = [NSURL URLWithString:self.baseURL];
+        if (URL == nil) {
+            return;
+        }
+        
+        // Only the connection is of use, a HEAD request keeps the response empty
+        NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:URL
+                                                               cachePolicy:NSURLRequestReloadIgnoringLocalCacheData
+                                                           timeoutInterval:self.suggestTimeout];
+        [request setHTTPMethod:@"HEAD"];
+        [self _addTrackingHeaders:request];
+        self.warmUpDate = [NSDate date];
+        self.warmUpConnection = [[NSURLConnection alloc] initWithRequest:request delegate:self startImmediately:NO];
+        [self.warmUpConnection start];
+    } waitUntilDone:NO];
 }
 
-- (void)suggestQuery:(NSString *)query page:(NSUInteger)page perPage:(NSUInteger)perPage {
-    [self _cancelPending];
-    self.searchType = STSearchTypeSuggest;
-    self.query = query;
-    [self _doRequestForPage:page perPage:perPage];
+- (void)prefetchQueries:(NSArray *)queries type:(STSearchType)type {
+    [self _performOnClientThread:^{
+        for (NSString *query in queries) {
+            if ([query isKindOfClass:[NSString class]]) {
+                [self _doRequestForQuery:query type:type documentTypes:nil page:1 perPage:20 prefetch:YES];
+            }
+        }
+    } waitUntilDone:NO];
 }
 
 - (void)cancelQuery {
-    [self _cancelPending];
+    [self _performOnClientThread:^{
+        [self _cancelPending];
+    } waitUntilDone:YES];
+}
+
+- (void)cancelRequest:(STAPIRequest *)request {
+    [self _performOnClientThread:^{
+        if (request.client != self || request.finished || request.orphaned) {
+            return;
+        }
+        
+        if ([self _orphanRequestIfShared:request]) {
+            return;
+        }
+        
+        [request.connection cancel];
+        request.cancelled = YES;
+        [self _cleanUpRequest:request];
+        [self _delegateDidCancelRequest:request];
+        [self _startQueuedRequests];
+    } waitUntilDone:YES];
 }
 
 - (void)postClickAnalyticsForQuery:(NSString*)query withType:(STSearchType)type documentId:(NSString *)documentId {
     if (documentId == nil) return;
 
     if (type == STSearchTypeSearch || type == STSearchTypeSuggest) {
-        NSString *analyticsURL = (type == STSearchTypeSearch) ? BASE_SEARCH_ANALYTICS_URL : BASE_SUGGEST_ANALYTICS_URL;
+        NSString *analyticsURL = [self.baseURL stringByAppendingString:(type == STSearchTypeSearch) ? SEARCH_ANALYTICS_PATH : SUGGEST_ANALYTICS_PATH];
         NSString *docIdKey = (type == STSearchTypeSearch) ? @"doc_id" : @"entry_id";
         NSString *queryKey = (type == STSearchTypeSearch) ? @"q" : @"prefix";
         
@@ -136,18 +293,42 @@ const NSInteger STTimeoutErrorCode = 2;
         
         NSMutableURLRequest *request = [[NSMutableURLRequest alloc] initWithURL:requestURL];
         [self _addTrackingHeaders:request];
-        [NSURLConnection sendAsynchronousRequest:request queue:[NSOperationQueue mainQueue] completionHandler:^(NSURLResponse *r, NSData *d, NSError *e){}];
+        [self.analyticsQueue addEventWithURL:requestURL HTTPHeaderFields:request.allHTTPHeaderFields];
     }
 }
 
 #pragma mark - NSURLConnectionDelegate
 
 - (void)connection:(NSURLConnection *)connection didFailWithError:(NSError *)error {
-    [self _delegateDidFailQuery:self.query withType:self.searchType error:error];
-    [self _cleanUp];
+    if (connection == self.warmUpConnection) {
+        self.warmUpConnection = nil;
+        return;
+    }
+    
+    STAPIRequest *request = [self _requestForConnection:connection];
+    if (request == nil) return;
+    
+    // The other connection of a hedged request is still running and may yet succeed
+    if ([self _dropHedgedConnection:connection ofRequest:request]) {
+        [self _startQueuedRequests];
+        return;
+    }
+    
+    if (![self _retryRequest:request afterError:error]) {
+        [self _settleFlightOfRequest:request result:nil error:error bytes:0];
+        [self _cleanUpRequest:request];
+        [self _delegateDidFailRequest:request error:error];
+    }
+    [self _startQueuedRequests];
 }
 
 - (void)connection:(NSURLConnection *)connection didReceiveResponse:(NSURLResponse *)response {
+    STAPIRequest *request = [self _requestForConnection:connection];
+    if (request == nil) return;
+    
+    // The first response wins, whatever it says
+    [self _keepConnection:connection ofRequest:request];
+    
     NSHTTPURLResponse *httpResponse = (NSHTTPURLResponse *)response;
     
     if ((httpResponse.statusCode >= 200 && httpResponse.statusCode <= 299) == NO) {
@@ -156,65 +337,204 @@ const NSInteger STTimeoutErrorCode = 2;
         NSError *error = [NSError errorWithDomain:STErrorDomain
                                              code:STHTTPErrorCode
                                          userInfo:@{ STHTTPResponseKey : httpResponse, NSLocalizedDescriptionKey : @"Unexpected response from the server" }];
-        [self _delegateDidFailQuery:self.query withType:self.searchType error:error];
-        [self _cleanUp];
+        if (![self _retryRequest:request afterError:error]) {
+            [self _settleFlightOfRequest:request result:nil error:error bytes:0];
+            [self _cleanUpRequest:request];
+            [self _delegateDidFailRequest:request error:error];
+        }
+        [self _startQueuedRequests];
     }
     else {
-        self.response = response;
+        request.response = response;
+        request.timeline.responseDate = [NSDate date];
     }
 }
 
 - (void)connection:(NSURLConnection *)connection didReceiveData:(NSData *)data {
-    [self.responseData appendData:data];
+    STAPIRequest *request = [self _requestForConnection:connection];
+    if (request == nil) return;
+    
+    [request.responseData appendData:data];
+    
+    if (request.revalidatedRequest || request.orphaned || !request.streamsPartialResults) {
+        return;
+    }
+    
+    /* Chunks are chained behind each other and the complete response is chained behind the last
+     chunk, so every partial result is delivered before the final one. Once the query is stale the
+     remaining chunks are skipped.
+     */
+    if (request.streamingParser == nil) {
+        request.streamingParser = [[STStreamingResultParser alloc] init];
+    }
+    STStreamingResultParser *parser = request.streamingParser;
+    NSData *chunk = [data copy];
+    request.lastDecodeOperation = [self.decodePipeline performDecode:^{
+        if ([parser appendData:chunk] == 0) {
+            return;
+        }
+        
+        // Not prepared, a partial result only adds to the one before and the delegate can build on what it showed
+        NSDictionary *partialResult = @{ @"records" : parser.records };
+        [self _performOnClientThread:^{
+            if (request.finished) {
+                return;
+            }
+            [self _delegateDidReceivePartialResult:partialResult forRequest:request];
+        } waitUntilDone:NO];
+    } after:request.lastDecodeOperation isStale:[self _stalenessTestForRequest:request]];
+}
+
+- (NSCachedURLResponse *)connection:(NSURLConnection *)connection willCacheResponse:(NSCachedURLResponse *)cachedResponse {
+    // Results are kept decoded by queryCache and persistentStore, a raw copy in NSURLCache would only double them
+    return nil;
 }
 
 - (void)connectionDidFinishLoading:(NSURLConnection *)connection {
-    /* Capture the environment since a new query could start on the main thread while
-     the JSON parse is happening in the background
+    if (connection == self.warmUpConnection) {
+        self.warmUpConnection = nil;
+        return;
+    }
+    
+    STAPIRequest *request = [self _requestForConnection:connection];
+    if (request == nil) return;
+    
+    /* The connection is done so release its slot right away. The request itself stays pending
+     until the JSON parse completes in the background, that way it can still be canceled.
      */
-    NSData *captureData = self.responseData;
-    NSURLResponse *captureResponse = self.response;
-    NSURLRequest *captureRequest = self.request;
-    NSString *captureQuery = self.query;
-    STSearchType captureSearchType = self.searchType;
-    
-    dispatch_async([[self class] _jsonDecodeQueue], ^{
-        NSError *error = nil;
-        NSDictionary *dict = [NSJSONSerialization JSONObjectWithData:captureData
-                                                             options:0
-                                                               error:&error];
-        dispatch_async(dispatch_get_main_queue(), ^{
+    [request.timeoutTimer invalidate];
+    request.timeoutTimer = nil;
+    request.connection = nil;
+    request.timeline.loadedDate = [NSDate date];
+    request.timeline.payloadBytes = request.responseData.length;
+    request.timeline.wireBytes = [self _wireBytesForResponse:request.response payloadBytes:request.responseData.length];
+    [self _recordRoundTripTime:[request.timeline.loadedDate timeIntervalSinceDate:request.attemptStartDate]];
+    [self _startQueuedRequests];
+    
+    NSData *captureData = request.responseData;
+    [self.decodePipeline decodeData:captureData after:request.lastDecodeOperation isStale:[self _stalenessTestForRequest:request] completion:^(id dict, NSError *error) {
+        request.timeline.decodedDate = [NSDate date];
+        if (error == nil) {
+            [self _delegatePrepareResult:dict forRequest:request];
+        }
+        [self _performOnClientThread:^{
+            if (request.finished) {
+                return;
+            }
+            request.timeline.deliveredDate = [NSDate date];
+            
+            [self _settleFlightOfRequest:request result:dict error:error bytes:captureData.length];
+            [self _cleanUpRequest:request];
             if (error) {
-                [self _delegateDidFailQuery:captureQuery withType:captureSearchType error:error];
+                [self _delegateDidFailRequest:request error:error];
                 return;
             }
             
-            [self _delegateDidFinishQuery:captureQuery withResult:dict withType:captureSearchType];
+            if (request.revalidatedRequest) {
+                [self _finishRevalidation:request withResult:dict bytes:captureData.length];
+                return;
+            }
             
-            NSCachedURLResponse *cachedResponse = [[NSCachedURLResponse alloc] initWithResponse:captureResponse data:captureData];
-            [[[self class] _sharedAPICache] storeCachedResponse:cachedResponse forRequest:captureRequest];
-        });
+            [self _delegateDidFinishRequest:request withResult:dict];
+            
+            if (request.searchType == STSearchTypeSuggest) {
+                [self.suggestCache storeResult:dict forQuery:request.query params:request.params];
+            }
+            
+            [self.queryCache setResult:dict forKey:request.cacheKey bytes:captureData.length];
+            [self.persistentStore setResult:dict forKey:request.cacheKey];
+            [self _recordTimelineForRequest:request];
+        } waitUntilDone:NO];
+    }];
+}
+
+#pragma mark - Private
+
++ (NSThread *)_networkThread {
+    static dispatch_once_t onceToken;
+    static NSThread *networkThread = nil;
+    dispatch_once(&onceToken, ^{
+        networkThread = [[NSThread alloc] initWithTarget:self selector:@selector(_networkThreadMain:) object:nil];
+        networkThread.name = @"com.swiftype.api.network";
+        [networkThread start];
     });
-    
-    /* We finished loading and captured the variables we need later once parsing is complete
-     so cleanup now. We don't want to cleanup inside the dispatch_async back to the main queue
-     because another query might be running and we could possibly be cleaning up it's environment.
-     Which would be a mistake.
+    return networkThread;
+}
+
++ (void)_networkThreadMain:(id)object {
+    @autoreleasepool {
+        // The port keeps the run loop running while there are no connections or timers
+        NSRunLoop *runLoop = [NSRunLoop currentRunLoop];
+        [runLoop addPort:[NSPort port] forMode:NSDefaultRunLoopMode];
+        [runLoop run];
+    }
+}
+
+- (void)_performOnClientThread:(dispatch_block_t)block waitUntilDone:(BOOL)wait {
+    /* Connections, timers and the request queues of a client all live on one thread: the main thread,
+     or a shared thread with its own run loop when the client has a delegate queue. Only that thread
+     touches them, so the client needs no locks.
      */
-    [self _cleanUp];
+    if (self.delegateQueue == nil) {
+        if (!wait) {
+            dispatch_async(dispatch_get_main_queue(), block);
+        }
+        else if ([NSThread isMainThread]) {
+            block();
+        }
+        else {
+            dispatch_sync(dispatch_get_main_queue(), block);
+        }
+        return;
+    }
+    
+    NSThread *networkThread = [STAPIClient _networkThread];
+    if (wait && [NSThread currentThread] == networkThread) {
+        block();
+        return;
+    }
+    [self performSelector:@selector(_performBlock:) onThread:networkThread withObject:[block copy] waitUntilDone:wait];
 }
 
-#pragma mark - Private
+- (void)_performBlock:(dispatch_block_t)block {
+    block();
+}
 
-- (NSDictionary *)_requestParamsForPage:(NSUInteger)page perPage:(NSUInteger)perPage {
+- (void)_performOnDelegateQueue:(dispatch_block_t)block {
+    if (self.delegateQueue == nil) {
+        block();
+        return;
+    }
+    [self.delegateQueue addOperationWithBlock:block];
+}
+
+- (NSDictionary *)_requestParamsForQuery:(NSString *)query type:(STSearchType)type documentTypes:(NSArray *)documentTypes page:(NSUInteger)page perPage:(NSUInteger)perPage {
     NSMutableDictionary *requestParams = [NSMutableDictionary dictionaryWithDictionary:[self.delegate clientRequestParameters:self
-                                                                                                                     forQuery:self.query
-                                                                                                                     withType:self.searchType]];
+                                                                                                                     forQuery:query
+                                                                                                                     withType:type]];
     if (self.engineKey) {
         [requestParams setObject:self.engineKey forKey:@"engine_key"];
     }
-    if (self.query) {
-        [requestParams setObject:self.query forKey:@"q"];
+    if (query) {
+        [requestParams setObject:query forKey:@"q"];
+    }
+
+    NSDictionary *fetchFields = self.fetchFields;
+    if (documentTypes) {
+        [requestParams setObject:documentTypes forKey:@"document_types"];
+        // Fields of the other types would only make the request bigger
+        NSMutableDictionary *typeFetchFields = [NSMutableDictionary dictionaryWithCapacity:documentTypes.count];
+        for (NSString *documentType in documentTypes) {
+            NSArray *fields = [fetchFields objectForKey:documentType];
+            if (fields) {
+                [typeFetchFields setObject:fields forKey:documentType];
+            }
+        }
+        fetchFields = typeFetchFields;
+    }
+
+    if (fetchFields.count > 0 && [requestParams objectForKey:@"fetch_fields"] == nil) {
+        [requestParams setObject:fetchFields forKey:@"fetch_fields"];
     }
 
     [requestParams setObject:@(perPage) forKey:@"per_page"];
@@ -228,112 +548,680 @@ const NSInteger STTimeoutErrorCode = 2;
     [request setValue:@"iOS" forHTTPHeaderField:@"X-SwiftypeAPI-Platform"];
 }
 
-- (void)_doRequestForPage:(NSUInteger)page perPage:(NSUInteger)perPage {
+- (STRequestBuilder *)_requestBuilder {
+    // The static parts of the requests depend on the engine key and the base URL, either may have changed
+    STRequestBuilder *builder = self.requestBuilder;
+    BOOL sameEngineKey = (builder.engineKey == self.engineKey) || [builder.engineKey isEqualToString:self.engineKey];
+    if (builder && sameEngineKey && [builder.baseURL isEqualToString:self.baseURL]) {
+        return builder;
+    }
+    
+    NSMutableURLRequest *headerRequest = [[NSMutableURLRequest alloc] init];
+    [headerRequest setValue:@"application/json" forHTTPHeaderField:@"Content-Type"];
+    // The URL loading system inflates the body as it arrives, so the streaming parser still sees plain JSON
+    [headerRequest setValue:@"gzip, deflate" forHTTPHeaderField:@"Accept-Encoding"];
+    [self _addTrackingHeaders:headerRequest];
+    
+    self.requestBuilder = [[STRequestBuilder alloc] initWithBaseURL:self.baseURL engineKey:self.engineKey HTTPHeaderFields:headerRequest.allHTTPHeaderFields];
+    return self.requestBuilder;
+}
+
+- (NSUInteger)_wireBytesForResponse:(NSURLResponse *)response payloadBytes:(NSUInteger)payloadBytes {
+    // The body was inflated before it reached us, only the headers still tell its compressed size
+    NSDictionary *headers = [response isKindOfClass:[NSHTTPURLResponse class]] ? [(NSHTTPURLResponse *)response allHeaderFields] : nil;
+    NSString *encoding = nil;
+    NSString *length = nil;
+    for (NSString *name in headers) {
+        if ([name caseInsensitiveCompare:@"Content-Encoding"] == NSOrderedSame) {
+            encoding = [headers objectForKey:name];
+        }
+        else if ([name caseInsensitiveCompare:@"Content-Length"] == NSOrderedSame) {
+            length = [headers objectForKey:name];
+        }
+    }
+    
+    if (encoding.length == 0 || [encoding caseInsensitiveCompare:@"identity"] == NSOrderedSame || [length longLongValue] <= 0) {
+        return payloadBytes;
+    }
+    return (NSUInteger)[length longLongValue];
+}
+
+- (STAPIRequest *)_doRequestForQuery:(NSString *)query type:(STSearchType)type documentTypes:(NSArray *)documentTypes page:(NSUInteger)page perPage:(NSUInteger)perPage prefetch:(BOOL)prefetch {
     // Avoid whitespace queries
-    NSString *strippedString = [self.query stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
-    if ([strippedString isEqualToString:@""]) {
+    NSString *strippedString = [query stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
+    if (strippedString == nil || [strippedString isEqualToString:@""]) {
+        return nil;
+    }
+    
+    STAPIRequest *request = [[STAPIRequest alloc] initWithClient:self query:query searchType:type page:page perPage:perPage];
+    request.generation = self.generation;
+    request.documentTypes = documentTypes;
+    request.prefetch = prefetch;
+    if (prefetch) {
+        request.priority = STAPIRequestPriorityLow;
+    }
+    request.params = [self _requestParamsForQuery:query type:type documentTypes:documentTypes page:page perPage:perPage];
+    // Every streamed response is decoded twice, so only when the delegate shows this request while it loads
+    request.streamsPartialResults = !prefetch && [self _delegateWantsPartialResultsForRequest:request];
+    
+    // The body is canonical JSON, compact and identical for identical queries. The cache key is cut from the same bytes
+    NSString *cacheKey = nil;
+    NSURLRequest *URLRequest = [[self _requestBuilder] URLRequestForPath:(type == STSearchTypeSuggest) ? SUGGEST_PATH : SEARCH_PATH
+                                                                  params:request.params
+                                                                cacheKey:&cacheKey];
+    request.cacheKey = cacheKey;
+    request.URLRequest = URLRequest;
+    request.timeline.requestBytes = URLRequest.HTTPBody.length;
+    
+    [self.activeRequests addObject:request];
+    [self _delegateDidStartRequest:request];
+    
+    // Without a body there is nothing to send nor a key to look up
+    if (URLRequest == nil || cacheKey == nil) {
+        [self _failUnencodableRequest:request];
+        return request;
+    }
+    
+    NSDictionary *cachedResult = [self.queryCache resultForKey:request.cacheKey];
+    if (cachedResult) {
+        [self _deliverLocalResult:cachedResult forRequest:request];
+        if (self.cachePolicy == STAPICachePolicyStaleWhileRevalidate) {
+            [self _revalidateRequest:request staleResult:cachedResult];
+        }
+        return request;
+    }
+    
+    // Only the stored bytes are read here, they are parsed on the decode pipeline
+    NSDate *storedDate = nil;
+    NSData *storedData = [self.persistentStore dataForKey:request.cacheKey storedDate:&storedDate];
+    if (storedData) {
+        [self _deliverStoredData:storedData storedDate:storedDate forRequest:request];
+        return request;
+    }
+    
+    [self _lookUpUncachedRequest:request];
+    return request;
+}
+
+- (void)_lookUpUncachedRequest:(STAPIRequest *)request {
+    if (request.searchType == STSearchTypeSuggest) {
+        NSDictionary *prefixResult = [self.suggestCache resultForQuery:request.query params:request.params];
+        if (prefixResult) {
+            [self _deliverLocalResult:prefixResult forRequest:request];
+            return;
+        }
+        
+        NSDictionary *indexResult = [self _suggestIndexCanAnswerParams:request.params page:request.page] ? [self.suggestIndex resultForQuery:request.query perPage:request.perPage] : nil;
+        if (indexResult) {
+            [self _deliverLocalResult:indexResult forRequest:request];
+            if (self.reconcilesSuggestIndexResults) {
+                [self _revalidateRequest:request staleResult:indexResult];
+            }
+            return;
+        }
+    }
+    
+    // An identical query on its way to the server answers this one too, possibly for another client
+    if ([self.singleFlight joinFlightForRequest:request]) {
+        request.timeline.coalesced = YES;
         return;
     }
     
-    NSData *requestData = [NSJSONSerialization dataWithJSONObject:[self _requestParamsForPage:page perPage:perPage]
-                                                          options:NSJSONWritingPrettyPrinted
-                                                            error:nil];
-    
-    [self _delegateDidStartQuery:self.query withType:self.searchType];
-    
-    NSMutableURLRequest *request = [[NSMutableURLRequest alloc] initWithURL:
-                                    [NSURL URLWithString:(self.searchType == STSearchTypeSuggest) ? BASE_SUGGEST_URL : BASE_SEARCH_URL]];
-    [request setHTTPMethod:@"POST"];
-    [request setHTTPBody:requestData];
-    [request setValue:@"application/json" forHTTPHeaderField:@"Content-Type"];
-    [self _addTrackingHeaders:request];
-    
-    NSCachedURLResponse *cachedResponse = [[[self class] _sharedAPICache] cachedResponseForRequest:request];
-    if (cachedResponse) {
-        NSString *captureQuery = self.query;
-        STSearchType captureSearchType = self.searchType;
-        dispatch_async([[self class] _jsonDecodeQueue], ^{
-            NSError *error = nil;
-            NSDictionary *dict = [NSJSONSerialization JSONObjectWithData:cachedResponse.data
-                                                                 options:0
-                                                                   error:&error];
-            dispatch_async(dispatch_get_main_queue(), ^{
-                if (error) {
-                    [self _delegateDidFailQuery:captureQuery withType:captureSearchType error:error];
-                    
-                    // Remove the cached response since it looks like we got a JSON parse error
-                    [[[self class] _sharedAPICache] removeCachedResponseForRequest:request];
-                }
-                else {
-                    [self _delegateDidFinishQuery:captureQuery withResult:dict withType:captureSearchType];
-                }
-            });
-        });
+    [self.activeRequests removeObject:request];
+    [self.queuedRequests addObject:request];
+    [self _startQueuedRequests];
+}
 
+- (void)_deliverStoredData:(NSData *)data storedDate:(NSDate *)storedDate forRequest:(STAPIRequest *)request {
+    [self.decodePipeline decodeData:data after:nil isStale:[self _stalenessTestForRequest:request] completion:^(id dict, NSError *error) {
+        BOOL decoded = (error == nil && [dict isKindOfClass:[NSDictionary class]]);
+        if (decoded) {
+            request.timeline.decodedDate = [NSDate date];
+            [self _delegatePrepareResult:dict forRequest:request];
+        }
+        [self _performOnClientThread:^{
+            if (request.finished) {
+                return;
+            }
+            // A damaged record is a miss, the query goes on to the other sources
+            if (!decoded) {
+                [self _lookUpUncachedRequest:request];
+                return;
+            }
+            
+            [self.queryCache setResult:dict forKey:request.cacheKey bytes:data.length];
+            [self _finishRequest:request withLocalResult:dict];
+            // The memory cache is trusted as long as the policy says so, a stored result only until it gets old
+            if (self.cachePolicy == STAPICachePolicyStaleWhileRevalidate || -[storedDate timeIntervalSinceNow] >= self.persistentResultMaxAge) {
+                [self _revalidateRequest:request staleResult:dict];
+            }
+        } waitUntilDone:NO];
+    }];
+}
+
+- (STDecodeStalenessTest)_stalenessTestForRequest:(STAPIRequest *)request {
+    // Runs on the decode pipeline so it only reads the atomic properties of the request and client
+    __weak STAPIClient *weakSelf = self;
+    NSUInteger generation = request.generation;
+    return ^BOOL{
+        STAPIClient *strongSelf = weakSelf;
+        return strongSelf == nil || ((request.cancelled || strongSelf.generation != generation) && !request.orphaned);
+    };
+}
+
+- (BOOL)_suggestIndexCanAnswerParams:(NSDictionary *)params page:(NSUInteger)page {
+    // The index has no notion of filters and only ever holds one page
+    id filters = [params objectForKey:@"filters"];
+    BOOL filtered = [filters isKindOfClass:[NSDictionary class]] && [filters count] > 0;
+    return self.suggestIndex != nil && page <= 1 && !filtered;
+}
+
+- (void)_deliverLocalResult:(NSDictionary *)result forRequest:(STAPIRequest *)request {
+    // Still deliver asynchronously so callers always see the start before the finish
+    [self _performOnClientThread:^{
+        if (request.finished) {
+            return;
+        }
+        [self _finishRequest:request withLocalResult:result];
+    } waitUntilDone:NO];
+}
+
+- (void)_finishRequest:(STAPIRequest *)request withLocalResult:(NSDictionary *)result {
+    request.timeline.cacheHit = YES;
+    request.timeline.deliveredDate = [NSDate date];
+    [self _cleanUpRequest:request];
+    [self _delegateDidFinishRequest:request withResult:result];
+    [self _recordTimelineForRequest:request];
+}
+
+- (void)_failUnencodableRequest:(STAPIRequest *)request {
+    NSError *error = [NSError errorWithDomain:STErrorDomain
+                                         code:STRequestEncodingErrorCode
+                                     userInfo:@{ NSLocalizedDescriptionKey : @"Query could not be encoded" }];
+    // Asynchronous like a local result, so callers always see the start before the failure
+    [self _performOnClientThread:^{
+        if (request.finished) {
+            return;
+        }
+        
+        [self _cleanUpRequest:request];
+        [self _delegateDidFailRequest:request error:error];
+    } waitUntilDone:NO];
+}
+
+- (void)_revalidateRequest:(STAPIRequest *)request staleResult:(NSDictionary *)staleResult {
+    // One revalidation per cached result is enough
+    if ([self.revalidatingKeys containsObject:request.cacheKey]) {
+        return;
+    }
+    
+    STAPIRequest *revalidation = [[STAPIRequest alloc] initWithClient:self
+                                                                query:request.query
+                                                           searchType:request.searchType
+                                                                 page:request.page
+                                                              perPage:request.perPage];
+    revalidation.generation = self.generation;
+    revalidation.params = request.params;
+    revalidation.cacheKey = request.cacheKey;
+    revalidation.URLRequest = request.URLRequest;
+    revalidation.priority = STAPIRequestPriorityLow;
+    revalidation.revalidatedRequest = request;
+    revalidation.staleResult = staleResult;
+    
+    [self.revalidatingKeys addObject:request.cacheKey];
+    [self.queuedRequests addObject:revalidation];
+    [self _startQueuedRequests];
+}
+
+- (BOOL)_orphanRequestIfShared:(STAPIRequest *)request {
+    // The caller is let go, but the response is still loaded for the requests that joined this one
+    if (request.revalidatedRequest || ![self.singleFlight hasFollowersForRequest:request]) {
+        return NO;
+    }
+    
+    request.cancelled = YES;
+    [self _delegateDidCancelRequest:request];
+    request.orphaned = YES;
+    return YES;
+}
+
+- (void)_settleFlightOfRequest:(STAPIRequest *)request result:(NSDictionary *)result error:(NSError *)error bytes:(NSUInteger)bytes {
+    for (STAPIRequest *follower in [self.singleFlight finishFlightForRequest:request]) {
+        STAPIClient *client = follower.client;
+        [client _performOnClientThread:^{
+            [client _finishFollower:follower withResult:result error:error bytes:bytes];
+        } waitUntilDone:NO];
+    }
+}
+
+- (void)_finishFollower:(STAPIRequest *)request withResult:(NSDictionary *)result error:(NSError *)error bytes:(NSUInteger)bytes {
+    if (request.finished) {
+        return;
+    }
+    
+    request.timeline.deliveredDate = [NSDate date];
+    [self _cleanUpRequest:request];
+    if (error) {
+        [self _delegateDidFailRequest:request error:error];
         return;
     }
     
-    self.request = request;
+    [self _delegateDidFinishRequest:request withResult:result];
+    
+    // Clients may use caches of their own, the shared ones were already filled by the leader
+    if (request.searchType == STSearchTypeSuggest) {
+        [self.suggestCache storeResult:result forQuery:request.query params:request.params];
+    }
+    [self.queryCache setResult:result forKey:request.cacheKey bytes:bytes];
+    [self.persistentStore setResult:result forKey:request.cacheKey];
+    [self _recordTimelineForRequest:request];
+}
+
+- (void)_finishRevalidation:(STAPIRequest *)revalidation withResult:(NSDictionary *)result bytes:(NSUInteger)bytes {
+    // Storing again also restarts the time to live of an unchanged result
+    [self.queryCache setResult:result forKey:revalidation.cacheKey bytes:bytes];
+    [self.persistentStore setResult:result forKey:revalidation.cacheKey];
+    if (revalidation.searchType == STSearchTypeSuggest) {
+        [self.suggestCache storeResult:result forQuery:revalidation.query params:revalidation.params];
+    }
+    
+    if (![result isEqual:revalidation.staleResult]) {
+        [self _delegateDidUpdateRequest:revalidation.revalidatedRequest withResult:result];
+    }
+}
+
+- (void)_startQueuedRequests {
+    while (self.queuedRequests.count > 0 && [self _numberOfOpenConnections] < MAX(self.maxConcurrentRequests, 1)) {
+        // Highest priority first, oldest first among requests of the same priority
+        STAPIRequest *next = nil;
+        for (STAPIRequest *request in self.queuedRequests) {
+            if (next == nil || request.priority > next.priority) {
+                next = request;
+            }
+        }
+        
+        [self.queuedRequests removeObject:next];
+        [self.activeRequests addObject:next];
+        [self _startConnectionForRequest:next];
+    }
+}
+
+- (void)_startConnectionForRequest:(STAPIRequest *)request {
+    /* Every request gets its own NSURLConnection but they all go to the same API host, so the
+     URL loading system hands out its pooled keep-alive sockets instead of opening a new one
+     for each query.
+     */
+    request.attemptStartDate = [NSDate date];
+    if (request.timeline.connectionStartDate == nil) {
+        request.timeline.connectionStartDate = request.attemptStartDate;
+    }
+    request.connection = [[NSURLConnection alloc] initWithRequest:request.URLRequest delegate:self startImmediately:NO];
+    [request.connection start];
     
-    self.connection = [[NSURLConnection alloc] initWithRequest:request delegate:self];
-    [self.connection start];
+    self.attemptCount++;
+    if (self.attemptCount >= ST_BUDGET_WINDOW) {
+        self.attemptCount /= 2;
+        self.hedgeCount /= 2;
+        self.retryCount /= 2;
+    }
+    
+    // The timeout covers every attempt, so only the first one starts it
+    if (request.timeoutTimer == nil) {
+        request.timeoutTimer = [NSTimer scheduledTimerWithTimeInterval:[self _timeoutForType:request.searchType]
+                                                                target:self
+                                                              selector:@selector(_connectionTimeout:)
+                                                              userInfo:request
+                                                               repeats:NO];
+    }
     
-    self.timeoutTimer = [NSTimer scheduledTimerWithTimeInterval:20.0
-                                                         target:self
-                                                       selector:@selector(_connectionTimeout)
-                                                       userInfo:nil
-                                                        repeats:NO];
+    NSTimeInterval hedgeDelay = [self _hedgeDelayForRequest:request];
+    if (hedgeDelay > 0.0) {
+        request.hedgeTimer = [NSTimer scheduledTimerWithTimeInterval:hedgeDelay
+                                                              target:self
+                                                            selector:@selector(_hedgeTimerFired:)
+                                                            userInfo:request
+                                                             repeats:NO];
+    }
+}
+
+- (NSTimeInterval)_timeoutForType:(STSearchType)type {
+    return (type == STSearchTypeSuggest) ? self.suggestTimeout : self.searchTimeout;
+}
+
+- (NSTimeInterval)_hedgeDelayForRequest:(STAPIRequest *)request {
+    // Nobody waits on a revalidation, so its tail isn't worth an extra request
+    if (!self.hedgesRequests || request.revalidatedRequest || request.timeline.hedged) {
+        return 0.0;
+    }
+    if ([self.metrics sampleCountForStage:STAPIMetricsStageFirstByte type:request.searchType] < ST_HEDGE_MINIMUM_SAMPLES) {
+        return 0.0;
+    }
+    return [self.metrics percentile:95.0 forStage:STAPIMetricsStageFirstByte type:request.searchType];
+}
+
+- (BOOL)_budget:(double)budget allowsExtraAttemptsAfter:(NSUInteger)extraCount {
+    return (extraCount + 1) <= budget * self.attemptCount;
+}
+
+- (void)_hedgeTimerFired:(NSTimer *)timer {
+    STAPIRequest *request = timer.userInfo;
+    request.hedgeTimer = nil;
+    if (request.finished || request.connection == nil || request.response != nil) {
+        return;
+    }
+    
+    // A duplicate must never hold up a query that is waiting for a slot
+    if (self.queuedRequests.count > 0 || [self _numberOfOpenConnections] >= MAX(self.maxConcurrentRequests, 1)) {
+        return;
+    }
+    if (![self _budget:self.hedgeBudget allowsExtraAttemptsAfter:self.hedgeCount]) {
+        return;
+    }
+    
+    self.hedgeCount++;
+    request.timeline.hedged = YES;
+    request.hedgeConnection = [[NSURLConnection alloc] initWithRequest:request.URLRequest delegate:self startImmediately:NO];
+    [request.hedgeConnection start];
+}
+
+- (void)_keepConnection:(NSURLConnection *)connection ofRequest:(STAPIRequest *)request {
+    [request.hedgeTimer invalidate];
+    request.hedgeTimer = nil;
+    if (request.hedgeConnection == nil) {
+        return;
+    }
+    
+    if (connection == request.hedgeConnection) {
+        [request.connection cancel];
+        request.connection = request.hedgeConnection;
+    }
+    else {
+        [request.hedgeConnection cancel];
+    }
+    request.hedgeConnection = nil;
+}
+
+- (BOOL)_dropHedgedConnection:(NSURLConnection *)connection ofRequest:(STAPIRequest *)request {
+    if (request.hedgeConnection == nil) {
+        return NO;
+    }
+    
+    if (connection == request.connection) {
+        request.connection = request.hedgeConnection;
+    }
+    request.hedgeConnection = nil;
+    return YES;
+}
+
+- (BOOL)_isRetryableError:(NSError *)error {
+    // Queries only read, so sending one again is safe as long as the failure says nothing about the query itself
+    if ([error.domain isEqualToString:NSURLErrorDomain]) {
+        switch (error.code) {
+            case NSURLErrorTimedOut:
+            case NSURLErrorCannotFindHost:
+            case NSURLErrorCannotConnectToHost:
+            case NSURLErrorNetworkConnectionLost:
+            case NSURLErrorDNSLookupFailed:
+                return YES;
+            default:
+                return NO;
+        }
+    }
+    if ([error.domain isEqualToString:STErrorDomain] && error.code == STHTTPErrorCode) {
+        NSInteger statusCode = [[error.userInfo objectForKey:STHTTPResponseKey] statusCode];
+        return statusCode == 502 || statusCode == 503 || statusCode == 504;
+    }
+    return NO;
+}
+
+- (BOOL)_retryRequest:(STAPIRequest *)request afterError:(NSError *)error {
+    if (request.timeline.retryCount >= self.maxRetryCount || ![self _isRetryableError:error]) {
+        return NO;
+    }
+    if (![self _budget:self.retryBudget allowsExtraAttemptsAfter:self.retryCount]) {
+        return NO;
+    }
+    
+    /* Full jitter spreads out the retries of clients that failed at the same moment, and basing the
+     backoff on the measured round trip makes a slow network back off for longer.
+     */
+    NSTimeInterval backoff = MAX(self.roundTripTime, 0.1) * (1 << request.timeline.retryCount);
+    backoff *= STRandomFraction();
+    if ([request.timeoutTimer.fireDate timeIntervalSinceNow] <= backoff) {
+        return NO;
+    }
+    
+    self.retryCount++;
+    request.timeline.retryCount++;
+    request.connection = nil;
+    [request.hedgeTimer invalidate];
+    request.hedgeTimer = nil;
+    request.response = nil;
+    request.responseData = [NSMutableData data];
+    request.streamingParser = nil;
+    request.retryTimer = [NSTimer scheduledTimerWithTimeInterval:backoff
+                                                          target:self
+                                                        selector:@selector(_retryTimerFired:)
+                                                        userInfo:request
+                                                         repeats:NO];
+    return YES;
+}
+
+- (void)_retryTimerFired:(NSTimer *)timer {
+    STAPIRequest *request = timer.userInfo;
+    request.retryTimer = nil;
+    if (request.finished) {
+        return;
+    }
+    
+    // Back in line like any other query, so retries never exceed maxConcurrentRequests
+    [self.activeRequests removeObject:request];
+    [self.queuedRequests addObject:request];
+    [self _startQueuedRequests];
+}
+
+- (void)_recordRoundTripTime:(NSTimeInterval)roundTripTime {
+    // Exponentially weighted so the estimate follows changing network conditions
+    if (self.roundTripTime == 0.0) {
+        self.roundTripTime = roundTripTime;
+    }
+    else {
+        self.roundTripTime = 0.7 * self.roundTripTime + 0.3 * roundTripTime;
+    }
+}
+
+- (void)_recordTimelineForRequest:(STAPIRequest *)request {
+    // The caller of an orphaned request canceled it and doesn't count it
+    if (request.orphaned) return;
+    
+    [self.metrics addTimeline:request.timeline];
+    [self _performOnDelegateQueue:^{
+        if ([self.delegate respondsToSelector:@selector(client:didCollectTimeline:forRequest:)]) {
+            [self.delegate client:self didCollectTimeline:request.timeline forRequest:request];
+        }
+    }];
+}
+
+- (STAPIRequest *)_requestForConnection:(NSURLConnection *)connection {
+    for (STAPIRequest *request in self.activeRequests) {
+        if (request.connection == connection || request.hedgeConnection == connection) {
+            return request;
+        }
+    }
+    return nil;
+}
+
+- (NSUInteger)_numberOfOpenConnections {
+    NSUInteger count = 0;
+    for (STAPIRequest *request in self.activeRequests) {
+        if (request.connection) {
+            count++;
+        }
+        if (request.hedgeConnection) {
+            count++;
+        }
+    }
+    return count;
 }
 
 - (void)_cancelPending {
-    [self.connection cancel];
-    if (self.connection) {
-        [self _delegateDidCancelQuery:self.query withType:self.searchType];
+    // Everything issued so far is superseded, which lets the decode pipeline skip it wholesale
+    self.generation++;
+    
+    NSArray *pending = self.pendingRequests;
+    NSMutableArray *shared = [NSMutableArray array];
+    for (STAPIRequest *request in pending) {
+        request.cancelled = YES;
+        if (!request.revalidatedRequest && [self.singleFlight hasFollowersForRequest:request]) {
+            [shared addObject:request];
+            continue;
+        }
+        [request.connection cancel];
+        [self _cleanUpRequest:request];
+    }
+    for (STAPIRequest *request in pending) {
+        [self _delegateDidCancelRequest:request];
+    }
+    // Only now, so the cancel callbacks above still reach the delegate
+    for (STAPIRequest *request in shared) {
+        request.orphaned = YES;
     }
-    [self _cleanUp];
 }
 
-- (void)_cleanUp {
-    self.connection = nil;
-    self.responseData = [NSMutableData data];
-    [self.timeoutTimer invalidate];
-    self.timeoutTimer = nil;
-    self.request = nil;
-    self.response = nil;
-    self.query = @"";
-    self.searchType = STSearchTypeUndefined;
+- (void)_cleanUpRequest:(STAPIRequest *)request {
+    if (request.revalidatedRequest) {
+        [self.revalidatingKeys removeObject:request.cacheKey];
+    }
+    request.finished = YES;
+    request.connection = nil;
+    [request.hedgeConnection cancel];
+    request.hedgeConnection = nil;
+    [request.timeoutTimer invalidate];
+    request.timeoutTimer = nil;
+    [request.hedgeTimer invalidate];
+    request.hedgeTimer = nil;
+    [request.retryTimer invalidate];
+    request.retryTimer = nil;
+    request.responseData = nil;
+    request.streamingParser = nil;
+    request.lastDecodeOperation = nil;
+    [self.activeRequests removeObject:request];
+    [self.queuedRequests removeObject:request];
+    [self.singleFlight leaveFlightForRequest:request];
 }
 
-- (void)_connectionTimeout {
-    [self _cancelPending];
+- (void)_connectionTimeout:(NSTimer *)timer {
+    STAPIRequest *request = timer.userInfo;
+    if (request.finished) return;
+    
+    [request.connection cancel];
     NSError *error = [NSError errorWithDomain:STErrorDomain
                                          code:STTimeoutErrorCode
                                      userInfo:@{ NSLocalizedDescriptionKey : @"Connection timeout" }];
-    [self _delegateDidFailQuery:self.query withType:self.searchType error:error];
+    [self _settleFlightOfRequest:request result:nil error:error bytes:0];
+    [self _cleanUpRequest:request];
+    [self _delegateDidFailRequest:request error:error];
+    [self _startQueuedRequests];
 }
 
-- (void)_delegateDidStartQuery:(NSString *)query withType:(STSearchType)type {
-    if ([self.delegate respondsToSelector:@selector(client:didStartQuery:withType:)]) {
-        [self.delegate client:self didStartQuery:query withType:type];
-    }
+- (void)_delegateDidStartRequest:(STAPIRequest *)request {
+    // Revalidations and prefetches happen behind the delegate's back
+    if (request.revalidatedRequest || request.orphaned || request.prefetch) return;
+    
+    [self _performOnDelegateQueue:^{
+        if ([self.delegate respondsToSelector:@selector(client:didStartRequest:)]) {
+            [self.delegate client:self didStartRequest:request];
+        }
+        if ([self.delegate respondsToSelector:@selector(client:didStartQuery:withType:)]) {
+            [self.delegate client:self didStartQuery:request.query withType:request.searchType];
+        }
+    }];
 }
 
-- (void)_delegateDidFinishQuery:(NSString *)query withResult:(NSDictionary *)result withType:(STSearchType)type {
-    if ([self.delegate respondsToSelector:@selector(client:didFinishQuery:withResult:withType:)]) {
-        [self.delegate client:self didFinishQuery:query withResult:result withType:type];
-    }
+- (void)_delegateDidFinishRequest:(STAPIRequest *)request withResult:(NSDictionary *)result {
+    if (request.revalidatedRequest || request.orphaned || request.prefetch) return;
+    
+    [self _performOnDelegateQueue:^{
+        if ([self.delegate respondsToSelector:@selector(client:didFinishRequest:withResult:)]) {
+            [self.delegate client:self didFinishRequest:request withResult:result];
+        }
+        if ([self.delegate respondsToSelector:@selector(client:didFinishQuery:withResult:withType:)]) {
+            [self.delegate client:self didFinishQuery:request.query withResult:result withType:request.searchType];
+        }
+    }];
 }
 
-- (void)_delegateDidCancelQuery:(NSString *)query withType:(STSearchType)type {
-    if ([self.delegate respondsToSelector:@selector(client:didCancelQuery:withType:)]) {
-        [self.delegate client:self didCancelQuery:query withType:type];
+- (void)_delegatePrepareResult:(NSDictionary *)result forRequest:(STAPIRequest *)request {
+    if (request.prefetch) return;
+    
+    // Runs on the decode pipeline, the delegate is only read here
+    id<STAPIClientDelegate> delegate = self.delegate;
+    if ([delegate respondsToSelector:@selector(client:prepareResult:forRequest:)]) {
+        [delegate client:self prepareResult:result forRequest:request];
     }
 }
 
-- (void)_delegateDidFailQuery:(NSString *)query withType:(STSearchType)type error:(NSError *)error {
-    if ([self.delegate respondsToSelector:@selector(client:didFailQuery:withType:error:)]) {
-        [self.delegate client:self didFailQuery:query withType:type error:error];
+- (BOOL)_delegateWantsPartialResultsForRequest:(STAPIRequest *)request {
+    id<STAPIClientDelegate> delegate = self.delegate;
+    if (![delegate respondsToSelector:@selector(client:didReceivePartialResult:forRequest:)] &&
+        ![delegate respondsToSelector:@selector(client:didReceivePartialResult:forQuery:withType:)]) {
+        return NO;
     }
+    if ([delegate respondsToSelector:@selector(client:shouldReceivePartialResultsForRequest:)]) {
+        return [delegate client:self shouldReceivePartialResultsForRequest:request];
+    }
+    // Suggestions are small and later pages are appended whole, only a new search is worth showing early
+    return request.searchType == STSearchTypeSearch && request.page <= 1;
+}
+
+- (void)_delegateDidReceivePartialResult:(NSDictionary *)result forRequest:(STAPIRequest *)request {
+    [self _performOnDelegateQueue:^{
+        if ([self.delegate respondsToSelector:@selector(client:didReceivePartialResult:forRequest:)]) {
+            [self.delegate client:self didReceivePartialResult:result forRequest:request];
+        }
+        if ([self.delegate respondsToSelector:@selector(client:didReceivePartialResult:forQuery:withType:)]) {
+            [self.delegate client:self didReceivePartialResult:result forQuery:request.query withType:request.searchType];
+        }
+    }];
+}
+
+- (void)_delegateDidUpdateRequest:(STAPIRequest *)request withResult:(NSDictionary *)result {
+    if (request.prefetch) return;
+    
+    [self _performOnDelegateQueue:^{
+        if ([self.delegate respondsToSelector:@selector(client:didUpdateRequest:withResult:)]) {
+            [self.delegate client:self didUpdateRequest:request withResult:result];
+        }
+        if ([self.delegate respondsToSelector:@selector(client:didUpdateQuery:withResult:withType:)]) {
+            [self.delegate client:self didUpdateQuery:request.query withResult:result withType:request.searchType];
+        }
+    }];
+}
+
+- (void)_delegateDidCancelRequest:(STAPIRequest *)request {
+    if (request.revalidatedRequest || request.orphaned || request.prefetch) return;
+    
+    [self _performOnDelegateQueue:^{
+        if ([self.delegate respondsToSelector:@selector(client:didCancelRequest:)]) {
+            [self.delegate client:self didCancelRequest:request];
+        }
+        if ([self.delegate respondsToSelector:@selector(client:didCancelQuery:withType:)]) {
+            [self.delegate client:self didCancelQuery:request.query withType:request.searchType];
+        }
+    }];
+}
+
+- (void)_delegateDidFailRequest:(STAPIRequest *)request error:(NSError *)error {
+    if (request.revalidatedRequest || request.orphaned || request.prefetch) return;
+    
+    [self _performOnDelegateQueue:^{
+        if ([self.delegate respondsToSelector:@selector(client:didFailRequest:error:)]) {
+            [self.delegate client:self didFailRequest:request error:error];
+        }
+        if ([self.delegate respondsToSelector:@selector(client:didFailQuery:withType:error:)]) {
+            [self.delegate client:self didFailQuery:request.query withType:request.searchType error:error];
+        }
+    }];
 }
 
 @end
@@ -0,0 +1,138 @@
+//
+//  STAPIMetrics.h
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "STAPIClient.h"
+
+@class STAPIRequestTimeline;
+
+/** A stage of a request as reported by `STAPIRequestTimeline`.
+
+ `STAPIMetricsStageDebounce` - The query was held back before it was started
+
+ `STAPIMetricsStageQueue` - Waiting for a free connection slot
+
+ `STAPIMetricsStageFirstByte` - From sending the request until the response headers arrived
+
+ `STAPIMetricsStageTransfer` - Downloading the response body
+
+ `STAPIMetricsStageDecode` - Decoding the JSON
+
+ `STAPIMetricsStageDelivery` - Handing the result to the delegate on the main queue
+
+ `STAPIMetricsStageTotal` - From creation to delivery
+ */
+typedef enum {
+    STAPIMetricsStageDebounce,
+    STAPIMetricsStageQueue,
+    STAPIMetricsStageFirstByte,
+    STAPIMetricsStageTransfer,
+    STAPIMetricsStageDecode,
+    STAPIMetricsStageDelivery,
+    STAPIMetricsStageTotal
+} STAPIMetricsStage;
+
+/**
+ Aggregates the timelines of the requests a `STAPIClient` delivered.
+
+ For every search type and stage the most recent `windowSize` durations are kept, from which percentiles and
+ histograms are computed. Stages a request skipped are not sampled, so cache hits don't drag down the network
+ percentiles. Counters of requests, cache hits, payload bytes and saved bytes cover everything since the last `reset`.
+
+ All methods are safe to call from any thread.
+ */
+@interface STAPIMetrics : NSObject
+
+/**
+ Upper bounds in seconds of the histogram buckets. The last bucket has no upper bound and is not listed.
+ */
++ (NSArray *)histogramBucketBounds;
+
+/**
+ Number of recent samples kept per search type and stage.
+
+ The default value is 200.
+ */
+@property (nonatomic, assign) NSUInteger windowSize;
+
+/**
+ Adds the durations of a delivered request.
+
+ @param timeline Timeline of the request
+ */
+- (void)addTimeline:(STAPIRequestTimeline *)timeline;
+
+/**
+ Number of requests of a type that were delivered
+
+ @param type The search type
+ */
+- (NSUInteger)requestCountForType:(STSearchType)type;
+
+/**
+ Number of requests of a type that were answered from a cache
+
+ @param type The search type
+ */
+- (NSUInteger)cacheHitCountForType:(STSearchType)type;
+
+/**
+ Total number of response bytes received for requests of a type
+
+ @param type The search type
+ */
+- (unsigned long long)payloadBytesForType:(STSearchType)type;
+
+/**
+ Total number of response bytes compression kept off the network for requests of a type
+
+ @param type The search type
+ */
+- (unsigned long long)savedBytesForType:(STSearchType)type;
+
+/**
+ Number of recent durations of a stage the percentiles are computed from, at most `windowSize`
+
+ @param stage The stage
+ @param type The search type
+ */
+- (NSUInteger)sampleCountForStage:(STAPIMetricsStage)stage type:(STSearchType)type;
+
+/**
+ Computes a percentile of the recent durations of a stage.
+
+ @param percentile Between 0 and 100, for example 95 for the p95
+ @param stage The stage
+ @param type The search type
+
+ @return Duration in seconds, 0 if there are no samples
+ */
+- (NSTimeInterval)percentile:(double)percentile forStage:(STAPIMetricsStage)stage type:(STSearchType)type;
+
+/**
+ Counts the recent durations of a stage per bucket of `histogramBucketBounds`.
+
+ @param stage The stage
+ @param type The search type
+
+ @return Array of `NSNumber` counts, one more than there are bucket bounds
+ */
+- (NSArray *)histogramForStage:(STAPIMetricsStage)stage type:(STSearchType)type;
+
+/**
+ Snapshot of all counters and of the p50, p95 and p99 of every stage, keyed by search type ("search" and
+ "suggest"). Only contains property list values so it can be exported to telemetry as is.
+ */
+- (NSDictionary *)dictionaryRepresentation;
+
+/**
+ Removes all samples and resets the counters to 0
+ */
+- (void)reset;
+
+@end
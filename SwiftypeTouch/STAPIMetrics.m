@@ -0,0 +1,222 @@
+//
+//  STAPIMetrics.m
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import "STAPIMetrics.h"
+#import "STAPIRequestTimeline.h"
+
+#define ST_METRICS_TYPE_COUNT 3
+#define ST_METRICS_STAGE_COUNT (STAPIMetricsStageTotal + 1)
+#define ST_METRICS_SLOT_COUNT (ST_METRICS_TYPE_COUNT * ST_METRICS_STAGE_COUNT)
+
+@interface STAPIMetrics () {
+    NSUInteger _nextSampleIndex[ST_METRICS_SLOT_COUNT];
+    NSUInteger _requestCount[ST_METRICS_TYPE_COUNT];
+    NSUInteger _cacheHitCount[ST_METRICS_TYPE_COUNT];
+    unsigned long long _payloadBytes[ST_METRICS_TYPE_COUNT];
+    unsigned long long _savedBytes[ST_METRICS_TYPE_COUNT];
+}
+
+@property (nonatomic, strong) NSMutableArray *samples;
+
+- (NSUInteger)_slotForStage:(STAPIMetricsStage)stage type:(STSearchType)type;
+- (void)_addSample:(NSTimeInterval)duration stage:(STAPIMetricsStage)stage type:(STSearchType)type;
+- (NSDictionary *)_dictionaryForType:(STSearchType)type;
+
+@end
+
+@implementation STAPIMetrics
+
+#pragma mark - NSObject
+
+- (id)init {
+    self = [super init];
+    if (self) {
+        self.windowSize = 200;
+        [self reset];
+    }
+    return self;
+}
+
+#pragma mark - STAPIMetrics
+
++ (NSArray *)histogramBucketBounds {
+    static NSArray *bounds = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        bounds = @[ @0.01, @0.025, @0.05, @0.1, @0.25, @0.5, @1.0, @2.5, @5.0, @10.0 ];
+    });
+    return bounds;
+}
+
+- (void)setWindowSize:(NSUInteger)windowSize {
+    @synchronized(self) {
+        _windowSize = MAX(windowSize, 1);
+        // Keeping the ring order intact while shrinking isn't worth it, start over instead
+        for (NSMutableArray *slotSamples in self.samples) {
+            [slotSamples removeAllObjects];
+        }
+        memset(_nextSampleIndex, 0, sizeof(_nextSampleIndex));
+    }
+}
+
+- (void)addTimeline:(STAPIRequestTimeline *)timeline {
+    if (timeline == nil) return;
+
+    STSearchType type = timeline.searchType;
+    @synchronized(self) {
+        _requestCount[type]++;
+        _payloadBytes[type] += timeline.payloadBytes;
+        _savedBytes[type] += timeline.savedBytes;
+        if (timeline.cacheHit) {
+            _cacheHitCount[type]++;
+        }
+
+        if (timeline.debounceDuration > 0.0) {
+            [self _addSample:timeline.debounceDuration stage:STAPIMetricsStageDebounce type:type];
+        }
+        if (!timeline.cacheHit && !timeline.coalesced) {
+            [self _addSample:timeline.queueDuration stage:STAPIMetricsStageQueue type:type];
+            [self _addSample:timeline.timeToFirstByte stage:STAPIMetricsStageFirstByte type:type];
+            [self _addSample:timeline.transferDuration stage:STAPIMetricsStageTransfer type:type];
+            [self _addSample:timeline.decodeDuration stage:STAPIMetricsStageDecode type:type];
+        }
+        [self _addSample:timeline.deliveryDuration stage:STAPIMetricsStageDelivery type:type];
+        [self _addSample:timeline.totalDuration stage:STAPIMetricsStageTotal type:type];
+    }
+}
+
+- (NSUInteger)requestCountForType:(STSearchType)type {
+    @synchronized(self) {
+        return _requestCount[type];
+    }
+}
+
+- (NSUInteger)cacheHitCountForType:(STSearchType)type {
+    @synchronized(self) {
+        return _cacheHitCount[type];
+    }
+}
+
+- (unsigned long long)payloadBytesForType:(STSearchType)type {
+    @synchronized(self) {
+        return _payloadBytes[type];
+    }
+}
+
+- (unsigned long long)savedBytesForType:(STSearchType)type {
+    @synchronized(self) {
+        return _savedBytes[type];
+    }
+}
+
+- (NSUInteger)sampleCountForStage:(STAPIMetricsStage)stage type:(STSearchType)type {
+    @synchronized(self) {
+        return [[self.samples objectAtIndex:[self _slotForStage:stage type:type]] count];
+    }
+}
+
+- (NSTimeInterval)percentile:(double)percentile forStage:(STAPIMetricsStage)stage type:(STSearchType)type {
+    NSArray *sorted = nil;
+    @synchronized(self) {
+        sorted = [[self.samples objectAtIndex:[self _slotForStage:stage type:type]] sortedArrayUsingSelector:@selector(compare:)];
+    }
+    if (sorted.count == 0) {
+        return 0.0;
+    }
+
+    // Nearest rank, so every reported value is a duration that was actually measured
+    double rank = ceil(MIN(MAX(percentile, 0.0), 100.0) / 100.0 * sorted.count);
+    NSUInteger index = (rank < 1.0) ? 0 : (NSUInteger)rank - 1;
+    return [[sorted objectAtIndex:index] doubleValue];
+}
+
+- (NSArray *)histogramForStage:(STAPIMetricsStage)stage type:(STSearchType)type {
+    NSArray *bounds = [[self class] histogramBucketBounds];
+    NSUInteger counts[bounds.count + 1];
+    memset(counts, 0, sizeof(counts));
+
+    @synchronized(self) {
+        for (NSNumber *sample in [self.samples objectAtIndex:[self _slotForStage:stage type:type]]) {
+            NSUInteger bucket = 0;
+            while (bucket < bounds.count && [sample doubleValue] > [[bounds objectAtIndex:bucket] doubleValue]) {
+                bucket++;
+            }
+            counts[bucket]++;
+        }
+    }
+
+    NSMutableArray *histogram = [NSMutableArray arrayWithCapacity:bounds.count + 1];
+    for (NSUInteger bucket = 0; bucket <= bounds.count; bucket++) {
+        [histogram addObject:@(counts[bucket])];
+    }
+    return histogram;
+}
+
+- (NSDictionary *)dictionaryRepresentation {
+    return @{
+        @"search" : [self _dictionaryForType:STSearchTypeSearch],
+        @"suggest" : [self _dictionaryForType:STSearchTypeSuggest]
+    };
+}
+
+- (void)reset {
+    @synchronized(self) {
+        self.samples = [NSMutableArray arrayWithCapacity:ST_METRICS_SLOT_COUNT];
+        for (NSUInteger slot = 0; slot < ST_METRICS_SLOT_COUNT; slot++) {
+            [self.samples addObject:[NSMutableArray array]];
+        }
+        memset(_nextSampleIndex, 0, sizeof(_nextSampleIndex));
+        memset(_requestCount, 0, sizeof(_requestCount));
+        memset(_cacheHitCount, 0, sizeof(_cacheHitCount));
+        memset(_payloadBytes, 0, sizeof(_payloadBytes));
+        memset(_savedBytes, 0, sizeof(_savedBytes));
+    }
+}
+
+#pragma mark - Private
+
+- (NSUInteger)_slotForStage:(STAPIMetricsStage)stage type:(STSearchType)type {
+    return type * ST_METRICS_STAGE_COUNT + stage;
+}
+
+- (void)_addSample:(NSTimeInterval)duration stage:(STAPIMetricsStage)stage type:(STSearchType)type {
+    NSUInteger slot = [self _slotForStage:stage type:type];
+    NSMutableArray *slotSamples = [self.samples objectAtIndex:slot];
+    if (slotSamples.count < self.windowSize) {
+        [slotSamples addObject:@(duration)];
+    }
+    else {
+        // The window is full, overwrite the oldest sample
+        [slotSamples replaceObjectAtIndex:_nextSampleIndex[slot] withObject:@(duration)];
+    }
+    _nextSampleIndex[slot] = (_nextSampleIndex[slot] + 1) % self.windowSize;
+}
+
+- (NSDictionary *)_dictionaryForType:(STSearchType)type {
+    static NSArray *stageNames = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        stageNames = @[ @"debounce", @"queue", @"first_byte", @"transfer", @"decode", @"delivery", @"total" ];
+    });
+
+    NSMutableDictionary *d = [NSMutableDictionary dictionary];
+    [d setObject:@([self requestCountForType:type]) forKey:@"requests"];
+    [d setObject:@([self cacheHitCountForType:type]) forKey:@"cache_hits"];
+    [d setObject:@([self payloadBytesForType:type]) forKey:@"bytes"];
+    [d setObject:@([self savedBytesForType:type]) forKey:@"saved_bytes"];
+    for (NSUInteger stage = 0; stage < ST_METRICS_STAGE_COUNT; stage++) {
+        [d setObject:@{
+            @"p50" : @([self percentile:50.0 forStage:stage type:type]),
+            @"p95" : @([self percentile:95.0 forStage:stage type:type]),
+            @"p99" : @([self percentile:99.0 forStage:stage type:type])
+        } forKey:[stageNames objectAtIndex:stage]];
+    }
+    return d;
+}
+
+@end
@@ -0,0 +1,87 @@
+//
+//  STAPIRequest+Private.h
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import "STAPIRequest.h"
+#import "STAPIRequestTimeline.h"
+
+@class STStreamingResultParser;
+
+/*
+ State of a request that is only managed by `STAPIClient`. Not part of the public headers.
+ */
+@interface STAPIRequest ()
+
+@property (nonatomic, weak) STAPIClient *client;
+@property (nonatomic, copy) NSString *query;
+@property (nonatomic, assign) STSearchType searchType;
+@property (nonatomic, assign) NSUInteger page;
+@property (nonatomic, assign) NSUInteger perPage;
+@property (nonatomic, copy) NSArray *documentTypes;
+@property (atomic, assign) BOOL cancelled;
+@property (nonatomic, assign) BOOL finished;
+@property (nonatomic, strong) STAPIRequestTimeline *timeline;
+
+@property (nonatomic, strong) NSDictionary *params;
+@property (nonatomic, copy) NSString *cacheKey;
+@property (nonatomic, strong) NSURLRequest *URLRequest;
+@property (nonatomic, strong) NSURLConnection *connection;
+@property (nonatomic, strong) NSURLResponse *response;
+@property (nonatomic, strong) NSMutableData *responseData;
+@property (nonatomic, strong) NSTimer *timeoutTimer;
+@property (nonatomic, strong) NSDate *attemptStartDate;
+
+// A duplicate connection sent when the first one is slower than usual, the first to respond wins
+@property (nonatomic, strong) NSURLConnection *hedgeConnection;
+@property (nonatomic, strong) NSTimer *hedgeTimer;
+
+// Fires when a failed request is sent again
+@property (nonatomic, strong) NSTimer *retryTimer;
+@property (nonatomic, strong) STStreamingResultParser *streamingParser;
+@property (nonatomic, strong) NSOperation *lastDecodeOperation;
+@property (nonatomic, assign) NSUInteger generation;
+
+// Set on background requests that revalidate the cached result delivered for another request
+@property (nonatomic, strong) STAPIRequest *revalidatedRequest;
+@property (nonatomic, strong) NSDictionary *staleResult;
+
+// Set on a canceled request that keeps loading because identical requests joined it through STSingleFlight
+@property (atomic, assign) BOOL orphaned;
+
+// Set on requests that only fill the caches, the delegate never hears of them
+@property (nonatomic, assign) BOOL prefetch;
+
+// Set when the delegate wants partial results, only then are records decoded while the response downloads
+@property (nonatomic, assign) BOOL streamsPartialResults;
+
+- (id)initWithClient:(STAPIClient *)client query:(NSString *)query searchType:(STSearchType)type page:(NSUInteger)page perPage:(NSUInteger)perPage;
+
+@end
+
+/*
+ The client fills in the timeline of a request as it moves through its stages.
+ */
+@interface STAPIRequestTimeline ()
+
+@property (nonatomic, assign) STSearchType searchType;
+@property (nonatomic, strong) NSDate *createdDate;
+@property (nonatomic, strong) NSDate *connectionStartDate;
+@property (nonatomic, strong) NSDate *responseDate;
+@property (nonatomic, strong) NSDate *loadedDate;
+@property (nonatomic, strong) NSDate *decodedDate;
+@property (nonatomic, strong) NSDate *deliveredDate;
+@property (nonatomic, assign) BOOL cacheHit;
+@property (nonatomic, assign) NSUInteger payloadBytes;
+@property (nonatomic, assign) NSUInteger wireBytes;
+@property (nonatomic, assign) NSUInteger requestBytes;
+@property (nonatomic, assign) NSUInteger retryCount;
+@property (nonatomic, assign) BOOL hedged;
+@property (nonatomic, assign) BOOL coalesced;
+
+- (id)initWithSearchType:(STSearchType)type;
+
+@end
@@ -0,0 +1,100 @@
+//
+//  STAPIRequest.h
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "STAPIClient.h"
+
+@class STAPIRequestTimeline;
+
+/** Relative importance of a request.
+
+ `STAPIRequestPriorityLow` - Background work such as prefetching. Only started when no higher priority request is waiting.
+
+ `STAPIRequestPriorityNormal` - Default priority for search and suggest queries.
+
+ `STAPIRequestPriorityHigh` - Interactive work that should jump ahead of anything queued.
+ */
+typedef enum {
+    STAPIRequestPriorityLow = -1,
+    STAPIRequestPriorityNormal = 0,
+    STAPIRequestPriorityHigh = 1
+} STAPIRequestPriority;
+
+/**
+ Handle for a single query issued by `STAPIClient`. Every call to `searchQuery:` or `suggestQuery:`
+ returns a new `STAPIRequest` and the same instance is passed back through the request based
+ `STAPIClientDelegate` callbacks, which makes it possible to tell several concurrent queries apart.
+
+ A request is created by the client and should not be instantiated directly.
+ */
+@interface STAPIRequest : NSObject
+
+/**
+ Identifier that is unique among all requests created in the process
+ */
+@property (nonatomic, readonly, assign) NSUInteger requestId;
+
+/**
+ The client that issued the request
+ */
+@property (nonatomic, readonly, weak) STAPIClient *client;
+
+/**
+ The query string sent to the server
+ */
+@property (nonatomic, readonly, copy) NSString *query;
+
+/**
+ The type of search being performed. Either a search or a suggest.
+ */
+@property (nonatomic, readonly, assign) STSearchType searchType;
+
+/**
+ The page that was requested
+ */
+@property (nonatomic, readonly, assign) NSUInteger page;
+
+/**
+ The document types the query was restricted to, nil if it asked for every document type of the engine
+ */
+@property (nonatomic, readonly, copy) NSArray *documentTypes;
+
+/**
+ Maximum number of items requested per page
+ */
+@property (nonatomic, readonly, assign) NSUInteger perPage;
+
+/**
+ Priority used by the client when deciding which waiting request is sent next. Changing the
+ priority after the request has been sent to the server has no effect.
+ */
+@property (nonatomic, assign) STAPIRequestPriority priority;
+
+/**
+ `YES` once the request was canceled
+ */
+@property (atomic, readonly, getter = isCancelled) BOOL cancelled;
+
+/**
+ `YES` once the request has finished, failed or was canceled. No more delegate
+ callbacks will be made for a finished request.
+ */
+@property (nonatomic, readonly, getter = isFinished) BOOL finished;
+
+/**
+ Timing of the request's stages, filled in as the request progresses
+ */
+@property (nonatomic, readonly, strong) STAPIRequestTimeline *timeline;
+
+/**
+ Cancel the request. The delegate's cancel callbacks will be called unless the request
+ has already finished.
+ */
+- (void)cancel;
+
+@end
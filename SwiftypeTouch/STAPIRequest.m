@@ -0,0 +1,58 @@
+//
+//  STAPIRequest.m
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import "STAPIRequest.h"
+#import "STAPIRequest+Private.h"
+
+@interface STAPIRequest ()
+
+@property (nonatomic, assign) NSUInteger requestId;
+
++ (NSUInteger)_nextRequestId;
+
+@end
+
+@implementation STAPIRequest
+
+#pragma mark - NSObject
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@: %p id=%lu query=%@ type=%d page=%lu documentTypes=%@>",
+            NSStringFromClass([self class]), self, (unsigned long)self.requestId, self.query, self.searchType, (unsigned long)self.page, self.documentTypes];
+}
+
+#pragma mark - STAPIRequest
+
++ (NSUInteger)_nextRequestId {
+    static NSUInteger lastRequestId = 0;
+    @synchronized(self) {
+        return ++lastRequestId;
+    }
+}
+
+- (id)initWithClient:(STAPIClient *)client query:(NSString *)query searchType:(STSearchType)type page:(NSUInteger)page perPage:(NSUInteger)perPage {
+    self = [super init];
+    if (self) {
+        self.requestId = [[self class] _nextRequestId];
+        self.client = client;
+        self.query = query;
+        self.searchType = type;
+        self.page = page;
+        self.perPage = perPage;
+        self.priority = STAPIRequestPriorityNormal;
+        self.responseData = [NSMutableData data];
+        self.timeline = [[STAPIRequestTimeline alloc] initWithSearchType:type];
+    }
+    return self;
+}
+
+- (void)cancel {
+    [self.client cancelRequest:self];
+}
+
+@end
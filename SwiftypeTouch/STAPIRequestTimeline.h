@@ -0,0 +1,149 @@
+//
+//  STAPIRequestTimeline.h
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "STAPIClient.h"
+
+/**
+ Timing of a single `STAPIRequest`, from the moment it was created until its result was handed to the delegate.
+
+ The request goes through these stages, each of which has a duration property:
+
+   * `queueDuration` - waiting for a free connection slot
+   * `timeToFirstByte` - from sending the request until the response headers arrived. This covers connection
+     setup, which `NSURLConnection` does not report separately, and the server's processing time.
+   * `transferDuration` - downloading the response body
+   * `decodeDuration` - decoding the JSON, including time spent waiting for a free decoder
+   * `deliveryDuration` - from the end of decoding until the main queue delivered the result
+
+ Results answered from a cache or by an identical request already in flight skip the network stages. Their
+ `deliveryDuration` covers the whole time from creation to delivery. A duration is 0 when the request never went
+ through that stage.
+ */
+@interface STAPIRequestTimeline : NSObject
+
+/**
+ The type of query the timeline belongs to
+ */
+@property (nonatomic, readonly, assign) STSearchType searchType;
+
+/**
+ When the request was created
+ */
+@property (nonatomic, readonly, strong) NSDate *createdDate;
+
+/**
+ When the request was sent to the server. nil for cached results.
+ */
+@property (nonatomic, readonly, strong) NSDate *connectionStartDate;
+
+/**
+ When the response headers arrived. nil for cached results.
+ */
+@property (nonatomic, readonly, strong) NSDate *responseDate;
+
+/**
+ When the last byte of the response arrived. nil for cached results.
+ */
+@property (nonatomic, readonly, strong) NSDate *loadedDate;
+
+/**
+ When decoding of the response finished. nil for cached results.
+ */
+@property (nonatomic, readonly, strong) NSDate *decodedDate;
+
+/**
+ When the main queue started delivering the result
+ */
+@property (nonatomic, readonly, strong) NSDate *deliveredDate;
+
+/**
+ `YES` if the result came from one of the client's caches
+ */
+@property (nonatomic, readonly, assign) BOOL cacheHit;
+
+/**
+ Size of the response body in bytes. 0 for cached results.
+ */
+@property (nonatomic, readonly, assign) NSUInteger payloadBytes;
+
+/**
+ Size of the response body as it was transferred, before the URL loading system inflated a gzip or deflate
+ encoded response. Equal to `payloadBytes` when the response was not compressed or its compressed size is
+ unknown. 0 for cached results.
+ */
+@property (nonatomic, readonly, assign) NSUInteger wireBytes;
+
+/**
+ Number of response bytes compression kept off the network, `payloadBytes` minus `wireBytes`
+ */
+@property (nonatomic, readonly) NSUInteger savedBytes;
+
+/**
+ Size of the request body in bytes
+ */
+@property (nonatomic, readonly, assign) NSUInteger requestBytes;
+
+/**
+ Number of times the request was sent again after a failure that is safe to retry
+ */
+@property (nonatomic, readonly, assign) NSUInteger retryCount;
+
+/**
+ `YES` if a duplicate of the request was sent because the response took longer than usual
+ */
+@property (nonatomic, readonly, assign) BOOL hedged;
+
+/**
+ `YES` if the request was answered by an identical request that was already on its way to the server
+ */
+@property (nonatomic, readonly, assign) BOOL coalesced;
+
+/**
+ Number of seconds the query was held back before it was started, for example by `STSuggestScheduler`
+ waiting for the user to stop typing. Set by whoever held the query back, 0 otherwise.
+ */
+@property (nonatomic, assign) NSTimeInterval debounceDuration;
+
+/**
+ Number of seconds spent waiting for a free connection slot
+ */
+@property (nonatomic, readonly) NSTimeInterval queueDuration;
+
+/**
+ Number of seconds from sending the request until the response headers arrived
+ */
+@property (nonatomic, readonly) NSTimeInterval timeToFirstByte;
+
+/**
+ Number of seconds spent downloading the response body
+ */
+@property (nonatomic, readonly) NSTimeInterval transferDuration;
+
+/**
+ Number of seconds from the last byte until the decoded result was available
+ */
+@property (nonatomic, readonly) NSTimeInterval decodeDuration;
+
+/**
+ Number of seconds from the decoded result, or the creation of a cached request, until the main queue delivered it
+ */
+@property (nonatomic, readonly) NSTimeInterval deliveryDuration;
+
+/**
+ Number of seconds from creation to delivery. Does not include `debounceDuration`.
+ */
+@property (nonatomic, readonly) NSTimeInterval totalDuration;
+
+/**
+ The durations, cache hit flag, byte counts, retries, hedging and coalescing as property list values, suitable
+ for exporting to telemetry
+ */
+- (NSDictionary *)dictionaryRepresentation;
+
+@end
@@ -0,0 +1,91 @@
+//
+//  STAPIRequestTimeline.m
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import "STAPIRequestTimeline.h"
+#import "STAPIRequest+Private.h"
+
+static NSTimeInterval STIntervalBetween(NSDate *start, NSDate *end) {
+    if (start == nil || end == nil) {
+        return 0.0;
+    }
+    return MAX([end timeIntervalSinceDate:start], 0.0);
+}
+
+@implementation STAPIRequestTimeline
+
+#pragma mark - NSObject
+
+- (id)init {
+    return [self initWithSearchType:STSearchTypeSearch];
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@: %p %@>", NSStringFromClass([self class]), self, [self dictionaryRepresentation]];
+}
+
+#pragma mark - STAPIRequestTimeline
+
+- (id)initWithSearchType:(STSearchType)type {
+    self = [super init];
+    if (self) {
+        self.searchType = type;
+        self.createdDate = [NSDate date];
+    }
+    return self;
+}
+
+- (NSTimeInterval)queueDuration {
+    return STIntervalBetween(self.createdDate, self.connectionStartDate);
+}
+
+- (NSTimeInterval)timeToFirstByte {
+    return STIntervalBetween(self.connectionStartDate, self.responseDate);
+}
+
+- (NSTimeInterval)transferDuration {
+    return STIntervalBetween(self.responseDate, self.loadedDate);
+}
+
+- (NSTimeInterval)decodeDuration {
+    return STIntervalBetween(self.loadedDate, self.decodedDate);
+}
+
+- (NSTimeInterval)deliveryDuration {
+    return STIntervalBetween((self.cacheHit || self.coalesced) ? self.createdDate : self.decodedDate, self.deliveredDate);
+}
+
+- (NSTimeInterval)totalDuration {
+    return STIntervalBetween(self.createdDate, self.deliveredDate);
+}
+
+- (NSUInteger)savedBytes {
+    return (self.payloadBytes > self.wireBytes) ? self.payloadBytes - self.wireBytes : 0;
+}
+
+- (NSDictionary *)dictionaryRepresentation {
+    return @{
+        @"type" : (self.searchType == STSearchTypeSuggest) ? @"suggest" : @"search",
+        @"debounce" : @(self.debounceDuration),
+        @"queue" : @(self.queueDuration),
+        @"first_byte" : @(self.timeToFirstByte),
+        @"transfer" : @(self.transferDuration),
+        @"decode" : @(self.decodeDuration),
+        @"delivery" : @(self.deliveryDuration),
+        @"total" : @(self.totalDuration),
+        @"cache_hit" : @(self.cacheHit),
+        @"bytes" : @(self.payloadBytes),
+        @"wire_bytes" : @(self.wireBytes),
+        @"saved_bytes" : @(self.savedBytes),
+        @"request_bytes" : @(self.requestBytes),
+        @"retries" : @(self.retryCount),
+        @"hedged" : @(self.hedged),
+        @"coalesced" : @(self.coalesced)
+    };
+}
+
+@end
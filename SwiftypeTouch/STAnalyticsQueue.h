@@ -0,0 +1,120 @@
+//
+//  STAnalyticsQueue.h
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ Background queue that delivers analytics events for `STAPIClient`.
+
+ Every event is first appended to a journal on disk, one compact JSON line per event, so events
+ recorded while offline or right before the app is terminated are sent the next time the app runs.
+ Events are sent in batches, either `flushInterval` seconds after the first unsent event was
+ recorded or as soon as `flushThreshold` events are waiting. The events of a batch are sent one
+ after the other so they share a single keep-alive connection to the analytics host.
+
+ When an event can't be delivered the batch stops and is retried later, waiting twice as long
+ after every consecutive failure, from `minimumRetryInterval` up to `maximumRetryInterval`.
+ Events the server rejects outright are dropped instead of retried.
+
+ No work happens on the main thread. All methods and counters are safe to use from any thread.
+ */
+@interface STAnalyticsQueue : NSObject
+
+/**
+ Queue shared by all instances of `STAPIClient`. Its journal lives in the application support directory.
+ */
++ (STAnalyticsQueue *)sharedQueue;
+
+/**
+ Path of the journal holding the events that were not yet delivered
+ */
+@property (nonatomic, readonly, copy) NSString *journalPath;
+
+/**
+ Number of seconds an event waits for others to join its batch.
+
+ The default value is 30 seconds.
+ */
+@property (nonatomic, assign) NSTimeInterval flushInterval;
+
+/**
+ Number of waiting events that triggers a batch right away.
+
+ The default value is 20.
+ */
+@property (nonatomic, assign) NSUInteger flushThreshold;
+
+/**
+ Maximum number of events kept in the journal. The oldest events are dropped beyond this.
+
+ The default value is 500.
+ */
+@property (nonatomic, assign) NSUInteger maxEventCount;
+
+/**
+ Number of seconds to wait before the first retry of a failed batch.
+
+ The default value is 5 seconds.
+ */
+@property (nonatomic, assign) NSTimeInterval minimumRetryInterval;
+
+/**
+ Longest number of seconds to wait before retrying a failed batch.
+
+ The default value is 600 seconds.
+ */
+@property (nonatomic, assign) NSTimeInterval maximumRetryInterval;
+
+/**
+ Number of seconds before sending a single event times out.
+
+ The default value is 20 seconds.
+ */
+@property (nonatomic, assign) NSTimeInterval requestTimeout;
+
+/**
+ Number of events waiting to be sent
+ */
+@property (nonatomic, readonly) NSUInteger pendingEventCount;
+
+/**
+ Number of events delivered
+ */
+@property (nonatomic, readonly) NSUInteger sentEventCount;
+
+/**
+ Number of events rejected by the server or dropped to stay within `maxEventCount`
+ */
+@property (nonatomic, readonly) NSUInteger droppedEventCount;
+
+/**
+ Number of batches in a row that failed. 0 once a batch succeeds.
+ */
+@property (nonatomic, readonly) NSUInteger consecutiveFailureCount;
+
+/**
+ Initializes a new `STAnalyticsQueue` and loads the events left in its journal.
+
+ @param journalPath Path of the journal file. Its directory is created when needed.
+ */
+- (id)initWithJournalPath:(NSString *)journalPath;
+
+/**
+ Records an event to be sent with a GET request.
+
+ @param URL URL of the request, including its query string
+ @param headers Additional HTTP header fields of the request. May be nil.
+ */
+- (void)addEventWithURL:(NSURL *)URL HTTPHeaderFields:(NSDictionary *)headers;
+
+/**
+ Sends the waiting events now, even while waiting to retry a failed batch.
+ */
+- (void)flush;
+
+@end
@@ -0,0 +1,307 @@
+//
+//  STAnalyticsQueue.m
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import "STAnalyticsQueue.h"
+
+typedef enum {
+    STAnalyticsSendResultSent,
+    STAnalyticsSendResultRejected,
+    STAnalyticsSendResultFailed
+} STAnalyticsSendResult;
+
+@interface STAnalyticsQueue ()
+
+@property (nonatomic, copy) NSString *journalPath;
+@property (nonatomic, strong) NSOperationQueue *workQueue;
+@property (nonatomic, strong) NSMutableArray *events;
+@property (nonatomic, assign) NSUInteger flushGeneration;
+@property (nonatomic, assign) BOOL flushScheduled;
+@property (nonatomic, strong) NSDate *retryDate;
+@property (nonatomic, assign) NSUInteger pendingEventCount;
+@property (nonatomic, assign) NSUInteger sentEventCount;
+@property (nonatomic, assign) NSUInteger droppedEventCount;
+@property (nonatomic, assign) NSUInteger consecutiveFailureCount;
+
+- (void)_loadJournal;
+- (void)_appendEventToJournal:(NSDictionary *)event;
+- (void)_rewriteJournal;
+- (void)_addEvent:(NSDictionary *)event;
+- (void)_scheduleFlushAfter:(NSTimeInterval)delay;
+- (void)_flush;
+- (STAnalyticsSendResult)_sendEvent:(NSDictionary *)event;
+- (void)_updateCountsWithSent:(NSUInteger)sent dropped:(NSUInteger)dropped;
+
+@end
+
+@implementation STAnalyticsQueue
+
+#pragma mark - NSObject
+
+- (id)init {
+    NSString *supportDirectory = [NSSearchPathForDirectoriesInDomains(NSApplicationSupportDirectory, NSUserDomainMask, YES) lastObject];
+    return [self initWithJournalPath:[supportDirectory stringByAppendingPathComponent:@"SwiftypeTouch/analytics.journal"]];
+}
+
+#pragma mark - STAnalyticsQueue
+
++ (STAnalyticsQueue *)sharedQueue {
+    static dispatch_once_t onceToken;
+    static STAnalyticsQueue *sharedQueue = nil;
+    dispatch_once(&onceToken, ^{
+        sharedQueue = [[STAnalyticsQueue alloc] init];
+    });
+    return sharedQueue;
+}
+
+- (id)initWithJournalPath:(NSString *)journalPath {
+    self = [super init];
+    if (self) {
+        self.journalPath = journalPath;
+        self.flushInterval = 30.0;
+        self.flushThreshold = 20;
+        self.maxEventCount = 500;
+        self.minimumRetryInterval = 5.0;
+        self.maximumRetryInterval = 600.0;
+        self.requestTimeout = 20.0;
+        self.events = [NSMutableArray array];
+
+        // Every piece of state below is only touched from this queue, one operation at a time
+        self.workQueue = [[NSOperationQueue alloc] init];
+        self.workQueue.name = @"com.swiftype.api.analytics";
+        self.workQueue.maxConcurrentOperationCount = 1;
+
+        [self.workQueue addOperationWithBlock:^{
+            [self _loadJournal];
+            // Leftovers from an earlier run wait a full interval so they don't compete with startup traffic
+            if (self.events.count > 0) {
+                [self _scheduleFlushAfter:self.flushInterval];
+            }
+        }];
+    }
+    return self;
+}
+
+- (void)addEventWithURL:(NSURL *)URL HTTPHeaderFields:(NSDictionary *)headers {
+    if (URL == nil) return;
+
+    NSMutableDictionary *event = [NSMutableDictionary dictionaryWithCapacity:3];
+    [event setObject:[URL absoluteString] forKey:@"u"];
+    [event setObject:@(floor([[NSDate date] timeIntervalSince1970])) forKey:@"t"];
+    if (headers.count > 0) {
+        [event setObject:headers forKey:@"h"];
+    }
+
+    [self.workQueue addOperationWithBlock:^{
+        [self _addEvent:event];
+    }];
+}
+
+- (void)flush {
+    [self.workQueue addOperationWithBlock:^{
+        self.retryDate = nil;
+        [self _flush];
+    }];
+}
+
+#pragma mark - Private
+
+- (void)_loadJournal {
+    NSData *journal = [NSData dataWithContentsOfFile:self.journalPath];
+    if (journal.length == 0) return;
+
+    const char *bytes = journal.bytes;
+    NSUInteger lineStart = 0;
+    for (NSUInteger i = 0; i <= journal.length; i++) {
+        if (i < journal.length && bytes[i] != '\n') {
+            continue;
+        }
+        if (i > lineStart) {
+            // The app may have been killed halfway through an append, skip whatever doesn't parse
+            NSData *line = [journal subdataWithRange:NSMakeRange(lineStart, i - lineStart)];
+            id event = [NSJSONSerialization JSONObjectWithData:line options:0 error:NULL];
+            if ([event isKindOfClass:[NSDictionary class]] && [[event objectForKey:@"u"] isKindOfClass:[NSString class]]) {
+                [self.events addObject:event];
+            }
+        }
+        lineStart = i + 1;
+    }
+
+    if (self.events.count > self.maxEventCount) {
+        NSUInteger overflow = self.events.count - self.maxEventCount;
+        [self.events removeObjectsInRange:NSMakeRange(0, overflow)];
+        [self _updateCountsWithSent:0 dropped:overflow];
+        [self _rewriteJournal];
+    }
+    else {
+        [self _updateCountsWithSent:0 dropped:0];
+    }
+}
+
+- (void)_appendEventToJournal:(NSDictionary *)event {
+    NSMutableData *line = [[NSJSONSerialization dataWithJSONObject:event options:0 error:NULL] mutableCopy];
+    if (line == nil) return;
+    [line appendBytes:"\n" length:1];
+
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    if (![fileManager fileExistsAtPath:self.journalPath]) {
+        [fileManager createDirectoryAtPath:[self.journalPath stringByDeletingLastPathComponent]
+               withIntermediateDirectories:YES
+                                attributes:nil
+                                     error:NULL];
+        [fileManager createFileAtPath:self.journalPath contents:nil attributes:nil];
+    }
+
+    NSFileHandle *fileHandle = [NSFileHandle fileHandleForWritingAtPath:self.journalPath];
+    [fileHandle seekToEndOfFile];
+    [fileHandle writeData:line];
+    [fileHandle closeFile];
+}
+
+- (void)_rewriteJournal {
+    if (self.events.count == 0) {
+        [[NSFileManager defaultManager] removeItemAtPath:self.journalPath error:NULL];
+        return;
+    }
+
+    NSMutableData *journal = [NSMutableData data];
+    for (NSDictionary *event in self.events) {
+        NSData *line = [NSJSONSerialization dataWithJSONObject:event options:0 error:NULL];
+        if (line) {
+            [journal appendData:line];
+            [journal appendBytes:"\n" length:1];
+        }
+    }
+    [journal writeToFile:self.journalPath atomically:YES];
+}
+
+- (void)_addEvent:(NSDictionary *)event {
+    [self.events addObject:event];
+
+    if (self.events.count > self.maxEventCount) {
+        NSUInteger overflow = self.events.count - self.maxEventCount;
+        [self.events removeObjectsInRange:NSMakeRange(0, overflow)];
+        [self _updateCountsWithSent:0 dropped:overflow];
+        [self _rewriteJournal];
+    }
+    else {
+        [self _appendEventToJournal:event];
+        [self _updateCountsWithSent:0 dropped:0];
+    }
+
+    // While backing off the scheduled retry takes care of the new event as well
+    if (self.retryDate) return;
+
+    if (self.events.count >= self.flushThreshold) {
+        [self _flush];
+    }
+    else if (!self.flushScheduled) {
+        [self _scheduleFlushAfter:self.flushInterval];
+    }
+}
+
+- (void)_scheduleFlushAfter:(NSTimeInterval)delay {
+    self.flushScheduled = YES;
+    NSUInteger generation = ++self.flushGeneration;
+
+    __weak STAnalyticsQueue *weakSelf = self;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+        [weakSelf.workQueue addOperationWithBlock:^{
+            STAnalyticsQueue *strongSelf = weakSelf;
+            // A later schedule or a flush that already happened supersedes this one
+            if (strongSelf == nil || generation != strongSelf.flushGeneration) return;
+
+            strongSelf.flushScheduled = NO;
+            strongSelf.retryDate = nil;
+            [strongSelf _flush];
+        }];
+    });
+}
+
+- (void)_flush {
+    if (self.retryDate) return;
+
+    self.flushGeneration++;
+    self.flushScheduled = NO;
+    if (self.events.count == 0) return;
+
+    NSUInteger sent = 0;
+    NSUInteger dropped = 0;
+    BOOL failed = NO;
+    for (NSDictionary *event in self.events) {
+        STAnalyticsSendResult result = [self _sendEvent:event];
+        if (result == STAnalyticsSendResultFailed) {
+            failed = YES;
+            break;
+        }
+        if (result == STAnalyticsSendResultSent) {
+            sent++;
+        }
+        else {
+            dropped++;
+        }
+    }
+
+    [self.events removeObjectsInRange:NSMakeRange(0, sent + dropped)];
+    [self _updateCountsWithSent:sent dropped:dropped];
+    [self _rewriteJournal];
+
+    if (failed) {
+        self.consecutiveFailureCount++;
+        NSTimeInterval delay = self.minimumRetryInterval * pow(2.0, MIN(self.consecutiveFailureCount - 1, 30));
+        delay = MIN(delay, self.maximumRetryInterval);
+        [self _scheduleFlushAfter:delay];
+        self.retryDate = [NSDate dateWithTimeIntervalSinceNow:delay];
+    }
+    else {
+        self.consecutiveFailureCount = 0;
+    }
+}
+
+- (STAnalyticsSendResult)_sendEvent:(NSDictionary *)event {
+    NSURL *URL = [NSURL URLWithString:[event objectForKey:@"u"]];
+    if (URL == nil) {
+        return STAnalyticsSendResultRejected;
+    }
+
+    NSMutableURLRequest *request = [[NSMutableURLRequest alloc] initWithURL:URL
+                                                                cachePolicy:NSURLRequestReloadIgnoringLocalCacheData
+                                                            timeoutInterval:self.requestTimeout];
+    NSDictionary *headers = [event objectForKey:@"h"];
+    if ([headers isKindOfClass:[NSDictionary class]]) {
+        for (NSString *field in headers) {
+            [request setValue:[headers objectForKey:field] forHTTPHeaderField:field];
+        }
+    }
+
+    // Blocking is fine here, the work queue is dedicated to analytics and sends one event at a time
+    NSHTTPURLResponse *response = nil;
+    [NSURLConnection sendSynchronousRequest:request returningResponse:&response error:NULL];
+    if (![response isKindOfClass:[NSHTTPURLResponse class]]) {
+        return STAnalyticsSendResultFailed;
+    }
+
+    NSInteger statusCode = response.statusCode;
+    if (statusCode >= 200 && statusCode <= 299) {
+        return STAnalyticsSendResultSent;
+    }
+    // Retrying a request the server considers malformed won't change its mind
+    if (statusCode >= 400 && statusCode <= 499 && statusCode != 408 && statusCode != 429) {
+        return STAnalyticsSendResultRejected;
+    }
+    return STAnalyticsSendResultFailed;
+}
+
+- (void)_updateCountsWithSent:(NSUInteger)sent dropped:(NSUInteger)dropped {
+    @synchronized(self) {
+        self.sentEventCount += sent;
+        self.droppedEventCount += dropped;
+        self.pendingEventCount = self.events.count;
+    }
+}
+
+@end
@@ -31,10 +31,13 @@
  
  * `STSearchResultsObject`
     * `recordSectionOrder` - returns `@[ self.documentTypeSlug ]` instead of the empty array
+    * `renderedFieldsForDocumentType:` - returns `@[ @"title", @"url" ]` so other fields aren't downloaded
+    * `searchedFieldsForDocumentType:` - returns `@[ @"title" ]` so suggestions of longer prefixes are answered locally
  * `searchResultsDataSource` for `UISearchDisplayController`
     * `tableView:titleForHeaderInSection:` - returns nil
     * `tableView:cellForRowAtIndexPath:` - For suggest queries renders the title of the cell. For
-       search queries renders the title and url as the subtitle.
+       search queries renders the title and url as the subtitle. The record is read through
+       `recordForType:atIndex:`, like when it is selected, if a subclass overrides the record lookups.
  * `searchResultsDelegate` for `UISearchDisplayController`
     * `tableView:didSelectRowAtIndexPath:` - Opens up a web page of the result
  */
@@ -7,6 +7,7 @@
 //
 
 #import "STCommonDocumentTypeResultsObject.h"
+#import "STSearchResultsObject+Private.h"
 #import "UI/STWebViewController.h"
 
 @interface STCommonDocumentTypeResultsObject ()
@@ -37,6 +38,14 @@
     return @[ self.documentTypeSlug ];
 }
 
+- (NSArray *)renderedFieldsForDocumentType:(NSString *)documentType {
+    return [self _titleAndURLFields];
+}
+
+- (NSArray *)searchedFieldsForDocumentType:(NSString *)documentType {
+    return @[ @"title" ];
+}
+
 - (NSString *)clientEngineKey {
     if (self.privateEngineKey) {
         return self.privateEngineKey;
@@ -64,15 +73,7 @@
         cell = [[UITableViewCell alloc] initWithStyle:UITableViewCellStyleSubtitle reuseIdentifier:CellIdentifier];
     }
     
-    NSDictionary *data = [self recordForType:self.documentTypeSlug atIndex:indexPath.row];
-    
-    if (self.searchType == STSearchTypeSearch) {
-        cell.textLabel.text = [data objectForKey:@"title"];
-        cell.detailTextLabel.text = [data objectForKey:@"url"];
-    }
-    else {
-        cell.textLabel.text = [data objectForKey:@"title"];
-    }
+    [self _configureCell:cell forRowAtIndexPath:indexPath];
     
     return cell;
 }
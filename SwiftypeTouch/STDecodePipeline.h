@@ -0,0 +1,103 @@
+//
+//  STDecodePipeline.h
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ Returns `YES` when the work it belongs to is no longer wanted, for example because the query
+ was canceled or superseded by a newer one. Called from a background thread.
+ */
+typedef BOOL (^STDecodeStalenessTest)(void);
+
+/**
+ Background pipeline that decodes API responses for `STAPIClient`.
+
+ Responses of different queries are decoded in parallel, up to `maxConcurrentDecodes` at a time,
+ so a large search page no longer holds up the next suggest response. Work submitted for the same
+ query can be chained with the `after` parameter to keep it in order.
+
+ Every job carries a staleness test. A job whose test passes before it starts is skipped without
+ parsing anything, and a result whose test passes once parsing has finished is dropped instead of
+ being handed back. Both cases are counted in `droppedCount`.
+
+ All methods and counters are safe to use from any thread.
+ */
+@interface STDecodePipeline : NSObject
+
+/**
+ Pipeline shared by all instances of `STAPIClient`
+ */
++ (STDecodePipeline *)sharedPipeline;
+
+/**
+ Maximum number of jobs running at the same time.
+
+ The default value is the number of active processors, but at least 2.
+ */
+@property (nonatomic, assign) NSUInteger maxConcurrentDecodes;
+
+/**
+ Number of jobs waiting or running
+ */
+@property (nonatomic, readonly) NSUInteger queueDepth;
+
+/**
+ Number of jobs that ran to completion
+ */
+@property (nonatomic, readonly) NSUInteger decodeCount;
+
+/**
+ Number of jobs skipped or whose result was dropped because they had become stale
+ */
+@property (nonatomic, readonly) NSUInteger droppedCount;
+
+/**
+ Total number of seconds spent running jobs
+ */
+@property (nonatomic, readonly) NSTimeInterval totalDecodeTime;
+
+/**
+ Average number of seconds a completed job ran, or 0 if no job completed yet
+ */
+@property (nonatomic, readonly) NSTimeInterval averageDecodeTime;
+
+/**
+ Decodes a JSON payload.
+
+ @param data The JSON payload
+ @param previous Operation that must finish before this one starts, or nil
+ @param isStale Staleness test of the query the payload belongs to, or nil
+ @param completion Called on a background thread with the decoded object or the parse error. Not
+ called when the job turned out to be stale.
+
+ @return Operation that can be passed as `previous` to later jobs of the same query
+ */
+- (NSOperation *)decodeData:(NSData *)data
+                      after:(NSOperation *)previous
+                    isStale:(STDecodeStalenessTest)isStale
+                 completion:(void (^)(id result, NSError *error))completion;
+
+/**
+ Runs arbitrary decoding work, for example feeding a chunk to an incremental parser.
+
+ @param block The work to run on a background thread
+ @param previous Operation that must finish before this one starts, or nil
+ @param isStale Staleness test of the query the work belongs to, or nil
+
+ @return Operation that can be passed as `previous` to later jobs of the same query
+ */
+- (NSOperation *)performDecode:(void (^)(void))block
+                         after:(NSOperation *)previous
+                       isStale:(STDecodeStalenessTest)isStale;
+
+/**
+ Resets the decode and drop counters as well as the decode time to 0
+ */
+- (void)resetStatistics;
+
+@end
@@ -0,0 +1,141 @@
+//
+//  STDecodePipeline.m
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import "STDecodePipeline.h"
+
+@interface STDecodePipeline ()
+
+@property (nonatomic, strong) NSOperationQueue *operationQueue;
+@property (nonatomic, assign) NSUInteger decodeCount;
+@property (nonatomic, assign) NSUInteger droppedCount;
+@property (nonatomic, assign) NSTimeInterval totalDecodeTime;
+
+- (NSOperation *)_addOperationWithBlock:(void (^)(void))block after:(NSOperation *)previous;
+- (void)_recordDecodeTime:(NSTimeInterval)decodeTime;
+- (void)_recordDrop;
+
+@end
+
+@implementation STDecodePipeline
+
+#pragma mark - NSObject
+
+- (id)init {
+    self = [super init];
+    if (self) {
+        self.operationQueue = [[NSOperationQueue alloc] init];
+        self.operationQueue.name = @"com.swiftype.api.decodePipeline";
+        self.maxConcurrentDecodes = MAX([[NSProcessInfo processInfo] activeProcessorCount], 2);
+    }
+    return self;
+}
+
+#pragma mark - STDecodePipeline
+
++ (STDecodePipeline *)sharedPipeline {
+    static dispatch_once_t onceToken;
+    static STDecodePipeline *sharedPipeline = nil;
+    dispatch_once(&onceToken, ^{
+        sharedPipeline = [[STDecodePipeline alloc] init];
+    });
+    return sharedPipeline;
+}
+
+- (void)setMaxConcurrentDecodes:(NSUInteger)maxConcurrentDecodes {
+    _maxConcurrentDecodes = MAX(maxConcurrentDecodes, 1);
+    self.operationQueue.maxConcurrentOperationCount = _maxConcurrentDecodes;
+}
+
+- (NSUInteger)queueDepth {
+    return self.operationQueue.operationCount;
+}
+
+- (NSTimeInterval)averageDecodeTime {
+    @synchronized(self) {
+        if (self.decodeCount == 0) {
+            return 0.0;
+        }
+        return self.totalDecodeTime / self.decodeCount;
+    }
+}
+
+- (NSOperation *)decodeData:(NSData *)data
+                      after:(NSOperation *)previous
+                    isStale:(STDecodeStalenessTest)isStale
+                 completion:(void (^)(id result, NSError *error))completion {
+    return [self _addOperationWithBlock:^{
+        if (isStale && isStale()) {
+            [self _recordDrop];
+            return;
+        }
+
+        NSDate *start = [NSDate date];
+        NSError *error = nil;
+        id result = [NSJSONSerialization JSONObjectWithData:data options:0 error:&error];
+        [self _recordDecodeTime:-[start timeIntervalSinceNow]];
+
+        // The query may have been superseded while the payload was parsed
+        if (isStale && isStale()) {
+            [self _recordDrop];
+            return;
+        }
+
+        if (completion) {
+            completion(result, error);
+        }
+    } after:previous];
+}
+
+- (NSOperation *)performDecode:(void (^)(void))block
+                         after:(NSOperation *)previous
+                       isStale:(STDecodeStalenessTest)isStale {
+    return [self _addOperationWithBlock:^{
+        if (isStale && isStale()) {
+            [self _recordDrop];
+            return;
+        }
+
+        NSDate *start = [NSDate date];
+        block();
+        [self _recordDecodeTime:-[start timeIntervalSinceNow]];
+    } after:previous];
+}
+
+- (void)resetStatistics {
+    @synchronized(self) {
+        self.decodeCount = 0;
+        self.droppedCount = 0;
+        self.totalDecodeTime = 0.0;
+    }
+}
+
+#pragma mark - Private
+
+- (NSOperation *)_addOperationWithBlock:(void (^)(void))block after:(NSOperation *)previous {
+    NSBlockOperation *operation = [NSBlockOperation blockOperationWithBlock:block];
+    if (previous) {
+        [operation addDependency:previous];
+    }
+    [self.operationQueue addOperation:operation];
+    return operation;
+}
+
+- (void)_recordDecodeTime:(NSTimeInterval)decodeTime {
+    @synchronized(self) {
+        self.decodeCount++;
+        self.totalDecodeTime += decodeTime;
+    }
+}
+
+- (void)_recordDrop {
+    @synchronized(self) {
+        self.droppedCount++;
+    }
+}
+
+@end
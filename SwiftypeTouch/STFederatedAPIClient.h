@@ -0,0 +1,70 @@
+//
+//  STFederatedAPIClient.h
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import "STAPIClient.h"
+
+/**
+ Client that searches several engines at once and answers with one merged result.
+
+ Every query is sent to all engines in parallel through one `STAPIClient` per engine, so searching N engines
+ takes about as long as searching the slowest of them. Once every engine has answered, or `deadline` has
+ passed, the results are merged and delivered to the delegate as the result of a single `STAPIRequest`.
+ Engines that haven't answered by the deadline are canceled and left out. If none has answered by then, the
+ first one to answer is delivered.
+
+ Records of the same document type are merged across engines and ranked by their `_score`, as the engines report
+ it. Page N of a federated query holds page N of every engine, nothing is cut, so paging through the results
+ visits every record exactly once. Its `per_page` is the sum of the page sizes of the engines and `num_pages`
+ the largest number of pages any engine has. `engineQuotas` caps how many records a single engine contributes
+ per document type and page. Every merged record carries the key of its engine as `_engine`, and clicks are
+ posted to that engine. Clicks on documents the client no longer remembers are dropped.
+
+ A federated client is a drop-in replacement for `STAPIClient`, for example returned from
+ `[STSearchResultsObject clientForResultObject]`. The delegate is asked for request parameters once per engine,
+ with the engine's client. `fetchFields`, `delegateQueue`, `requestPolicy`, `cachePolicy`,
+ `persistentResultMaxAge` and the timeouts are passed on to the clients in `engineClients`; other settings are
+ made on those clients directly, whose delegate must remain the federated client. Cached results the engines
+ revalidate in the background are merged again and delivered as an update. A federated client keeps its own
+ state on the main thread and is used from there. With a `delegateQueue` the engines load on the background
+ thread and the delegate is called on the queue.
+ */
+@interface STFederatedAPIClient : STAPIClient
+
+/**
+ Initializes a client for several engines.
+
+ @param engineKeys The keys of the engines that will be queried, in order of preference when scores are equal
+ */
+- (id)initWithEngineKeys:(NSArray *)engineKeys;
+
+/**
+ The keys of the engines that are queried
+ */
+@property (nonatomic, readonly, copy) NSArray *engineKeys;
+
+/**
+ One client per engine key, in the order of `engineKeys`
+ */
+@property (nonatomic, readonly, copy) NSArray *engineClients;
+
+/**
+ Number of seconds after which a query is answered with the engines that have answered so far.
+
+ The default value is 1.5 seconds.
+ */
+@property (nonatomic, assign) NSTimeInterval deadline;
+
+/**
+ Maximum number of records an engine contributes per document type and page, keyed by engine key. Such an
+ engine is asked for pages of that size. Engines without an entry are asked for the requested page size.
+
+ The default value is nil.
+ */
+@property (nonatomic, copy) NSDictionary *engineQuotas;
+
+@end
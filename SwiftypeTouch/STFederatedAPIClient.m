@@ -0,0 +1,493 @@
+//
+//  STFederatedAPIClient.m
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import "STFederatedAPIClient.h"
+#import "STAPIClient+Private.h"
+#import "STAPIRequest+Private.h"
+
+// State of one query fanned out to every engine
+@interface STFederatedQuery : NSObject
+
+@property (nonatomic, strong) STAPIRequest *request;
+@property (nonatomic, strong) NSMutableArray *engineRequests;
+@property (nonatomic, strong) NSMutableDictionary *results;
+@property (nonatomic, strong) NSError *error;
+@property (nonatomic, assign) NSUInteger answeredCount;
+@property (nonatomic, strong) NSTimer *deadlineTimer;
+@property (nonatomic, assign) BOOL deadlinePassed;
+@property (nonatomic, assign) BOOL delivered;
+
+@end
+
+@implementation STFederatedQuery
+@end
+
+@interface STFederatedAPIClient () <STAPIClientDelegate>
+
+@property (nonatomic, readwrite, copy) NSArray *engineKeys;
+@property (nonatomic, readwrite, copy) NSArray *engineClients;
+@property (nonatomic, strong) NSMutableArray *queries;
+@property (nonatomic, strong) NSMutableArray *deliveredQueries;
+@property (nonatomic, strong) NSCache *documentEngines;
+
+- (STAPIRequest *)_fanOutQuery:(NSString *)query type:(STSearchType)type documentTypes:(NSArray *)documentTypes page:(NSUInteger)page perPage:(NSUInteger)perPage;
+- (STFederatedQuery *)_queryForRequest:(STAPIRequest *)request;
+- (STFederatedQuery *)_queryForEngineRequest:(STAPIRequest *)engineRequest;
+- (NSString *)_engineKeyForClient:(STAPIClient *)client;
+- (NSUInteger)_perPage:(NSUInteger)perPage forEngineKey:(NSString *)engineKey;
+- (void)_performOnMainThread:(dispatch_block_t)block;
+- (void)_engineRequestDidEnd:(STAPIRequest *)engineRequest client:(STAPIClient *)client result:(NSDictionary *)result error:(NSError *)error;
+- (void)_deadlinePassed:(NSTimer *)timer;
+- (void)_finishQuery:(STFederatedQuery *)federatedQuery;
+- (NSDictionary *)_mergedResultForQuery:(STFederatedQuery *)federatedQuery;
+
+@end
+
+@implementation STFederatedAPIClient
+
+#pragma mark - NSObject
+
+- (void)dealloc {
+    for (STAPIClient *engineClient in _engineClients) {
+        engineClient.delegate = nil;
+    }
+}
+
+#pragma mark - STAPIClient
+
+- (id)initWithApiKey:(NSString *)engineKey {
+    return [self initWithEngineKeys:(engineKey ? @[ engineKey ] : @[])];
+}
+
+- (void)setFetchFields:(NSDictionary *)fetchFields {
+    [super setFetchFields:fetchFields];
+    for (STAPIClient *engineClient in self.engineClients) {
+        engineClient.fetchFields = fetchFields;
+    }
+}
+
+- (void)setDelegateQueue:(NSOperationQueue *)delegateQueue {
+    [super setDelegateQueue:delegateQueue];
+    for (STAPIClient *engineClient in self.engineClients) {
+        engineClient.delegateQueue = delegateQueue;
+    }
+}
+
+- (void)setRequestPolicy:(STAPIRequestPolicy)requestPolicy {
+    [super setRequestPolicy:requestPolicy];
+    for (STAPIClient *engineClient in self.engineClients) {
+        engineClient.requestPolicy = requestPolicy;
+    }
+}
+
+- (void)setSuggestTimeout:(NSTimeInterval)suggestTimeout {
+    [super setSuggestTimeout:suggestTimeout];
+    for (STAPIClient *engineClient in self.engineClients) {
+        engineClient.suggestTimeout = suggestTimeout;
+    }
+}
+
+- (void)setSearchTimeout:(NSTimeInterval)searchTimeout {
+    [super setSearchTimeout:searchTimeout];
+    for (STAPIClient *engineClient in self.engineClients) {
+        engineClient.searchTimeout = searchTimeout;
+    }
+}
+
+- (void)setCachePolicy:(STAPICachePolicy)cachePolicy {
+    [super setCachePolicy:cachePolicy];
+    for (STAPIClient *engineClient in self.engineClients) {
+        engineClient.cachePolicy = cachePolicy;
+    }
+}
+
+- (void)setPersistentResultMaxAge:(NSTimeInterval)persistentResultMaxAge {
+    [super setPersistentResultMaxAge:persistentResultMaxAge];
+    for (STAPIClient *engineClient in self.engineClients) {
+        engineClient.persistentResultMaxAge = persistentResultMaxAge;
+    }
+}
+
+- (NSTimeInterval)roundTripTime {
+    // A federated query takes as long as its slowest engine
+    NSTimeInterval roundTripTime = 0.0;
+    for (STAPIClient *engineClient in self.engineClients) {
+        roundTripTime = MAX(roundTripTime, engineClient.roundTripTime);
+    }
+    return roundTripTime;
+}
+
+- (NSArray *)pendingRequests {
+    return [self.queries valueForKey:@"request"];
+}
+
+- (STAPIRequest *)searchQuery:(NSString *)query documentTypes:(NSArray *)documentTypes page:(NSUInteger)page perPage:(NSUInteger)perPage {
+    return [self _fanOutQuery:query type:STSearchTypeSearch documentTypes:documentTypes page:page perPage:perPage];
+}
+
+- (STAPIRequest *)suggestQuery:(NSString *)query page:(NSUInteger)page perPage:(NSUInteger)perPage {
+    return [self _fanOutQuery:query type:STSearchTypeSuggest documentTypes:nil page:page perPage:perPage];
+}
+
+- (BOOL)canAnswerSuggestQueryLocally:(NSString *)query {
+    for (STAPIClient *engineClient in self.engineClients) {
+        if (![engineClient canAnswerSuggestQueryLocally:query]) {
+            return NO;
+        }
+    }
+    return self.engineClients.count > 0;
+}
+
+- (void)warmUp {
+    for (STAPIClient *engineClient in self.engineClients) {
+        [engineClient warmUp];
+    }
+}
+
+- (void)prefetchQueries:(NSArray *)queries type:(STSearchType)type {
+    for (STAPIClient *engineClient in self.engineClients) {
+        [engineClient prefetchQueries:queries type:type];
+    }
+}
+
+- (void)cancelQuery {
+    for (STFederatedQuery *federatedQuery in [self.queries copy]) {
+        [self cancelRequest:federatedQuery.request];
+    }
+}
+
+- (void)cancelRequest:(STAPIRequest *)request {
+    if (request.client != self || request.finished) {
+        return;
+    }
+
+    STFederatedQuery *federatedQuery = [self _queryForRequest:request];
+    federatedQuery.delivered = YES;
+    [federatedQuery.deadlineTimer invalidate];
+    federatedQuery.deadlineTimer = nil;
+    [self.queries removeObject:federatedQuery];
+
+    request.cancelled = YES;
+    request.finished = YES;
+    for (id engineRequest in federatedQuery.engineRequests) {
+        if (engineRequest != [NSNull null]) {
+            [engineRequest cancel];
+        }
+    }
+    [self _delegateDidCancelRequest:request];
+}
+
+- (void)postClickAnalyticsForQuery:(NSString *)query withType:(STSearchType)type documentId:(NSString *)documentId {
+    if (documentId == nil) return;
+
+    // The click belongs to the engine that returned the document. Crediting any other engine would skew its
+    // analytics, so a click on a document no merge has seen is dropped
+    NSString *engineKey = [self.documentEngines objectForKey:documentId];
+    NSUInteger index = engineKey ? [self.engineKeys indexOfObject:engineKey] : NSNotFound;
+    if (index < self.engineClients.count) {
+        [[self.engineClients objectAtIndex:index] postClickAnalyticsForQuery:query withType:type documentId:documentId];
+    }
+}
+
+#pragma mark - STFederatedAPIClient
+
+- (id)initWithEngineKeys:(NSArray *)engineKeys {
+    self = [super initWithApiKey:nil];
+    if (self) {
+        self.engineKeys = engineKeys;
+        self.deadline = 1.5;
+        self.queries = [NSMutableArray array];
+        self.deliveredQueries = [NSMutableArray array];
+        self.documentEngines = [[NSCache alloc] init];
+        self.documentEngines.countLimit = 1000;
+
+        // Settings made later are passed on by the setters above
+        NSMutableArray *engineClients = [NSMutableArray arrayWithCapacity:engineKeys.count];
+        for (NSString *engineKey in engineKeys) {
+            STAPIClient *engineClient = [[STAPIClient alloc] initWithApiKey:engineKey];
+            engineClient.fetchFields = self.fetchFields;
+            engineClient.delegateQueue = self.delegateQueue;
+            engineClient.requestPolicy = self.requestPolicy;
+            engineClient.suggestTimeout = self.suggestTimeout;
+            engineClient.searchTimeout = self.searchTimeout;
+            engineClient.cachePolicy = self.cachePolicy;
+            engineClient.persistentResultMaxAge = self.persistentResultMaxAge;
+            engineClient.delegate = self;
+            [engineClients addObject:engineClient];
+        }
+        self.engineClients = engineClients;
+    }
+    return self;
+}
+
+#pragma mark - STAPIClientDelegate
+
+- (NSDictionary *)clientRequestParameters:(STAPIClient *)client forQuery:(NSString *)query withType:(STSearchType)type {
+    return [self.delegate clientRequestParameters:client forQuery:query withType:type];
+}
+
+- (void)client:(STAPIClient *)client didFinishRequest:(STAPIRequest *)request withResult:(NSDictionary *)result {
+    [self _performOnMainThread:^{
+        [self _engineRequestDidEnd:request client:client result:result error:nil];
+    }];
+}
+
+- (void)client:(STAPIClient *)client didFailRequest:(STAPIRequest *)request error:(NSError *)error {
+    [self _performOnMainThread:^{
+        [self _engineRequestDidEnd:request client:client result:nil error:error];
+    }];
+}
+
+- (void)client:(STAPIClient *)client didCancelRequest:(STAPIRequest *)request {
+    [self _performOnMainThread:^{
+        [self _engineRequestDidEnd:request client:client result:nil error:nil];
+    }];
+}
+
+- (void)client:(STAPIClient *)client didUpdateRequest:(STAPIRequest *)request withResult:(NSDictionary *)result {
+    [self _performOnMainThread:^{
+        STFederatedQuery *federatedQuery = [self _queryForEngineRequest:request];
+        NSString *engineKey = [self _engineKeyForClient:client];
+        if (federatedQuery == nil || federatedQuery.request.cancelled || engineKey == nil) return;
+
+        [federatedQuery.results setObject:result forKey:engineKey];
+        if (federatedQuery.delivered) {
+            [self _delegateDidUpdateRequest:federatedQuery.request withResult:[self _mergedResultForQuery:federatedQuery]];
+        }
+    }];
+}
+
+#pragma mark - Private
+
+- (STAPIRequest *)_fanOutQuery:(NSString *)query type:(STSearchType)type documentTypes:(NSArray *)documentTypes page:(NSUInteger)page perPage:(NSUInteger)perPage {
+    NSString *strippedString = [query stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
+    if (strippedString.length == 0) {
+        return nil;
+    }
+    if (self.requestPolicy == STAPIRequestPolicyLatestWins) {
+        [self cancelQuery];
+    }
+
+    STFederatedQuery *federatedQuery = [[STFederatedQuery alloc] init];
+    federatedQuery.request = [[STAPIRequest alloc] initWithClient:self query:query searchType:type page:page perPage:perPage];
+    federatedQuery.request.documentTypes = documentTypes;
+    federatedQuery.engineRequests = [NSMutableArray arrayWithCapacity:self.engineClients.count];
+    federatedQuery.results = [NSMutableDictionary dictionaryWithCapacity:self.engineClients.count];
+    [self.queries addObject:federatedQuery];
+    [self _delegateDidStartRequest:federatedQuery.request];
+
+    // Every engine client has its own connection slots, so all engines are asked at the same time
+    for (NSUInteger i = 0; i < self.engineClients.count; i++) {
+        STAPIClient *engineClient = [self.engineClients objectAtIndex:i];
+        NSUInteger enginePerPage = [self _perPage:perPage forEngineKey:[self.engineKeys objectAtIndex:i]];
+        STAPIRequest *engineRequest = nil;
+        if (enginePerPage > 0) {
+            engineRequest = (type == STSearchTypeSuggest) ?
+                [engineClient suggestQuery:query page:page perPage:enginePerPage] :
+                [engineClient searchQuery:query documentTypes:documentTypes page:page perPage:enginePerPage];
+        }
+        [federatedQuery.engineRequests addObject:(engineRequest ? engineRequest : [NSNull null])];
+        if (engineRequest == nil) {
+            federatedQuery.answeredCount++;
+        }
+    }
+
+    if (federatedQuery.answeredCount >= federatedQuery.engineRequests.count) {
+        [self _finishQuery:federatedQuery];
+    }
+    else {
+        federatedQuery.deadlineTimer = [NSTimer scheduledTimerWithTimeInterval:self.deadline
+                                                                        target:self
+                                                                      selector:@selector(_deadlinePassed:)
+                                                                      userInfo:federatedQuery
+                                                                       repeats:NO];
+    }
+    return federatedQuery.request;
+}
+
+- (STFederatedQuery *)_queryForRequest:(STAPIRequest *)request {
+    for (STFederatedQuery *federatedQuery in self.queries) {
+        if (federatedQuery.request == request) {
+            return federatedQuery;
+        }
+    }
+    return nil;
+}
+
+- (STFederatedQuery *)_queryForEngineRequest:(STAPIRequest *)engineRequest {
+    for (NSArray *queries in @[ self.queries, self.deliveredQueries ]) {
+        for (STFederatedQuery *federatedQuery in queries) {
+            if ([federatedQuery.engineRequests indexOfObjectIdenticalTo:engineRequest] != NSNotFound) {
+                return federatedQuery;
+            }
+        }
+    }
+    return nil;
+}
+
+- (NSString *)_engineKeyForClient:(STAPIClient *)client {
+    NSUInteger index = [self.engineClients indexOfObjectIdenticalTo:client];
+    return (index != NSNotFound) ? [self.engineKeys objectAtIndex:index] : nil;
+}
+
+- (NSUInteger)_perPage:(NSUInteger)perPage forEngineKey:(NSString *)engineKey {
+    // A quota is applied by asking for smaller pages, so page N of every engine continues where page N - 1 ended
+    NSNumber *quota = [self.engineQuotas objectForKey:engineKey];
+    return quota ? MIN([quota unsignedIntegerValue], perPage) : perPage;
+}
+
+- (void)_performOnMainThread:(dispatch_block_t)block {
+    // Engine clients with a delegate queue call back on it, the federated queries only live on the main thread
+    if ([NSThread isMainThread]) {
+        block();
+    }
+    else {
+        dispatch_async(dispatch_get_main_queue(), block);
+    }
+}
+
+- (void)_engineRequestDidEnd:(STAPIRequest *)engineRequest client:(STAPIClient *)client result:(NSDictionary *)result error:(NSError *)error {
+    STFederatedQuery *federatedQuery = [self _queryForEngineRequest:engineRequest];
+    NSString *engineKey = [self _engineKeyForClient:client];
+    // Stragglers canceled after delivery end up here as well
+    if (federatedQuery == nil || federatedQuery.delivered || engineKey == nil) return;
+
+    federatedQuery.answeredCount++;
+    if (result) {
+        [federatedQuery.results setObject:result forKey:engineKey];
+    }
+    if (error && federatedQuery.error == nil) {
+        federatedQuery.error = error;
+    }
+
+    BOOL everyEngineAnswered = federatedQuery.answeredCount >= federatedQuery.engineRequests.count;
+    if (everyEngineAnswered || (federatedQuery.deadlinePassed && federatedQuery.results.count > 0)) {
+        [self _finishQuery:federatedQuery];
+    }
+}
+
+- (void)_deadlinePassed:(NSTimer *)timer {
+    STFederatedQuery *federatedQuery = timer.userInfo;
+    federatedQuery.deadlineTimer = nil;
+    if (federatedQuery.delivered) return;
+
+    // Without any answer yet the first engine to answer is delivered instead
+    federatedQuery.deadlinePassed = YES;
+    if (federatedQuery.results.count > 0) {
+        [self _finishQuery:federatedQuery];
+    }
+}
+
+- (void)_finishQuery:(STFederatedQuery *)federatedQuery {
+    federatedQuery.delivered = YES;
+    [federatedQuery.deadlineTimer invalidate];
+    federatedQuery.deadlineTimer = nil;
+    [self.queries removeObject:federatedQuery];
+
+    for (id engineRequest in federatedQuery.engineRequests) {
+        if (engineRequest != [NSNull null] && ![engineRequest isFinished]) {
+            [engineRequest cancel];
+        }
+    }
+
+    STAPIRequest *request = federatedQuery.request;
+    request.finished = YES;
+    request.timeline.deliveredDate = [NSDate date];
+
+    if (federatedQuery.results.count == 0) {
+        if (federatedQuery.error) {
+            [self _delegateDidFailRequest:request error:federatedQuery.error];
+        }
+        else {
+            request.cancelled = YES;
+            [self _delegateDidCancelRequest:request];
+        }
+        return;
+    }
+
+    // Keep a few delivered queries around so revalidated engine results can still update them
+    [self.deliveredQueries addObject:federatedQuery];
+    if (self.deliveredQueries.count > 8) {
+        [self.deliveredQueries removeObjectAtIndex:0];
+    }
+    [self _delegateDidFinishRequest:request withResult:[self _mergedResultForQuery:federatedQuery]];
+}
+
+- (NSDictionary *)_mergedResultForQuery:(STFederatedQuery *)federatedQuery {
+    STAPIRequest *request = federatedQuery.request;
+
+    NSMutableOrderedSet *types = [NSMutableOrderedSet orderedSet];
+    for (NSString *engineKey in self.engineKeys) {
+        NSDictionary *records = [[federatedQuery.results objectForKey:engineKey] objectForKey:@"records"];
+        if ([records isKindOfClass:[NSDictionary class]]) {
+            [types addObjectsFromArray:[[records allKeys] sortedArrayUsingSelector:@selector(compare:)]];
+        }
+    }
+
+    NSMutableDictionary *mergedRecords = [NSMutableDictionary dictionaryWithCapacity:types.count];
+    NSMutableDictionary *mergedInfo = [NSMutableDictionary dictionaryWithCapacity:types.count];
+    NSUInteger recordCount = 0;
+
+    for (NSString *type in types) {
+        NSMutableArray *candidates = [NSMutableArray array];
+        NSUInteger totalResultCount = 0;
+        NSUInteger pageCount = 0;
+        NSUInteger perPage = 0;
+
+        for (NSString *engineKey in self.engineKeys) {
+            NSDictionary *result = [federatedQuery.results objectForKey:engineKey];
+            NSArray *typeRecords = [[result objectForKey:@"records"] objectForKey:type];
+            if (![typeRecords isKindOfClass:[NSArray class]]) continue;
+
+            // The merged page holds the whole page of every engine, so there is a next page as long as one engine has one
+            NSUInteger enginePerPage = [self _perPage:request.perPage forEngineKey:engineKey];
+            NSUInteger engineResultCount = [[[[result objectForKey:@"info"] objectForKey:type] objectForKey:@"total_result_count"] unsignedIntegerValue];
+            totalResultCount += engineResultCount;
+            perPage += enginePerPage;
+            if (enginePerPage > 0) {
+                pageCount = MAX(pageCount, (engineResultCount + enginePerPage - 1) / enginePerPage);
+            }
+
+            for (NSDictionary *record in typeRecords) {
+                if (![record isKindOfClass:[NSDictionary class]]) continue;
+
+                NSMutableDictionary *mergedRecord = [record mutableCopy];
+                [mergedRecord setObject:engineKey forKey:@"_engine"];
+                [candidates addObject:mergedRecord];
+
+                id documentId = [record objectForKey:@"id"];
+                if (documentId) {
+                    [self.documentEngines setObject:engineKey forKey:documentId];
+                }
+            }
+        }
+
+        // Stable, so equal scores keep the order of the engines and of their own ranking
+        [candidates sortWithOptions:NSSortStable usingComparator:^NSComparisonResult(NSDictionary *a, NSDictionary *b) {
+            id rankA = [a objectForKey:@"_score"];
+            id rankB = [b objectForKey:@"_score"];
+            double scoreA = [rankA isKindOfClass:[NSNumber class]] ? [rankA doubleValue] : 0.0;
+            double scoreB = [rankB isKindOfClass:[NSNumber class]] ? [rankB doubleValue] : 0.0;
+            return (scoreA > scoreB) ? NSOrderedAscending : (scoreA < scoreB) ? NSOrderedDescending : NSOrderedSame;
+        }];
+
+        [mergedRecords setObject:candidates forKey:type];
+        [mergedInfo setObject:@{
+            @"query" : request.query,
+            @"current_page" : @(request.page),
+            @"num_pages" : @(pageCount),
+            @"per_page" : @(perPage),
+            @"total_result_count" : @(totalResultCount)
+        } forKey:type];
+        recordCount += candidates.count;
+    }
+
+    return @{ @"records" : mergedRecords, @"info" : mergedInfo, @"record_count" : @(recordCount) };
+}
+
+@end
@@ -7,6 +7,7 @@
 //
 
 #import "STPageDocumentTypeResultsObject.h"
+#import "STSearchResultsObject+Private.h"
 #import "UI/STWebViewController.h"
 
 @interface STPageDocumentTypeResultsObject ()
@@ -35,6 +36,14 @@
     return @[ @"page" ];
 }
 
+- (NSArray *)renderedFieldsForDocumentType:(NSString *)documentType {
+    return [self _titleAndURLFields];
+}
+
+- (NSArray *)searchedFieldsForDocumentType:(NSString *)documentType {
+    return @[ @"title" ];
+}
+
 - (NSString *)clientEngineKey {
     if (self.privateEngineKey) {
         return self.privateEngineKey;
@@ -62,15 +71,7 @@
         cell = [[UITableViewCell alloc] initWithStyle:UITableViewCellStyleSubtitle reuseIdentifier:CellIdentifier];
     }
     
-    NSDictionary *data = [self recordForType:@"page" atIndex:indexPath.row];
-    
-    if (self.searchType == STSearchTypeSearch) {
-        cell.textLabel.text = [data objectForKey:@"title"];
-        cell.detailTextLabel.text = [data objectForKey:@"url"];
-    }
-    else {
-        cell.textLabel.text = [data objectForKey:@"title"];
-    }
+    [self _configureCell:cell forRowAtIndexPath:indexPath];
     
     return cell;
 }
@@ -0,0 +1,27 @@
+//
+//  STPagedArray.h
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ Immutable array of the records of several pages, read from the pages without copying them.
+
+ Creating the array takes time proportional to the number of pages and looking up an object time logarithmic
+ in it. The pages must not change afterwards, which the immutable arrays pages are usually kept in guarantee.
+ Copying the array returns the same instance.
+ */
+@interface STPagedArray : NSArray
+
+/**
+ Creates an array of the objects of its pages in order.
+
+ @param pages Arrays of objects, may contain empty arrays
+ */
+- (id)initWithPages:(NSArray *)pages;
+
+@end
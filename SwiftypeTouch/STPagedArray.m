@@ -0,0 +1,71 @@
+//
+//  STPagedArray.m
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import "STPagedArray.h"
+
+@interface STPagedArray ()
+
+@property (nonatomic, copy) NSArray *pages;
+@property (nonatomic, strong) NSData *startData;
+@property (nonatomic, assign) NSUInteger objectCount;
+
+@end
+
+@implementation STPagedArray
+
+#pragma mark - NSObject
+
+- (id)copyWithZone:(NSZone *)zone {
+    return self;
+}
+
+#pragma mark - NSArray
+
+- (NSUInteger)count {
+    return self.objectCount;
+}
+
+- (id)objectAtIndex:(NSUInteger)index {
+    if (index >= self.objectCount) {
+        [NSException raise:NSRangeException format:@"Index %lu beyond bounds of %lu objects", (unsigned long)index, (unsigned long)self.objectCount];
+    }
+
+    // The last page starting at or before the index holds it, an empty page starts where the next one does
+    const NSUInteger *starts = self.startData.bytes;
+    NSUInteger low = 0;
+    NSUInteger high = self.pages.count - 1;
+    while (low < high) {
+        NSUInteger middle = (low + high + 1) / 2;
+        if (starts[middle] <= index) {
+            low = middle;
+        }
+        else {
+            high = middle - 1;
+        }
+    }
+    return [[self.pages objectAtIndex:low] objectAtIndex:index - starts[low]];
+}
+
+#pragma mark - STPagedArray
+
+- (id)initWithPages:(NSArray *)pages {
+    self = [super init];
+    if (self) {
+        self.pages = pages;
+        NSMutableData *startData = [NSMutableData dataWithLength:(pages.count + 1) * sizeof(NSUInteger)];
+        NSUInteger *starts = startData.mutableBytes;
+        for (NSUInteger page = 0; page < pages.count; page++) {
+            starts[page + 1] = starts[page] + [[pages objectAtIndex:page] count];
+        }
+        self.startData = startData;
+        self.objectCount = starts[pages.count];
+    }
+    return self;
+}
+
+@end
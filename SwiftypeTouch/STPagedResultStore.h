@@ -0,0 +1,228 @@
+//
+//  STPagedResultStore.h
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class STAPIRequest;
+
+/**
+ Accumulates the records of consecutive result pages of a single query.
+
+ Each appended page is kept as an immutable chunk per document type, and its records are also added to
+ a flat index so any record can be looked up by position in constant time. Appending a page costs time
+ proportional to the page, not to the records stored so far. Records whose `id` was already seen on an
+ earlier page are skipped, so results that shift between page requests don't show up twice.
+
+ Every document type counts its own pages, the pages that contained records of it in the order they were
+ appended. A page restricted to some document types, or a type first seen on a later page, leaves the pages
+ of the other types alone.
+
+ `appendResult:` reports which indexes each page added, which is what `UITableView` needs to insert
+ rows instead of reloading everything.
+
+ With `windowed` set the store keeps full records only for the pages of a document type near the one in view,
+ see `moveWindowToIndex:forType:`. The records of pages further away are compacted down to their `id` and
+ `compactFields`, which is enough to display them, while their positions stay the same. A compacted page is
+ made whole again by fetching it once more and passing the result to `expandWithResult:`.
+ */
+@interface STPagedResultStore : NSObject
+
+/**
+ The `info` section of every document type as of the most recent page that contained the type. Pages
+ of some document types only, as `-[STAPIClient searchQuery:documentTypes:page:perPage:]` returns them, leave the info
+ of the other types alone.
+ */
+@property (nonatomic, readonly, strong) NSDictionary *info;
+
+/**
+ Number of pages appended since the store was created or last emptied
+ */
+@property (nonatomic, readonly) NSUInteger pageCount;
+
+/**
+ Number of records skipped because their `id` was already stored
+ */
+@property (nonatomic, readonly) NSUInteger duplicateCount;
+
+/**
+ The stored records keyed by document type, as immutable arrays read from the stored pages. Records that are
+ already stored never move. Appending, compacting or expanding a page makes the store return a new dictionary,
+ the arrays handed out before keep the records they had. Suitable as the `records` section of a result.
+ */
+@property (nonatomic, readonly, strong) NSDictionary *records;
+
+/**
+ The stored records page by page keyed by document type, each an array of the arrays `recordsForType:inPage:`
+ returns. Compacting or expanding a page replaces its array, so a page that is the same array as before holds
+ the same records. Suitable as the `pages` of `+[STResultSnapshot snapshotOfResult:pages:sectionOrder:displayFields:reusingSnapshot:]`.
+ */
+@property (nonatomic, readonly, strong) NSDictionary *pages;
+
+/**
+ Whether the records of pages outside the window are compacted. Turning it off doesn't expand pages that are
+ already compacted.
+
+ The default value is `NO`.
+ */
+@property (nonatomic, assign, getter = isWindowed) BOOL windowed;
+
+/**
+ Number of pages on either side of the page in view whose records are kept in full. `shrinkWindow` narrows the
+ window for a while, it grows back to this radius as the window moves.
+
+ The default value is 2.
+ */
+@property (nonatomic, assign) NSUInteger windowRadius;
+
+/**
+ Arrays of the field names kept by compacted records, keyed by document type. The `id` is always kept.
+ Pages of a document type without an entry are always kept in full.
+ */
+@property (nonatomic, copy) NSDictionary *compactFields;
+
+/**
+ Appends the records of a result page.
+
+ @param result Decoded result as returned by `STAPIClient`
+
+ @return Ranges of the indexes that were added, as `NSValue` objects keyed by document type
+ */
+- (NSDictionary *)appendResult:(NSDictionary *)result;
+
+/**
+ Appends the records of a result page and remembers how it was requested, so that a compacted page can be
+ requested again with the same parameters and be answered from the client's cache.
+
+ @param result Decoded result as returned by `STAPIClient`
+ @param request The request that returned the result, may be nil
+
+ @return Ranges of the indexes that were added, as `NSValue` objects keyed by document type
+ */
+- (NSDictionary *)appendResult:(NSDictionary *)result ofRequest:(STAPIRequest *)request;
+
+/**
+ Number of records stored for a document type
+
+ @param type Document type
+ */
+- (NSUInteger)countForType:(NSString *)type;
+
+/**
+ Looks up a record by position.
+
+ @param type Document type
+ @param index Position among all stored records of the type
+
+ @return The record or nil if the index is out of bounds
+ */
+- (id)recordForType:(NSString *)type atIndex:(NSUInteger)index;
+
+/**
+ Number of pages stored for a document type
+
+ @param type Document type
+ */
+- (NSUInteger)numberOfPagesForType:(NSString *)type;
+
+/**
+ The records a single page contributed for a document type, after duplicates were removed.
+
+ @param type Document type
+ @param page Index of the page among the pages of the type, starting at 0
+
+ @return Immutable array of records, empty if the page or type is unknown
+ */
+- (NSArray *)recordsForType:(NSString *)type inPage:(NSUInteger)page;
+
+/**
+ The page a stored record was appended with. Takes time logarithmic in the number of pages of the type.
+
+ @param index Position among all stored records of the type
+ @param type Document type
+
+ @return Index of the page among the pages of the type, `NSNotFound` if the index is out of bounds
+ */
+- (NSUInteger)pageOfIndex:(NSUInteger)index forType:(NSString *)type;
+
+/**
+ The `current_page` the document type had in the result a page was appended from, which is the page to
+ request to get its records again.
+
+ @param page Index of the page among the pages of the type
+ @param type Document type
+
+ @return The page number or 0 if the result did not name one
+ */
+- (NSInteger)resultPageOfPage:(NSUInteger)page forType:(NSString *)type;
+
+/**
+ The document types of the request a page was appended from, see `appendResult:ofRequest:`.
+
+ @param page Index of the page among the pages of the type
+ @param type Document type
+
+ @return The document types, nil if the request asked for every type or isn't known
+ */
+- (NSArray *)documentTypesRequestedForPage:(NSUInteger)page forType:(NSString *)type;
+
+/**
+ The number of records per page of the request a page was appended from, see `appendResult:ofRequest:`.
+
+ @param page Index of the page among the pages of the type
+ @param type Document type
+
+ @return The number of records per page or 0 if the request isn't known
+ */
+- (NSUInteger)perPageRequestedForPage:(NSUInteger)page forType:(NSString *)type;
+
+/**
+ Whether the records a page contributed for a document type are compacted.
+
+ @param page Index of the page among the pages of the type
+ @param type Document type
+ */
+- (BOOL)isPageCompacted:(NSUInteger)page forType:(NSString *)type;
+
+/**
+ Centers the window of a document type on the page of a record, compacting the pages that fall outside of
+ it. Pages whose result page is unknown are never compacted since they can't be fetched again. Does nothing
+ unless `windowed` is set.
+
+ @param index Position of the record in view among all stored records of the type
+ @param type Document type
+
+ @return `YES` if any page was compacted
+ */
+- (BOOL)moveWindowToIndex:(NSUInteger)index forType:(NSString *)type;
+
+/**
+ Halves the radius of the windows, down to 1, and compacts the pages that fall outside the smaller windows.
+ Every later move of a window to another page grows the radius by one page until it is back to `windowRadius`.
+ Meant for memory warnings. Does nothing unless `windowed` is set.
+
+ @return `YES` if any page was compacted
+ */
+- (BOOL)shrinkWindow;
+
+/**
+ Puts the full records of a result page back in place of the compacted records of the page it was appended
+ with. Records are matched by `id`, compacted records the result no longer contains stay compacted. Pages
+ that are outside the window by now are left alone.
+
+ @param result Decoded result of the page as returned by `STAPIClient`
+
+ @return Ranges of the indexes that were expanded, as `NSValue` objects keyed by document type
+ */
+- (NSDictionary *)expandWithResult:(NSDictionary *)result;
+
+/**
+ Empties the store, for example when a new query starts
+ */
+- (void)removeAllRecords;
+
+@end
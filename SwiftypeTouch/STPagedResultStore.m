@@ -0,0 +1,442 @@
+//
+//  STPagedResultStore.m
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import "STPagedResultStore.h"
+#import "STPagedArray.h"
+#import "STAPIRequest.h"
+
+/*
+ Everything stored for one document type. Its pages are those that contained the type, counted on their own
+ */
+@interface STPagedResultTypeRecords : NSObject
+
+@property (nonatomic, strong) NSMutableArray *records;
+@property (nonatomic, strong) NSMutableArray *pages;
+@property (nonatomic, strong) NSMutableData *pageStarts;
+@property (nonatomic, strong) NSMutableSet *seenIds;
+@property (nonatomic, strong) NSMutableArray *resultPages;
+@property (nonatomic, strong) NSMutableArray *requestedDocumentTypes;
+@property (nonatomic, strong) NSMutableArray *requestedPerPages;
+@property (nonatomic, strong) NSMutableIndexSet *compactedPages;
+@property (nonatomic, strong) NSMutableIndexSet *compactablePages;
+@property (nonatomic, strong) NSNumber *focusPage;
+
+- (void)addPage:(NSArray *)records;
+- (NSUInteger)pageOfIndex:(NSUInteger)index;
+- (NSRange)rangeOfPage:(NSUInteger)page;
+
+@end
+
+@implementation STPagedResultTypeRecords
+
+- (id)init {
+    self = [super init];
+    if (self) {
+        self.records = [NSMutableArray array];
+        self.pages = [NSMutableArray array];
+        self.pageStarts = [NSMutableData dataWithLength:sizeof(NSUInteger)];
+        self.seenIds = [NSMutableSet set];
+        self.resultPages = [NSMutableArray array];
+        self.requestedDocumentTypes = [NSMutableArray array];
+        self.requestedPerPages = [NSMutableArray array];
+        self.compactedPages = [NSMutableIndexSet indexSet];
+        self.compactablePages = [NSMutableIndexSet indexSet];
+    }
+    return self;
+}
+
+- (void)addPage:(NSArray *)records {
+    // Every page also records where the next one starts, so positions are found without adding up the pages
+    NSUInteger end = ((const NSUInteger *)self.pageStarts.bytes)[self.pages.count] + records.count;
+    [self.pages addObject:records];
+    [self.records addObjectsFromArray:records];
+    [self.pageStarts appendBytes:&end length:sizeof(end)];
+}
+
+- (NSUInteger)pageOfIndex:(NSUInteger)index {
+    const NSUInteger *starts = self.pageStarts.bytes;
+    if (index >= starts[self.pages.count]) {
+        return NSNotFound;
+    }
+
+    // The last page starting at or before the index holds it, an empty page starts where the next one does
+    NSUInteger low = 0;
+    NSUInteger high = self.pages.count - 1;
+    while (low < high) {
+        NSUInteger middle = (low + high + 1) / 2;
+        if (starts[middle] <= index) {
+            low = middle;
+        }
+        else {
+            high = middle - 1;
+        }
+    }
+    return low;
+}
+
+- (NSRange)rangeOfPage:(NSUInteger)page {
+    const NSUInteger *starts = self.pageStarts.bytes;
+    if (page >= self.pages.count) {
+        return NSMakeRange(starts[self.pages.count], 0);
+    }
+    return NSMakeRange(starts[page], starts[page + 1] - starts[page]);
+}
+
+@end
+
+@interface STPagedResultStore ()
+
+@property (nonatomic, strong) NSDictionary *info;
+@property (nonatomic, assign) NSUInteger pageCount;
+@property (nonatomic, assign) NSUInteger duplicateCount;
+@property (nonatomic, strong) NSMutableDictionary *typeRecords;
+@property (nonatomic, strong) NSDictionary *recordsView;
+@property (nonatomic, assign) NSUInteger activeWindowRadius;
+
+- (NSInteger)_resultPageOfType:(NSString *)type inResult:(NSDictionary *)result;
+- (BOOL)_page:(NSUInteger)page isInWindowOfTypeRecords:(STPagedResultTypeRecords *)typeRecords;
+- (BOOL)_compactPagesOutsideWindowOfType:(NSString *)type;
+- (void)_replacePage:(NSUInteger)page ofTypeRecords:(STPagedResultTypeRecords *)typeRecords withRecords:(NSArray *)records;
+- (NSArray *)_compactRecords:(NSArray *)records ofType:(NSString *)type;
+
+@end
+
+@implementation STPagedResultStore
+
+#pragma mark - NSObject
+
+- (id)init {
+    self = [super init];
+    if (self) {
+        self.typeRecords = [NSMutableDictionary dictionary];
+        self.windowRadius = 2;
+    }
+    return self;
+}
+
+#pragma mark - STPagedResultStore
+
+- (NSDictionary *)records {
+    // Views of the pages as they are now, compacting or expanding a page later replaces it without touching them
+    if (self.recordsView == nil) {
+        NSMutableDictionary *records = [NSMutableDictionary dictionaryWithCapacity:self.typeRecords.count];
+        for (NSString *type in self.typeRecords) {
+            [records setObject:[[STPagedArray alloc] initWithPages:[[self.typeRecords objectForKey:type] pages]] forKey:type];
+        }
+        self.recordsView = records;
+    }
+    return self.recordsView;
+}
+
+- (NSDictionary *)pages {
+    NSMutableDictionary *pages = [NSMutableDictionary dictionaryWithCapacity:self.typeRecords.count];
+    for (NSString *type in self.typeRecords) {
+        [pages setObject:[[[self.typeRecords objectForKey:type] pages] copy] forKey:type];
+    }
+    return pages;
+}
+
+- (void)setWindowRadius:(NSUInteger)windowRadius {
+    _windowRadius = windowRadius;
+    self.activeWindowRadius = windowRadius;
+}
+
+- (NSDictionary *)appendResult:(NSDictionary *)result {
+    return [self appendResult:result ofRequest:nil];
+}
+
+- (NSDictionary *)appendResult:(NSDictionary *)result ofRequest:(STAPIRequest *)request {
+    NSDictionary *resultRecords = [result objectForKey:@"records"];
+    if (![resultRecords isKindOfClass:[NSDictionary class]]) {
+        return @{};
+    }
+
+    NSMutableDictionary *addedRanges = [NSMutableDictionary dictionaryWithCapacity:resultRecords.count];
+    for (NSString *type in resultRecords) {
+        NSArray *pageRecords = [resultRecords objectForKey:type];
+        if (![pageRecords isKindOfClass:[NSArray class]]) {
+            continue;
+        }
+
+        STPagedResultTypeRecords *typeRecords = [self.typeRecords objectForKey:type];
+        if (typeRecords == nil) {
+            typeRecords = [[STPagedResultTypeRecords alloc] init];
+            [self.typeRecords setObject:typeRecords forKey:type];
+        }
+
+        NSMutableArray *chunk = [NSMutableArray arrayWithCapacity:pageRecords.count];
+        for (id record in pageRecords) {
+            id recordId = [record isKindOfClass:[NSDictionary class]] ? [record objectForKey:@"id"] : nil;
+            if (recordId) {
+                if ([typeRecords.seenIds containsObject:recordId]) {
+                    self.duplicateCount++;
+                    continue;
+                }
+                [typeRecords.seenIds addObject:recordId];
+            }
+            [chunk addObject:record];
+        }
+
+        // Only the pages that contained the type are its pages, a type first seen on a later page starts at 0
+        NSInteger resultPage = [self _resultPageOfType:type inResult:result];
+        NSRange range = NSMakeRange(typeRecords.records.count, chunk.count);
+        // Pages whose result page is unknown can't be fetched again, so they are never compacted
+        if (chunk.count > 0 && resultPage > 0) {
+            [typeRecords.compactablePages addIndex:typeRecords.pages.count];
+        }
+        [typeRecords addPage:[chunk copy]];
+        [typeRecords.resultPages addObject:@(resultPage)];
+        [typeRecords.requestedDocumentTypes addObject:request.documentTypes ? request.documentTypes : [NSNull null]];
+        [typeRecords.requestedPerPages addObject:@(request.perPage)];
+        [addedRanges setObject:[NSValue valueWithRange:range] forKey:type];
+    }
+
+    // A page restricted to some document types leaves the info of the other types as it was
+    NSDictionary *info = [result objectForKey:@"info"];
+    if ([info isKindOfClass:[NSDictionary class]]) {
+        NSMutableDictionary *mergedInfo = [NSMutableDictionary dictionaryWithDictionary:self.info];
+        [mergedInfo addEntriesFromDictionary:info];
+        self.info = mergedInfo;
+    }
+    self.pageCount++;
+    self.recordsView = nil;
+
+    return addedRanges;
+}
+
+- (NSUInteger)countForType:(NSString *)type {
+    return [[[self.typeRecords objectForKey:type] records] count];
+}
+
+- (id)recordForType:(NSString *)type atIndex:(NSUInteger)index {
+    NSArray *records = [[self.typeRecords objectForKey:type] records];
+    if (index < records.count) {
+        return [records objectAtIndex:index];
+    }
+    return nil;
+}
+
+- (NSUInteger)numberOfPagesForType:(NSString *)type {
+    return [[[self.typeRecords objectForKey:type] pages] count];
+}
+
+- (NSArray *)recordsForType:(NSString *)type inPage:(NSUInteger)page {
+    NSArray *pages = [[self.typeRecords objectForKey:type] pages];
+    if (page < pages.count) {
+        return [pages objectAtIndex:page];
+    }
+    return @[];
+}
+
+- (NSUInteger)pageOfIndex:(NSUInteger)index forType:(NSString *)type {
+    STPagedResultTypeRecords *typeRecords = [self.typeRecords objectForKey:type];
+    return typeRecords ? [typeRecords pageOfIndex:index] : NSNotFound;
+}
+
+- (NSInteger)resultPageOfPage:(NSUInteger)page forType:(NSString *)type {
+    NSArray *resultPages = [[self.typeRecords objectForKey:type] resultPages];
+    if (page < resultPages.count) {
+        return [[resultPages objectAtIndex:page] integerValue];
+    }
+    return 0;
+}
+
+- (NSArray *)documentTypesRequestedForPage:(NSUInteger)page forType:(NSString *)type {
+    NSArray *requestedDocumentTypes = [[self.typeRecords objectForKey:type] requestedDocumentTypes];
+    if (page < requestedDocumentTypes.count && [requestedDocumentTypes objectAtIndex:page] != [NSNull null]) {
+        return [requestedDocumentTypes objectAtIndex:page];
+    }
+    return nil;
+}
+
+- (NSUInteger)perPageRequestedForPage:(NSUInteger)page forType:(NSString *)type {
+    NSArray *requestedPerPages = [[self.typeRecords objectForKey:type] requestedPerPages];
+    if (page < requestedPerPages.count) {
+        return [[requestedPerPages objectAtIndex:page] unsignedIntegerValue];
+    }
+    return 0;
+}
+
+- (BOOL)isPageCompacted:(NSUInteger)page forType:(NSString *)type {
+    return [[[self.typeRecords objectForKey:type] compactedPages] containsIndex:page];
+}
+
+- (BOOL)moveWindowToIndex:(NSUInteger)index forType:(NSString *)type {
+    if (!self.windowed) {
+        return NO;
+    }
+
+    STPagedResultTypeRecords *typeRecords = [self.typeRecords objectForKey:type];
+    NSUInteger page = [self pageOfIndex:index forType:type];
+    if (page == NSNotFound) {
+        return NO;
+    }
+    // A window shrunk by a memory warning grows back a page at a time as the user moves on
+    if (![typeRecords.focusPage isEqualToNumber:@(page)] && self.activeWindowRadius < self.windowRadius) {
+        self.activeWindowRadius++;
+    }
+    typeRecords.focusPage = @(page);
+    return [self _compactPagesOutsideWindowOfType:type];
+}
+
+- (BOOL)shrinkWindow {
+    if (!self.windowed) {
+        return NO;
+    }
+
+    self.activeWindowRadius = MIN(MAX(self.activeWindowRadius / 2, 1), self.windowRadius);
+    BOOL compacted = NO;
+    for (NSString *type in self.typeRecords) {
+        if ([self _compactPagesOutsideWindowOfType:type]) {
+            compacted = YES;
+        }
+    }
+    return compacted;
+}
+
+- (NSDictionary *)expandWithResult:(NSDictionary *)result {
+    NSDictionary *resultRecords = [result objectForKey:@"records"];
+    if (![resultRecords isKindOfClass:[NSDictionary class]]) {
+        return @{};
+    }
+
+    NSMutableDictionary *expandedRanges = [NSMutableDictionary dictionary];
+    for (NSString *type in resultRecords) {
+        NSArray *pageRecords = [resultRecords objectForKey:type];
+        STPagedResultTypeRecords *typeRecords = [self.typeRecords objectForKey:type];
+        NSInteger resultPage = [self _resultPageOfType:type inResult:result];
+        NSUInteger page = [typeRecords.resultPages indexOfObject:@(resultPage)];
+        if (![pageRecords isKindOfClass:[NSArray class]] || typeRecords == nil || resultPage <= 0 || page == NSNotFound ||
+            ![typeRecords.compactedPages containsIndex:page] || ![self _page:page isInWindowOfTypeRecords:typeRecords]) {
+            continue;
+        }
+
+        NSMutableDictionary *fullRecords = [NSMutableDictionary dictionaryWithCapacity:pageRecords.count];
+        for (id record in pageRecords) {
+            id recordId = [record isKindOfClass:[NSDictionary class]] ? [record objectForKey:@"id"] : nil;
+            if (recordId) {
+                [fullRecords setObject:record forKey:recordId];
+            }
+        }
+
+        NSArray *compactedRecords = [typeRecords.pages objectAtIndex:page];
+        NSMutableArray *records = [NSMutableArray arrayWithCapacity:compactedRecords.count];
+        for (id record in compactedRecords) {
+            id recordId = [record isKindOfClass:[NSDictionary class]] ? [record objectForKey:@"id"] : nil;
+            id fullRecord = recordId ? [fullRecords objectForKey:recordId] : nil;
+            [records addObject:fullRecord ? fullRecord : record];
+        }
+
+        [self _replacePage:page ofTypeRecords:typeRecords withRecords:records];
+        [typeRecords.compactedPages removeIndex:page];
+        [typeRecords.compactablePages addIndex:page];
+        [expandedRanges setObject:[NSValue valueWithRange:[typeRecords rangeOfPage:page]] forKey:type];
+    }
+    return expandedRanges;
+}
+
+- (void)removeAllRecords {
+    // Fresh containers, arrays handed out through records keep their contents
+    self.typeRecords = [NSMutableDictionary dictionary];
+    self.recordsView = nil;
+    self.activeWindowRadius = self.windowRadius;
+    self.info = nil;
+    self.pageCount = 0;
+    self.duplicateCount = 0;
+}
+
+#pragma mark - Private
+
+- (NSInteger)_resultPageOfType:(NSString *)type inResult:(NSDictionary *)result {
+    NSDictionary *info = [result objectForKey:@"info"];
+    if (![info isKindOfClass:[NSDictionary class]]) {
+        return 0;
+    }
+
+    NSDictionary *typeInfo = [info objectForKey:type];
+    if ([typeInfo isKindOfClass:[NSDictionary class]]) {
+        NSNumber *currentPage = [typeInfo objectForKey:@"current_page"];
+        if ([currentPage isKindOfClass:[NSNumber class]]) {
+            return [currentPage integerValue];
+        }
+    }
+    return 0;
+}
+
+- (BOOL)_page:(NSUInteger)page isInWindowOfTypeRecords:(STPagedResultTypeRecords *)typeRecords {
+    if (!self.windowed || typeRecords.focusPage == nil) {
+        return YES;
+    }
+
+    NSUInteger focus = [typeRecords.focusPage unsignedIntegerValue];
+    NSUInteger distance = (page > focus) ? page - focus : focus - page;
+    return distance <= self.activeWindowRadius;
+}
+
+- (BOOL)_compactPagesOutsideWindowOfType:(NSString *)type {
+    // Without the fields that are displayed, a compacted record would show up blank
+    if (![[self.compactFields objectForKey:type] isKindOfClass:[NSArray class]]) {
+        return NO;
+    }
+
+    STPagedResultTypeRecords *typeRecords = [self.typeRecords objectForKey:type];
+    if (typeRecords.focusPage == nil) {
+        return NO;
+    }
+
+    // Only the pages still kept in full are looked at, not every page stored
+    NSUInteger focus = [typeRecords.focusPage unsignedIntegerValue];
+    NSMutableIndexSet *pages = [typeRecords.compactablePages mutableCopy];
+    NSUInteger radius = self.activeWindowRadius;
+    NSUInteger windowStart = (focus > radius) ? focus - radius : 0;
+    NSUInteger windowEnd = (radius < NSNotFound - 1 - focus) ? focus + radius : NSNotFound - 1;
+    [pages removeIndexesInRange:NSMakeRange(windowStart, windowEnd - windowStart + 1)];
+    [pages enumerateIndexesUsingBlock:^(NSUInteger page, BOOL *stop) {
+        NSArray *chunk = [typeRecords.pages objectAtIndex:page];
+        [self _replacePage:page ofTypeRecords:typeRecords withRecords:[self _compactRecords:chunk ofType:type]];
+        [typeRecords.compactedPages addIndex:page];
+        [typeRecords.compactablePages removeIndex:page];
+    }];
+    return pages.count > 0;
+}
+
+- (void)_replacePage:(NSUInteger)page ofTypeRecords:(STPagedResultTypeRecords *)typeRecords withRecords:(NSArray *)records {
+    // Same number of records in the same places, only the dictionaries change
+    NSRange range = [typeRecords rangeOfPage:page];
+    [typeRecords.records replaceObjectsInRange:range withObjectsFromArray:records];
+    [typeRecords.pages replaceObjectAtIndex:page withObject:[records copy]];
+    self.recordsView = nil;
+}
+
+- (NSArray *)_compactRecords:(NSArray *)records ofType:(NSString *)type {
+    NSArray *fields = [self.compactFields objectForKey:type];
+
+    NSMutableArray *compactedRecords = [NSMutableArray arrayWithCapacity:records.count];
+    for (id record in records) {
+        if (![record isKindOfClass:[NSDictionary class]]) {
+            [compactedRecords addObject:record];
+            continue;
+        }
+
+        NSMutableDictionary *compactedRecord = [NSMutableDictionary dictionaryWithCapacity:fields.count + 1];
+        id recordId = [record objectForKey:@"id"];
+        if (recordId) {
+            [compactedRecord setObject:recordId forKey:@"id"];
+        }
+        for (NSString *field in fields) {
+            id value = [record objectForKey:field];
+            if (value) {
+                [compactedRecord setObject:value forKey:field];
+            }
+        }
+        [compactedRecords addObject:[compactedRecord copy]];
+    }
+    return compactedRecords;
+}
+
+@end
@@ -8,6 +8,8 @@
 
 #import "STSearchResultsObject.h"
 
+@class STPagedResultStore;
+
 /**
  The purpose of `STPagingSearchResultsObject` is to extend the functionality `STSearchResultsObject`
  to include the paging of results. Currently, "Load More" cells are only displayed on search queries
@@ -22,6 +24,18 @@
  the `delegate` or `dataSource` callbacks implemented by `STPagingSearchResultsObject` to
  preserver some of this functionality.
  
+ The `snapshot` of the stored records is built from the pages of `resultStore`. Pages that weren't appended,
+ compacted or expanded since the previous snapshot are taken over without looking at their records, so a
+ deep browsing session costs the same per page as the first page did.
+ 
+ Long browsing sessions can keep the memory in check by setting `resultStore` `windowed`. Only the pages near
+ the rows being displayed then keep their full records, the records of pages further away are compacted down to
+ their `id` and the fields of `renderedFieldsForDocumentType:`. Document types that declare no rendered fields
+ are never compacted, since their cells may show any field. A compacted page is requested again once one of
+ its rows is displayed with the parameters it was loaded with, usually from the client's cache, and its rows are
+ reloaded when the full records are back. A memory warning halves the window with `-[STPagedResultStore shrinkWindow]`
+ and drops a prefetched page.
+ 
  Here is a list of the delegate methods that `STPagingSearchResultObject` implements in addition to
  those implemented by `STSearchResultsObject`:
  
@@ -33,14 +47,57 @@
     * `tableView:didSelectRowAtIndexPath:` - If the selection was a "Load More" cell then it either switches
       to that section's scope. If it is already in a specific document scope then it requests more results
       from the server and reloads the table view when the new results are available.
+  * `searchResultsDelegate` for `UISearchDisplayController`
+    * `tableView:willDisplayCell:forRowAtIndexPath:` - moves the window of `resultStore` to the row and expands its page
+      if it was compacted. Then prefetches the next page once a row within `prefetchDistance` of the end of a section
+      that has more pages is shown, if `prefetchEnabled` is set.
   * `delegate` for `STAPIClient`
-    * `client:didFinishQuery:withResult:withType:` - merges the new record data in with the current record
-      data. Then makes a call to `super` `client:didFinishQuery:withResult:withType:` with the merged records
-      as the result.
+    * `client:didFinishRequest:withResult:` - appends the records of a following page to `resultStore` and
+      inserts only the new rows through `setSearchResultData:addedRecordRanges:`. A first page, or a result
+      of another query, replaces the stored records. A prefetched page is held and the page requested to expand a
+      compacted one is merged into `resultStore` instead, then `super` is called.
+    * `client:didCancelRequest:` and `client:didFailRequest:error:` - keep track of the prefetched page and of the
+      pages requested to expand compacted ones before calling `super`.
+    * `client:didUpdateQuery:withResult:withType:` - ignores revalidated results once more than one page has
+      been loaded, otherwise defers to `super`.
 
  */
 @interface STPagingSearchResultsObject : STSearchResultsObject
 
+/**
+ Holds the records of every page loaded for the current search query. The `records` of
+ `searchResultData` are the store's immutable `records`, replaced as pages are appended.
+ */
+@property (nonatomic, readonly, strong) STPagedResultStore *resultStore;
+
+/**
+ Whether the next page of search results is fetched in the background before the user asks for it.
+ The page is held until `loadNextSearchResultPage` is called, which then shows it without another
+ round trip. A held or pending page is dropped as soon as the query changes.
+ 
+ The next page is fetched once a row within `prefetchDistance` rows of the end of a section with more
+ pages is displayed, or right after the first page arrives if `STAPIClient` `roundTripTime` is below
+ `prefetchRoundTripThreshold`.
+ 
+ The default value is `NO`.
+ */
+@property (nonatomic, assign) BOOL prefetchEnabled;
+
+/**
+ Number of rows before the end of a section at which the next page is prefetched.
+ 
+ The default value is 5.
+ */
+@property (nonatomic, assign) NSUInteger prefetchDistance;
+
+/**
+ Round trip time in seconds below which the second page is prefetched as soon as the first one arrives.
+ Set to 0 to prefetch only while scrolling.
+ 
+ The default value is 0.3 seconds.
+ */
+@property (nonatomic, assign) NSTimeInterval prefetchRoundTripThreshold;
+
 /**
  Determines if the index path could be a load more cell. Which means the section has more pages and the 
  row is the last index.
@@ -54,6 +111,13 @@
 /**
  Requests that the server load the next page of search result data. If the previous `searchType` was a 
  `STSearchTypeSuggest` then this method is a no-op.
+ 
+ Every document type keeps its own page. While the table view shows a single section only the next page of
+ that section's document type is requested, the pages of the other types stay as they are. While several
+ sections are shown the types that are on the lowest page and have more pages are requested together.
+ 
+ A page that was already prefetched is shown on the next pass of the run loop instead, and a prefetch
+ still in flight is given high priority and shown once it arrives.
  */
 - (void)loadNextSearchResultPage;
 
@@ -7,14 +7,33 @@
 //
 
 #import "STPagingSearchResultsObject.h"
+#import "STSearchResultsObject+Private.h"
+#import "STPagedResultStore.h"
+#import "STResultSnapshot.h"
 
 @interface STPagingSearchResultsObject ()
 
-@property (nonatomic, assign) NSInteger currentPage;
+@property (nonatomic, strong) STPagedResultStore *resultStore;
+@property (nonatomic, strong) STAPIRequest *prefetchRequest;
+@property (nonatomic, strong) STAPIRequest *prefetchedRequest;
+@property (nonatomic, strong) NSDictionary *prefetchedResult;
+@property (nonatomic, strong) NSMutableArray *expandRequests;
+@property (nonatomic, assign) BOOL storeRefreshScheduled;
 
-- (NSInteger)_numberOfPagesInSection:(NSInteger)section;
-- (NSInteger)_pageOfResult:(NSDictionary *)result;
-- (BOOL)_resultTypes:(NSDictionary *)result matchCurrentTypes:(NSDictionary *)current;
+- (NSInteger)_pageOfResult:(NSDictionary *)result ofRequest:(STAPIRequest *)request;
+- (void)_applyResult:(NSDictionary *)result forPage:(NSInteger)page ofRequest:(STAPIRequest *)request;
+- (NSArray *)_documentTypesForNextPage:(NSUInteger *)page;
+- (BOOL)_result:(NSDictionary *)result isNextPage:(NSInteger)page;
+- (NSDictionary *)_storeFirstPage:(NSDictionary *)result ofRequest:(STAPIRequest *)request;
+- (NSDictionary *)_resultWithStoredRecords:(NSDictionary *)result;
+- (void)_prefetchNextPage;
+- (void)_cancelPrefetch;
+- (void)_moveWindowToIndexPath:(NSIndexPath *)indexPath;
+- (void)_expandPage:(NSUInteger)page forType:(NSString *)type;
+- (void)_cancelExpansions;
+- (void)_scheduleStoreRefresh;
+- (void)_refreshStoredRecords;
+- (void)_didReceiveMemoryWarning:(NSNotification *)notification;
 
 @end
 
@@ -23,11 +42,26 @@
 - (id)initWithViewController:(UIViewController *)controller {
     self = [super initWithViewController:controller];
     if (self) {
-        self.currentPage = 0;
+        self.resultStore = [[STPagedResultStore alloc] init];
+        self.prefetchEnabled = NO;
+        self.prefetchDistance = 5;
+        self.prefetchRoundTripThreshold = 0.3;
+        self.expandRequests = [NSMutableArray array];
+        // Compacted records keep what the cells show, types whose cells render undeclared fields aren't compacted
+        self.resultStore.compactFields = self.displayFields;
+        
+        [[NSNotificationCenter defaultCenter] addObserver:self
+                                                 selector:@selector(_didReceiveMemoryWarning:)
+                                                     name:UIApplicationDidReceiveMemoryWarningNotification
+                                                   object:nil];
     }
     return self;
 }
 
+- (void)dealloc {
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+}
+
 #pragma mark - STPagingSearchResultsObject
 
 - (BOOL)isIndexPathMoreCell:(NSIndexPath *)indexPath {
@@ -36,11 +70,50 @@
 }
 
 - (void)loadNextSearchResultPage {
-    if (self.searchType == STSearchTypeSearch) {
-        [self.client searchQuery:self.query page:self.currentPage + 1 perPage:20];
+    if (self.searchType != STSearchTypeSearch) {
+        return;
+    }
+    
+    NSUInteger page = 0;
+    NSArray *documentTypes = [self _documentTypesForNextPage:&page];
+    if (documentTypes.count == 0) {
+        return;
+    }
+    
+    // A page fetched ahead only helps if it is the page of the types that are shown now
+    BOOL prefetchedPageMatches = self.prefetchedRequest.page == page && [self.prefetchedRequest.documentTypes isEqualToArray:documentTypes];
+    BOOL prefetchRequestMatches = self.prefetchRequest.page == page && [self.prefetchRequest.documentTypes isEqualToArray:documentTypes];
+    if (self.prefetchedResult && prefetchedPageMatches) {
+        NSDictionary *result = self.prefetchedResult;
+        STAPIRequest *request = self.prefetchedRequest;
+        self.prefetchedResult = nil;
+        self.prefetchedRequest = nil;
+        // Delivered on the next run loop pass like any other result, callers expect the table to change later.
+        // The results may have changed by then, the page is checked like one that just arrived
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [self _applyResult:result forPage:[self _pageOfResult:result ofRequest:request] ofRequest:request];
+        });
+    }
+    else if (self.prefetchRequest && prefetchRequestMatches) {
+        // Already on its way, it becomes the search query and is shown as soon as it arrives
+        self.searchRequest = self.prefetchRequest;
+        self.searchRequest.priority = STAPIRequestPriorityHigh;
+        self.prefetchRequest = nil;
+    }
+    else {
+        [self _cancelPrefetch];
+        [self startSearchQuery:self.query documentTypes:documentTypes page:page perPage:20];
     }
 }
 
+- (STAPIRequest *)startSearchQuery:(NSString *)query documentTypes:(NSArray *)documentTypes page:(NSUInteger)page perPage:(NSUInteger)perPage {
+    if (page <= 1 || ![query isEqualToString:self.query]) {
+        [self _cancelPrefetch];
+        [self _cancelExpansions];
+    }
+    return [super startSearchQuery:query documentTypes:documentTypes page:page perPage:perPage];
+}
+
 - (BOOL)hasMorePagesInSection:(NSInteger)section {
     // Only do paging for "search" queries. Not enabled for other queries
     if (self.searchType != STSearchTypeSearch) {
@@ -48,23 +121,23 @@
     }
     
     // We need section names that can be paged on
-    if ([self recordSectionOrder].count == 0) {
+    STResultSnapshot *snapshot = self.snapshot;
+    if (snapshot.numberOfSections == 0) {
         return NO;
     }
     
-    UITableView *tableView = self.searchDisplayController.searchResultsTableView;
-    NSInteger rowsInSection = [super tableView:tableView numberOfRowsInSection:section];
+    NSUInteger snapshotSection = [self _snapshotSectionForSection:section];
     // Don't need a "more" button if the section has no content
-    if (rowsInSection == 0) {
+    if ([snapshot numberOfRecordsInSection:snapshotSection] == 0) {
         return NO;
     }
     
     // This section doesn't have any more pages current_page >= num_pages
-    NSInteger currentPage = [self _pageOfResult:self.searchResultData];
-    if (currentPage >= [self _numberOfPagesInSection:section]) {
+    if (![snapshot hasMorePagesInSection:snapshotSection]) {
         return NO;
     }
     
+    UITableView *tableView = self.searchDisplayController.searchResultsTableView;
     NSInteger numberOfSections = [super numberOfSectionsInTableView:tableView];
     
     // No sections no more button
@@ -88,91 +161,310 @@
 
 #pragma mark - Private
 
-- (NSInteger)_numberOfPagesInSection:(NSInteger)section {
-    NSDictionary *info = [self.searchResultData objectForKey:@"info"];
+- (NSInteger)_pageOfResult:(NSDictionary *)result ofRequest:(STAPIRequest *)request {
+    // The info of the types that were asked for, other types may be on pages of their own
+    NSDictionary *info = [result objectForKey:@"info"];
     if ([info isKindOfClass:[NSDictionary class]]) {
-        NSString *type = [self recordTypeForSection:section];
-        if (type) {
+        for (NSString *type in request.documentTypes) {
             NSDictionary *typeInfo = [info objectForKey:type];
             if ([typeInfo isKindOfClass:[NSDictionary class]]) {
-                NSNumber *numPages = [typeInfo objectForKey:@"num_pages"];
-                if ([numPages isKindOfClass:[NSNumber class]]) {
-                    return [numPages integerValue];
+                NSNumber *n = [typeInfo objectForKey:@"current_page"];
+                if ([n isKindOfClass:[NSNumber class]]) {
+                    return [n integerValue];
                 }
             }
         }
     }
-    return 0;
+    
+    // Every type was asked for the same page, or couldn't figure things out so just say it was the first page
+    return (request.page > 0) ? request.page : 1;
 }
 
-- (NSInteger)_pageOfResult:(NSDictionary *)result {
-    NSDictionary *info = [result objectForKey:@"info"];
-    if ([info isKindOfClass:[NSDictionary class]]) {
-        for (id key in info) {
-            NSDictionary *typeInfo = [info objectForKey:key];
-            if ([typeInfo isKindOfClass:[NSDictionary class]]) {
-                NSNumber *n = [typeInfo objectForKey:@"current_page"];
-                if ([n isKindOfClass:[NSNumber class]]) {
-                    return [n integerValue];
-                }
-            }
+- (NSArray *)_documentTypesForNextPage:(NSUInteger *)page {
+    STResultSnapshot *snapshot = self.snapshot;
+    NSArray *candidateTypes = snapshot.sectionOrder;
+    // With a single section on screen only its type is paged, the other types keep their pages
+    if ([super numberOfSectionsInTableView:self.searchDisplayController.searchResultsTableView] == 1) {
+        NSString *type = [self recordTypeForSection:0];
+        candidateTypes = type ? @[ type ] : @[];
+    }
+    
+    // Only the types furthest behind are asked, so a single request moves them forward together
+    NSMutableArray *documentTypes = [NSMutableArray array];
+    NSInteger lowestPage = NSIntegerMax;
+    for (NSString *type in candidateTypes) {
+        NSUInteger section = [snapshot sectionForType:type];
+        if (section == NSNotFound || ![snapshot hasMorePagesInSection:section]) {
+            continue;
+        }
+        
+        NSInteger currentPage = [snapshot currentPageInSection:section];
+        if (currentPage < lowestPage) {
+            lowestPage = currentPage;
+            [documentTypes removeAllObjects];
+        }
+        if (currentPage == lowestPage) {
+            [documentTypes addObject:type];
         }
     }
     
-    // couldn't figure things out so just say it was the first page
-    return 1;
+    if (page) {
+        *page = (documentTypes.count > 0) ? lowestPage + 1 : 0;
+    }
+    return documentTypes;
 }
 
-- (BOOL)_resultTypes:(NSDictionary *)result matchCurrentTypes:(NSDictionary *)current {
+- (BOOL)_result:(NSDictionary *)result isNextPage:(NSInteger)page {
     NSDictionary *resultRecords = [result objectForKey:@"records"];
-    NSDictionary *currentRecords = [current objectForKey:@"records"];
-    if ([resultRecords isKindOfClass:[NSDictionary class]] && [currentRecords isKindOfClass:[NSDictionary class]]) {
-        NSArray *resultSortedKeys = [[resultRecords allKeys] sortedArrayUsingSelector:@selector(compare:)];
-        NSArray *currentSortedKeys = [[currentRecords allKeys] sortedArrayUsingSelector:@selector(compare:)];
-        
-        return [resultSortedKeys isEqualToArray:currentSortedKeys];
+    NSDictionary *currentRecords = [self.searchResultData objectForKey:@"records"];
+    if (![resultRecords isKindOfClass:[NSDictionary class]] || ![currentRecords isKindOfClass:[NSDictionary class]] || resultRecords.count == 0) {
+        return NO;
     }
     
-    return NO;
+    // Every type of the page must already be shown and the page must follow the one the type is on
+    STResultSnapshot *snapshot = self.snapshot;
+    for (NSString *type in resultRecords) {
+        if ([currentRecords objectForKey:type] == nil) {
+            return NO;
+        }
+        NSUInteger section = [snapshot sectionForType:type];
+        if (section != NSNotFound && page <= [snapshot currentPageInSection:section]) {
+            return NO;
+        }
+    }
+    return YES;
 }
 
-- (NSDictionary *)_mergeResultRecords:(NSDictionary *)result withCurrentRecords:(NSDictionary *)current {
-    if ([self _resultTypes:result matchCurrentTypes:current]) {
-        NSMutableDictionary *d = [NSMutableDictionary dictionaryWithDictionary:current];
-        
-        NSDictionary *resultRecords = [result objectForKey:@"records"];
-        NSDictionary *dRecords = [d objectForKey:@"records"];
-        NSMutableDictionary *mergedRecords = [NSMutableDictionary dictionary];
-        for (id key in resultRecords) {
-            NSArray *resultData = [resultRecords objectForKey:key];
-            NSArray *dData = [dRecords objectForKey:key];
-            if ([resultData isKindOfClass:[NSArray class]] && [dData isKindOfClass:[NSArray class]]) {
-                NSArray *mergedArray = [dData arrayByAddingObjectsFromArray:resultData];
-                [mergedRecords setObject:mergedArray forKey:key];
-            }
+- (void)_prefetchNextPage {
+    if (!self.prefetchEnabled || self.searchType != STSearchTypeSearch || self.query.length == 0) {
+        return;
+    }
+    // One page ahead is enough, and a page the user asked for is already on its way
+    if (self.prefetchRequest || self.prefetchedResult || self.searchRequest) {
+        return;
+    }
+    
+    NSUInteger page = 0;
+    NSArray *documentTypes = [self _documentTypesForNextPage:&page];
+    if (documentTypes.count == 0) {
+        return;
+    }
+    
+    self.prefetchRequest = [self.client searchQuery:self.query documentTypes:documentTypes page:page perPage:20];
+    self.prefetchRequest.priority = STAPIRequestPriorityLow;
+}
+
+- (void)_cancelSearchRequests {
+    [self _cancelPrefetch];
+    [self _cancelExpansions];
+    [super _cancelSearchRequests];
+}
+
+- (void)_updateDisplayedTypes {
+    [super _updateDisplayedTypes];
+    // Pages compacted before keep the fields they were compacted with until they are expanded
+    self.resultStore.compactFields = self.displayFields;
+}
+
+- (void)_cancelPrefetch {
+    STAPIRequest *request = self.prefetchRequest;
+    self.prefetchRequest = nil;
+    self.prefetchedRequest = nil;
+    self.prefetchedResult = nil;
+    [request cancel];
+}
+
+- (void)_moveWindowToIndexPath:(NSIndexPath *)indexPath {
+    STPagedResultStore *store = self.resultStore;
+    NSString *type = [self recordTypeForSection:indexPath.section];
+    if (!store.windowed || self.searchType != STSearchTypeSearch || type == nil || indexPath.row >= (NSInteger)[store countForType:type]) {
+        return;
+    }
+    
+    // Pages scrolled away from shrink on the next pass of the run loop, the table is in the middle of a layout
+    if ([store moveWindowToIndex:indexPath.row forType:type]) {
+        [self _scheduleStoreRefresh];
+    }
+    
+    NSUInteger page = [store pageOfIndex:indexPath.row forType:type];
+    if ([store isPageCompacted:page forType:type]) {
+        [self _expandPage:page forType:type];
+    }
+}
+
+- (void)_expandPage:(NSUInteger)page forType:(NSString *)type {
+    STPagedResultStore *store = self.resultStore;
+    NSInteger resultPage = [store resultPageOfPage:page forType:type];
+    NSArray *documentTypes = [store documentTypesRequestedForPage:page forType:type];
+    NSUInteger perPage = [store perPageRequestedForPage:page forType:type];
+    for (STAPIRequest *request in self.expandRequests) {
+        if (request.page == resultPage && (request.documentTypes == documentTypes || [request.documentTypes isEqualToArray:documentTypes])) {
+            return;
         }
-        [d setObject:mergedRecords forKey:@"records"];
-        [d setObject:[result objectForKey:@"info"] forKey:@"info"];
-        
-        return d;
+    }
+    
+    // Asked for exactly as the page was loaded before, so the query cache usually answers it
+    STAPIRequest *request = [self.client searchQuery:self.query documentTypes:documentTypes page:resultPage perPage:(perPage > 0 ? perPage : 20)];
+    if (request) {
+        [self.expandRequests addObject:request];
+    }
+}
+
+- (void)_cancelExpansions {
+    NSArray *requests = self.expandRequests;
+    self.expandRequests = [NSMutableArray array];
+    for (STAPIRequest *request in requests) {
+        [request cancel];
+    }
+}
+
+- (void)_scheduleStoreRefresh {
+    if (self.storeRefreshScheduled) {
+        return;
+    }
+    
+    self.storeRefreshScheduled = YES;
+    dispatch_async(dispatch_get_main_queue(), ^{
+        self.storeRefreshScheduled = NO;
+        [self _refreshStoredRecords];
+    });
+}
+
+- (void)_refreshStoredRecords {
+    // A new snapshot lets go of the records that were replaced, the diff reloads their rows
+    if (self.searchType == STSearchTypeSearch && self.resultStore.pageCount > 0) {
+        self.searchResultData = [self _resultWithStoredRecords:self.searchResultData];
+    }
+}
+
+- (void)_didReceiveMemoryWarning:(NSNotification *)notification {
+    // A page held for later can be fetched again
+    self.prefetchedRequest = nil;
+    self.prefetchedResult = nil;
+    if ([self.resultStore shrinkWindow]) {
+        [self _refreshStoredRecords];
+    }
+}
+
+- (NSDictionary *)_storeFirstPage:(NSDictionary *)result ofRequest:(STAPIRequest *)request {
+    [self.resultStore removeAllRecords];
+    [self.resultStore appendResult:result ofRequest:request];
+    return [self _resultWithStoredRecords:result];
+}
+
+- (STResultSnapshot *)_snapshotOfResult:(NSDictionary *)result {
+    // Put together from the store, the pages not appended, compacted or expanded since are taken over as they are
+    if ([result objectForKey:@"records"] == self.resultStore.records) {
+        return [STResultSnapshot snapshotOfResult:result
+                                            pages:self.resultStore.pages
+                                     sectionOrder:self.sectionOrder
+                                    displayFields:self.displayFields
+                                  reusingSnapshot:self.snapshot];
+    }
+    return [super _snapshotOfResult:result];
+}
+
+- (void)_applyResult:(NSDictionary *)result ofRequest:(STAPIRequest *)request {
+    // A prefetched page isn't the current request, it waits until it is asked for
+    if ([self _isCurrentRequest:request]) {
+        [self _applyResult:result forPage:[self _pageOfResult:result ofRequest:request] ofRequest:request];
+    }
+}
+
+- (void)_applyResult:(NSDictionary *)result forPage:(NSInteger)page ofRequest:(STAPIRequest *)request {
+    NSString *query = request.query;
+    STSearchType type = request.searchType;
+    BOOL sameSearch = type == STSearchTypeSearch && self.searchType == STSearchTypeSearch && [self.query isEqualToString:query];
+    
+    // A page fetched ahead is shown while it still follows the pages on screen. Anything else replaces them,
+    // which only the current request may do
+    if (sameSearch && self.searchResultData && [self _result:result isNextPage:page]) {
+        // Same query so only the records of the paged types change, append them and insert just the new rows
+        NSDictionary *addedRanges = [self.resultStore appendResult:result ofRequest:request];
+        [self setSearchResultData:[self _resultWithStoredRecords:result] addedRecordRanges:addedRanges];
+        return;
+    }
+    if (![self _isCurrentRequest:request]) {
+        return;
+    }
+    // A later page of the query on screen that doesn't follow it, showing it as the first page would lose the others
+    if (sameSearch && page > 1) {
+        return;
+    }
+    
+    [self _cancelPrefetch];
+    [self _cancelExpansions];
+    if (type == STSearchTypeSearch) {
+        result = [self _storeFirstPage:result ofRequest:request];
     }
     else {
-        return result;
+        [self.resultStore removeAllRecords];
+    }
+    [super _applyResult:result ofRequest:request];
+    
+    // On a fast link the next page is cheap enough to fetch before the user scrolls to it
+    NSTimeInterval roundTripTime = self.client.roundTripTime;
+    if (type == STSearchTypeSearch && page == 1 && roundTripTime > 0.0 && roundTripTime < self.prefetchRoundTripThreshold) {
+        [self _prefetchNextPage];
     }
 }
 
+- (NSDictionary *)_resultWithStoredRecords:(NSDictionary *)result {
+    // Only the top level is copied, the record arrays are immutable views of the store's pages
+    NSMutableDictionary *d = [NSMutableDictionary dictionaryWithDictionary:result];
+    [d setObject:self.resultStore.records forKey:@"records"];
+    if (self.resultStore.info) {
+        [d setObject:self.resultStore.info forKey:@"info"];
+    }
+    return d;
+}
+
 #pragma mark - STAPIDelegate
 
-- (void)client:(STAPIClient *)client didFinishQuery:(NSString *)query withResult:(NSDictionary *)result withType:(STSearchType)type {
-    NSInteger page = [self _pageOfResult:result];
-    if (type == STSearchTypeSearch &&
-        self.searchResultData &&
-        [self.query isEqualToString:query] &&
-        page > self.currentPage) {
-        result = [self _mergeResultRecords:result withCurrentRecords:self.searchResultData];
+- (void)client:(STAPIClient *)client didFinishRequest:(STAPIRequest *)request withResult:(NSDictionary *)result {
+    if (request == self.prefetchRequest) {
+        // Held until it is asked for, it isn't searchRequest so it isn't shown yet
+        self.prefetchRequest = nil;
+        self.prefetchedRequest = request;
+        self.prefetchedResult = result;
+    }
+    else if ([self.expandRequests containsObject:request]) {
+        [self.expandRequests removeObject:request];
+        // Merged here, it isn't searchRequest so it isn't shown as a page
+        if ([request.query isEqualToString:self.query] && [self.resultStore expandWithResult:result].count > 0) {
+            [self _refreshStoredRecords];
+        }
+    }
+    [super client:client didFinishRequest:request withResult:result];
+}
+
+- (void)client:(STAPIClient *)client didCancelRequest:(STAPIRequest *)request {
+    if (request == self.prefetchRequest) {
+        self.prefetchRequest = nil;
+    }
+    [self.expandRequests removeObject:request];
+    [super client:client didCancelRequest:request];
+}
+
+- (void)client:(STAPIClient *)client didFailRequest:(STAPIRequest *)request error:(NSError *)error {
+    if (request == self.prefetchRequest) {
+        self.prefetchRequest = nil;
+    }
+    // The page stays compacted and is asked for again when it scrolls back into view
+    [self.expandRequests removeObject:request];
+    [super client:client didFailRequest:request error:error];
+}
+
+- (void)client:(STAPIClient *)client didUpdateQuery:(NSString *)query withResult:(NSDictionary *)result withType:(STSearchType)type {
+    // An update of a single page can't replace records that were merged from several pages
+    if (self.resultStore.pageCount > 1) {
+        return;
+    }
+    if (type == STSearchTypeSearch && type == self.searchType && [query isEqualToString:self.query]) {
+        // Revalidated in place of the first page, which was asked for with every type
+        result = [self _storeFirstPage:result ofRequest:nil];
     }
-    self.currentPage = page;
-    [super client:client didFinishQuery:query withResult:result withType:type];
+    [super client:client didUpdateQuery:query withResult:result withType:type];
 }
 
 #pragma mark - UITableViewDataSource
@@ -195,6 +487,21 @@
     return nil;
 }
 
+#pragma mark - UITableViewDelegate
+
+- (void)tableView:(UITableView *)tableView willDisplayCell:(UITableViewCell *)cell forRowAtIndexPath:(NSIndexPath *)indexPath {
+    [self _moveWindowToIndexPath:indexPath];
+    
+    if (!self.prefetchEnabled || ![self hasMorePagesInSection:indexPath.section]) {
+        return;
+    }
+    
+    NSInteger rowsInSection = [self tableView:tableView numberOfRowsInSection:indexPath.section];
+    if (indexPath.row + (NSInteger)self.prefetchDistance >= rowsInSection - 1) {
+        [self _prefetchNextPage];
+    }
+}
+
 - (void)tableView:(UITableView *)tableView didSelectRowAtIndexPath:(NSIndexPath *)indexPath {
     if ([self isIndexPathMoreCell:indexPath]) {
         NSInteger numberOfSections = [super numberOfSectionsInTableView:tableView];
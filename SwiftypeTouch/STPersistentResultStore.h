@@ -0,0 +1,143 @@
+//
+//  STPersistentResultStore.h
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ On-disk store of query results that survives app launches, used by `STAPIClient` behind `STQueryCache`.
+
+ Results are appended to a single file of binary records, each with a small fixed header (key hash, lengths,
+ hit count and dates) followed by the key and the compact JSON of the result. The file is memory-mapped and
+ only the record headers are visited when it is opened, so startup cost doesn't depend on the size of the
+ results. Results are decoded when they are looked up, `dataForKey:storedDate:` leaves that to the caller.
+
+ The file holds at most `byteLimit` bytes. When it grows past that it is compacted: expired, replaced and
+ removed records are dropped and the remaining ones are kept by score, where a result scores higher the more
+ often and the more recently it was used. Keys are the same as for `STQueryCache`.
+
+ Writes and compaction happen on a background queue, and lookups never wait for the disk: the index is only
+ locked while it is read or updated, not while the file is read, written or rewritten. All methods are safe to
+ call from any thread.
+ */
+@interface STPersistentResultStore : NSObject
+
+/**
+ Store shared by all instances of `STAPIClient`, kept in the caches directory
+ */
++ (STPersistentResultStore *)sharedStore;
+
+/**
+ Initializes a store backed by a file. The file is created on the first write.
+
+ @param path Path of the store file
+ */
+- (id)initWithPath:(NSString *)path;
+
+/**
+ Path of the store file
+ */
+@property (nonatomic, readonly, copy) NSString *path;
+
+/**
+ Maximum size in bytes of the store file. Compaction brings it down to three quarters of the limit.
+
+ The default value is 2MB.
+ */
+@property (nonatomic, assign) NSUInteger byteLimit;
+
+/**
+ Number of seconds a stored result stays valid.
+
+ The default value is 86400 seconds.
+ */
+@property (nonatomic, assign) NSTimeInterval timeToLive;
+
+/**
+ Number of valid results in the store
+ */
+@property (nonatomic, readonly) NSUInteger count;
+
+/**
+ Current size in bytes of the store file
+ */
+@property (nonatomic, readonly) NSUInteger fileBytes;
+
+/**
+ Number of lookups that found a result
+ */
+@property (nonatomic, readonly) NSUInteger hitCount;
+
+/**
+ Number of lookups that found nothing or an expired result
+ */
+@property (nonatomic, readonly) NSUInteger missCount;
+
+/**
+ Number of times the file was compacted
+ */
+@property (nonatomic, readonly) NSUInteger compactionCount;
+
+/**
+ Looks up a result and counts it as used.
+
+ @param key Key built with `[STQueryCache keyForEndpoint:params:]`
+ @param bytes Set to the size of the stored JSON when a result is found, may be NULL
+
+ @return The stored result or nil if there is none or it has expired
+ */
+- (NSDictionary *)resultForKey:(NSString *)key bytes:(NSUInteger *)bytes;
+
+/**
+ Looks up the stored JSON of a result and counts it as used. Unlike `resultForKey:bytes:` nothing is decoded,
+ so the caller can parse the JSON off the main thread.
+
+ @param key Key built with `[STQueryCache keyForEndpoint:params:]`
+ @param storedDate Set to the date the result was stored when one is found, may be NULL
+
+ @return The compact JSON of the stored result or nil if there is none or it has expired
+ */
+- (NSData *)dataForKey:(NSString *)key storedDate:(NSDate **)storedDate;
+
+/**
+ Tells whether a valid result is stored, without counting a lookup.
+
+ @param key Key built with `[STQueryCache keyForEndpoint:params:]`
+ */
+- (BOOL)containsResultForKey:(NSString *)key;
+
+/**
+ Stores a result in the background, replacing an earlier one with the same key.
+
+ @param result Decoded result
+ @param key Key built with `[STQueryCache keyForEndpoint:params:]`
+ */
+- (void)setResult:(NSDictionary *)result forKey:(NSString *)key;
+
+/**
+ Removes a single result
+
+ @param key Key built with `[STQueryCache keyForEndpoint:params:]`
+ */
+- (void)removeResultForKey:(NSString *)key;
+
+/**
+ Removes every stored result and deletes the file
+ */
+- (void)removeAllResults;
+
+/**
+ Compacts the file in the background even if it is within `byteLimit`
+ */
+- (void)compact;
+
+/**
+ Blocks until all pending writes have reached the file
+ */
+- (void)synchronize;
+
+@end
@@ -0,0 +1,556 @@
+//
+//  STPersistentResultStore.m
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import "STPersistentResultStore.h"
+
+// File layout: an 8 byte header (magic, version) followed by records, all in host byte order.
+//
+//   record header  u64 key hash, u32 key length, u32 value length, u32 hit count, u32 flags,
+//                  f64 stored date, f64 expiration date, f64 last used date
+//   key            UTF-8
+//   value          compact JSON, empty for removals
+//
+// Records are padded to 8 bytes. A later record for the same key replaces an earlier one.
+
+#define ST_RESULT_STORE_MAGIC 0x53525453 // "STRS"
+#define ST_RESULT_STORE_VERSION 1
+#define ST_RESULT_STORE_FILE_HEADER_SIZE 8
+#define ST_RESULT_STORE_RECORD_HEADER_SIZE 48
+#define ST_RESULT_STORE_FLAG_REMOVED 1
+
+static uint64_t STPersistentResultStoreHash(NSData *keyData) {
+    // FNV-1a
+    const uint8_t *bytes = keyData.bytes;
+    uint64_t hash = 14695981039346656037ULL;
+    for (NSUInteger i = 0; i < keyData.length; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static inline NSUInteger STPersistentResultStoreRecordLength(NSUInteger keyLength, NSUInteger valueLength) {
+    return (ST_RESULT_STORE_RECORD_HEADER_SIZE + keyLength + valueLength + 7) & ~(NSUInteger)7;
+}
+
+@interface STPersistentResultStoreEntry : NSObject <NSCopying>
+
+@property (nonatomic, assign) NSUInteger offset;
+@property (nonatomic, assign) NSUInteger keyLength;
+@property (nonatomic, assign) NSUInteger valueLength;
+@property (nonatomic, assign) uint32_t hitCount;
+@property (nonatomic, assign) NSTimeInterval storedDate;
+@property (nonatomic, assign) NSTimeInterval expirationDate;
+@property (nonatomic, assign) NSTimeInterval lastUsedDate;
+
+@end
+
+@implementation STPersistentResultStoreEntry
+
+- (id)copyWithZone:(NSZone *)zone {
+    STPersistentResultStoreEntry *entry = [[STPersistentResultStoreEntry allocWithZone:zone] init];
+    entry.offset = self.offset;
+    entry.keyLength = self.keyLength;
+    entry.valueLength = self.valueLength;
+    entry.hitCount = self.hitCount;
+    entry.storedDate = self.storedDate;
+    entry.expirationDate = self.expirationDate;
+    entry.lastUsedDate = self.lastUsedDate;
+    return entry;
+}
+
+@end
+
+@interface STPersistentResultStore ()
+
+@property (nonatomic, readwrite, copy) NSString *path;
+@property (nonatomic, assign) NSUInteger hitCount;
+@property (nonatomic, assign) NSUInteger missCount;
+@property (nonatomic, assign) NSUInteger compactionCount;
+@property (nonatomic, assign) NSUInteger fileBytes;
+@property (nonatomic, assign) BOOL loaded;
+@property (nonatomic, assign) NSUInteger generation;
+@property (nonatomic, strong) NSData *data;
+@property (nonatomic, strong) NSMutableDictionary *entries;
+@property (nonatomic, strong) NSOperationQueue *workQueue;
+
+- (void)_load;
+- (BOOL)_mapThroughOffset:(NSUInteger)offset;
+- (STPersistentResultStoreEntry *)_validEntryForKeyData:(NSData *)keyData;
+- (NSData *)_recordWithKeyData:(NSData *)keyData value:(NSData *)value flags:(uint32_t)flags entry:(STPersistentResultStoreEntry *)entry;
+- (NSUInteger)_appendRecord:(NSData *)record generation:(NSUInteger)generation;
+- (void)_writeUsageOfEntry:(STPersistentResultStoreEntry *)entry hash:(NSNumber *)hash;
+- (void)_compactToByteLimit:(NSUInteger)byteLimit;
+
+@end
+
+@implementation STPersistentResultStore
+
+#pragma mark - NSObject
+
+- (id)init {
+    NSString *cachesDirectory = [NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES) lastObject];
+    return [self initWithPath:[cachesDirectory stringByAppendingPathComponent:@"SwiftypeTouch/results.store"]];
+}
+
+#pragma mark - STPersistentResultStore
+
++ (STPersistentResultStore *)sharedStore {
+    static dispatch_once_t onceToken;
+    static STPersistentResultStore *sharedStore = nil;
+    dispatch_once(&onceToken, ^{
+        sharedStore = [[STPersistentResultStore alloc] init];
+    });
+    return sharedStore;
+}
+
+- (id)initWithPath:(NSString *)path {
+    self = [super init];
+    if (self) {
+        self.path = path;
+        self.byteLimit = 1024*1024*2;
+        self.timeToLive = 86400.0;
+        self.entries = [NSMutableDictionary dictionary];
+
+        self.workQueue = [[NSOperationQueue alloc] init];
+        self.workQueue.name = @"com.swiftype.api.resultstore";
+        self.workQueue.maxConcurrentOperationCount = 1;
+
+        // Open the file right away so it is ready before the first query of the session
+        [self.workQueue addOperationWithBlock:^{
+            [self _load];
+        }];
+    }
+    return self;
+}
+
+- (NSUInteger)count {
+    [self _load];
+    @synchronized(self) {
+        return self.entries.count;
+    }
+}
+
+- (NSDictionary *)resultForKey:(NSString *)key bytes:(NSUInteger *)bytes {
+    NSData *value = [self dataForKey:key storedDate:NULL];
+    NSDictionary *result = value ? [NSJSONSerialization JSONObjectWithData:value options:0 error:NULL] : nil;
+    if (![result isKindOfClass:[NSDictionary class]]) {
+        return nil;
+    }
+    if (bytes) {
+        *bytes = value.length;
+    }
+    return result;
+}
+
+- (NSData *)dataForKey:(NSString *)key storedDate:(NSDate **)storedDate {
+    if (key == nil) return nil;
+    NSData *keyData = [key dataUsingEncoding:NSUTF8StringEncoding];
+    [self _load];
+
+    // Only the index is read under the lock, the work queue holds it just as briefly. The mapping stays valid
+    // when the file is appended to or replaced, so the record is compared and copied after the lock is released
+    __attribute__((objc_precise_lifetime)) NSData *data = nil;
+    STPersistentResultStoreEntry *entry = nil;
+    NSUInteger offset = 0;
+    NSUInteger valueLength = 0;
+    @synchronized(self) {
+        entry = [self _validEntryForKeyData:keyData];
+        if (entry && [self _mapThroughOffset:entry.offset + STPersistentResultStoreRecordLength(entry.keyLength, entry.valueLength)]) {
+            data = self.data;
+            offset = entry.offset;
+            valueLength = entry.valueLength;
+        }
+    }
+
+    NSData *value = nil;
+    const uint8_t *record = data ? (const uint8_t *)data.bytes + offset : NULL;
+    // The hash can collide, the key is what counts
+    if (record && memcmp(record + ST_RESULT_STORE_RECORD_HEADER_SIZE, keyData.bytes, keyData.length) == 0) {
+        // A copy outlives the mapping, so the caller can decode it on any thread
+        value = [NSData dataWithBytes:record + ST_RESULT_STORE_RECORD_HEADER_SIZE + keyData.length length:valueLength];
+    }
+
+    NSTimeInterval stored = 0.0;
+    @synchronized(self) {
+        if (value == nil) {
+            self.missCount++;
+            return nil;
+        }
+        self.hitCount++;
+        entry.hitCount++;
+        entry.lastUsedDate = [[NSDate date] timeIntervalSince1970];
+        stored = entry.storedDate;
+    }
+
+    NSNumber *hash = @(STPersistentResultStoreHash(keyData));
+    [self.workQueue addOperationWithBlock:^{
+        [self _writeUsageOfEntry:entry hash:hash];
+    }];
+    if (storedDate) {
+        *storedDate = [NSDate dateWithTimeIntervalSince1970:stored];
+    }
+    return value;
+}
+
+- (BOOL)containsResultForKey:(NSString *)key {
+    if (key == nil) return NO;
+
+    [self _load];
+    @synchronized(self) {
+        return [self _validEntryForKeyData:[key dataUsingEncoding:NSUTF8StringEncoding]] != nil;
+    }
+}
+
+- (void)setResult:(NSDictionary *)result forKey:(NSString *)key {
+    if (result == nil || key == nil) return;
+
+    NSUInteger generation = self.generation;
+    [self.workQueue addOperationWithBlock:^{
+        NSData *value = [NSJSONSerialization dataWithJSONObject:result options:0 error:NULL];
+        NSData *keyData = [key dataUsingEncoding:NSUTF8StringEncoding];
+        if (value == nil || keyData == nil) return;
+
+        NSUInteger recordLength = STPersistentResultStoreRecordLength(keyData.length, value.length);
+        // A single result taking a good part of the budget would just push out everything else
+        if (recordLength > self.byteLimit / 4) return;
+        [self _load];
+
+        STPersistentResultStoreEntry *entry = [[STPersistentResultStoreEntry alloc] init];
+        entry.keyLength = keyData.length;
+        entry.valueLength = value.length;
+        entry.storedDate = [[NSDate date] timeIntervalSince1970];
+        entry.expirationDate = entry.storedDate + self.timeToLive;
+        entry.lastUsedDate = entry.storedDate;
+
+        // Keep the popularity of a result across revalidations
+        NSNumber *hash = @(STPersistentResultStoreHash(keyData));
+        @synchronized(self) {
+            entry.hitCount = [[self.entries objectForKey:hash] hitCount];
+        }
+
+        NSUInteger offset = [self _appendRecord:[self _recordWithKeyData:keyData value:value flags:0 entry:entry] generation:generation];
+        if (offset == NSNotFound) return;
+        entry.offset = offset;
+
+        BOOL overLimit = NO;
+        @synchronized(self) {
+            // Everything was removed while the record was written
+            if (generation != self.generation) return;
+            [self.entries setObject:entry forKey:hash];
+            overLimit = self.fileBytes > self.byteLimit;
+        }
+        if (overLimit) {
+            [self _compactToByteLimit:self.byteLimit * 3 / 4];
+        }
+    }];
+}
+
+- (void)removeResultForKey:(NSString *)key {
+    if (key == nil) return;
+
+    NSData *keyData = [key dataUsingEncoding:NSUTF8StringEncoding];
+    NSNumber *hash = @(STPersistentResultStoreHash(keyData));
+    NSUInteger generation = 0;
+    [self _load];
+    @synchronized(self) {
+        if ([self.entries objectForKey:hash] == nil) return;
+        [self.entries removeObjectForKey:hash];
+        generation = self.generation;
+    }
+
+    // The removal has to reach the file, otherwise the next launch brings the result back
+    [self.workQueue addOperationWithBlock:^{
+        STPersistentResultStoreEntry *tombstone = [[STPersistentResultStoreEntry alloc] init];
+        tombstone.keyLength = keyData.length;
+        tombstone.storedDate = [[NSDate date] timeIntervalSince1970];
+        [self _appendRecord:[self _recordWithKeyData:keyData value:nil flags:ST_RESULT_STORE_FLAG_REMOVED entry:tombstone] generation:generation];
+    }];
+}
+
+- (void)removeAllResults {
+    @synchronized(self) {
+        self.generation++;
+        [self.entries removeAllObjects];
+        self.data = nil;
+        self.fileBytes = 0;
+        self.loaded = YES;
+        [[NSFileManager defaultManager] removeItemAtPath:self.path error:NULL];
+    }
+}
+
+- (void)compact {
+    [self.workQueue addOperationWithBlock:^{
+        [self _load];
+        NSUInteger fileBytes = 0;
+        @synchronized(self) {
+            fileBytes = self.fileBytes;
+        }
+        [self _compactToByteLimit:MIN(fileBytes, self.byteLimit * 3 / 4)];
+    }];
+}
+
+- (void)synchronize {
+    [self.workQueue waitUntilAllOperationsAreFinished];
+}
+
+#pragma mark - Private
+
+- (void)_load {
+    NSUInteger generation = 0;
+    @synchronized(self) {
+        if (self.loaded) return;
+        generation = self.generation;
+    }
+
+    // Read without the lock so lookups don't wait for the disk, at startup two threads may both read the file
+    NSData *data = [NSData dataWithContentsOfFile:self.path options:NSDataReadingMappedAlways error:NULL];
+    const uint8_t *bytes = data.bytes;
+    uint32_t fileHeader[2] = { 0, 0 };
+    if (data.length >= ST_RESULT_STORE_FILE_HEADER_SIZE) {
+        memcpy(fileHeader, bytes, sizeof(fileHeader));
+    }
+
+    NSMutableDictionary *entries = [NSMutableDictionary dictionary];
+    NSUInteger offset = 0;
+    // Missing or from an incompatible version, the next write starts over
+    if (fileHeader[0] == ST_RESULT_STORE_MAGIC && fileHeader[1] == ST_RESULT_STORE_VERSION) {
+        // Only the record headers are read here, keys and values stay untouched until they are looked up
+        NSTimeInterval now = [[NSDate date] timeIntervalSince1970];
+        offset = ST_RESULT_STORE_FILE_HEADER_SIZE;
+        while (offset + ST_RESULT_STORE_RECORD_HEADER_SIZE <= data.length) {
+            const uint8_t *header = bytes + offset;
+            uint64_t hash;
+            uint32_t lengths[4];
+            double dates[3];
+            memcpy(&hash, header, sizeof(hash));
+            memcpy(lengths, header + 8, sizeof(lengths));
+            memcpy(dates, header + 24, sizeof(dates));
+
+            NSUInteger recordLength = STPersistentResultStoreRecordLength(lengths[0], lengths[1]);
+            if (offset + recordLength > data.length) {
+                // Torn write at the end, the next append overwrites it
+                break;
+            }
+
+            NSNumber *key = @(hash);
+            if ((lengths[3] & ST_RESULT_STORE_FLAG_REMOVED) || dates[1] <= now) {
+                [entries removeObjectForKey:key];
+            }
+            else {
+                STPersistentResultStoreEntry *entry = [[STPersistentResultStoreEntry alloc] init];
+                entry.offset = offset;
+                entry.keyLength = lengths[0];
+                entry.valueLength = lengths[1];
+                entry.hitCount = lengths[2];
+                entry.storedDate = dates[0];
+                entry.expirationDate = dates[1];
+                entry.lastUsedDate = dates[2];
+                [entries setObject:entry forKey:key];
+            }
+            offset += recordLength;
+        }
+    }
+
+    @synchronized(self) {
+        // Loaded by another thread or emptied in the meantime
+        if (self.loaded || generation != self.generation) return;
+        self.loaded = YES;
+        self.entries = entries;
+        self.data = (offset > 0) ? data : nil;
+        self.fileBytes = offset;
+    }
+}
+
+- (BOOL)_mapThroughOffset:(NSUInteger)offset {
+    if (self.data.length >= offset) {
+        return YES;
+    }
+    // Records were appended since the file was mapped
+    self.data = [NSData dataWithContentsOfFile:self.path options:NSDataReadingMappedAlways error:NULL];
+    return self.data.length >= offset;
+}
+
+- (STPersistentResultStoreEntry *)_validEntryForKeyData:(NSData *)keyData {
+    NSNumber *hash = @(STPersistentResultStoreHash(keyData));
+    STPersistentResultStoreEntry *entry = [self.entries objectForKey:hash];
+    if (entry == nil || entry.keyLength != keyData.length) {
+        return nil;
+    }
+    if (entry.expirationDate <= [[NSDate date] timeIntervalSince1970]) {
+        [self.entries removeObjectForKey:hash];
+        return nil;
+    }
+    return entry;
+}
+
+- (NSData *)_recordWithKeyData:(NSData *)keyData value:(NSData *)value flags:(uint32_t)flags entry:(STPersistentResultStoreEntry *)entry {
+    NSMutableData *record = [NSMutableData dataWithLength:STPersistentResultStoreRecordLength(keyData.length, value.length)];
+    uint8_t *bytes = record.mutableBytes;
+
+    uint64_t hash = STPersistentResultStoreHash(keyData);
+    uint32_t lengths[4] = { (uint32_t)keyData.length, (uint32_t)value.length, entry.hitCount, flags };
+    double dates[3] = { entry.storedDate, entry.expirationDate, entry.lastUsedDate };
+    memcpy(bytes, &hash, sizeof(hash));
+    memcpy(bytes + 8, lengths, sizeof(lengths));
+    memcpy(bytes + 24, dates, sizeof(dates));
+    memcpy(bytes + ST_RESULT_STORE_RECORD_HEADER_SIZE, keyData.bytes, keyData.length);
+    if (value.length > 0) {
+        memcpy(bytes + ST_RESULT_STORE_RECORD_HEADER_SIZE + keyData.length, value.bytes, value.length);
+    }
+    return record;
+}
+
+- (NSUInteger)_appendRecord:(NSData *)record generation:(NSUInteger)generation {
+    // Only the work queue writes to the file, the lock is held just long enough to read and publish its length
+    NSUInteger fileBytes = 0;
+    @synchronized(self) {
+        if (generation != self.generation) return NSNotFound;
+        fileBytes = self.fileBytes;
+    }
+
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    BOOL created = NO;
+    if (fileBytes < ST_RESULT_STORE_FILE_HEADER_SIZE || ![fileManager fileExistsAtPath:self.path]) {
+        [fileManager createDirectoryAtPath:[self.path stringByDeletingLastPathComponent]
+               withIntermediateDirectories:YES
+                                attributes:nil
+                                     error:NULL];
+        uint32_t fileHeader[2] = { ST_RESULT_STORE_MAGIC, ST_RESULT_STORE_VERSION };
+        if (![fileManager createFileAtPath:self.path contents:[NSData dataWithBytes:fileHeader length:sizeof(fileHeader)] attributes:nil]) {
+            return NSNotFound;
+        }
+        fileBytes = ST_RESULT_STORE_FILE_HEADER_SIZE;
+        created = YES;
+    }
+
+    NSFileHandle *fileHandle = [NSFileHandle fileHandleForWritingAtPath:self.path];
+    if (fileHandle == nil) {
+        return NSNotFound;
+    }
+    // Drops a torn record left at the end by an earlier crash
+    [fileHandle truncateFileAtOffset:fileBytes];
+    [fileHandle writeData:record];
+    [fileHandle closeFile];
+
+    @synchronized(self) {
+        // Everything was removed while the record was written, the next append starts a new file
+        if (generation != self.generation) return NSNotFound;
+        if (created) {
+            self.data = nil;
+        }
+        self.fileBytes = fileBytes + record.length;
+    }
+    return fileBytes;
+}
+
+- (void)_writeUsageOfEntry:(STPersistentResultStoreEntry *)entry hash:(NSNumber *)hash {
+    NSUInteger offset = 0;
+    uint32_t hitCount = 0;
+    double lastUsedDate = 0.0;
+    @synchronized(self) {
+        // Replaced or moved by a compaction in the meantime, which already wrote the usage
+        if ([self.entries objectForKey:hash] != entry || entry.offset + ST_RESULT_STORE_RECORD_HEADER_SIZE > self.fileBytes) {
+            return;
+        }
+        offset = entry.offset;
+        hitCount = entry.hitCount;
+        lastUsedDate = entry.lastUsedDate;
+    }
+
+    // Runs on the work queue like every other write, so the record can't move while it is updated
+    NSFileHandle *fileHandle = [NSFileHandle fileHandleForWritingAtPath:self.path];
+    [fileHandle seekToFileOffset:offset + 16];
+    [fileHandle writeData:[NSData dataWithBytes:&hitCount length:sizeof(hitCount)]];
+    [fileHandle seekToFileOffset:offset + 40];
+    [fileHandle writeData:[NSData dataWithBytes:&lastUsedDate length:sizeof(lastUsedDate)]];
+    [fileHandle closeFile];
+}
+
+- (void)_compactToByteLimit:(NSUInteger)byteLimit {
+    // The index is copied under the lock and the file rewritten without it. Lookups keep reading the old mapping
+    // meanwhile, and no record is appended since appends run on the same queue as this
+    NSUInteger generation = 0;
+    NSDictionary *liveEntries = nil;
+    NSMutableDictionary *entryCopies = nil;
+    __attribute__((objc_precise_lifetime)) NSData *data = nil;
+    @synchronized(self) {
+        if (![self _mapThroughOffset:self.fileBytes]) {
+            // The file is gone or unreadable, start over rather than keep pointing into it
+            [self.entries removeAllObjects];
+            self.fileBytes = 0;
+            return;
+        }
+        generation = self.generation;
+        data = self.data;
+        liveEntries = [self.entries copy];
+        entryCopies = [NSMutableDictionary dictionaryWithCapacity:liveEntries.count];
+        [liveEntries enumerateKeysAndObjectsUsingBlock:^(NSNumber *hash, STPersistentResultStoreEntry *entry, BOOL *stop) {
+            [entryCopies setObject:[entry copy] forKey:hash];
+        }];
+    }
+
+    // Popular and recently used results first, a result's score halves as soon as it wasn't used for an hour
+    NSTimeInterval now = [[NSDate date] timeIntervalSince1970];
+    NSArray *hashes = [entryCopies keysSortedByValueUsingComparator:^NSComparisonResult(STPersistentResultStoreEntry *a, STPersistentResultStoreEntry *b) {
+        double scoreA = (1.0 + a.hitCount) / (1.0 + MAX(now - a.lastUsedDate, 0.0) / 3600.0);
+        double scoreB = (1.0 + b.hitCount) / (1.0 + MAX(now - b.lastUsedDate, 0.0) / 3600.0);
+        return (scoreA > scoreB) ? NSOrderedAscending : (scoreA < scoreB) ? NSOrderedDescending : NSOrderedSame;
+    }];
+
+    uint32_t fileHeader[2] = { ST_RESULT_STORE_MAGIC, ST_RESULT_STORE_VERSION };
+    NSMutableData *compacted = [NSMutableData dataWithCapacity:byteLimit];
+    [compacted appendBytes:fileHeader length:sizeof(fileHeader)];
+    NSMutableDictionary *offsets = [NSMutableDictionary dictionaryWithCapacity:hashes.count];
+    const uint8_t *bytes = data.bytes;
+
+    for (NSNumber *hash in hashes) {
+        STPersistentResultStoreEntry *entry = [entryCopies objectForKey:hash];
+        NSUInteger recordLength = STPersistentResultStoreRecordLength(entry.keyLength, entry.valueLength);
+        if (entry.expirationDate <= now) continue;
+        if (compacted.length + recordLength > byteLimit) continue;
+
+        NSUInteger offset = compacted.length;
+        [compacted appendBytes:bytes + entry.offset length:recordLength];
+        // Usage updates may still be queued for the old position
+        uint32_t hitCount = entry.hitCount;
+        double lastUsedDate = entry.lastUsedDate;
+        [compacted replaceBytesInRange:NSMakeRange(offset + 16, sizeof(hitCount)) withBytes:&hitCount];
+        [compacted replaceBytesInRange:NSMakeRange(offset + 40, sizeof(lastUsedDate)) withBytes:&lastUsedDate];
+        [offsets setObject:@(offset) forKey:hash];
+    }
+
+    NSString *compactedPath = [self.path stringByAppendingPathExtension:@"compacting"];
+    if (![compacted writeToFile:compactedPath options:0 error:NULL]) {
+        return;
+    }
+
+    @synchronized(self) {
+        // Everything was removed while the file was rewritten, it must not come back
+        if (generation != self.generation || rename([compactedPath fileSystemRepresentation], [self.path fileSystemRepresentation]) != 0) {
+            [[NSFileManager defaultManager] removeItemAtPath:compactedPath error:NULL];
+            return;
+        }
+
+        // Results removed in the meantime stay out, their tombstones are queued behind this compaction
+        NSMutableDictionary *entries = [NSMutableDictionary dictionaryWithCapacity:offsets.count];
+        [offsets enumerateKeysAndObjectsUsingBlock:^(NSNumber *hash, NSNumber *offset, BOOL *stop) {
+            STPersistentResultStoreEntry *entry = [liveEntries objectForKey:hash];
+            if ([self.entries objectForKey:hash] == entry) {
+                entry.offset = [offset unsignedIntegerValue];
+                [entries setObject:entry forKey:hash];
+            }
+        }];
+        self.entries = entries;
+        self.data = nil;
+        self.fileBytes = compacted.length;
+        self.compactionCount++;
+    }
+}
+
+@end
@@ -0,0 +1,140 @@
+//
+//  STQueryCache.h
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ In-process cache of decoded query results used by `STAPIClient`.
+
+ Results are stored already decoded so a hit never touches the JSON parser. Entries are keyed on a
+ canonical form of the endpoint and the posted parameters (engine key, query, page and everything
+ provided by the delegate), so two identical queries always map to the same key regardless of
+ dictionary ordering.
+
+ The cache holds at most `byteLimit` bytes, measured as the size of the response payload each
+ result was decoded from. When the limit is exceeded the least recently used results are evicted.
+ Each entry also expires `timeToLive` seconds after it was stored.
+
+ All methods are safe to call from any thread.
+ */
+@interface STQueryCache : NSObject
+
+/**
+ Cache shared by all instances of `STAPIClient`
+ */
++ (STQueryCache *)sharedCache;
+
+/**
+ Builds the canonical key for a query.
+
+ @param endpoint URL of the API endpoint the query is posted to
+ @param params The parameters posted to the endpoint
+
+ @return Key that is identical for identical queries
+ */
++ (NSString *)keyForEndpoint:(NSString *)endpoint params:(NSDictionary *)params;
+
+/**
+ Maximum total payload size in bytes of all cached results.
+
+ The default value is 5MB.
+ */
+@property (nonatomic, assign) NSUInteger byteLimit;
+
+/**
+ Number of seconds a result is kept when no explicit time to live is given.
+
+ The default value is 300 seconds.
+ */
+@property (nonatomic, assign) NSTimeInterval timeToLive;
+
+/**
+ Number of results currently cached
+ */
+@property (nonatomic, readonly) NSUInteger count;
+
+/**
+ Total payload size in bytes of the results currently cached
+ */
+@property (nonatomic, readonly) NSUInteger totalBytes;
+
+/**
+ Number of lookups that found a result
+ */
+@property (nonatomic, readonly) NSUInteger hitCount;
+
+/**
+ Number of lookups that found nothing or an expired result
+ */
+@property (nonatomic, readonly) NSUInteger missCount;
+
+/**
+ Number of results removed to stay within `byteLimit`
+ */
+@property (nonatomic, readonly) NSUInteger evictionCount;
+
+/**
+ Number of results removed because their time to live had passed
+ */
+@property (nonatomic, readonly) NSUInteger expirationCount;
+
+/**
+ Looks up a result and marks it as recently used.
+
+ @param key Key built with `keyForEndpoint:params:`
+
+ @return The cached result or nil if there is none or it has expired
+ */
+- (NSDictionary *)resultForKey:(NSString *)key;
+
+/**
+ Tells whether an unexpired result is cached, without counting a lookup or marking it as used.
+
+ @param key Key built with `keyForEndpoint:params:`
+
+ @return `YES` if `resultForKey:` would return a result
+ */
+- (BOOL)containsResultForKey:(NSString *)key;
+
+/**
+ Stores a result using the default `timeToLive`.
+
+ @param result Decoded result
+ @param key Key built with `keyForEndpoint:params:`
+ @param bytes Size of the payload the result was decoded from
+ */
+- (void)setResult:(NSDictionary *)result forKey:(NSString *)key bytes:(NSUInteger)bytes;
+
+/**
+ Stores a result.
+
+ @param result Decoded result
+ @param key Key built with `keyForEndpoint:params:`
+ @param bytes Size of the payload the result was decoded from
+ @param timeToLive Number of seconds before the result expires
+ */
+- (void)setResult:(NSDictionary *)result forKey:(NSString *)key bytes:(NSUInteger)bytes timeToLive:(NSTimeInterval)timeToLive;
+
+/**
+ Removes a single result
+
+ @param key Key built with `keyForEndpoint:params:`
+ */
+- (void)removeResultForKey:(NSString *)key;
+
+/**
+ Removes every cached result
+ */
+- (void)removeAllResults;
+
+/**
+ Resets the hit, miss, eviction and expiration counters to 0
+ */
+- (void)resetStatistics;
+
+@end
@@ -0,0 +1,185 @@
+//
+//  STQueryCache.m
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import "STQueryCache.h"
+
+#import "NSDictionary+STUtils.h"
+
+@interface STQueryCacheEntry : NSObject
+
+@property (nonatomic, strong) NSDictionary *result;
+@property (nonatomic, assign) NSUInteger bytes;
+@property (nonatomic, strong) NSDate *expirationDate;
+
+@end
+
+@implementation STQueryCacheEntry
+@end
+
+@interface STQueryCache ()
+
+@property (nonatomic, strong) NSMutableDictionary *entries;
+@property (nonatomic, strong) NSMutableOrderedSet *recentlyUsedKeys;
+@property (nonatomic, assign) NSUInteger totalBytes;
+@property (nonatomic, assign) NSUInteger hitCount;
+@property (nonatomic, assign) NSUInteger missCount;
+@property (nonatomic, assign) NSUInteger evictionCount;
+@property (nonatomic, assign) NSUInteger expirationCount;
+
+- (void)_removeEntryForKey:(NSString *)key;
+- (void)_evictToByteLimit;
+
+@end
+
+@implementation STQueryCache
+
+#pragma mark - NSObject
+
+- (id)init {
+    self = [super init];
+    if (self) {
+        self.entries = [NSMutableDictionary dictionary];
+        self.recentlyUsedKeys = [NSMutableOrderedSet orderedSet];
+        self.byteLimit = 1024*1024*5;
+        self.timeToLive = 300.0;
+    }
+    return self;
+}
+
+#pragma mark - STQueryCache
+
++ (STQueryCache *)sharedCache {
+    static dispatch_once_t onceToken;
+    static STQueryCache *sharedCache = nil;
+    dispatch_once(&onceToken, ^{
+        sharedCache = [[STQueryCache alloc] init];
+    });
+    return sharedCache;
+}
+
++ (NSString *)keyForEndpoint:(NSString *)endpoint params:(NSDictionary *)params {
+    return [@{ @"endpoint" : (endpoint ? endpoint : @""), @"params" : (params ? params : @{}) } STCanonicalJSONString];
+}
+
+- (void)setByteLimit:(NSUInteger)byteLimit {
+    @synchronized(self) {
+        _byteLimit = byteLimit;
+        [self _evictToByteLimit];
+    }
+}
+
+- (NSUInteger)count {
+    @synchronized(self) {
+        return self.entries.count;
+    }
+}
+
+- (NSDictionary *)resultForKey:(NSString *)key {
+    if (key == nil) return nil;
+
+    @synchronized(self) {
+        STQueryCacheEntry *entry = [self.entries objectForKey:key];
+        if (entry && [entry.expirationDate timeIntervalSinceNow] <= 0) {
+            [self _removeEntryForKey:key];
+            self.expirationCount++;
+            entry = nil;
+        }
+
+        if (entry == nil) {
+            self.missCount++;
+            return nil;
+        }
+
+        self.hitCount++;
+        [self.recentlyUsedKeys removeObject:key];
+        [self.recentlyUsedKeys addObject:key];
+        return entry.result;
+    }
+}
+
+- (BOOL)containsResultForKey:(NSString *)key {
+    if (key == nil) return NO;
+
+    @synchronized(self) {
+        STQueryCacheEntry *entry = [self.entries objectForKey:key];
+        return entry != nil && [entry.expirationDate timeIntervalSinceNow] > 0;
+    }
+}
+
+- (void)setResult:(NSDictionary *)result forKey:(NSString *)key bytes:(NSUInteger)bytes {
+    [self setResult:result forKey:key bytes:bytes timeToLive:self.timeToLive];
+}
+
+- (void)setResult:(NSDictionary *)result forKey:(NSString *)key bytes:(NSUInteger)bytes timeToLive:(NSTimeInterval)timeToLive {
+    if (result == nil || key == nil) return;
+
+    @synchronized(self) {
+        [self _removeEntryForKey:key];
+
+        // A single result larger than the whole budget would just evict everything else
+        if (bytes > self.byteLimit) {
+            return;
+        }
+
+        STQueryCacheEntry *entry = [[STQueryCacheEntry alloc] init];
+        entry.result = result;
+        entry.bytes = bytes;
+        entry.expirationDate = [NSDate dateWithTimeIntervalSinceNow:timeToLive];
+
+        [self.entries setObject:entry forKey:key];
+        [self.recentlyUsedKeys addObject:key];
+        self.totalBytes += bytes;
+
+        [self _evictToByteLimit];
+    }
+}
+
+- (void)removeResultForKey:(NSString *)key {
+    if (key == nil) return;
+
+    @synchronized(self) {
+        [self _removeEntryForKey:key];
+    }
+}
+
+- (void)removeAllResults {
+    @synchronized(self) {
+        [self.entries removeAllObjects];
+        [self.recentlyUsedKeys removeAllObjects];
+        self.totalBytes = 0;
+    }
+}
+
+- (void)resetStatistics {
+    @synchronized(self) {
+        self.hitCount = 0;
+        self.missCount = 0;
+        self.evictionCount = 0;
+        self.expirationCount = 0;
+    }
+}
+
+#pragma mark - Private
+
+- (void)_removeEntryForKey:(NSString *)key {
+    STQueryCacheEntry *entry = [self.entries objectForKey:key];
+    if (entry) {
+        self.totalBytes -= entry.bytes;
+        [self.entries removeObjectForKey:key];
+        [self.recentlyUsedKeys removeObject:key];
+    }
+}
+
+- (void)_evictToByteLimit {
+    while (self.totalBytes > self.byteLimit && self.recentlyUsedKeys.count > 0) {
+        [self _removeEntryForKey:[self.recentlyUsedKeys objectAtIndex:0]];
+        self.evictionCount++;
+    }
+}
+
+@end
@@ -0,0 +1,71 @@
+//
+//  STRequestBuilder.h
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ Builds the URL requests of one engine with as few allocations as possible.
+
+ Everything that stays the same between requests is encoded once: the URL and the headers of every endpoint
+ are kept in a template request, the JSON of the engine key and the start of the cache key of every endpoint
+ are kept as bytes. The parameters of a request are written as canonical JSON, the one writer behind
+ `NSDictionary STCanonicalJSONString` as well, into a byte buffer that is reused by the next request. The
+ body of the request and its cache key are cut from that one buffer, so the parameters are only serialized
+ once and the cache key is the one `STQueryCache keyForEndpoint:params:` returns.
+
+ A builder is not thread safe. `STAPIClient` keeps one and only uses it on the thread its requests start on.
+ */
+@interface STRequestBuilder : NSObject
+
+/**
+ Creates a builder.
+
+ @param baseURL URL the paths of the endpoints are appended to
+ @param engineKey The engine key sent with every request, may be nil
+ @param headerFields Header fields set on every request
+ */
+- (id)initWithBaseURL:(NSString *)baseURL engineKey:(NSString *)engineKey HTTPHeaderFields:(NSDictionary *)headerFields;
+
+/**
+ URL the paths of the endpoints are appended to
+ */
+@property (nonatomic, readonly, copy) NSString *baseURL;
+
+/**
+ The engine key whose JSON is encoded ahead of time
+ */
+@property (nonatomic, readonly, copy) NSString *engineKey;
+
+/**
+ Header fields set on every request
+ */
+@property (nonatomic, readonly, copy) NSDictionary *HTTPHeaderFields;
+
+/**
+ Builds a POST request whose body is the canonical JSON of the parameters.
+
+ @param path Path of the endpoint, appended to `baseURL`
+ @param params Request parameters
+ @param cacheKey Set to the cache key of the request if not NULL
+
+ @return A new request, or nil if the parameters contain a number JSON can't represent such as NaN or infinity
+ */
+- (NSMutableURLRequest *)URLRequestForPath:(NSString *)path params:(NSDictionary *)params cacheKey:(NSString **)cacheKey;
+
+/**
+ Writes an object as canonical JSON: the keys of every dictionary sorted, no insignificant whitespace, and
+ quotes, backslashes and control characters escaped. Objects other than strings, numbers, dictionaries and
+ arrays are written as `null`.
+
+ @param object The object to write
+ 
+ @return The UTF-8 bytes of the JSON, or nil if the object contains NaN or infinity
+ */
++ (NSData *)canonicalJSONDataWithObject:(id)object;
+
+@end
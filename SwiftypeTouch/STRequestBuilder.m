@@ -0,0 +1,345 @@
+//
+//  STRequestBuilder.m
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import "STRequestBuilder.h"
+#import "NSDictionary+STUtils.h"
+
+#include <math.h>
+
+// Dictionaries with more keys than this are sorted through an array instead of on the stack
+#define ST_STACK_KEY_COUNT 32
+// Characters of a string converted to UTF-8 at a time
+#define ST_STRING_CHUNK_LENGTH 256
+
+/*
+ What a byte turns into inside a JSON string, 0 if it is copied as is. Quotes, backslashes and control
+ characters are escaped, every other byte of the UTF-8 is kept.
+ */
+static const char STJSONEscapes[256] = {
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 't', 'n', 'u', 'u', 'r', 'u', 'u',
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+    ['"'] = '"',
+    ['\\'] = '\\'
+};
+
+typedef struct {
+    char *bytes;
+    NSUInteger length;
+    NSUInteger capacity;
+    BOOL failed;
+} STByteBuffer;
+
+/*
+ The buffer a request is written into and the pre-encoded engine key
+ */
+typedef struct {
+    STByteBuffer *buffer;
+    __unsafe_unretained NSString *engineKey;
+    __unsafe_unretained NSData *engineKeyJSON;
+} STJSONWriter;
+
+static void STByteBufferAppend(STByteBuffer *buffer, const void *bytes, NSUInteger length) {
+    if (buffer->failed) {
+        return;
+    }
+    if (buffer->length + length > buffer->capacity) {
+        NSUInteger capacity = MAX(buffer->capacity * 2, buffer->length + length);
+        char *bytes = realloc(buffer->bytes, capacity);
+        if (bytes == NULL) {
+            buffer->failed = YES;
+            return;
+        }
+        buffer->bytes = bytes;
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->bytes + buffer->length, bytes, length);
+    buffer->length += length;
+}
+
+static void STWriteEscapedBytes(STByteBuffer *buffer, const unsigned char *bytes, NSUInteger length) {
+    static const char hexDigits[] = "0123456789abcdef";
+    NSUInteger runStart = 0;
+    for (NSUInteger i = 0; i < length; i++) {
+        char escape = STJSONEscapes[bytes[i]];
+        if (escape == 0) {
+            continue;
+        }
+        // Flush the run of bytes that need no escaping
+        STByteBufferAppend(buffer, bytes + runStart, i - runStart);
+        runStart = i + 1;
+        if (escape == 'u') {
+            char unicodeEscape[6] = { '\\', 'u', '0', '0', hexDigits[bytes[i] >> 4], hexDigits[bytes[i] & 0xf] };
+            STByteBufferAppend(buffer, unicodeEscape, sizeof(unicodeEscape));
+        }
+        else {
+            char shortEscape[2] = { '\\', escape };
+            STByteBufferAppend(buffer, shortEscape, sizeof(shortEscape));
+        }
+    }
+    STByteBufferAppend(buffer, bytes + runStart, length - runStart);
+}
+
+static void STWriteJSONString(STJSONWriter *writer, NSString *string) {
+    if (string == writer->engineKey && writer->engineKeyJSON) {
+        STByteBufferAppend(writer->buffer, writer->engineKeyJSON.bytes, writer->engineKeyJSON.length);
+        return;
+    }
+
+    STByteBufferAppend(writer->buffer, "\"", 1);
+    // Converted in chunks on the stack, getBytes: never splits a character across two of them
+    unsigned char chunk[ST_STRING_CHUNK_LENGTH];
+    NSRange remainingRange = NSMakeRange(0, string.length);
+    while (remainingRange.length > 0) {
+        NSUInteger usedLength = 0;
+        [string getBytes:chunk maxLength:sizeof(chunk) usedLength:&usedLength encoding:NSUTF8StringEncoding
+                 options:0 range:remainingRange remainingRange:&remainingRange];
+        if (usedLength == 0) {
+            // Only a broken surrogate pair gets here
+            NSData *lossyData = [[string substringWithRange:remainingRange] dataUsingEncoding:NSUTF8StringEncoding allowLossyConversion:YES];
+            STWriteEscapedBytes(writer->buffer, lossyData.bytes, lossyData.length);
+            break;
+        }
+        STWriteEscapedBytes(writer->buffer, chunk, usedLength);
+    }
+    STByteBufferAppend(writer->buffer, "\"", 1);
+}
+
+static void STWriteJSONNumber(STJSONWriter *writer, NSNumber *number) {
+    // Compared by identity, YES and NO are singletons and CFBooleanGetTypeID would pull in CoreFoundation
+    if (number == [NSNumber numberWithBool:YES] || number == [NSNumber numberWithBool:NO]) {
+        if ([number boolValue]) {
+            STByteBufferAppend(writer->buffer, "true", 4);
+        }
+        else {
+            STByteBufferAppend(writer->buffer, "false", 5);
+        }
+        return;
+    }
+
+    // Integers, page and per_page among them, are formatted on the stack. stringValue does the rest
+    const char *type = [number objCType];
+    char digits[32];
+    int length = -1;
+    if (type[0] != '\0' && type[1] == '\0') {
+        if (strchr("cislq", type[0])) {
+            length = snprintf(digits, sizeof(digits), "%lld", [number longLongValue]);
+        }
+        else if (strchr("CISLQ", type[0])) {
+            length = snprintf(digits, sizeof(digits), "%llu", [number unsignedLongLongValue]);
+        }
+    }
+    if (length > 0 && length < (int)sizeof(digits)) {
+        STByteBufferAppend(writer->buffer, digits, length);
+        return;
+    }
+
+    // stringValue would write nan or inf, which no JSON parser takes
+    if (!isfinite([number doubleValue])) {
+        writer->buffer->failed = YES;
+        return;
+    }
+    const char *string = [[number stringValue] UTF8String];
+    STByteBufferAppend(writer->buffer, string, strlen(string));
+}
+
+static void STWriteJSON(STJSONWriter *writer, id object);
+
+static void STWriteJSONDictionary(STJSONWriter *writer, NSDictionary *dictionary) {
+    NSUInteger count = dictionary.count;
+    if (count > ST_STACK_KEY_COUNT) {
+        STByteBufferAppend(writer->buffer, "{", 1);
+        NSArray *keys = [[dictionary allKeys] sortedArrayUsingSelector:@selector(compare:)];
+        BOOL first = YES;
+        for (id key in keys) {
+            if (!first) STByteBufferAppend(writer->buffer, ",", 1);
+            first = NO;
+            STWriteJSONString(writer, [key description]);
+            STByteBufferAppend(writer->buffer, ":", 1);
+            STWriteJSON(writer, [dictionary objectForKey:key]);
+        }
+        STByteBufferAppend(writer->buffer, "}", 1);
+        return;
+    }
+
+    // Request parameters have a handful of keys, an insertion sort on the stack beats sorting an array
+    __unsafe_unretained id keys[ST_STACK_KEY_COUNT];
+    __unsafe_unretained id values[ST_STACK_KEY_COUNT];
+    [dictionary getObjects:values andKeys:keys];
+    for (NSUInteger i = 1; i < count; i++) {
+        __unsafe_unretained id key = keys[i];
+        __unsafe_unretained id value = values[i];
+        NSUInteger j = i;
+        while (j > 0 && [keys[j - 1] compare:key] == NSOrderedDescending) {
+            keys[j] = keys[j - 1];
+            values[j] = values[j - 1];
+            j--;
+        }
+        keys[j] = key;
+        values[j] = value;
+    }
+
+    STByteBufferAppend(writer->buffer, "{", 1);
+    for (NSUInteger i = 0; i < count; i++) {
+        if (i > 0) STByteBufferAppend(writer->buffer, ",", 1);
+        STWriteJSONString(writer, [keys[i] description]);
+        STByteBufferAppend(writer->buffer, ":", 1);
+        STWriteJSON(writer, values[i]);
+    }
+    STByteBufferAppend(writer->buffer, "}", 1);
+}
+
+static void STWriteJSON(STJSONWriter *writer, id object) {
+    if ([object isKindOfClass:[NSString class]]) {
+        STWriteJSONString(writer, object);
+    }
+    else if ([object isKindOfClass:[NSNumber class]]) {
+        STWriteJSONNumber(writer, object);
+    }
+    else if ([object isKindOfClass:[NSDictionary class]]) {
+        STWriteJSONDictionary(writer, object);
+    }
+    else if ([object isKindOfClass:[NSArray class]]) {
+        STByteBufferAppend(writer->buffer, "[", 1);
+        BOOL first = YES;
+        for (id item in object) {
+            if (!first) STByteBufferAppend(writer->buffer, ",", 1);
+            first = NO;
+            STWriteJSON(writer, item);
+        }
+        STByteBufferAppend(writer->buffer, "]", 1);
+    }
+    else {
+        STByteBufferAppend(writer->buffer, "null", 4);
+    }
+}
+
+/*
+ The static parts of the requests to one endpoint
+ */
+@interface STRequestEndpoint : NSObject
+
+@property (nonatomic, strong) NSURLRequest *templateRequest;
+@property (nonatomic, strong) NSData *cacheKeyPrefix;
+
+@end
+
+@implementation STRequestEndpoint
+
+@end
+
+@interface STRequestBuilder () {
+    STByteBuffer _buffer;
+}
+
+@property (nonatomic, readwrite, copy) NSString *baseURL;
+@property (nonatomic, readwrite, copy) NSString *engineKey;
+@property (nonatomic, readwrite, copy) NSDictionary *HTTPHeaderFields;
+@property (nonatomic, strong) NSData *engineKeyJSON;
+@property (nonatomic, strong) NSMutableDictionary *endpoints;
+
+- (STRequestEndpoint *)_endpointForPath:(NSString *)path;
+
+@end
+
+@implementation STRequestBuilder
+
+#pragma mark - NSObject
+
+- (id)init {
+    return [self initWithBaseURL:@"" engineKey:nil HTTPHeaderFields:nil];
+}
+
+- (void)dealloc {
+    free(_buffer.bytes);
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@: %p baseURL=%@ endpoints=%lu buffer=%lu>",
+            NSStringFromClass([self class]), self, self.baseURL, (unsigned long)self.endpoints.count, (unsigned long)_buffer.capacity];
+}
+
+#pragma mark - STRequestBuilder
+
++ (NSData *)canonicalJSONDataWithObject:(id)object {
+    STByteBuffer buffer = { NULL, 0, 0, NO };
+    STJSONWriter writer = { &buffer, nil, nil };
+    STWriteJSON(&writer, object);
+    if (buffer.failed) {
+        free(buffer.bytes);
+        return nil;
+    }
+    // The buffer is handed over, not copied
+    return buffer.bytes ? [NSData dataWithBytesNoCopy:buffer.bytes length:buffer.length freeWhenDone:YES] : [NSData data];
+}
+
+- (id)initWithBaseURL:(NSString *)baseURL engineKey:(NSString *)engineKey HTTPHeaderFields:(NSDictionary *)headerFields {
+    self = [super init];
+    if (self) {
+        self.baseURL = baseURL ? baseURL : @"";
+        self.engineKey = engineKey;
+        self.HTTPHeaderFields = headerFields ? headerFields : @{};
+        self.endpoints = [NSMutableDictionary dictionary];
+
+        if (self.engineKey) {
+            // The canonical JSON of a one element array is the element in brackets
+            NSString *engineKeyJSON = [@{ @"k" : @[ self.engineKey ] } STCanonicalJSONString];
+            engineKeyJSON = [engineKeyJSON substringWithRange:NSMakeRange(6, engineKeyJSON.length - 8)];
+            self.engineKeyJSON = [engineKeyJSON dataUsingEncoding:NSUTF8StringEncoding];
+        }
+    }
+    return self;
+}
+
+- (NSMutableURLRequest *)URLRequestForPath:(NSString *)path params:(NSDictionary *)params cacheKey:(NSString **)cacheKey {
+    STRequestEndpoint *endpoint = [self _endpointForPath:path];
+
+    // The cache key wraps the body, both are written at once
+    _buffer.length = 0;
+    _buffer.failed = NO;
+    STByteBufferAppend(&_buffer, endpoint.cacheKeyPrefix.bytes, endpoint.cacheKeyPrefix.length);
+    STJSONWriter writer = { &_buffer, self.engineKey, self.engineKeyJSON };
+    STWriteJSONDictionary(&writer, params ? params : @{});
+    STByteBufferAppend(&_buffer, "}", 1);
+    if (_buffer.failed) {
+        return nil;
+    }
+
+    NSUInteger prefixLength = endpoint.cacheKeyPrefix.length;
+    NSMutableURLRequest *URLRequest = [endpoint.templateRequest mutableCopy];
+    [URLRequest setHTTPBody:[NSData dataWithBytes:_buffer.bytes + prefixLength length:_buffer.length - prefixLength - 1]];
+    if (cacheKey) {
+        *cacheKey = [[NSString alloc] initWithBytes:_buffer.bytes length:_buffer.length encoding:NSUTF8StringEncoding];
+    }
+    return URLRequest;
+}
+
+#pragma mark - Private
+
+- (STRequestEndpoint *)_endpointForPath:(NSString *)path {
+    STRequestEndpoint *endpoint = [self.endpoints objectForKey:path];
+    if (endpoint) {
+        return endpoint;
+    }
+
+    NSString *URLString = [self.baseURL stringByAppendingString:path];
+    NSMutableURLRequest *templateRequest = [[NSMutableURLRequest alloc] initWithURL:[NSURL URLWithString:URLString]];
+    [templateRequest setHTTPMethod:@"POST"];
+    [templateRequest setAllHTTPHeaderFields:self.HTTPHeaderFields];
+
+    // Everything of STQueryCache's key up to the params: {"endpoint":"...","params":
+    NSString *endpointJSON = [@{ @"endpoint" : URLString } STCanonicalJSONString];
+    NSString *cacheKeyPrefix = [[endpointJSON substringToIndex:endpointJSON.length - 1] stringByAppendingString:@",\"params\":"];
+
+    endpoint = [[STRequestEndpoint alloc] init];
+    endpoint.templateRequest = templateRequest;
+    endpoint.cacheKeyPrefix = [cacheKeyPrefix dataUsingEncoding:NSUTF8StringEncoding];
+    [self.endpoints setObject:endpoint forKey:path];
+    return endpoint;
+}
+
+@end
@@ -0,0 +1,105 @@
+//
+//  STResultDiff.h
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class STResultSnapshot;
+
+/**
+ Changes between two `STResultSnapshot` objects of the same section order, as the row updates a table view
+ needs to go from one to the other.
+
+ Records are matched by their `id` within a section. A matched record whose content changed is reloaded. The
+ fewest records are moved: the longest sequence of matched records still in their old order stays put and only
+ the others are moved, so moving one row to the front moves just that row. One that changed and moved is deleted
+ and inserted again since a table view can't do both to the same row. Records without an `id`, or whose `id`
+ appears more than once in the section, can't be matched and are always deleted and inserted.
+
+ Deleted, reloaded and moved-from indexes refer to the old snapshot, inserted and moved-to indexes to the new
+ one, which is how `UITableView` expects them between `beginUpdates` and `endUpdates`. Computing the diff takes
+ time proportional to the number of records in both snapshots, times the logarithm of that for the moves.
+ Pages that a snapshot took over from the other one are skipped, so after appending a page or replacing some
+ pages of `STPagedResultStore` only the records of those pages are compared.
+ */
+@interface STResultDiff : NSObject
+
+/**
+ Compares two snapshots.
+
+ @param fromSnapshot The snapshot currently displayed
+ @param toSnapshot The snapshot that replaces it
+
+ @return The changes from `fromSnapshot` to `toSnapshot`
+ */
++ (STResultDiff *)diffFromSnapshot:(STResultSnapshot *)fromSnapshot toSnapshot:(STResultSnapshot *)toSnapshot;
+
+/**
+ Compares two snapshots that only differ by records appended at the end of their sections. The appended
+ records are inserted and nothing else changes, which takes time proportional to the number of sections
+ instead of the number of records. Falls back to `diffFromSnapshot:toSnapshot:` unless every section of the
+ new snapshot holds as many records as the old one plus its appended range.
+
+ @param fromSnapshot The snapshot currently displayed
+ @param toSnapshot The snapshot that replaces it
+ @param appendedRanges Ranges of the appended records as `NSValue` objects keyed by document type, as
+ `-[STPagedResultStore appendResult:]` returns them. May be nil.
+
+ @return The changes from `fromSnapshot` to `toSnapshot`
+ */
++ (STResultDiff *)diffFromSnapshot:(STResultSnapshot *)fromSnapshot toSnapshot:(STResultSnapshot *)toSnapshot appendedRanges:(NSDictionary *)appendedRanges;
+
+/**
+ `YES` if the snapshots have different section orders. No row changes are computed in that case.
+ */
+@property (nonatomic, readonly, assign) BOOL sectionsChanged;
+
+/**
+ Number of sections both snapshots share
+ */
+@property (nonatomic, readonly) NSUInteger numberOfSections;
+
+/**
+ Number of records found in both snapshots, whether or not they changed
+ */
+@property (nonatomic, readonly, assign) NSUInteger matchedCount;
+
+/**
+ `YES` if any record was deleted, inserted, reloaded or moved, or the sections changed
+ */
+@property (nonatomic, readonly) BOOL hasChanges;
+
+/**
+ Indexes of the old snapshot's records that are gone
+
+ @param section Index into the section order
+ */
+- (NSIndexSet *)deletedIndexesInSection:(NSUInteger)section;
+
+/**
+ Indexes of the new snapshot's records that are new
+
+ @param section Index into the section order
+ */
+- (NSIndexSet *)insertedIndexesInSection:(NSUInteger)section;
+
+/**
+ Indexes of the old snapshot's records whose content changed in place
+
+ @param section Index into the section order
+ */
+- (NSIndexSet *)reloadedIndexesInSection:(NSUInteger)section;
+
+/**
+ Calls a block for every record that moved but did not change.
+
+ @param section Index into the section order
+ @param block Called with the index of the record in the old and in the new snapshot
+ */
+- (void)enumerateMovesInSection:(NSUInteger)section usingBlock:(void (^)(NSUInteger fromIndex, NSUInteger toIndex))block;
+
+@end
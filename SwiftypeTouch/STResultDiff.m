@@ -0,0 +1,328 @@
+//
+//  STResultDiff.m
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import "STResultDiff.h"
+#import "STResultSnapshot.h"
+#import "STResultSnapshot+Private.h"
+
+/*
+ The changes of a single section
+ */
+@interface STResultSectionDiff : NSObject
+
+@property (nonatomic, strong) NSMutableIndexSet *deletedIndexes;
+@property (nonatomic, strong) NSMutableIndexSet *insertedIndexes;
+@property (nonatomic, strong) NSMutableIndexSet *reloadedIndexes;
+@property (nonatomic, strong) NSMutableArray *moves;
+
+@end
+
+@implementation STResultSectionDiff
+
+- (id)init {
+    self = [super init];
+    if (self) {
+        self.deletedIndexes = [NSMutableIndexSet indexSet];
+        self.insertedIndexes = [NSMutableIndexSet indexSet];
+        self.reloadedIndexes = [NSMutableIndexSet indexSet];
+        self.moves = [NSMutableArray array];
+    }
+    return self;
+}
+
+@end
+
+@interface STResultDiff ()
+
+@property (nonatomic, assign) BOOL sectionsChanged;
+@property (nonatomic, assign) NSUInteger matchedCount;
+@property (nonatomic, strong) NSArray *sectionDiffs;
+
+- (STResultSectionDiff *)_diffFromPages:(NSArray *)oldPages toPages:(NSArray *)newPages;
+- (STResultSectionDiff *)_diffFromRecords:(NSArray *)oldRecords toRecords:(NSArray *)newRecords;
+- (NSDictionary *)_indexesByIdOfRecords:(NSArray *)records;
+
+@end
+
+@implementation STResultDiff
+
+#pragma mark - NSObject
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@: %p sectionsChanged=%d matched=%lu changes=%d>",
+            NSStringFromClass([self class]), self, self.sectionsChanged, (unsigned long)self.matchedCount, self.hasChanges];
+}
+
+#pragma mark - STResultDiff
+
++ (STResultDiff *)diffFromSnapshot:(STResultSnapshot *)fromSnapshot toSnapshot:(STResultSnapshot *)toSnapshot {
+    STResultDiff *diff = [[STResultDiff alloc] init];
+    if (![fromSnapshot.sectionOrder isEqualToArray:toSnapshot.sectionOrder]) {
+        diff.sectionsChanged = YES;
+        diff.sectionDiffs = @[];
+        return diff;
+    }
+
+    NSMutableArray *sectionDiffs = [NSMutableArray arrayWithCapacity:toSnapshot.numberOfSections];
+    for (NSUInteger section = 0; section < toSnapshot.numberOfSections; section++) {
+        STResultSectionDiff *sectionDiff = [diff _diffFromPages:[fromSnapshot _pagesInSection:section]
+                                                        toPages:[toSnapshot _pagesInSection:section]];
+        if (sectionDiff == nil) {
+            sectionDiff = [diff _diffFromRecords:[fromSnapshot recordsInSection:section]
+                                       toRecords:[toSnapshot recordsInSection:section]];
+        }
+        [sectionDiffs addObject:sectionDiff];
+    }
+    diff.sectionDiffs = sectionDiffs;
+    return diff;
+}
+
++ (STResultDiff *)diffFromSnapshot:(STResultSnapshot *)fromSnapshot toSnapshot:(STResultSnapshot *)toSnapshot appendedRanges:(NSDictionary *)appendedRanges {
+    if (appendedRanges.count == 0 || ![fromSnapshot.sectionOrder isEqualToArray:toSnapshot.sectionOrder]) {
+        return [STResultDiff diffFromSnapshot:fromSnapshot toSnapshot:toSnapshot];
+    }
+
+    STResultDiff *diff = [[STResultDiff alloc] init];
+    NSMutableArray *sectionDiffs = [NSMutableArray arrayWithCapacity:toSnapshot.numberOfSections];
+    NSUInteger matchedCount = 0;
+    for (NSUInteger section = 0; section < toSnapshot.numberOfSections; section++) {
+        NSUInteger oldCount = [fromSnapshot numberOfRecordsInSection:section];
+        NSUInteger newCount = [toSnapshot numberOfRecordsInSection:section];
+        NSValue *rangeValue = [appendedRanges objectForKey:[toSnapshot typeForSection:section]];
+        NSRange range = rangeValue ? [rangeValue rangeValue] : NSMakeRange(oldCount, 0);
+        // Records that went missing or landed anywhere else need the records compared
+        if (range.location != oldCount || NSMaxRange(range) != newCount) {
+            return [STResultDiff diffFromSnapshot:fromSnapshot toSnapshot:toSnapshot];
+        }
+
+        STResultSectionDiff *sectionDiff = [[STResultSectionDiff alloc] init];
+        [sectionDiff.insertedIndexes addIndexesInRange:range];
+        [sectionDiffs addObject:sectionDiff];
+        matchedCount += oldCount;
+    }
+    diff.sectionDiffs = sectionDiffs;
+    diff.matchedCount = matchedCount;
+    return diff;
+}
+
+- (NSUInteger)numberOfSections {
+    return self.sectionDiffs.count;
+}
+
+- (BOOL)hasChanges {
+    if (self.sectionsChanged) {
+        return YES;
+    }
+
+    for (STResultSectionDiff *sectionDiff in self.sectionDiffs) {
+        if (sectionDiff.deletedIndexes.count > 0 || sectionDiff.insertedIndexes.count > 0 ||
+            sectionDiff.reloadedIndexes.count > 0 || sectionDiff.moves.count > 0) {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+- (NSIndexSet *)deletedIndexesInSection:(NSUInteger)section {
+    if (section < self.sectionDiffs.count) {
+        return [[self.sectionDiffs objectAtIndex:section] deletedIndexes];
+    }
+    return [NSIndexSet indexSet];
+}
+
+- (NSIndexSet *)insertedIndexesInSection:(NSUInteger)section {
+    if (section < self.sectionDiffs.count) {
+        return [[self.sectionDiffs objectAtIndex:section] insertedIndexes];
+    }
+    return [NSIndexSet indexSet];
+}
+
+- (NSIndexSet *)reloadedIndexesInSection:(NSUInteger)section {
+    if (section < self.sectionDiffs.count) {
+        return [[self.sectionDiffs objectAtIndex:section] reloadedIndexes];
+    }
+    return [NSIndexSet indexSet];
+}
+
+- (void)enumerateMovesInSection:(NSUInteger)section usingBlock:(void (^)(NSUInteger fromIndex, NSUInteger toIndex))block {
+    if (section >= self.sectionDiffs.count) {
+        return;
+    }
+
+    for (NSArray *move in [[self.sectionDiffs objectAtIndex:section] moves]) {
+        block([[move objectAtIndex:0] unsignedIntegerValue], [[move objectAtIndex:1] unsignedIntegerValue]);
+    }
+}
+
+#pragma mark - Private
+
+- (STResultSectionDiff *)_diffFromPages:(NSArray *)oldPages toPages:(NSArray *)newPages {
+    /* A page both snapshots share holds the same records in the same place, so only the other pages are looked
+     at. Pages replaced by as many records with the same ids are reloaded where they changed, pages added at
+     the end are inserted. Anything else needs the records of the section matched by id.
+     */
+    if (newPages.count < oldPages.count) {
+        return nil;
+    }
+
+    STResultSectionDiff *sectionDiff = [[STResultSectionDiff alloc] init];
+    NSUInteger matchedCount = 0;
+    NSUInteger start = 0;
+    for (NSUInteger page = 0; page < newPages.count; page++) {
+        NSArray *newRecords = [newPages objectAtIndex:page];
+        if (page >= oldPages.count) {
+            [sectionDiff.insertedIndexes addIndexesInRange:NSMakeRange(start, newRecords.count)];
+            start += newRecords.count;
+            continue;
+        }
+
+        NSArray *oldRecords = [oldPages objectAtIndex:page];
+        if (oldRecords != newRecords) {
+            if (oldRecords.count != newRecords.count) {
+                return nil;
+            }
+            for (NSUInteger index = 0; index < newRecords.count; index++) {
+                NSDictionary *oldRecord = [oldRecords objectAtIndex:index];
+                NSDictionary *newRecord = [newRecords objectAtIndex:index];
+                id recordId = [newRecord objectForKey:@"id"];
+                if (recordId == nil || ![recordId isEqual:[oldRecord objectForKey:@"id"]]) {
+                    return nil;
+                }
+                if (![oldRecord isEqual:newRecord]) {
+                    [sectionDiff.reloadedIndexes addIndex:start + index];
+                }
+            }
+        }
+        matchedCount += oldRecords.count;
+        start += newRecords.count;
+    }
+
+    self.matchedCount += matchedCount;
+    return sectionDiff;
+}
+
+- (STResultSectionDiff *)_diffFromRecords:(NSArray *)oldRecords toRecords:(NSArray *)newRecords {
+    STResultSectionDiff *sectionDiff = [[STResultSectionDiff alloc] init];
+    NSUInteger oldCount = oldRecords.count;
+    NSUInteger newCount = newRecords.count;
+
+    // Pair up the records by id, anything left unpaired is deleted or inserted
+    NSDictionary *oldIndexesById = [self _indexesByIdOfRecords:oldRecords];
+    NSDictionary *newIndexesById = [self _indexesByIdOfRecords:newRecords];
+    NSMutableData *oldToNewData = [NSMutableData dataWithLength:oldCount * sizeof(NSUInteger)];
+    NSMutableData *newToOldData = [NSMutableData dataWithLength:newCount * sizeof(NSUInteger)];
+    NSUInteger *oldToNew = oldToNewData.mutableBytes;
+    NSUInteger *newToOld = newToOldData.mutableBytes;
+    for (NSUInteger i = 0; i < oldCount; i++) {
+        oldToNew[i] = NSNotFound;
+    }
+    for (NSUInteger j = 0; j < newCount; j++) {
+        newToOld[j] = NSNotFound;
+    }
+    [newIndexesById enumerateKeysAndObjectsUsingBlock:^(id recordId, NSNumber *newIndex, BOOL *stop) {
+        NSNumber *oldIndex = [oldIndexesById objectForKey:recordId];
+        if (oldIndex && newIndex != (id)[NSNull null] && oldIndex != (id)[NSNull null]) {
+            oldToNew[[oldIndex unsignedIntegerValue]] = [newIndex unsignedIntegerValue];
+            newToOld[[newIndex unsignedIntegerValue]] = [oldIndex unsignedIntegerValue];
+        }
+    }];
+
+    for (NSUInteger i = 0; i < oldCount; i++) {
+        if (oldToNew[i] == NSNotFound) {
+            [sectionDiff.deletedIndexes addIndex:i];
+        }
+    }
+
+    /* The paired records that keep their order are the longest run of old indexes that increases in the new
+     order, only the others have to move. Found in O(n log n): tails[k] is the pairing ending the smallest
+     increasing run of length k + 1 seen so far, and previous links each pairing to the one before it in its run.
+     */
+    NSMutableData *pairedData = [NSMutableData dataWithLength:newCount * sizeof(NSUInteger)];
+    NSMutableData *tailData = [NSMutableData dataWithLength:newCount * sizeof(NSUInteger)];
+    NSMutableData *previousData = [NSMutableData dataWithLength:newCount * sizeof(NSUInteger)];
+    NSMutableData *keptData = [NSMutableData dataWithLength:newCount * sizeof(BOOL)];
+    NSUInteger *paired = pairedData.mutableBytes;
+    NSUInteger *tails = tailData.mutableBytes;
+    NSUInteger *previous = previousData.mutableBytes;
+    BOOL *kept = keptData.mutableBytes;
+    NSUInteger matchedCount = 0;
+    NSUInteger runLength = 0;
+    for (NSUInteger j = 0; j < newCount; j++) {
+        NSUInteger i = newToOld[j];
+        if (i == NSNotFound) {
+            continue;
+        }
+
+        NSUInteger low = 0;
+        NSUInteger high = runLength;
+        while (low < high) {
+            NSUInteger middle = (low + high) / 2;
+            if (newToOld[paired[tails[middle]]] < i) {
+                low = middle + 1;
+            }
+            else {
+                high = middle;
+            }
+        }
+        paired[matchedCount] = j;
+        previous[matchedCount] = (low > 0) ? tails[low - 1] : NSNotFound;
+        tails[low] = matchedCount;
+        if (low == runLength) {
+            runLength++;
+        }
+        matchedCount++;
+    }
+    for (NSUInteger k = (runLength > 0) ? tails[runLength - 1] : NSNotFound; k != NSNotFound; k = previous[k]) {
+        kept[paired[k]] = YES;
+    }
+
+    for (NSUInteger j = 0; j < newCount; j++) {
+        NSUInteger i = newToOld[j];
+        if (i == NSNotFound) {
+            [sectionDiff.insertedIndexes addIndex:j];
+            continue;
+        }
+
+        BOOL changed = ![[oldRecords objectAtIndex:i] isEqual:[newRecords objectAtIndex:j]];
+        BOOL moved = !kept[j];
+        if (moved && changed) {
+            [sectionDiff.deletedIndexes addIndex:i];
+            [sectionDiff.insertedIndexes addIndex:j];
+        }
+        else if (moved) {
+            [sectionDiff.moves addObject:@[ @(i), @(j) ]];
+        }
+        else if (changed) {
+            [sectionDiff.reloadedIndexes addIndex:i];
+        }
+    }
+
+    self.matchedCount += matchedCount;
+    return sectionDiff;
+}
+
+- (NSDictionary *)_indexesByIdOfRecords:(NSArray *)records {
+    // An id seen twice can't tell its records apart, it is kept as NSNull so neither gets paired
+    NSMutableDictionary *indexesById = [NSMutableDictionary dictionaryWithCapacity:records.count];
+    NSUInteger index = 0;
+    for (NSDictionary *record in records) {
+        id recordId = [record objectForKey:@"id"];
+        if (recordId) {
+            if ([indexesById objectForKey:recordId]) {
+                [indexesById setObject:[NSNull null] forKey:recordId];
+            }
+            else {
+                [indexesById setObject:@(index) forKey:recordId];
+            }
+        }
+        index++;
+    }
+    return indexesById;
+}
+
+@end
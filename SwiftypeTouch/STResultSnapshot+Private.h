@@ -0,0 +1,20 @@
+//
+//  STResultSnapshot+Private.h
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import "STResultSnapshot.h"
+
+/*
+ Page layout of `STResultSnapshot` shared with `STResultDiff`. Not part of the public headers.
+ */
+@interface STResultSnapshot ()
+
+// The checked records of a section page by page. A page taken over from the reused snapshot is the same array
+// in both snapshots, so it holds the same records
+- (NSArray *)_pagesInSection:(NSUInteger)section;
+
+@end
@@ -0,0 +1,234 @@
+//
+//  STResultSnapshot.h
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ Immutable, typed view of a decoded result laid out for a table view.
+
+ The result is checked once when the snapshot is created: the records of every document type of the section
+ order are copied into an array per page, anything that is not a dictionary is replaced by an empty one,
+ and the paging info and the strings of the display fields are pulled out of their dictionaries. Looking up
+ a section, a row count, a page count, a record by position or a display string by position afterwards takes
+ constant time and needs neither dictionary lookups nor class checks. Display fields are resolved to their
+ positions when the snapshot is built, see `indexOfField:inSection:`.
+
+ Building a snapshot takes time proportional to the number of records, so it is best done in the background,
+ for example in `client:prepareResult:forRequest:`, and handed to the main thread. A snapshot isn't kept with its
+ result, whoever builds one decides how long to keep it. Results that grow page by page, like those of `STPagedResultStore`, are better
+ served by `snapshotOfResult:pages:sectionOrder:displayFields:reusingSnapshot:`, which only checks the pages
+ that changed since the previous snapshot, and results that grow at the end while they load by
+ `snapshotOfResult:sectionOrder:displayFields:extendingSnapshot:`. Snapshots are safe to use from any thread.
+ */
+@interface STResultSnapshot : NSObject
+
+/**
+ Builds the snapshot of a result for a section order.
+
+ @param result Decoded result as returned by `STAPIClient`, may be nil
+ @param sectionOrder Document types in the order of the sections
+ @param displayFields Arrays of field names keyed by document type, may be nil
+
+ @return A snapshot of the result
+ */
++ (STResultSnapshot *)snapshotOfResult:(NSDictionary *)result sectionOrder:(NSArray *)sectionOrder displayFields:(NSDictionary *)displayFields;
+
+/**
+ Builds the snapshot of a result whose records come in pages. A page that is the same array as the page at the
+ same position of `snapshot` is taken over as it is, so building the snapshot takes time proportional to the
+ number of records in new or replaced pages. The pages must not be changed once passed, a page whose records
+ change has to be replaced by a new array.
+
+ @param result Decoded result, its `info` is read for paging and its `records` for types outside `sectionOrder`
+ @param pages Arrays of the pages of records of each document type, every page an array of records
+ @param sectionOrder Document types in the order of the sections
+ @param displayFields Arrays of field names keyed by document type, may be nil
+ @param snapshot Earlier snapshot of the same pages, only reused if it has the same section order and display fields
+
+ @return A snapshot of the result
+ */
++ (STResultSnapshot *)snapshotOfResult:(NSDictionary *)result pages:(NSDictionary *)pages sectionOrder:(NSArray *)sectionOrder displayFields:(NSDictionary *)displayFields reusingSnapshot:(STResultSnapshot *)snapshot;
+
+/**
+ Builds the snapshot of a result whose records only grew at the end since `snapshot` was built, like the partial
+ results of a response that is still loading. The records already in `snapshot` are taken over without looking at
+ them, so building the snapshot takes time proportional to the records that were added.
+
+ @param result Decoded result whose records of every type of `sectionOrder` start with those of `snapshot`
+ @param sectionOrder Document types in the order of the sections
+ @param displayFields Arrays of field names keyed by document type, may be nil
+ @param snapshot Snapshot of the earlier records. A snapshot of other section order or display fields, or one
+ with more records than `result`, is not reused
+
+ @return A snapshot of the result
+ */
++ (STResultSnapshot *)snapshotOfResult:(NSDictionary *)result sectionOrder:(NSArray *)sectionOrder displayFields:(NSDictionary *)displayFields extendingSnapshot:(STResultSnapshot *)snapshot;
+
+/**
+ Builds a snapshot, like `snapshotOfResult:sectionOrder:displayFields:`.
+
+ @param result Decoded result as returned by `STAPIClient`, may be nil
+ @param sectionOrder Document types in the order of the sections
+ @param displayFields Arrays of field names keyed by document type, may be nil
+ */
+- (id)initWithResult:(NSDictionary *)result sectionOrder:(NSArray *)sectionOrder displayFields:(NSDictionary *)displayFields;
+
+/**
+ The result the snapshot was built from. Only weakly referenced so a snapshot kept around doesn't keep the
+ whole result alive, nil once nothing else holds the result.
+ */
+@property (nonatomic, readonly, weak) NSDictionary *result;
+
+/**
+ Document types in the order of the sections
+ */
+@property (nonatomic, readonly, copy) NSArray *sectionOrder;
+
+/**
+ Arrays of field names keyed by document type whose values are kept as strings
+ */
+@property (nonatomic, readonly, copy) NSDictionary *displayFields;
+
+/**
+ Number of sections, the number of document types in `sectionOrder`
+ */
+@property (nonatomic, readonly) NSUInteger numberOfSections;
+
+/**
+ Number of records in all sections
+ */
+@property (nonatomic, readonly) NSUInteger numberOfRecords;
+
+/**
+ The `current_page` of the first document type in the result's `info`, 1 if the result does not name one
+ */
+@property (nonatomic, readonly) NSInteger currentPage;
+
+/**
+ The document type of a section
+
+ @param section Index into `sectionOrder`
+
+ @return The document type or nil if the section is out of bounds
+ */
+- (NSString *)typeForSection:(NSUInteger)section;
+
+/**
+ The section of a document type
+
+ @param type Document type
+
+ @return Index into `sectionOrder` or `NSNotFound` if the type has no section
+ */
+- (NSUInteger)sectionForType:(NSString *)type;
+
+/**
+ Number of records in a section, 0 if the section is out of bounds
+
+ @param section Index into `sectionOrder`
+ */
+- (NSUInteger)numberOfRecordsInSection:(NSUInteger)section;
+
+/**
+ The records of a section
+
+ @param section Index into `sectionOrder`
+
+ @return Array of `NSDictionary` records, empty if the section is out of bounds
+ */
+- (NSArray *)recordsInSection:(NSUInteger)section;
+
+/**
+ The records of a document type. Types outside of `sectionOrder` are looked up in `result`.
+
+ @param type Document type
+
+ @return Array of records, empty if the result has no records of the type
+ */
+- (NSArray *)recordsForType:(NSString *)type;
+
+/**
+ Looks up a record by position.
+
+ @param index Position of the record in its section
+ @param section Index into `sectionOrder`
+
+ @return The record or an empty dictionary if the index or the section is out of bounds
+ */
+- (NSDictionary *)recordAtIndex:(NSUInteger)index inSection:(NSUInteger)section;
+
+/**
+ The `num_pages` of a section's `info`, 0 if the result does not name one
+
+ @param section Index into `sectionOrder`
+ */
+- (NSInteger)numberOfPagesInSection:(NSUInteger)section;
+
+/**
+ The `current_page` of a section's `info`. Sections can be on different pages when they were paged
+ separately, a section whose `info` does not name one is on `currentPage`.
+
+ @param section Index into `sectionOrder`
+ */
+- (NSInteger)currentPageInSection:(NSUInteger)section;
+
+/**
+ Whether a section has pages after its current page
+
+ @param section Index into `sectionOrder`
+ */
+- (BOOL)hasMorePagesInSection:(NSUInteger)section;
+
+/**
+ Whether any section has pages after its current page
+ */
+- (BOOL)hasMorePages;
+
+/**
+ Whether the snapshot was built for a section order and display fields, and so can stand in for one built
+ for them.
+
+ @param sectionOrder Document types in the order of the sections
+ @param displayFields Arrays of field names keyed by document type, may be nil
+ */
+- (BOOL)matchesSectionOrder:(NSArray *)sectionOrder displayFields:(NSDictionary *)displayFields;
+
+/**
+ The position of a display field among the `displayFields` of a section's document type. Meant to be looked up
+ once per snapshot and passed to `stringForFieldAtIndex:atIndex:inSection:` for every row.
+
+ @param field Field name
+ @param section Index into `sectionOrder`
+
+ @return The position or `NSNotFound` if the field isn't a display field of the section
+ */
+- (NSUInteger)indexOfField:(NSString *)field inSection:(NSUInteger)section;
+
+/**
+ Looks up the value of a display field of a record by the field's name.
+
+ @param field One of the `displayFields` of the section's document type
+ @param index Position of the record in its section
+ @param section Index into `sectionOrder`
+
+ @return The value if it is a string, the description of a number, nil otherwise
+ */
+- (NSString *)stringForField:(NSString *)field atIndex:(NSUInteger)index inSection:(NSUInteger)section;
+
+/**
+ Looks up the value of a display field of a record by the field's position, in constant time.
+
+ @param fieldIndex Position of the field among the `displayFields` of the section's document type
+ @param index Position of the record in its section
+ @param section Index into `sectionOrder`
+
+ @return The value if it is a string, the description of a number, nil otherwise
+ */
+- (NSString *)stringForFieldAtIndex:(NSUInteger)fieldIndex atIndex:(NSUInteger)index inSection:(NSUInteger)section;
+
+@end
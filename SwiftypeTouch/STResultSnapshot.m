@@ -0,0 +1,471 @@
+//
+//  STResultSnapshot.m
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import "STResultSnapshot.h"
+#import "STResultSnapshot+Private.h"
+
+/*
+ The checked records of one page of a section and the strings of their display fields. Shared by every
+ snapshot built from the same page
+ */
+@interface STResultSnapshotPage : NSObject
+
+@property (nonatomic, strong) NSArray *source;
+@property (nonatomic, strong) NSArray *records;
+@property (nonatomic, strong) NSArray *fieldValues;
+
+@end
+
+@implementation STResultSnapshotPage
+@end
+
+/*
+ The records of a section as a single array, looked up in the pages they came in without copying them. Every
+ record knows its page, so a lookup takes constant time
+ */
+@interface STResultSnapshotRecords : NSArray
+
+@property (nonatomic, copy) NSArray *pages;
+@property (nonatomic, strong) NSData *startData;
+@property (nonatomic, strong) NSData *recordPageData;
+@property (nonatomic, assign) NSUInteger recordCount;
+
+- (id)initWithPages:(NSArray *)pages;
+- (NSUInteger)pageOfIndex:(NSUInteger)index start:(NSUInteger *)start;
+
+@end
+
+@implementation STResultSnapshotRecords
+
+- (id)initWithPages:(NSArray *)pages {
+    self = [super init];
+    if (self) {
+        self.pages = pages;
+        NSMutableData *startData = [NSMutableData dataWithLength:(pages.count + 1) * sizeof(NSUInteger)];
+        NSUInteger *starts = startData.mutableBytes;
+        for (NSUInteger page = 0; page < pages.count; page++) {
+            starts[page + 1] = starts[page] + [[[pages objectAtIndex:page] records] count];
+        }
+        self.startData = startData;
+        self.recordCount = starts[pages.count];
+
+        NSMutableData *recordPageData = [NSMutableData dataWithLength:self.recordCount * sizeof(NSUInteger)];
+        NSUInteger *recordPages = recordPageData.mutableBytes;
+        for (NSUInteger page = 0; page < pages.count; page++) {
+            for (NSUInteger index = starts[page]; index < starts[page + 1]; index++) {
+                recordPages[index] = page;
+            }
+        }
+        self.recordPageData = recordPageData;
+    }
+    return self;
+}
+
+- (id)copyWithZone:(NSZone *)zone {
+    // Immutable, a copy would only walk every page
+    return self;
+}
+
+- (NSUInteger)count {
+    return self.recordCount;
+}
+
+- (id)objectAtIndex:(NSUInteger)index {
+    NSUInteger start = 0;
+    NSUInteger page = [self pageOfIndex:index start:&start];
+    if (page == NSNotFound) {
+        [NSException raise:NSRangeException format:@"Index %lu beyond bounds of %lu records", (unsigned long)index, (unsigned long)self.recordCount];
+    }
+    return [[[self.pages objectAtIndex:page] records] objectAtIndex:index - start];
+}
+
+- (NSUInteger)pageOfIndex:(NSUInteger)index start:(NSUInteger *)start {
+    if (index >= self.recordCount) {
+        return NSNotFound;
+    }
+
+    NSUInteger page = ((const NSUInteger *)self.recordPageData.bytes)[index];
+    *start = ((const NSUInteger *)self.startData.bytes)[page];
+    return page;
+}
+
+@end
+
+@interface STResultSnapshot ()
+
+@property (nonatomic, weak) NSDictionary *result;
+@property (nonatomic, strong) NSDictionary *records;
+@property (nonatomic, copy) NSArray *sectionOrder;
+@property (nonatomic, copy) NSDictionary *displayFields;
+@property (nonatomic, assign) NSUInteger numberOfRecords;
+@property (nonatomic, assign) NSInteger currentPage;
+@property (nonatomic, strong) NSDictionary *sectionsByType;
+@property (nonatomic, strong) NSArray *sectionRecords;
+@property (nonatomic, strong) NSArray *sectionPageCounts;
+@property (nonatomic, strong) NSArray *sectionCurrentPages;
+@property (nonatomic, strong) NSArray *sectionFields;
+@property (nonatomic, strong) NSArray *sectionFieldIndexes;
+
+- (id)_initWithResult:(NSDictionary *)result pages:(NSDictionary *)pages sectionOrder:(NSArray *)sectionOrder displayFields:(NSDictionary *)displayFields reusingSnapshot:(STResultSnapshot *)snapshot;
++ (STResultSnapshotPage *)_pageOfRecords:(id)records fields:(NSArray *)fields;
++ (NSArray *)_validRecords:(id)records;
++ (NSArray *)_valuesOfFields:(NSArray *)fields inRecords:(NSArray *)records;
++ (NSInteger)_integerForKey:(NSString *)key inInfo:(id)info;
+
+@end
+
+@implementation STResultSnapshot
+
+#pragma mark - NSObject
+
+- (id)init {
+    return [self initWithResult:nil sectionOrder:@[] displayFields:nil];
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"<%@: %p sections=%@ records=%lu page=%ld>",
+            NSStringFromClass([self class]), self, self.sectionOrder, (unsigned long)self.numberOfRecords, (long)self.currentPage];
+}
+
+#pragma mark - STResultSnapshot
+
++ (STResultSnapshot *)snapshotOfResult:(NSDictionary *)result sectionOrder:(NSArray *)sectionOrder displayFields:(NSDictionary *)displayFields {
+    return [[STResultSnapshot alloc] initWithResult:result sectionOrder:sectionOrder displayFields:displayFields];
+}
+
++ (STResultSnapshot *)snapshotOfResult:(NSDictionary *)result pages:(NSDictionary *)pages sectionOrder:(NSArray *)sectionOrder displayFields:(NSDictionary *)displayFields reusingSnapshot:(STResultSnapshot *)snapshot {
+    // Pages are only known to hold the same records as before when they were checked for the same fields
+    if (![snapshot matchesSectionOrder:sectionOrder displayFields:displayFields]) {
+        snapshot = nil;
+    }
+    return [[STResultSnapshot alloc] _initWithResult:result pages:(pages ? pages : @{}) sectionOrder:sectionOrder displayFields:displayFields reusingSnapshot:snapshot];
+}
+
++ (STResultSnapshot *)snapshotOfResult:(NSDictionary *)result sectionOrder:(NSArray *)sectionOrder displayFields:(NSDictionary *)displayFields extendingSnapshot:(STResultSnapshot *)snapshot {
+    NSDictionary *records = [result isKindOfClass:[NSDictionary class]] ? [result objectForKey:@"records"] : nil;
+    if (![records isKindOfClass:[NSDictionary class]] || ![snapshot matchesSectionOrder:sectionOrder displayFields:displayFields]) {
+        return [STResultSnapshot snapshotOfResult:result sectionOrder:sectionOrder displayFields:displayFields];
+    }
+
+    // The pages of the earlier records are taken over, the records added since become one more page
+    NSMutableDictionary *pages = [NSMutableDictionary dictionaryWithCapacity:snapshot.sectionOrder.count];
+    for (NSUInteger section = 0; section < snapshot.sectionOrder.count; section++) {
+        NSString *type = [snapshot.sectionOrder objectAtIndex:section];
+        STResultSnapshotRecords *earlierRecords = [snapshot.sectionRecords objectAtIndex:section];
+        NSArray *typeRecords = [records objectForKey:type];
+        if (![typeRecords isKindOfClass:[NSArray class]]) {
+            typeRecords = @[];
+        }
+        if (typeRecords.count < earlierRecords.count) {
+            return [STResultSnapshot snapshotOfResult:result sectionOrder:sectionOrder displayFields:displayFields];
+        }
+
+        NSMutableArray *typePages = [NSMutableArray arrayWithCapacity:earlierRecords.pages.count + 1];
+        for (STResultSnapshotPage *page in earlierRecords.pages) {
+            [typePages addObject:page.source];
+        }
+        if (typeRecords.count > earlierRecords.count) {
+            [typePages addObject:[typeRecords subarrayWithRange:NSMakeRange(earlierRecords.count, typeRecords.count - earlierRecords.count)]];
+        }
+        [pages setObject:typePages forKey:type];
+    }
+    return [[STResultSnapshot alloc] _initWithResult:result pages:pages sectionOrder:sectionOrder displayFields:displayFields reusingSnapshot:snapshot];
+}
+
+- (id)initWithResult:(NSDictionary *)result sectionOrder:(NSArray *)sectionOrder displayFields:(NSDictionary *)displayFields {
+    return [self _initWithResult:result pages:nil sectionOrder:sectionOrder displayFields:displayFields reusingSnapshot:nil];
+}
+
+- (NSUInteger)numberOfSections {
+    return self.sectionOrder.count;
+}
+
+- (NSString *)typeForSection:(NSUInteger)section {
+    if (section < self.sectionOrder.count) {
+        return [self.sectionOrder objectAtIndex:section];
+    }
+    return nil;
+}
+
+- (NSUInteger)sectionForType:(NSString *)type {
+    NSNumber *section = type ? [self.sectionsByType objectForKey:type] : nil;
+    return section ? [section unsignedIntegerValue] : NSNotFound;
+}
+
+- (NSUInteger)numberOfRecordsInSection:(NSUInteger)section {
+    if (section < self.sectionRecords.count) {
+        return [[self.sectionRecords objectAtIndex:section] count];
+    }
+    return 0;
+}
+
+- (NSArray *)recordsInSection:(NSUInteger)section {
+    if (section < self.sectionRecords.count) {
+        return [self.sectionRecords objectAtIndex:section];
+    }
+    return @[];
+}
+
+- (NSArray *)recordsForType:(NSString *)type {
+    NSUInteger section = [self sectionForType:type];
+    if (section != NSNotFound) {
+        return [self.sectionRecords objectAtIndex:section];
+    }
+
+    // The records are held rather than the result, which holds the snapshot
+    NSArray *records = [self.records objectForKey:type];
+    if ([records isKindOfClass:[NSArray class]]) {
+        return records;
+    }
+    return @[];
+}
+
+- (NSDictionary *)recordAtIndex:(NSUInteger)index inSection:(NSUInteger)section {
+    NSArray *records = [self recordsInSection:section];
+    if (index < records.count) {
+        return [records objectAtIndex:index];
+    }
+    return @{};
+}
+
+- (NSInteger)numberOfPagesInSection:(NSUInteger)section {
+    if (section < self.sectionPageCounts.count) {
+        return [[self.sectionPageCounts objectAtIndex:section] integerValue];
+    }
+    return 0;
+}
+
+- (NSInteger)currentPageInSection:(NSUInteger)section {
+    if (section < self.sectionCurrentPages.count) {
+        return [[self.sectionCurrentPages objectAtIndex:section] integerValue];
+    }
+    return self.currentPage;
+}
+
+- (BOOL)hasMorePagesInSection:(NSUInteger)section {
+    return [self currentPageInSection:section] < [self numberOfPagesInSection:section];
+}
+
+- (BOOL)hasMorePages {
+    for (NSUInteger section = 0; section < self.sectionPageCounts.count; section++) {
+        if ([self hasMorePagesInSection:section]) {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+- (NSUInteger)indexOfField:(NSString *)field inSection:(NSUInteger)section {
+    NSNumber *fieldIndex = (section < self.sectionFieldIndexes.count && field) ? [[self.sectionFieldIndexes objectAtIndex:section] objectForKey:field] : nil;
+    return fieldIndex ? [fieldIndex unsignedIntegerValue] : NSNotFound;
+}
+
+- (NSString *)stringForField:(NSString *)field atIndex:(NSUInteger)index inSection:(NSUInteger)section {
+    return [self stringForFieldAtIndex:[self indexOfField:field inSection:section] atIndex:index inSection:section];
+}
+
+- (NSString *)stringForFieldAtIndex:(NSUInteger)fieldIndex atIndex:(NSUInteger)index inSection:(NSUInteger)section {
+    if (section >= self.sectionFields.count) {
+        return nil;
+    }
+
+    NSArray *fields = [self.sectionFields objectAtIndex:section];
+    STResultSnapshotRecords *records = [self.sectionRecords objectAtIndex:section];
+    NSUInteger start = 0;
+    NSUInteger page = [records pageOfIndex:index start:&start];
+    if (fieldIndex >= fields.count || page == NSNotFound) {
+        return nil;
+    }
+
+    // Values are laid out record by record, every record of a page has a slot for each field
+    id value = [[[records.pages objectAtIndex:page] fieldValues] objectAtIndex:(index - start) * fields.count + fieldIndex];
+    return (value == [NSNull null]) ? nil : value;
+}
+
+#pragma mark - STResultSnapshot+Private
+
+- (NSArray *)_pagesInSection:(NSUInteger)section {
+    if (section >= self.sectionRecords.count) {
+        return @[];
+    }
+
+    NSArray *pages = [[self.sectionRecords objectAtIndex:section] pages];
+    NSMutableArray *pageRecords = [NSMutableArray arrayWithCapacity:pages.count];
+    for (STResultSnapshotPage *page in pages) {
+        [pageRecords addObject:page.records];
+    }
+    return pageRecords;
+}
+
+#pragma mark - Private
+
+- (id)_initWithResult:(NSDictionary *)result pages:(NSDictionary *)pages sectionOrder:(NSArray *)sectionOrder displayFields:(NSDictionary *)displayFields reusingSnapshot:(STResultSnapshot *)snapshot {
+    self = [super init];
+    if (self) {
+        if (![result isKindOfClass:[NSDictionary class]]) {
+            result = @{};
+        }
+        self.result = result;
+        self.sectionOrder = sectionOrder ? sectionOrder : @[];
+        self.displayFields = displayFields;
+
+        id records = [result objectForKey:@"records"];
+        id info = [result objectForKey:@"info"];
+        if (![records isKindOfClass:[NSDictionary class]]) {
+            records = nil;
+        }
+        self.records = records;
+        if (![info isKindOfClass:[NSDictionary class]]) {
+            info = nil;
+        }
+
+        NSUInteger sectionCount = self.sectionOrder.count;
+        NSMutableDictionary *sectionsByType = [NSMutableDictionary dictionaryWithCapacity:sectionCount];
+        NSMutableArray *sectionRecords = [NSMutableArray arrayWithCapacity:sectionCount];
+        NSMutableArray *sectionPageCounts = [NSMutableArray arrayWithCapacity:sectionCount];
+        NSMutableArray *sectionCurrentPages = [NSMutableArray arrayWithCapacity:sectionCount];
+        NSMutableArray *sectionFields = [NSMutableArray arrayWithCapacity:sectionCount];
+        NSMutableArray *sectionFieldIndexes = [NSMutableArray arrayWithCapacity:sectionCount];
+        NSUInteger numberOfRecords = 0;
+
+        for (NSUInteger section = 0; section < sectionCount; section++) {
+            NSString *type = [self.sectionOrder objectAtIndex:section];
+            // The first section of a type wins, like it would for recordTypeForSection:
+            if ([sectionsByType objectForKey:type] == nil) {
+                [sectionsByType setObject:@(section) forKey:type];
+            }
+
+            NSArray *fields = [displayFields objectForKey:type];
+            if (![fields isKindOfClass:[NSArray class]]) {
+                fields = @[];
+            }
+            [sectionFields addObject:fields];
+            // Resolved by name once, display strings are then found by position. The first of repeated fields wins
+            NSMutableDictionary *fieldIndexes = [NSMutableDictionary dictionaryWithCapacity:fields.count];
+            for (NSUInteger fieldIndex = fields.count; fieldIndex > 0; fieldIndex--) {
+                id field = [fields objectAtIndex:fieldIndex - 1];
+                if ([field isKindOfClass:[NSString class]]) {
+                    [fieldIndexes setObject:@(fieldIndex - 1) forKey:field];
+                }
+            }
+            [sectionFieldIndexes addObject:fieldIndexes];
+
+            // A result without pages is a single page. Of the pages given, those that are the same array as the
+            // page at the same position of the reused snapshot are taken over without looking at their records
+            NSArray *typePages = pages ? [pages objectForKey:type] : @[ [records objectForKey:type] ? [records objectForKey:type] : @[] ];
+            if (![typePages isKindOfClass:[NSArray class]]) {
+                typePages = @[];
+            }
+            NSArray *reusablePages = [[snapshot.sectionRecords objectAtIndex:section] pages];
+            NSMutableArray *snapshotPages = [NSMutableArray arrayWithCapacity:typePages.count];
+            for (NSUInteger page = 0; page < typePages.count; page++) {
+                id pageRecords = [typePages objectAtIndex:page];
+                STResultSnapshotPage *reusablePage = (page < reusablePages.count) ? [reusablePages objectAtIndex:page] : nil;
+                if (reusablePage.source == pageRecords) {
+                    [snapshotPages addObject:reusablePage];
+                }
+                else {
+                    [snapshotPages addObject:[STResultSnapshot _pageOfRecords:pageRecords fields:fields]];
+                }
+            }
+            STResultSnapshotRecords *typeRecords = [[STResultSnapshotRecords alloc] initWithPages:snapshotPages];
+            [sectionRecords addObject:typeRecords];
+            numberOfRecords += typeRecords.count;
+
+            [sectionPageCounts addObject:@([STResultSnapshot _integerForKey:@"num_pages" inInfo:[info objectForKey:type]])];
+            [sectionCurrentPages addObject:@([STResultSnapshot _integerForKey:@"current_page" inInfo:[info objectForKey:type]])];
+        }
+
+        self.sectionsByType = sectionsByType;
+        self.sectionRecords = sectionRecords;
+        self.sectionPageCounts = sectionPageCounts;
+        self.sectionFields = sectionFields;
+        self.sectionFieldIndexes = sectionFieldIndexes;
+        self.numberOfRecords = numberOfRecords;
+
+        // Types are on the same page unless they were paged separately, the first one that says which settles it
+        self.currentPage = 1;
+        for (id key in info) {
+            NSInteger currentPage = [STResultSnapshot _integerForKey:@"current_page" inInfo:[info objectForKey:key]];
+            if (currentPage > 0) {
+                self.currentPage = currentPage;
+                break;
+            }
+        }
+        for (NSUInteger section = 0; section < sectionCount; section++) {
+            if ([[sectionCurrentPages objectAtIndex:section] integerValue] <= 0) {
+                [sectionCurrentPages replaceObjectAtIndex:section withObject:@(self.currentPage)];
+            }
+        }
+        self.sectionCurrentPages = sectionCurrentPages;
+    }
+    return self;
+}
+
+- (BOOL)matchesSectionOrder:(NSArray *)sectionOrder displayFields:(NSDictionary *)displayFields {
+    if (![self.sectionOrder isEqualToArray:sectionOrder ? sectionOrder : @[]]) {
+        return NO;
+    }
+    return self.displayFields == displayFields || [self.displayFields isEqualToDictionary:displayFields];
+}
+
++ (STResultSnapshotPage *)_pageOfRecords:(id)records fields:(NSArray *)fields {
+    STResultSnapshotPage *page = [[STResultSnapshotPage alloc] init];
+    page.source = records;
+    page.records = [STResultSnapshot _validRecords:records];
+    page.fieldValues = [STResultSnapshot _valuesOfFields:fields inRecords:page.records];
+    return page;
+}
+
++ (NSArray *)_validRecords:(id)records {
+    if (![records isKindOfClass:[NSArray class]]) {
+        return @[];
+    }
+
+    // Copied since the caller may keep appending to a mutable array, the snapshot must not change with it
+    NSMutableArray *validRecords = [NSMutableArray arrayWithCapacity:[records count]];
+    for (id record in records) {
+        [validRecords addObject:[record isKindOfClass:[NSDictionary class]] ? record : @{}];
+    }
+    return validRecords;
+}
+
++ (NSArray *)_valuesOfFields:(NSArray *)fields inRecords:(NSArray *)records {
+    if (fields.count == 0) {
+        return @[];
+    }
+
+    NSMutableArray *values = [NSMutableArray arrayWithCapacity:records.count * fields.count];
+    for (NSDictionary *record in records) {
+        for (NSString *field in fields) {
+            id value = [record objectForKey:field];
+            if ([value isKindOfClass:[NSString class]]) {
+                [values addObject:value];
+            }
+            else if ([value isKindOfClass:[NSNumber class]]) {
+                [values addObject:[value description]];
+            }
+            else {
+                [values addObject:[NSNull null]];
+            }
+        }
+    }
+    return values;
+}
+
++ (NSInteger)_integerForKey:(NSString *)key inInfo:(id)info {
+    if ([info isKindOfClass:[NSDictionary class]]) {
+        NSNumber *n = [info objectForKey:key];
+        if ([n isKindOfClass:[NSNumber class]]) {
+            return [n integerValue];
+        }
+    }
+    return 0;
+}
+
+@end
@@ -0,0 +1,56 @@
+//
+//  STSearchResultsObject+Private.h
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import "STSearchResultsObject.h"
+
+/*
+ Table layout helpers of `STSearchResultsObject` shared with its subclasses. Not part of the public headers.
+ */
+@interface STSearchResultsObject ()
+
+// Writable so a subclass can make a request it started on its own the search query the user waits for
+@property (nonatomic, strong) STAPIRequest *searchRequest;
+
+// Document types of the sections, as returned by recordSectionOrder when the results were last set. Atomic
+// since results are prepared for them in the background
+@property (atomic, copy) NSArray *sectionOrder;
+
+// Fields of each document type its cells render, as declared by renderedFieldsForDocumentType:. Nil when none are
+@property (atomic, copy) NSDictionary *displayFields;
+
+// Fields of each document type suggest queries search, as declared by searchedFieldsForDocumentType:. Nil when none are
+@property (atomic, copy) NSDictionary *searchFields;
+
+// The title and url, in that order. What the bundled result objects render for every document type
+- (NSArray *)_titleAndURLFields;
+
+// Shows the title of a record and, for search results, its url in a subtitle cell. Read from the display strings of
+// `snapshot` by position when the rendered fields are _titleAndURLFields and the record lookups aren't overridden,
+// through recordForType:atIndex: otherwise
+- (void)_configureCell:(UITableViewCell *)cell forRowAtIndexPath:(NSIndexPath *)indexPath;
+
+// Snapshot of a result about to be shown, subclasses that know how the result was put together can reuse `snapshot`
+- (STResultSnapshot *)_snapshotOfResult:(NSDictionary *)result;
+
+// Asks recordSectionOrder and renderedFieldsForDocumentType: again, the results are about to be laid out for them
+- (void)_updateDisplayedTypes;
+
+// Index into the section order of `snapshot` for a table view section, taking the selected scope into account
+- (NSUInteger)_snapshotSectionForSection:(NSUInteger)section;
+
+// Whether the result of a finished request may replace the results on screen
+- (BOOL)_isCurrentRequest:(STAPIRequest *)request;
+
+// Shows the result of a finished request unless the request was canceled or overtaken, which its handle tells.
+// Called by client:didFinishRequest:withResult: before the request ends
+- (void)_applyResult:(NSDictionary *)result ofRequest:(STAPIRequest *)request;
+
+// Cancels the search query in flight and anything fetched along with it, newer text made it stale
+- (void)_cancelSearchRequests;
+
+@end
@@ -9,6 +9,20 @@
 #import <Foundation/Foundation.h>
 #import "STAPIClient.h"
 
+@class STSuggestScheduler;
+@class STResultSnapshot;
+
+/** When `STSearchResultsObject` clears the caches shared by every `STAPIClient`.
+
+ `STAPICacheClearPolicyNever` - Caches are never cleared automatically. Cached results expire on their own.
+
+ `STAPICacheClearPolicyOnEndEditing` - Caches are cleared whenever the search bar ends editing.
+ */
+typedef enum {
+    STAPICacheClearPolicyNever,
+    STAPICacheClearPolicyOnEndEditing
+} STAPICacheClearPolicy;
+
 /**
  `STSearchResultsObject` is an abstract class the provides a generic way to integrate
  `STAPIClient` into an iOS application. It provides basic functionality for STAPIClient
@@ -26,6 +40,8 @@
  following methods:
  
    * `recordSectionOrder` - provide the list of document type keys and order they should be displayed
+   * `renderedFieldsForDocumentType:` - optionally list the fields the cells use so only those are downloaded
+   * `searchedFieldsForDocumentType:` - optionally list the fields suggestions are matched on so they can be answered locally
    * `clientEngineKey` - provide key of the search engine that queries will be run against
    * `clientRequestParameters:forQuery:withType:` (delegate method from `STAPIClientDelegate`) - provide
      search parameters for a query.
@@ -50,22 +66,39 @@
  description of what it does and the helpful functionality it provides:
  
  * `searchResultsDataSource` for `UISearchDisplayController`
-   * `tableView:titleForHeaderInSection:` - returns a section title based on the data returned by `recordSectionOrder`
+   * `tableView:titleForHeaderInSection:` - returns a section title based on the data returned by `recordSectionOrder`,
+     for sections whose `recordsForType:` isn't empty
    * `numberOfSectionsInTableView:` - returns the number of sections in the table view taking into account the current search scope
-   * `tableView:numberOfRowsInSection:` - returns the number of rows in a given section taking into account the current search scope
+   * `tableView:numberOfRowsInSection:` - returns the number of `recordsForType:` of the `recordTypeForSection:`, taking into
+     account the current search scope
    * `searchBar:selectedScopeButtonIndexDidChange:` -
  * `delegate` for `UISearchDisplayController`
-   * `searchDisplayController:shouldReloadTableForSearchString:` - starts a timer that fires after 250ms at which point a suggest
-     query will actually be sent to the server. This helps prevent a request being generated for each keystroke
+   * `searchDisplayController:shouldReloadTableForSearchString:` - hands the text to `suggestScheduler` which sends a suggest
+     query once the user pauses typing, finishes a word or types something the client's caches can answer. This helps
+     prevent a request being generated for each keystroke
    * `searchDisplayController:didHideSearchResultsTableView:` - the table view is dismissed so clear out the `searchResultData`
  * `delegate` for `UISearchBar`
-   * `searchBarTextDidEndEditing:` - clears out the web request cache used to cache API requests
-   * `searchBarSearchButtonClicked:` - sends a search query to the server and cancels any pending suggest timer
+   * `searchBarTextDidBeginEditing:` - calls `warmUp` so the first query finds an open connection
+   * `searchBarTextDidEndEditing:` - clears out the caches used by API requests if `cacheClearPolicy` asks for it
+   * `searchBarSearchButtonClicked:` - sends a search query to the server and cancels any scheduled or pending
+     suggest query
    * `searchBar:selectedScopeButtonIndexDidChange:` - reloads table view since the search scope has changed
  * `delegate` for `STAPIClient`
-   * `clientRequestParameters:forQuery:withType:` - required delegate method so just returns an empty dictionary
-   * `client:didFinishQuery:withResult:withType:` - saves the response information to the properties on 
-     `query`, `searchType`, and `searchResultData`.
+   * `clientRequestParameters:forQuery:withType:` - required delegate method, returns the `search_fields` of
+     `searchedFieldsForDocumentType:` for suggest queries and an empty dictionary otherwise
+   * `client:didFinishRequest:withResult:` - saves the response information to the properties on 
+     `query`, `searchType`, and `searchResultData`. Results of a query that was canceled or replaced by a newer
+     one of the same type are ignored, a suggest query fired by `suggestScheduler` cancels the search in flight.
+     The request handle tells which query a result belongs to, so subclasses overriding this method must call `super`.
+   * `client:didFinishQuery:withResult:withType:` - does nothing, results are shown by `client:didFinishRequest:withResult:`.
+     Kept for subclasses that call `super`.
+   * `client:shouldReceivePartialResultsForRequest:` - only asks for partial results of the first page of searches
+     for every document type.
+   * `client:didReceivePartialResult:forRequest:` - displays the records of the first page of a search
+     query as they arrive. Only the records added since the previous partial result are read and inserted.
+   * `client:didUpdateQuery:withResult:withType:` - replaces `searchResultData` when a revalidated result
+     belongs to the query currently displayed.
+   * `client:prepareResult:forRequest:` - builds the `snapshot` of a result while still in the background.
 
  */
 @interface STSearchResultsObject : NSObject
@@ -82,6 +115,40 @@ STAPIClientDelegate>
  */
 @property (nonatomic, readonly, strong) STAPIClient *client;
 
+/**
+ Decides when typed text is sent as a suggest query. Its delays, in-flight limit and delegate
+ can be adjusted to tune autocomplete.
+ 
+ @note By default the scheduler's delegate is set to the `STSearchResultsObject`.
+ */
+@property (nonatomic, readonly, strong) STSuggestScheduler *suggestScheduler;
+
+/**
+ Handle of the most recent suggest query that has not yet finished.
+ */
+@property (nonatomic, readonly, strong) STAPIRequest *suggestRequest;
+
+/**
+ Handle of the most recent search query (including requests for additional pages) that has
+ not yet finished. Starting another search query cancels this one.
+ */
+@property (nonatomic, readonly, strong) STAPIRequest *searchRequest;
+
+/**
+ Determines when the caches used by `STAPIClient` are cleared.
+ 
+ The default value is `STAPICacheClearPolicyNever`.
+ */
+@property (nonatomic, assign) STAPICacheClearPolicy cacheClearPolicy;
+
+/**
+ Suggest queries prefetched by `warmUp`, for example the most popular queries of the engine or the
+ prefixes the user typed recently. Their results are answered from the caches once typed.
+ 
+ The default value is nil, nothing is prefetched.
+ */
+@property (nonatomic, copy) NSArray *warmUpQueries;
+
 /**
  The query that most recently finished successfully.
  */
@@ -94,9 +161,24 @@ STAPIClientDelegate>
 
 /**
  The searched results from the last query that finished successfully.
+
+ When it changes, the search results table view is told about the rows that changed, found by comparing the
+ records of the old and new `snapshot` by `id` with `STResultDiff`. The table view is reloaded completely
+ when the two results have no record in common or the table isn't laid out by this object.
  */
 @property (nonatomic, readonly, strong) NSDictionary *searchResultData;
 
+/**
+ Typed view of `searchResultData` in the order of `recordSectionOrder`, replaced together with it.
+
+ The default `recordsForType:`, `recordForType:atIndex:` and `recordTypeForSection:` answer from the snapshot,
+ so the table view's row counts and section titles, which go through them, and its paging take constant time
+ unless a subclass overrides them. The snapshot of a result that arrives from the server is built in the background by
+ `client:prepareResult:forRequest:` and handed over when the result is shown, other results are converted once when
+ they are set.
+ */
+@property (nonatomic, readonly, strong) STResultSnapshot *snapshot;
+
 /**
  The controller passed to the designated initializer. This is the
  same as the `UISearchDisplayControllers` `searchContentsController`.
@@ -149,12 +231,43 @@ STAPIClientDelegate>
  `numberOfSectionsInTableView:` and `tableView:numberOfRowsInSection:` which are overridden by
  `STSearchResultsObject` to provide the section and row counts based on the search result data.
  The result of this method is also used when automatically setting up the search scope bar.
+ It is asked while initializing and again whenever `searchResultData` is set, so the sections may change
+ from one result to the next.
  
  Every suggest or search query will contain a dictionary called `record`. Within `record`
  each key will be the name of the document type.
  */
 - (NSArray *)recordSectionOrder;
 
+/**
+ Subclasses override this method to name the fields of a document type they render or otherwise read.
+ 
+ @param documentType One of the keys returned by `recordSectionOrder`
+ 
+ @return An array of field names or nil to download every field
+ 
+ By default this method returns nil. When it returns fields for any document type in `recordSectionOrder`
+ they are set as the client's `fetchFields`, so results only carry what the table view shows. The `id`
+ of a record is always returned by the server. It is asked while initializing and again whenever
+ `searchResultData` is set, changed fields apply to the queries sent from then on.
+ */
+- (NSArray *)renderedFieldsForDocumentType:(NSString *)documentType;
+
+/**
+ Subclasses override this method to name the fields of a document type suggest queries match the typed text against.
+ 
+ @param documentType One of the keys returned by `recordSectionOrder`
+ 
+ @return An array of field names, optionally boosted like `title^3`, or nil to search the engine's default fields
+ 
+ By default this method returns nil. When it returns fields for any document type in `recordSectionOrder` they are
+ sent as the `search_fields` of suggest queries by `clientRequestParameters:forQuery:withType:`. Only then can the
+ client's `suggestCache` answer a longer prefix from the suggestions of a shorter one, it has to know which fields
+ the server matched. The fields should be among those of `renderedFieldsForDocumentType:`, records are filtered on
+ what was downloaded. It is asked at the same times as `renderedFieldsForDocumentType:`.
+ */
+- (NSArray *)searchedFieldsForDocumentType:(NSString *)documentType;
+
 /**
  Indicates that the search bar should have the scope indicators set. `STSearchResultsObject` will
  automatically creating an "All" section and handling refreshing the table view when switching between
@@ -170,6 +283,16 @@ STAPIClientDelegate>
  */
 - (BOOL)shouldDisplaySearchScopeButtons;
 
+/**
+ Provides subclasses with the ability to provide their own client, for example a `STFederatedAPIClient`
+ that searches several engines at once.
+ 
+ @return Instance of `STAPIClient` used by the `STSearchResultsObject` and exposed with the `client` property.
+ 
+ By default the `STSearchResultsObject` will provide an instance of `STAPIClient` for `clientEngineKey`.
+ */
+- (STAPIClient *)clientForResultObject;
+
 /**
  Provides subclasses with the ability to provide their own custom subclass of UISearchBar.
  
@@ -231,6 +354,54 @@ STAPIClientDelegate>
  */
 - (NSString *)recordTypeForSection:(NSUInteger)index;
 
+/**
+ Starts a search query through `client`. Any search query that is still pending is canceled first,
+ pending suggest queries are left alone.
+ 
+ @param query The query to be used in the search
+ 
+ @param page The page to request
+ 
+ @param perPage Maximum number of items per page
+ 
+ @return Handle for the query, which is also available through `searchRequest` until it finishes
+ */
+- (STAPIRequest *)startSearchQuery:(NSString *)query page:(NSUInteger)page perPage:(NSUInteger)perPage;
+
+/**
+ Starts a search query through `client` for some document types only. Any search query that is still pending
+ is canceled first, pending suggest queries are left alone.
+ 
+ @param query The query to be used in the search
+ 
+ @param documentTypes Names of the document types to search, nil for every document type
+ 
+ @param page The page to request
+ 
+ @param perPage Maximum number of items per page
+ 
+ @return Handle for the query, which is also available through `searchRequest` until it finishes
+ 
+ `startSearchQuery:page:perPage:` calls this method with nil `documentTypes`, so subclasses only need to
+ override this one.
+ */
+- (STAPIRequest *)startSearchQuery:(NSString *)query documentTypes:(NSArray *)documentTypes page:(NSUInteger)page perPage:(NSUInteger)perPage;
+
+/**
+ Replaces `searchResultData` with data that only grew by records appended at the end, inserting the new
+ rows into the table view instead of reloading all of it.
+ 
+ @param searchResultData The new search results
+ 
+ @param addedRecordRanges Ranges of the appended record indexes as `NSValue` objects keyed by document type,
+ as returned by `-[STPagedResultStore appendResult:]`
+ 
+ The table view is updated the same way as for `searchResultData`, the ranges only spare comparing the
+ records that were already shown. Rows following the records of a section, such as a "Load More" row, are
+ reloaded as well. Without ranges, or when they don't fit the records, the snapshots are compared in full.
+ */
+- (void)setSearchResultData:(NSDictionary *)searchResultData addedRecordRanges:(NSDictionary *)addedRecordRanges;
+
 /**
  Posts analytics to the server for a click on a specific document.
  
@@ -238,4 +409,10 @@ STAPIClientDelegate>
  */
 - (void)postClickAnalyticsWithDocumentId:(NSString *)documentId;
 
+/**
+ Opens a connection to the server and prefetches `warmUpQueries` ahead of the first query. Called when the
+ search bar begins editing, apps can call it earlier, for example when the view with the search bar appears.
+ */
+- (void)warmUp;
+
 @end
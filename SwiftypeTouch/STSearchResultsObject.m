@@ -7,29 +7,52 @@
 //
 
 #import "STSearchResultsObject.h"
+#import "STSearchResultsObject+Private.h"
+#import "STResultSnapshot.h"
+#import "STResultDiff.h"
+#import "STSuggestScheduler.h"
 #import "UI/STSearchBar.h"
 
-@interface STSearchResultsObject ()
+// Positions of the fields of _titleAndURLFields among the display fields of a snapshot
+enum {
+    STTitleFieldIndex = 0,
+    STURLFieldIndex = 1
+};
+
+@interface STSearchResultsObject () <STSuggestSchedulerDelegate>
 
 @property (nonatomic, strong) STAPIClient *client;
+@property (nonatomic, strong) STAPIRequest *suggestRequest;
 @property (nonatomic, copy) NSString *query;
 @property (nonatomic, assign) STSearchType searchType;
 @property (nonatomic, strong) NSDictionary *searchResultData;
+@property (nonatomic, strong) STResultSnapshot *snapshot;
 @property (nonatomic, strong) UISearchDisplayController *searchDisplayController;
 @property (nonatomic, strong) UISearchBar *searchBar;
-@property (nonatomic, strong) NSTimer *suggestTimer;
-
-- (void)_fireSuggestQuery:(NSTimer *)timer;
+@property (nonatomic, strong) STSuggestScheduler *suggestScheduler;
+@property (nonatomic, strong) STAPIRequest *partialResultRequest;
+@property (nonatomic, strong) NSDictionary *partialResult;
+@property (nonatomic, strong) NSCache *preparedSnapshots;
+@property (nonatomic, assign) BOOL cellsReadDisplayStrings;
+
+- (void)_requestDidEnd:(STAPIRequest *)request;
+- (void)_setSearchResultData:(NSDictionary *)searchResultData addedRecordRanges:(NSDictionary *)addedRecordRanges extendingSnapshot:(BOOL)extends;
+- (NSArray *)_numberOfRowsInTableView:(UITableView *)tableView;
+- (void)_updateScopeButtonTitles;
+- (void)_updateTableView:(UITableView *)tableView rowsBefore:(NSArray *)rowsBefore fromSnapshot:(STResultSnapshot *)previousSnapshot diff:(STResultDiff *)diff;
 - (BOOL)_shouldShowSpecificScope;
 - (BOOL)_scopingHelperEnabled;
+- (NSDictionary *)_fetchFields;
+- (NSDictionary *)_searchFields;
+- (NSDictionary *)_fieldsOfSectionTypes:(NSArray *(^)(NSString *documentType))fieldsOfType;
+- (void)_updateCellLookup;
 
 @end
 
 @implementation STSearchResultsObject
 
 - (void)setSearchResultData:(NSDictionary *)searchResultData {
-    _searchResultData = searchResultData;
-    [self.searchDisplayController.searchResultsTableView reloadData];
+    [self setSearchResultData:searchResultData addedRecordRanges:nil];
 }
 
 - (UIViewController *)controller {
@@ -46,17 +69,20 @@
 - (id)initWithViewController:(UIViewController *)controller {
     self = [super init];
     if (self) {
-        self.client = [[STAPIClient alloc] initWithApiKey:[self clientEngineKey]];
+        // Results are shown shortly after they are prepared, a few are enough while queries overlap
+        self.preparedSnapshots = [[NSCache alloc] init];
+        self.preparedSnapshots.countLimit = 4;
+        self.sectionOrder = [self recordSectionOrder];
+        self.displayFields = [self _fetchFields];
+        self.searchFields = [self _searchFields];
+        [self _updateCellLookup];
+        self.client = [self clientForResultObject];
+        self.client.fetchFields = self.displayFields;
+        self.suggestScheduler = [[STSuggestScheduler alloc] initWithClient:self.client];
+        self.suggestScheduler.delegate = self;
         
         self.searchBar = [self searchBarForResultObject];
-
-        if ([self _scopingHelperEnabled]) {
-            NSMutableArray *buttonTitles = [NSMutableArray arrayWithObject:@"All"];
-            for (NSString *s in [self recordSectionOrder]) {
-                [buttonTitles addObject:[s capitalizedString]];
-            }
-            self.searchBar.scopeButtonTitles = buttonTitles;
-        }
+        [self _updateScopeButtonTitles];
         
         if (controller) {
             self.searchDisplayController = [[UISearchDisplayController alloc] initWithSearchBar:self.searchBar
@@ -68,6 +94,7 @@
         self.searchBar.delegate = self;
         self.client.delegate = self;
         
+        self.cacheClearPolicy = STAPICacheClearPolicyNever;
         self.searchResultData = @{};
     }
     return self;
@@ -81,26 +108,31 @@
     return @[];
 }
 
+- (NSArray *)renderedFieldsForDocumentType:(NSString *)documentType {
+    return nil;
+}
+
+- (NSArray *)searchedFieldsForDocumentType:(NSString *)documentType {
+    return nil;
+}
+
 - (BOOL)shouldDisplaySearchScopeButtons {
     return NO;
 }
 
+- (STAPIClient *)clientForResultObject {
+    return [[STAPIClient alloc] initWithApiKey:[self clientEngineKey]];
+}
+
 - (UISearchBar *)searchBarForResultObject {
     return [[STSearchBar alloc] initWithFrame:CGRectMake(0.0f, 0.0f, 320.0f, 44.0f)];
 }
 
 - (NSArray *)recordsForType:(NSString *)type {
-    NSDictionary *records = [self.searchResultData objectForKey:@"records"];
-    if ([records isKindOfClass:[NSDictionary class]]) {
-        NSArray *result = [records objectForKey:type];
-        if ([result isKindOfClass:[NSArray class]]) {
-            return result;
-        }
-    }
-    return @[];
+    return [self.snapshot recordsForType:type];
 }
 
-- (NSDictionary *)recordForType:(NSString *)type atIndex:(NSUInteger)index {    
+- (NSDictionary *)recordForType:(NSString *)type atIndex:(NSUInteger)index {
     NSArray *recordsForType = [self recordsForType:type];
     if (index < recordsForType.count) {
         NSDictionary *result = [recordsForType objectAtIndex:index];
@@ -113,26 +145,34 @@
 }
 
 - (NSString *)recordTypeForSection:(NSUInteger)index {
-    // If the section order wasn't specified then we have nothing to return
-    if ([self recordSectionOrder].count == 0) {
-        return nil;
-    }
-    
-    if ([self _shouldShowSpecificScope]) {
-        index = self.searchBar.selectedScopeButtonIndex - 1;
-    }
-    
-    if (index < [self recordSectionOrder].count) {
-        return [[self recordSectionOrder] objectAtIndex:index];
-    }
-    
-    return nil;
+    return [self.snapshot typeForSection:[self _snapshotSectionForSection:index]];
+}
+
+- (STAPIRequest *)startSearchQuery:(NSString *)query page:(NSUInteger)page perPage:(NSUInteger)perPage {
+    return [self startSearchQuery:query documentTypes:nil page:page perPage:perPage];
+}
+
+- (STAPIRequest *)startSearchQuery:(NSString *)query documentTypes:(NSArray *)documentTypes page:(NSUInteger)page perPage:(NSUInteger)perPage {
+    [self.searchRequest cancel];
+    self.searchRequest = [self.client searchQuery:query documentTypes:documentTypes page:page perPage:perPage];
+    return self.searchRequest;
+}
+
+- (void)setSearchResultData:(NSDictionary *)searchResultData addedRecordRanges:(NSDictionary *)addedRecordRanges {
+    [self _setSearchResultData:searchResultData addedRecordRanges:addedRecordRanges extendingSnapshot:NO];
 }
 
 - (void)postClickAnalyticsWithDocumentId:(NSString *)documentId {
     [self.client postClickAnalyticsForQuery:self.query withType:self.searchType documentId:documentId];
 }
 
+- (void)warmUp {
+    [self.client warmUp];
+    if (self.warmUpQueries.count > 0) {
+        [self.client prefetchQueries:self.warmUpQueries type:STSearchTypeSuggest];
+    }
+}
+
 #pragma mark - UITableViewDataSource
 
 - (NSString *)tableView:(UITableView *)tableView titleForHeaderInSection:(NSInteger)section {
@@ -140,9 +180,9 @@
         return nil;
     }
     
-    NSString *s = [self recordTypeForSection:section];
-    if ([self recordsForType:s].count > 0) {
-        return [s capitalizedString];
+    NSString *type = [self recordTypeForSection:section];
+    if ([self recordsForType:type].count > 0) {
+        return [type capitalizedString];
     }
     return nil;
 }
@@ -152,23 +192,268 @@
         return 1;
     }
 
-    return [self recordSectionOrder].count;
+    return self.sectionOrder.count;
 }
 
 - (NSInteger)tableView:(UITableView *)tableView numberOfRowsInSection:(NSInteger)section {
-    NSString *recordType = [self recordTypeForSection:section];
-    if (recordType) {
-        NSArray *records = [self recordsForType:recordType];
-        return records.count;
+    // Through the overridable lookups, answered from the snapshot unless a subclass says otherwise
+    NSString *type = [self recordTypeForSection:section];
+    if (type) {
+        return [self recordsForType:type].count;
     }
     return 0;
 }
 
 #pragma mark - Private
 
-- (void)_fireSuggestQuery:(NSTimer *)timer {
-    [self.client suggestQuery:timer.userInfo];
-    self.suggestTimer = nil;
+- (STResultSnapshot *)_snapshotOfResult:(NSDictionary *)result {
+    // A snapshot prepared for the result is handed over once, from then on it is kept as `snapshot`
+    NSValue *key = [NSValue valueWithNonretainedObject:result];
+    STResultSnapshot *preparedSnapshot = [self.preparedSnapshots objectForKey:key];
+    if (preparedSnapshot) {
+        [self.preparedSnapshots removeObjectForKey:key];
+    }
+    // The address of a result that is gone may be taken by another one, the snapshot's result tells them apart
+    if (preparedSnapshot.result == result && [preparedSnapshot matchesSectionOrder:self.sectionOrder displayFields:self.displayFields]) {
+        return preparedSnapshot;
+    }
+    return [STResultSnapshot snapshotOfResult:result sectionOrder:self.sectionOrder displayFields:self.displayFields];
+}
+
+- (void)_updateDisplayedTypes {
+    NSArray *sectionOrder = [self recordSectionOrder];
+    if (![sectionOrder isEqualToArray:self.sectionOrder]) {
+        self.sectionOrder = sectionOrder;
+        [self _updateScopeButtonTitles];
+    }
+
+    // Results already on their way carry the old fields, rows missing a new one render it blank until the next query
+    NSDictionary *displayFields = [self _fetchFields];
+    if (displayFields != self.displayFields && ![displayFields isEqualToDictionary:self.displayFields]) {
+        self.displayFields = displayFields;
+        self.client.fetchFields = displayFields;
+    }
+    self.searchFields = [self _searchFields];
+    [self _updateCellLookup];
+}
+
+- (void)_updateCellLookup {
+    // Decided once for all rows, a subclass that looks up records its own way must see every cell go through it
+    BOOL lookupsOverridden = NO;
+    SEL lookups[] = { @selector(recordsForType:), @selector(recordForType:atIndex:), @selector(recordTypeForSection:) };
+    for (NSUInteger i = 0; i < sizeof(lookups) / sizeof(lookups[0]); i++) {
+        if ([self methodForSelector:lookups[i]] != [STSearchResultsObject instanceMethodForSelector:lookups[i]]) {
+            lookupsOverridden = YES;
+        }
+    }
+
+    BOOL rendersTitleAndURL = self.sectionOrder.count > 0;
+    for (NSString *type in self.sectionOrder) {
+        if (![[self.displayFields objectForKey:type] isEqual:[self _titleAndURLFields]]) {
+            rendersTitleAndURL = NO;
+        }
+    }
+    self.cellsReadDisplayStrings = !lookupsOverridden && rendersTitleAndURL;
+}
+
+- (void)_updateScopeButtonTitles {
+    if (![self _scopingHelperEnabled]) {
+        return;
+    }
+
+    NSMutableArray *buttonTitles = [NSMutableArray arrayWithObject:@"All"];
+    for (NSString *s in self.sectionOrder) {
+        [buttonTitles addObject:[s capitalizedString]];
+    }
+    self.searchBar.scopeButtonTitles = buttonTitles;
+}
+
+- (BOOL)_isCurrentRequest:(STAPIRequest *)request {
+    // Pages of the current search are started as searchRequest too, anything else was overtaken
+    if (request.searchType == STSearchTypeSearch) {
+        return request == self.searchRequest;
+    }
+    // Local answers don't wait for the in-flight limit, so an older suggestion can arrive after a newer one.
+    // It still fills the caches, only its result isn't shown
+    return request == self.suggestRequest;
+}
+
+- (void)_applyResult:(NSDictionary *)result ofRequest:(STAPIRequest *)request {
+    if (![self _isCurrentRequest:request]) {
+        return;
+    }
+
+    self.query = request.query;
+    self.searchType = request.searchType;
+    self.searchResultData = result;
+}
+
+- (void)_cancelSearchRequests {
+    STAPIRequest *request = self.searchRequest;
+    self.searchRequest = nil;
+    [request cancel];
+}
+
+- (void)_setSearchResultData:(NSDictionary *)searchResultData addedRecordRanges:(NSDictionary *)addedRecordRanges extendingSnapshot:(BOOL)extends {
+    UITableView *tableView = self.searchDisplayController.searchResultsTableView;
+    STResultSnapshot *previousSnapshot = self.snapshot;
+    NSArray *rowsBefore = [self _numberOfRowsInTableView:tableView];
+
+    _searchResultData = searchResultData;
+    [self _updateDisplayedTypes];
+    if (extends) {
+        self.snapshot = [STResultSnapshot snapshotOfResult:searchResultData sectionOrder:self.sectionOrder displayFields:self.displayFields extendingSnapshot:previousSnapshot];
+    }
+    else {
+        self.snapshot = [self _snapshotOfResult:searchResultData];
+    }
+    STResultDiff *diff = previousSnapshot ? [STResultDiff diffFromSnapshot:previousSnapshot toSnapshot:self.snapshot appendedRanges:addedRecordRanges] : nil;
+    [self _updateTableView:tableView rowsBefore:rowsBefore fromSnapshot:previousSnapshot diff:diff];
+}
+
+- (void)_requestDidEnd:(STAPIRequest *)request {
+    if (request == self.suggestRequest) {
+        self.suggestRequest = nil;
+    }
+    else if (request == self.searchRequest) {
+        self.searchRequest = nil;
+    }
+    
+    if (request == self.partialResultRequest) {
+        self.partialResultRequest = nil;
+        self.partialResult = nil;
+    }
+    
+    if (request.searchType == STSearchTypeSuggest) {
+        [self.suggestScheduler queryDidEnd:request];
+    }
+}
+
+- (NSArray *)_numberOfRowsInTableView:(UITableView *)tableView {
+    // Only a table this object feeds, laid out for the current scope, can be updated row by row
+    if (tableView == nil || tableView.dataSource != self) {
+        return nil;
+    }
+
+    NSInteger numberOfSections = [tableView numberOfSections];
+    if (numberOfSections != [self numberOfSectionsInTableView:tableView]) {
+        return nil;
+    }
+
+    NSMutableArray *rows = [NSMutableArray arrayWithCapacity:numberOfSections];
+    for (NSInteger section = 0; section < numberOfSections; section++) {
+        [rows addObject:@([tableView numberOfRowsInSection:section])];
+    }
+    return rows;
+}
+
+- (void)_updateTableView:(UITableView *)tableView rowsBefore:(NSArray *)rowsBefore fromSnapshot:(STResultSnapshot *)previousSnapshot diff:(STResultDiff *)diff {
+    // Without a record in common every row is replaced anyway, reloading is cheaper than a batch of that size
+    if (rowsBefore == nil || diff == nil || diff.sectionsChanged || diff.matchedCount == 0) {
+        [tableView reloadData];
+        return;
+    }
+
+    NSMutableArray *deletedRows = [NSMutableArray array];
+    NSMutableArray *insertedRows = [NSMutableArray array];
+    NSMutableArray *reloadedRows = [NSMutableArray array];
+    NSMutableArray *movedRows = [NSMutableArray array];
+    NSMutableIndexSet *reloadedSections = [NSMutableIndexSet indexSet];
+    for (NSInteger section = 0; section < (NSInteger)rowsBefore.count; section++) {
+        NSUInteger snapshotSection = [self _snapshotSectionForSection:section];
+        NSInteger before = [[rowsBefore objectAtIndex:section] integerValue];
+        NSInteger after = [self tableView:tableView numberOfRowsInSection:section];
+        NSInteger oldCount = [previousSnapshot numberOfRecordsInSection:snapshotSection];
+        NSInteger newCount = [self.snapshot numberOfRecordsInSection:snapshotSection];
+
+        // The header only shows while a section has records, and rows the table never had can't be updated
+        if ((oldCount == 0) != (newCount == 0) || before < oldCount || after < newCount) {
+            [reloadedSections addIndex:section];
+            continue;
+        }
+
+        [[diff deletedIndexesInSection:snapshotSection] enumerateIndexesUsingBlock:^(NSUInteger row, BOOL *stop) {
+            [deletedRows addObject:[NSIndexPath indexPathForRow:row inSection:section]];
+        }];
+        [[diff insertedIndexesInSection:snapshotSection] enumerateIndexesUsingBlock:^(NSUInteger row, BOOL *stop) {
+            [insertedRows addObject:[NSIndexPath indexPathForRow:row inSection:section]];
+        }];
+        [[diff reloadedIndexesInSection:snapshotSection] enumerateIndexesUsingBlock:^(NSUInteger row, BOOL *stop) {
+            [reloadedRows addObject:[NSIndexPath indexPathForRow:row inSection:section]];
+        }];
+        [diff enumerateMovesInSection:snapshotSection usingBlock:^(NSUInteger fromRow, NSUInteger toRow) {
+            [movedRows addObject:@[ [NSIndexPath indexPathForRow:fromRow inSection:section], [NSIndexPath indexPathForRow:toRow inSection:section] ]];
+        }];
+
+        // Rows following the records, like "Load More", are replaced when their number changes and reloaded
+        // when records were added or removed before them, a "Load More" row may be showing its spinner
+        if (before - oldCount != after - newCount) {
+            for (NSInteger row = oldCount; row < before; row++) {
+                [deletedRows addObject:[NSIndexPath indexPathForRow:row inSection:section]];
+            }
+            for (NSInteger row = newCount; row < after; row++) {
+                [insertedRows addObject:[NSIndexPath indexPathForRow:row inSection:section]];
+            }
+        }
+        else if (oldCount != newCount) {
+            for (NSInteger row = oldCount; row < before; row++) {
+                [reloadedRows addObject:[NSIndexPath indexPathForRow:row inSection:section]];
+            }
+        }
+    }
+
+    if (deletedRows.count == 0 && insertedRows.count == 0 && reloadedRows.count == 0 && movedRows.count == 0 && reloadedSections.count == 0) {
+        return;
+    }
+
+    [tableView beginUpdates];
+    [tableView deleteRowsAtIndexPaths:deletedRows withRowAnimation:UITableViewRowAnimationNone];
+    [tableView insertRowsAtIndexPaths:insertedRows withRowAnimation:UITableViewRowAnimationNone];
+    [tableView reloadRowsAtIndexPaths:reloadedRows withRowAnimation:UITableViewRowAnimationNone];
+    for (NSArray *move in movedRows) {
+        [tableView moveRowAtIndexPath:[move objectAtIndex:0] toIndexPath:[move objectAtIndex:1]];
+    }
+    [tableView reloadSections:reloadedSections withRowAnimation:UITableViewRowAnimationNone];
+    [tableView endUpdates];
+}
+
+- (NSArray *)_titleAndURLFields {
+    return @[ @"title", @"url" ];
+}
+
+- (void)_configureCell:(UITableViewCell *)cell forRowAtIndexPath:(NSIndexPath *)indexPath {
+    NSString *title = nil;
+    NSString *url = nil;
+    if (self.cellsReadDisplayStrings) {
+        // Pulled out of the records when the result arrived, found by position
+        STResultSnapshot *snapshot = self.snapshot;
+        NSUInteger section = [self _snapshotSectionForSection:indexPath.section];
+        title = [snapshot stringForFieldAtIndex:STTitleFieldIndex atIndex:indexPath.row inSection:section];
+        url = [snapshot stringForFieldAtIndex:STURLFieldIndex atIndex:indexPath.row inSection:section];
+    }
+    else {
+        // The same lookup selecting the row goes through
+        id record = [self recordForType:[self recordTypeForSection:indexPath.section] atIndex:indexPath.row];
+        if ([record isKindOfClass:[NSDictionary class]]) {
+            id titleValue = [record objectForKey:@"title"];
+            id urlValue = [record objectForKey:@"url"];
+            title = [titleValue isKindOfClass:[NSString class]] ? titleValue : ([titleValue isKindOfClass:[NSNumber class]] ? [titleValue description] : nil);
+            url = [urlValue isKindOfClass:[NSString class]] ? urlValue : ([urlValue isKindOfClass:[NSNumber class]] ? [urlValue description] : nil);
+        }
+    }
+
+    cell.textLabel.text = title;
+    if (self.searchType == STSearchTypeSearch) {
+        cell.detailTextLabel.text = url;
+    }
+}
+
+- (NSUInteger)_snapshotSectionForSection:(NSUInteger)section {
+    // A specific scope shows a single section, the one of the selected document type
+    if ([self _shouldShowSpecificScope]) {
+        return self.searchBar.selectedScopeButtonIndex - 1;
+    }
+    return section;
 }
 
 - (BOOL)_shouldShowSpecificScope {
@@ -176,7 +461,30 @@
 }
 
 - (BOOL)_scopingHelperEnabled {
-    return [self shouldDisplaySearchScopeButtons] && [self recordSectionOrder].count > 1;
+    return [self shouldDisplaySearchScopeButtons] && self.sectionOrder.count > 1;
+}
+
+- (NSDictionary *)_fetchFields {
+    return [self _fieldsOfSectionTypes:^NSArray *(NSString *documentType) {
+        return [self renderedFieldsForDocumentType:documentType];
+    }];
+}
+
+- (NSDictionary *)_searchFields {
+    return [self _fieldsOfSectionTypes:^NSArray *(NSString *documentType) {
+        return [self searchedFieldsForDocumentType:documentType];
+    }];
+}
+
+- (NSDictionary *)_fieldsOfSectionTypes:(NSArray *(^)(NSString *documentType))fieldsOfType {
+    NSMutableDictionary *fieldsByType = [NSMutableDictionary dictionary];
+    for (NSString *documentType in self.sectionOrder) {
+        NSArray *fields = fieldsOfType(documentType);
+        if (fields.count > 0) {
+            [fieldsByType setObject:fields forKey:documentType];
+        }
+    }
+    return (fieldsByType.count > 0) ? fieldsByType : nil;
 }
 
 #pragma mark - UISearchBarDelegate
@@ -186,16 +494,17 @@
         self.searchResultData = @{};
     }
 
-    [self.suggestTimer invalidate];
-    self.suggestTimer = [NSTimer scheduledTimerWithTimeInterval:.25
-                                                         target:self
-                                                       selector:@selector(_fireSuggestQuery:)
-                                                       userInfo:searchString
-                                                        repeats:NO];
+    [self.suggestScheduler textDidChange:searchString];
+}
+
+- (void)searchBarTextDidBeginEditing:(UISearchBar *)searchBar {
+    [self warmUp];
 }
 
 - (void)searchBarTextDidEndEditing:(UISearchBar *)searchBar {
-    [STAPIClient clearAPICache];
+    if (self.cacheClearPolicy == STAPICacheClearPolicyOnEndEditing) {
+        [STAPIClient clearAPICache];
+    }
 }
 
 - (void)searchBarCancelButtonClicked:(UISearchBar *)searchBar {
@@ -203,25 +512,92 @@
 }
 
 - (void)searchBarSearchButtonClicked:(UISearchBar *)searchBar {
-    [self.client searchQuery:searchBar.text];
-    [self.suggestTimer invalidate];
-    self.suggestTimer = nil;
+    // Drop the scheduled suggestion first, otherwise canceling the current one would send it
+    [self.suggestScheduler cancel];
+    [self.suggestRequest cancel];
+    self.suggestRequest = nil;
+    [self startSearchQuery:searchBar.text page:1 perPage:20];
 }
 
 - (void)searchBar:(UISearchBar *)searchBar selectedScopeButtonIndexDidChange:(NSInteger)selectedScope {
     [self.searchDisplayController.searchResultsTableView reloadData];
 }
 
+#pragma mark - STSuggestSchedulerDelegate
+
+- (STAPIRequest *)suggestScheduler:(STSuggestScheduler *)scheduler fireQuery:(NSString *)query {
+    // Results of a search still on its way would replace the suggestions for the newer text
+    [self _cancelSearchRequests];
+    self.suggestRequest = [self.client suggestQuery:query];
+    return self.suggestRequest;
+}
+
 #pragma mark - STAPIDelegate
 
 - (NSDictionary *)clientRequestParameters:(STAPIClient *)client forQuery:(NSString *)query withType:(STSearchType)type {
+    // Suggestions for a longer prefix can then be filtered out of those of a shorter one by the client's suggestCache
+    NSDictionary *searchFields = self.searchFields;
+    if (type == STSearchTypeSuggest && searchFields) {
+        return @{ @"search_fields" : searchFields };
+    }
     return @{};
 }
 
+- (void)client:(STAPIClient *)client prepareResult:(NSDictionary *)result forRequest:(STAPIRequest *)request {
+    // Prepared for the section order and display fields of the last results, a result set for others is built again
+    STResultSnapshot *snapshot = [STResultSnapshot snapshotOfResult:result sectionOrder:self.sectionOrder displayFields:self.displayFields];
+    [self.preparedSnapshots setObject:snapshot forKey:[NSValue valueWithNonretainedObject:result]];
+}
+
+- (void)client:(STAPIClient *)client didFinishRequest:(STAPIRequest *)request withResult:(NSDictionary *)result {
+    // Shown while the request is still current, ending a suggestion may fire the next one
+    [self _applyResult:result ofRequest:request];
+    [self _requestDidEnd:request];
+}
+
 - (void)client:(STAPIClient *)client didFinishQuery:(NSString *)query withResult:(NSDictionary *)result withType:(STSearchType)type {
-    self.query = query;
-    self.searchType = type;
-    self.searchResultData = result;
+    // Results are shown by client:didFinishRequest:withResult:, which knows their request. Kept for subclasses calling super
+}
+
+- (void)client:(STAPIClient *)client didCancelRequest:(STAPIRequest *)request {
+    [self _requestDidEnd:request];
+}
+
+- (void)client:(STAPIClient *)client didFailRequest:(STAPIRequest *)request error:(NSError *)error {
+    [self _requestDidEnd:request];
+}
+
+- (BOOL)client:(STAPIClient *)client shouldReceivePartialResultsForRequest:(STAPIRequest *)request {
+    // Asked before the request is returned, so it can't be compared to searchRequest yet
+    return request.searchType == STSearchTypeSearch && request.page <= 1 && request.documentTypes == nil;
+}
+
+- (void)client:(STAPIClient *)client didReceivePartialResult:(NSDictionary *)result forRequest:(STAPIRequest *)request {
+    // Partial pages can't be merged with earlier ones so only show the first page of a new search early
+    if (request == self.searchRequest && request.page == 1) {
+        // Each partial result only adds records at the end of the one shown before, only those are looked at
+        BOOL extends = (request == self.partialResultRequest && self.searchResultData == self.partialResult);
+        NSMutableDictionary *addedRanges = [NSMutableDictionary dictionary];
+        NSDictionary *records = [result objectForKey:@"records"];
+        for (NSString *type in (extends ? records : nil)) {
+            NSUInteger shownCount = [self.snapshot recordsForType:type].count;
+            NSUInteger count = [[records objectForKey:type] count];
+            [addedRanges setObject:[NSValue valueWithRange:NSMakeRange(shownCount, count - MIN(shownCount, count))] forKey:type];
+        }
+
+        self.query = request.query;
+        self.searchType = request.searchType;
+        self.partialResultRequest = request;
+        self.partialResult = result;
+        [self _setSearchResultData:result addedRecordRanges:(extends ? addedRanges : nil) extendingSnapshot:extends];
+    }
+}
+
+- (void)client:(STAPIClient *)client didUpdateQuery:(NSString *)query withResult:(NSDictionary *)result withType:(STSearchType)type {
+    // Only refresh what is on screen, the user may have moved on to another query
+    if (type == self.searchType && [query isEqualToString:self.query]) {
+        self.searchResultData = result;
+    }
 }
 
 @end
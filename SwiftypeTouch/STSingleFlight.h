@@ -0,0 +1,72 @@
+//
+//  STSingleFlight.h
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+@class STAPIRequest;
+
+/**
+ Registry of the queries that are on their way to the server, shared by every `STAPIClient` of the process.
+
+ Queries are keyed like `STQueryCache` keys them, by endpoint and canonical parameters. The first query with a
+ key leads a flight and is sent to the server. Identical queries started before the leader's response was decoded
+ join the flight as followers instead of being sent as well, and receive the leader's decoded result or failure.
+ Followers may belong to other clients, each of which delivers the result to its own delegate.
+
+ Used by `STAPIClient`, there is no need to call it directly. All methods are safe to call from any thread.
+ */
+@interface STSingleFlight : NSObject
+
+/**
+ Registry shared by all instances of `STAPIClient`
+ */
++ (STSingleFlight *)sharedSingleFlight;
+
+/**
+ Number of flights currently waiting on the server
+ */
+@property (nonatomic, readonly) NSUInteger flightCount;
+
+/**
+ Number of queries that joined a flight instead of being sent to the server
+ */
+@property (nonatomic, readonly) NSUInteger joinCount;
+
+/**
+ Makes a request that is about to be sent the leader of a new flight, or a follower if a flight with its key exists.
+
+ @param request Request that is about to be sent
+
+ @return `YES` if the request joined an existing flight and must not be sent
+ */
+- (BOOL)joinFlightForRequest:(STAPIRequest *)request;
+
+/**
+ Tells whether other requests are waiting on a leader
+
+ @param request Leader of a flight
+ */
+- (BOOL)hasFollowersForRequest:(STAPIRequest *)request;
+
+/**
+ Ends the flight of a leader once its response is known
+
+ @param request Leader of a flight
+
+ @return The followers waiting on the leader, empty if the request leads no flight
+ */
+- (NSArray *)finishFlightForRequest:(STAPIRequest *)request;
+
+/**
+ Removes a follower from its flight, or ends the flight of a leader nobody else waits on
+
+ @param request Leader or follower of a flight
+ */
+- (void)leaveFlightForRequest:(STAPIRequest *)request;
+
+@end
@@ -0,0 +1,129 @@
+//
+//  STSingleFlight.m
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import "STSingleFlight.h"
+#import "STAPIRequest+Private.h"
+
+/*
+ The leader of a key and the requests waiting on it
+ */
+@interface STSingleFlightEntry : NSObject
+
+@property (nonatomic, strong) STAPIRequest *leader;
+@property (nonatomic, strong) NSMutableArray *followers;
+
+@end
+
+@implementation STSingleFlightEntry
+
+@end
+
+@interface STSingleFlight ()
+
+@property (nonatomic, strong) NSMutableDictionary *flights;
+@property (nonatomic, assign) NSUInteger joinCount;
+
+@end
+
+@implementation STSingleFlight
+
+#pragma mark - NSObject
+
+- (id)init {
+    self = [super init];
+    if (self) {
+        self.flights = [NSMutableDictionary dictionary];
+    }
+    return self;
+}
+
+#pragma mark - STSingleFlight
+
++ (STSingleFlight *)sharedSingleFlight {
+    static dispatch_once_t onceToken;
+    static STSingleFlight *sharedSingleFlight = nil;
+    dispatch_once(&onceToken, ^{
+        sharedSingleFlight = [[STSingleFlight alloc] init];
+    });
+    return sharedSingleFlight;
+}
+
+- (NSUInteger)flightCount {
+    @synchronized(self) {
+        return self.flights.count;
+    }
+}
+
+- (BOOL)joinFlightForRequest:(STAPIRequest *)request {
+    if (request.cacheKey == nil) {
+        return NO;
+    }
+
+    @synchronized(self) {
+        STSingleFlightEntry *entry = [self.flights objectForKey:request.cacheKey];
+        if (entry) {
+            [entry.followers addObject:request];
+            self.joinCount++;
+            return YES;
+        }
+
+        entry = [[STSingleFlightEntry alloc] init];
+        entry.leader = request;
+        entry.followers = [NSMutableArray array];
+        [self.flights setObject:entry forKey:request.cacheKey];
+        return NO;
+    }
+}
+
+- (BOOL)hasFollowersForRequest:(STAPIRequest *)request {
+    if (request.cacheKey == nil) {
+        return NO;
+    }
+
+    @synchronized(self) {
+        STSingleFlightEntry *entry = [self.flights objectForKey:request.cacheKey];
+        return entry.leader == request && entry.followers.count > 0;
+    }
+}
+
+- (NSArray *)finishFlightForRequest:(STAPIRequest *)request {
+    if (request.cacheKey == nil) {
+        return @[];
+    }
+
+    @synchronized(self) {
+        STSingleFlightEntry *entry = [self.flights objectForKey:request.cacheKey];
+        if (entry.leader != request) {
+            return @[];
+        }
+
+        [self.flights removeObjectForKey:request.cacheKey];
+        return [entry.followers copy];
+    }
+}
+
+- (void)leaveFlightForRequest:(STAPIRequest *)request {
+    if (request.cacheKey == nil) {
+        return;
+    }
+
+    @synchronized(self) {
+        STSingleFlightEntry *entry = [self.flights objectForKey:request.cacheKey];
+        if (entry.leader == request) {
+            // Followers keep the flight going, it ends with the leader's response
+            if (entry.followers.count == 0) {
+                [self.flights removeObjectForKey:request.cacheKey];
+            }
+        }
+        else {
+            [entry.followers removeObjectIdenticalTo:request];
+        }
+    }
+}
+
+@end
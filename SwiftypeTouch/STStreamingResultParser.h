@@ -0,0 +1,57 @@
+//
+//  STStreamingResultParser.h
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ Incremental decoder for Swiftype search and suggest responses.
+
+ The parser is fed the response body one chunk at a time as it arrives. It tokenizes just enough of
+ the JSON to follow the structure of the document and decodes every element of a `records.<type>`
+ array as soon as its closing bracket has been received. Everything outside of `records` is skipped,
+ the complete response is still expected to be decoded once the last byte has arrived.
+
+ Bytes that belong to records which were already decoded are discarded, so the parser only holds on
+ to the unfinished tail of the response.
+
+ A parser is not thread safe. It may be used from a background queue as long as all calls are made
+ from the same serial queue.
+ */
+@interface STStreamingResultParser : NSObject
+
+/**
+ Records decoded so far. Each key is a document type and each value an `NSArray` of the records
+ of that type in the order they appear in the response.
+
+ The records completed by each chunk are kept as a page of their own, and the arrays returned here only
+ refer to those pages. Asking for the records after every chunk therefore doesn't copy the records decoded
+ earlier, and an array returned before starts with the same records as one returned later.
+ */
+@property (nonatomic, readonly) NSDictionary *records;
+
+/**
+ Total number of records decoded so far
+ */
+@property (nonatomic, readonly) NSUInteger recordCount;
+
+/**
+ `YES` once the parser found data it could not make sense of. No more records will be decoded
+ after that.
+ */
+@property (nonatomic, readonly, getter = hasFailed) BOOL failed;
+
+/**
+ Feeds the next chunk of the response to the parser.
+
+ @param data Next chunk of the response body
+
+ @return Number of records completed by this chunk
+ */
+- (NSUInteger)appendData:(NSData *)data;
+
+@end
@@ -0,0 +1,267 @@
+//
+//  STStreamingResultParser.m
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import "STStreamingResultParser.h"
+#import "STPagedArray.h"
+
+#define ST_STREAMING_MAX_DEPTH 64
+
+typedef enum {
+    STContainerRoleOther,
+    STContainerRoleRoot,
+    STContainerRoleRecords,
+    STContainerRoleTypeArray
+} STContainerRole;
+
+typedef struct {
+    BOOL isObject;
+    BOOL expectingKey;
+    STContainerRole role;
+} STContainerFrame;
+
+@interface STStreamingResultParser () {
+    STContainerFrame _stack[ST_STREAMING_MAX_DEPTH];
+    NSUInteger _depth;
+    BOOL _inString;
+    BOOL _escaped;
+    BOOL _capturingKey;
+    NSUInteger _keyStart;
+    NSUInteger _elementStart;
+    NSUInteger _bufferBase;
+    NSUInteger _position;
+}
+
+@property (nonatomic, strong) NSMutableData *buffer;
+@property (nonatomic, strong) NSMutableDictionary *pages;
+@property (nonatomic, strong) NSMutableDictionary *pendingRecords;
+@property (nonatomic, strong) NSString *rootKey;
+@property (nonatomic, strong) NSString *recordsKey;
+@property (nonatomic, copy) NSString *currentType;
+@property (nonatomic, assign) NSUInteger recordCount;
+@property (nonatomic, assign) BOOL failed;
+
+- (NSString *)_stringFromStart:(NSUInteger)start end:(NSUInteger)end;
+- (BOOL)_emitRecordFromStart:(NSUInteger)start end:(NSUInteger)end;
+- (void)_closePages;
+- (void)_compact;
+
+@end
+
+@implementation STStreamingResultParser
+
+#pragma mark - NSObject
+
+- (id)init {
+    self = [super init];
+    if (self) {
+        self.buffer = [NSMutableData data];
+        self.pages = [NSMutableDictionary dictionary];
+        self.pendingRecords = [NSMutableDictionary dictionary];
+        _elementStart = NSNotFound;
+    }
+    return self;
+}
+
+#pragma mark - STStreamingResultParser
+
+- (NSDictionary *)records {
+    // Only the lists of pages are copied, the records decoded earlier are never touched again
+    NSMutableDictionary *records = [NSMutableDictionary dictionaryWithCapacity:self.pages.count];
+    for (NSString *type in self.pages) {
+        [records setObject:[[STPagedArray alloc] initWithPages:[self.pages objectForKey:type]] forKey:type];
+    }
+    return records;
+}
+
+- (NSUInteger)appendData:(NSData *)data {
+    if (self.failed || data.length == 0) {
+        return 0;
+    }
+
+    NSUInteger recordCountBefore = self.recordCount;
+    [self.buffer appendData:data];
+
+    const unsigned char *bytes = [self.buffer bytes];
+    NSUInteger end = _bufferBase + self.buffer.length;
+
+    for (; _position < end && !self.failed; _position++) {
+        unsigned char c = bytes[_position - _bufferBase];
+
+        if (_inString) {
+            if (_escaped) {
+                _escaped = NO;
+            }
+            else if (c == '\\') {
+                _escaped = YES;
+            }
+            else if (c == '"') {
+                _inString = NO;
+                if (_capturingKey) {
+                    _capturingKey = NO;
+                    NSString *key = [self _stringFromStart:_keyStart end:_position + 1];
+                    if (_stack[_depth - 1].role == STContainerRoleRoot) {
+                        self.rootKey = key;
+                    }
+                    else {
+                        self.recordsKey = key;
+                    }
+                }
+            }
+            continue;
+        }
+
+        if (c == ' ' || c == '\n' || c == '\r' || c == '\t') {
+            continue;
+        }
+
+        STContainerFrame *top = (_depth > 0) ? &_stack[_depth - 1] : NULL;
+
+        // Anything other than a separator inside a records array begins the next record
+        if (top && top->role == STContainerRoleTypeArray && _elementStart == NSNotFound && c != ',' && c != ']') {
+            _elementStart = _position;
+        }
+
+        switch (c) {
+            case '"':
+                _inString = YES;
+                if (top && top->isObject && top->expectingKey &&
+                    (top->role == STContainerRoleRoot || top->role == STContainerRoleRecords)) {
+                    _capturingKey = YES;
+                    _keyStart = _position;
+                }
+                break;
+
+            case '{':
+            case '[': {
+                if (_depth == ST_STREAMING_MAX_DEPTH) {
+                    self.failed = YES;
+                    break;
+                }
+
+                STContainerRole role = STContainerRoleOther;
+                if (top == NULL) {
+                    role = STContainerRoleRoot;
+                }
+                else if (top->role == STContainerRoleRoot && c == '{' && [self.rootKey isEqualToString:@"records"]) {
+                    role = STContainerRoleRecords;
+                }
+                else if (top->role == STContainerRoleRecords && c == '[' && self.recordsKey) {
+                    role = STContainerRoleTypeArray;
+                    self.currentType = self.recordsKey;
+                    if ([self.pages objectForKey:self.currentType] == nil) {
+                        [self.pages setObject:[NSMutableArray array] forKey:self.currentType];
+                    }
+                }
+
+                _stack[_depth].isObject = (c == '{');
+                _stack[_depth].expectingKey = (c == '{');
+                _stack[_depth].role = role;
+                _depth++;
+                break;
+            }
+
+            case '}':
+            case ']': {
+                if (top == NULL) {
+                    self.failed = YES;
+                    break;
+                }
+
+                // A scalar record is terminated by the closing bracket of its array
+                if (top->role == STContainerRoleTypeArray && _elementStart != NSNotFound) {
+                    [self _emitRecordFromStart:_elementStart end:_position];
+                    _elementStart = NSNotFound;
+                }
+
+                _depth--;
+
+                if (_depth > 0 && _stack[_depth - 1].role == STContainerRoleTypeArray && _elementStart != NSNotFound) {
+                    [self _emitRecordFromStart:_elementStart end:_position + 1];
+                    _elementStart = NSNotFound;
+                }
+                break;
+            }
+
+            case ':':
+                if (top) top->expectingKey = NO;
+                break;
+
+            case ',':
+                if (top == NULL) break;
+                if (top->isObject) {
+                    top->expectingKey = YES;
+                }
+                else if (top->role == STContainerRoleTypeArray && _elementStart != NSNotFound) {
+                    [self _emitRecordFromStart:_elementStart end:_position];
+                    _elementStart = NSNotFound;
+                }
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    [self _closePages];
+    [self _compact];
+
+    return self.recordCount - recordCountBefore;
+}
+
+#pragma mark - Private
+
+- (NSString *)_stringFromStart:(NSUInteger)start end:(NSUInteger)end {
+    NSData *quoted = [self.buffer subdataWithRange:NSMakeRange(start - _bufferBase, end - start)];
+    id value = [NSJSONSerialization JSONObjectWithData:quoted options:NSJSONReadingAllowFragments error:nil];
+    return [value isKindOfClass:[NSString class]] ? value : nil;
+}
+
+- (BOOL)_emitRecordFromStart:(NSUInteger)start end:(NSUInteger)end {
+    NSData *recordData = [self.buffer subdataWithRange:NSMakeRange(start - _bufferBase, end - start)];
+    id record = [NSJSONSerialization JSONObjectWithData:recordData options:NSJSONReadingAllowFragments error:nil];
+    if (record == nil) {
+        self.failed = YES;
+        return NO;
+    }
+
+    NSMutableArray *pending = [self.pendingRecords objectForKey:self.currentType];
+    if (pending == nil) {
+        pending = [NSMutableArray array];
+        [self.pendingRecords setObject:pending forKey:self.currentType];
+    }
+    [pending addObject:record];
+    self.recordCount++;
+    return YES;
+}
+
+- (void)_closePages {
+    // The records completed by a chunk become a page of their own that never changes
+    for (NSString *type in self.pendingRecords) {
+        [[self.pages objectForKey:type] addObject:[[self.pendingRecords objectForKey:type] copy]];
+    }
+    [self.pendingRecords removeAllObjects];
+}
+
+- (void)_compact {
+    // Keep the bytes of an unfinished record or key, everything before them has been consumed
+    NSUInteger keep = _position;
+    if (_elementStart != NSNotFound) {
+        keep = MIN(keep, _elementStart);
+    }
+    if (_capturingKey) {
+        keep = MIN(keep, _keyStart);
+    }
+
+    NSUInteger discard = keep - _bufferBase;
+    if (discard > 0) {
+        [self.buffer replaceBytesInRange:NSMakeRange(0, discard) withBytes:NULL length:0];
+        _bufferBase = keep;
+    }
+}
+
+@end
@@ -0,0 +1,126 @@
+//
+//  STSuggestIndex.h
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ Error code used with `STErrorDomain` when an index can't be built, read or updated
+ */
+extern const NSInteger STSuggestIndexErrorCode;
+
+/**
+ Offline suggest index built from a snapshot of an engine's documents.
+
+ The index is a single binary file holding a prefix trie over the words of the indexed fields, the
+ documents containing each word (postings) and the documents themselves. Every trie node also keeps
+ the best ranked documents below it, so a prefix is answered by walking a few nodes without touching
+ the postings. The file is memory-mapped the first time it is queried, so opening an index costs
+ nothing and only the pages a query touches become resident.
+
+ Results have the same shape as a response of the suggest endpoint. Every query word is matched as a
+ prefix of a word in the indexed fields. A single word is answered exactly; with several words the
+ candidates come from each word's best ranked documents and postings, so rare combinations may be
+ missed and left to the server.
+
+ Building needs memory proportional to the snapshot, so large catalogs are best built ahead of time,
+ for example on a server, and shipped as a file. Queries are safe from any thread.
+ */
+@interface STSuggestIndex : NSObject
+
+/**
+ Builds an index file from a snapshot of documents.
+
+ @param documentsByType Arrays of document dictionaries keyed by document type. Documents need an `id` to be
+ updated or removed later.
+ @param indexedFields Names of the fields whose words can be suggested, for example `@[ @"title" ]`
+ @param rankField Numeric field ranking the documents, higher first, or nil to keep the snapshot order
+ @param path Where to write the file. An existing file is replaced atomically.
+ @param error Set when the file couldn't be written
+
+ @return The new index or nil on failure
+ */
++ (STSuggestIndex *)indexWithDocuments:(NSDictionary *)documentsByType
+                         indexedFields:(NSArray *)indexedFields
+                             rankField:(NSString *)rankField
+                                  path:(NSString *)path
+                                 error:(NSError **)error;
+
+/**
+ Initializes an index backed by an existing file. Nothing is read until the first query.
+
+ @param path Path of a file written by `indexWithDocuments:indexedFields:rankField:path:error:`
+ */
+- (id)initWithPath:(NSString *)path;
+
+/**
+ Path of the index file
+ */
+@property (nonatomic, readonly, copy) NSString *path;
+
+/**
+ Whether the file is currently mapped
+ */
+@property (nonatomic, readonly, getter = isLoaded) BOOL loaded;
+
+/**
+ Number of documents in the index. Maps the file if needed, 0 if it can't be read.
+ */
+@property (nonatomic, readonly) NSUInteger documentCount;
+
+/**
+ Number of nodes in the prefix trie. Maps the file if needed, 0 if it can't be read.
+ */
+@property (nonatomic, readonly) NSUInteger nodeCount;
+
+/**
+ Size of the mapped file in bytes, 0 while not loaded
+ */
+@property (nonatomic, readonly) NSUInteger mappedBytes;
+
+/**
+ Bytes of the mapping that are currently resident in memory, 0 while not loaded. Pages the system
+ evicted don't count, they are read back from the file when needed.
+ */
+@property (nonatomic, readonly) NSUInteger residentBytes;
+
+/**
+ Looks up suggestions.
+
+ @param query The text the user entered
+ @param perPage Maximum number of documents returned per document type
+
+ @return Result in the format of the suggest endpoint, or nil if the index has no match or can't be read
+ */
+- (NSDictionary *)resultForQuery:(NSString *)query perPage:(NSUInteger)perPage;
+
+/**
+ Tells whether `resultForQuery:perPage:` could find anything, without building a result.
+
+ @param query The text the user entered
+ */
+- (BOOL)canAnswerQuery:(NSString *)query;
+
+/**
+ Applies an incremental snapshot. The file is rewritten with the changes, keeping the indexed fields
+ and rank field it was built with. The new file is built while queries keep running on the current one,
+ and replaces it once it is complete.
+
+ @param documentsByType Added or changed documents keyed by document type. A document replaces the one with the same `id`.
+ @param documentIdsByType Arrays of ids of removed documents keyed by document type
+ @param error Set when the file couldn't be read or written
+
+ @return `YES` on success
+ */
+- (BOOL)updateWithDocuments:(NSDictionary *)documentsByType removedDocumentIds:(NSDictionary *)documentIdsByType error:(NSError **)error;
+
+/**
+ Unmaps the file. It is mapped again by the next query.
+ */
+- (void)unload;
+
+@end
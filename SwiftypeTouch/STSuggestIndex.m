@@ -0,0 +1,833 @@
+//
+//  STSuggestIndex.m
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import "STSuggestIndex.h"
+#import "STAPIClient.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+const NSInteger STSuggestIndexErrorCode = 3;
+
+// File layout, all integers are 32 bit in host byte order:
+//
+//   header     magic, version, documentCount, nodeCount, metadataOffset, metadataLength,
+//              documentTableOffset, documentDataOffset, nodesOffset, topsOffset, postingsOffset, fileLength
+//   metadata   JSON object with the document types, indexed fields and rank field
+//   documents  per document: data offset, data length, type index
+//   data       compact JSON of every document
+//   nodes      trie nodes in breadth first order so the children of a node are contiguous, root first
+//   tops       best ranked documents below each node
+//   postings   documents containing the word ending at each node
+//
+// Documents are stored by rank so a lower document index is a better suggestion, and every list of
+// document indexes is ascending.
+
+#define ST_SUGGEST_INDEX_MAGIC 0x49535453 // "STSI"
+#define ST_SUGGEST_INDEX_VERSION 1
+#define ST_SUGGEST_INDEX_HEADER_FIELDS 12
+#define ST_SUGGEST_INDEX_HEADER_SIZE (ST_SUGGEST_INDEX_HEADER_FIELDS * sizeof(uint32_t))
+#define ST_SUGGEST_INDEX_DOCUMENT_SIZE (3 * sizeof(uint32_t))
+#define ST_SUGGEST_INDEX_NODE_SIZE 24
+#define ST_SUGGEST_INDEX_TOP_COUNT 32
+
+enum {
+    STSuggestIndexHeaderMagic,
+    STSuggestIndexHeaderVersion,
+    STSuggestIndexHeaderDocumentCount,
+    STSuggestIndexHeaderNodeCount,
+    STSuggestIndexHeaderMetadataOffset,
+    STSuggestIndexHeaderMetadataLength,
+    STSuggestIndexHeaderDocumentTableOffset,
+    STSuggestIndexHeaderDocumentDataOffset,
+    STSuggestIndexHeaderNodesOffset,
+    STSuggestIndexHeaderTopsOffset,
+    STSuggestIndexHeaderPostingsOffset,
+    STSuggestIndexHeaderFileLength
+};
+
+typedef struct {
+    unichar character;
+    uint16_t childCount;
+    uint32_t firstChild;
+    uint32_t topStart;
+    uint32_t topCount;
+    uint32_t postingsStart;
+    uint32_t postingsCount;
+} STSuggestIndexNode;
+
+static inline uint32_t STSuggestIndexReadUInt32(const uint8_t *bytes, NSUInteger offset) {
+    uint32_t value;
+    memcpy(&value, bytes + offset, sizeof(value));
+    return value;
+}
+
+static inline BOOL STSuggestIndexRangeFits(uint64_t offset, uint64_t length, uint64_t limit) {
+    return offset <= limit && length <= limit - offset;
+}
+
+static inline void STSuggestIndexAppendUInt32(NSMutableData *data, uint32_t value) {
+    [data appendBytes:&value length:sizeof(value)];
+}
+
+static NSArray *STSuggestIndexWords(NSString *string) {
+    NSString *folded = [string stringByFoldingWithOptions:NSCaseInsensitiveSearch | NSDiacriticInsensitiveSearch locale:nil];
+    NSArray *components = [folded componentsSeparatedByCharactersInSet:[[NSCharacterSet alphanumericCharacterSet] invertedSet]];
+    NSMutableArray *words = [NSMutableArray arrayWithCapacity:components.count];
+    for (NSString *component in components) {
+        if (component.length > 0) {
+            [words addObject:component];
+        }
+    }
+    return words;
+}
+
+// Decodes a document of a mapping that passed the section checks of _load
+static NSDictionary *STSuggestIndexDocumentAtIndex(NSData *data, NSArray *types, uint32_t index, NSString **type) {
+    const uint8_t *bytes = data.bytes;
+    if (index >= STSuggestIndexReadUInt32(bytes, STSuggestIndexHeaderDocumentCount * sizeof(uint32_t))) {
+        return nil;
+    }
+    NSUInteger tableOffset = STSuggestIndexReadUInt32(bytes, STSuggestIndexHeaderDocumentTableOffset * sizeof(uint32_t)) + (NSUInteger)index * ST_SUGGEST_INDEX_DOCUMENT_SIZE;
+    uint32_t dataOffset = STSuggestIndexReadUInt32(bytes, STSuggestIndexHeaderDocumentDataOffset * sizeof(uint32_t));
+    uint32_t dataLength = STSuggestIndexReadUInt32(bytes, STSuggestIndexHeaderNodesOffset * sizeof(uint32_t)) - dataOffset;
+    uint32_t offset = STSuggestIndexReadUInt32(bytes, tableOffset);
+    uint32_t length = STSuggestIndexReadUInt32(bytes, tableOffset + 4);
+    uint32_t typeIndex = STSuggestIndexReadUInt32(bytes, tableOffset + 8);
+    if (!STSuggestIndexRangeFits(offset, length, dataLength)) {
+        return nil;
+    }
+
+    if (type) {
+        *type = (typeIndex < types.count) ? [types objectAtIndex:typeIndex] : nil;
+    }
+    // The JSON is parsed straight out of the mapping
+    NSData *json = [NSData dataWithBytesNoCopy:(void *)(bytes + dataOffset + offset) length:length freeWhenDone:NO];
+    return [NSJSONSerialization JSONObjectWithData:json options:0 error:NULL];
+}
+
+#pragma mark -
+
+// Trie node while building, serialized to a STSuggestIndexNode
+@interface STSuggestIndexBuildNode : NSObject
+
+@property (nonatomic, assign) unichar character;
+@property (nonatomic, strong) NSMutableDictionary *children;
+@property (nonatomic, strong) NSMutableData *postings;
+@property (nonatomic, strong) NSData *top;
+
+@end
+
+@implementation STSuggestIndexBuildNode
+@end
+
+#pragma mark -
+
+@interface STSuggestIndex ()
+
+@property (nonatomic, readwrite, copy) NSString *path;
+@property (nonatomic, strong) NSData *data;
+@property (nonatomic, strong) NSArray *types;
+@property (nonatomic, strong) NSArray *indexedFields;
+@property (nonatomic, copy) NSString *rankField;
+@property (nonatomic, strong) NSObject *updateLock;
+
++ (NSData *)_fileDataWithDocuments:(NSArray *)documents types:(NSArray *)types indexedFields:(NSArray *)indexedFields rankField:(NSString *)rankField;
++ (NSArray *)_rankedDocuments:(NSDictionary *)documentsByType rankField:(NSString *)rankField;
++ (NSArray *)_wordsInDocument:(NSDictionary *)document indexedFields:(NSArray *)indexedFields;
++ (void)_addStringsInValue:(id)value toArray:(NSMutableArray *)strings;
++ (void)_computeTopForNode:(STSuggestIndexBuildNode *)node;
++ (NSError *)_errorWithDescription:(NSString *)description underlyingError:(NSError *)underlyingError;
+- (BOOL)_load;
+- (STSuggestIndexNode)_nodeAtIndex:(uint32_t)index;
+- (BOOL)_findNode:(STSuggestIndexNode *)node forPrefix:(NSString *)prefix;
+- (uint32_t)_listValueAtIndex:(uint32_t)index offsetField:(NSUInteger)offsetField;
+- (BOOL)_listContainsRangeFrom:(uint32_t)start count:(uint32_t)count offsetField:(NSUInteger)offsetField;
+- (NSDictionary *)_documentAtIndex:(uint32_t)index type:(NSString **)type;
+- (BOOL)_document:(NSDictionary *)document matchesWords:(NSArray *)words;
+- (NSArray *)_candidatesForWords:(NSArray *)words nodes:(STSuggestIndexNode *)nodes;
+
+@end
+
+@implementation STSuggestIndex
+
+#pragma mark - NSObject
+
+- (id)init {
+    return [self initWithPath:nil];
+}
+
+#pragma mark - STSuggestIndex
+
++ (STSuggestIndex *)indexWithDocuments:(NSDictionary *)documentsByType
+                         indexedFields:(NSArray *)indexedFields
+                             rankField:(NSString *)rankField
+                                  path:(NSString *)path
+                                 error:(NSError **)error {
+    NSArray *types = [[documentsByType allKeys] sortedArrayUsingSelector:@selector(compare:)];
+    NSArray *documents = [self _rankedDocuments:documentsByType rankField:rankField];
+    NSData *fileData = [self _fileDataWithDocuments:documents types:types indexedFields:indexedFields rankField:rankField];
+    if (fileData == nil) {
+        if (error) {
+            *error = [self _errorWithDescription:@"The documents couldn't be encoded" underlyingError:nil];
+        }
+        return nil;
+    }
+
+    NSError *writeError = nil;
+    if (![fileData writeToFile:path options:NSDataWritingAtomic error:&writeError]) {
+        if (error) {
+            *error = [self _errorWithDescription:@"The suggest index couldn't be written" underlyingError:writeError];
+        }
+        return nil;
+    }
+    return [[STSuggestIndex alloc] initWithPath:path];
+}
+
+- (id)initWithPath:(NSString *)path {
+    self = [super init];
+    if (self) {
+        self.path = path;
+        self.updateLock = [[NSObject alloc] init];
+    }
+    return self;
+}
+
+- (BOOL)isLoaded {
+    @synchronized(self) {
+        return self.data != nil;
+    }
+}
+
+- (NSUInteger)documentCount {
+    @synchronized(self) {
+        if (![self _load]) return 0;
+        return STSuggestIndexReadUInt32(self.data.bytes, STSuggestIndexHeaderDocumentCount * sizeof(uint32_t));
+    }
+}
+
+- (NSUInteger)nodeCount {
+    @synchronized(self) {
+        if (![self _load]) return 0;
+        return STSuggestIndexReadUInt32(self.data.bytes, STSuggestIndexHeaderNodeCount * sizeof(uint32_t));
+    }
+}
+
+- (NSUInteger)mappedBytes {
+    @synchronized(self) {
+        return self.data.length;
+    }
+}
+
+- (NSUInteger)residentBytes {
+    @synchronized(self) {
+        if (self.data == nil) return 0;
+
+        // mincore wants a page aligned address, a mapping always starts on a page
+        size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+        uintptr_t start = (uintptr_t)self.data.bytes & ~(uintptr_t)(pageSize - 1);
+        size_t length = (uintptr_t)self.data.bytes + self.data.length - start;
+        size_t pageCount = (length + pageSize - 1) / pageSize;
+
+        NSMutableData *residency = [NSMutableData dataWithLength:pageCount];
+        if (mincore((void *)start, length, residency.mutableBytes) != 0) {
+            // Not a mapping, for example when the system read the file into memory instead
+            return self.data.length;
+        }
+
+        const unsigned char *pages = residency.bytes;
+        NSUInteger residentPages = 0;
+        for (size_t i = 0; i < pageCount; i++) {
+            if (pages[i] & 1) {
+                residentPages++;
+            }
+        }
+        return MIN(residentPages * pageSize, self.data.length);
+    }
+}
+
+- (NSDictionary *)resultForQuery:(NSString *)query perPage:(NSUInteger)perPage {
+    NSArray *words = STSuggestIndexWords(query);
+    if (words.count == 0 || perPage == 0) {
+        return nil;
+    }
+
+    @synchronized(self) {
+        if (![self _load]) return nil;
+
+        STSuggestIndexNode nodes[words.count];
+        for (NSUInteger i = 0; i < words.count; i++) {
+            if (![self _findNode:&nodes[i] forPrefix:[words objectAtIndex:i]]) {
+                return nil;
+            }
+        }
+
+        NSMutableDictionary *records = [NSMutableDictionary dictionaryWithCapacity:self.types.count];
+        for (NSString *type in self.types) {
+            [records setObject:[NSMutableArray array] forKey:type];
+        }
+
+        NSUInteger recordCount = 0;
+        for (NSNumber *candidate in [self _candidatesForWords:words nodes:nodes]) {
+            NSString *type = nil;
+            NSDictionary *document = [self _documentAtIndex:[candidate unsignedIntValue] type:&type];
+            NSMutableArray *typeRecords = [records objectForKey:type];
+            if (document == nil || typeRecords == nil || typeRecords.count >= perPage) {
+                continue;
+            }
+            if (words.count > 1 && ![self _document:document matchesWords:words]) {
+                continue;
+            }
+            [typeRecords addObject:document];
+            recordCount++;
+        }
+        if (recordCount == 0) {
+            return nil;
+        }
+
+        NSMutableDictionary *info = [NSMutableDictionary dictionaryWithCapacity:records.count];
+        for (NSString *type in records) {
+            NSUInteger count = [[records objectForKey:type] count];
+            [info setObject:@{
+                @"query" : query,
+                @"current_page" : @1,
+                @"num_pages" : @1,
+                @"per_page" : @(perPage),
+                @"total_result_count" : @(count)
+            } forKey:type];
+        }
+        return @{ @"records" : records, @"info" : info, @"record_count" : @(recordCount) };
+    }
+}
+
+- (BOOL)canAnswerQuery:(NSString *)query {
+    NSArray *words = STSuggestIndexWords(query);
+    if (words.count == 0) {
+        return NO;
+    }
+
+    @synchronized(self) {
+        if (![self _load]) return NO;
+
+        for (NSString *word in words) {
+            STSuggestIndexNode node;
+            if (![self _findNode:&node forPrefix:word]) {
+                return NO;
+            }
+        }
+        // Several words only match if some document has all of them
+        return (words.count == 1) || [self resultForQuery:query perPage:1] != nil;
+    }
+}
+
+- (BOOL)updateWithDocuments:(NSDictionary *)documentsByType removedDocumentIds:(NSDictionary *)documentIdsByType error:(NSError **)error {
+    // Updates wait for each other, queries only wait for the swap at the end
+    @synchronized(self.updateLock) {
+        NSData *data = nil;
+        NSArray *types = nil;
+        NSArray *indexedFields = nil;
+        NSString *rankField = nil;
+        NSString *path = nil;
+        @synchronized(self) {
+            if (![self _load]) {
+                if (error) {
+                    *error = [[self class] _errorWithDescription:@"The suggest index couldn't be read" underlyingError:nil];
+                }
+                return NO;
+            }
+            data = self.data;
+            types = self.types;
+            indexedFields = self.indexedFields;
+            rankField = self.rankField;
+            path = self.path;
+        }
+
+        // The captured mapping stays valid after an unload or after the file is replaced
+        NSMutableDictionary *snapshot = [NSMutableDictionary dictionary];
+        NSMutableDictionary *positions = [NSMutableDictionary dictionary];
+        for (NSString *type in types) {
+            [snapshot setObject:[NSMutableArray array] forKey:type];
+            [positions setObject:[NSMutableDictionary dictionary] forKey:type];
+        }
+
+        // Start from the current snapshot, keeping its order for documents that don't change
+        uint32_t documentCount = STSuggestIndexReadUInt32(data.bytes, STSuggestIndexHeaderDocumentCount * sizeof(uint32_t));
+        for (uint32_t i = 0; i < documentCount; i++) {
+            NSString *type = nil;
+            NSDictionary *document = STSuggestIndexDocumentAtIndex(data, types, i, &type);
+            if (document == nil || type == nil) continue;
+
+            NSMutableArray *typeDocuments = [snapshot objectForKey:type];
+            id documentId = [document objectForKey:@"id"];
+            if (documentId) {
+                [[positions objectForKey:type] setObject:@(typeDocuments.count) forKey:documentId];
+            }
+            [typeDocuments addObject:document];
+        }
+
+        NSNull *removed = [NSNull null];
+        for (NSString *type in documentIdsByType) {
+            NSMutableArray *typeDocuments = [snapshot objectForKey:type];
+            NSMutableDictionary *typePositions = [positions objectForKey:type];
+            for (id documentId in [documentIdsByType objectForKey:type]) {
+                NSNumber *position = [typePositions objectForKey:documentId];
+                if (position) {
+                    [typeDocuments replaceObjectAtIndex:[position unsignedIntegerValue] withObject:removed];
+                    [typePositions removeObjectForKey:documentId];
+                }
+            }
+        }
+
+        for (NSString *type in documentsByType) {
+            NSMutableArray *typeDocuments = [snapshot objectForKey:type];
+            NSMutableDictionary *typePositions = [positions objectForKey:type];
+            if (typeDocuments == nil) {
+                typeDocuments = [NSMutableArray array];
+                typePositions = [NSMutableDictionary dictionary];
+                [snapshot setObject:typeDocuments forKey:type];
+                [positions setObject:typePositions forKey:type];
+            }
+
+            for (NSDictionary *document in [documentsByType objectForKey:type]) {
+                id documentId = [document objectForKey:@"id"];
+                NSNumber *position = documentId ? [typePositions objectForKey:documentId] : nil;
+                if (position) {
+                    [typeDocuments replaceObjectAtIndex:[position unsignedIntegerValue] withObject:document];
+                }
+                else {
+                    if (documentId) {
+                        [typePositions setObject:@(typeDocuments.count) forKey:documentId];
+                    }
+                    [typeDocuments addObject:document];
+                }
+            }
+        }
+
+        for (NSMutableArray *typeDocuments in [snapshot allValues]) {
+            [typeDocuments removeObjectIdenticalTo:removed];
+        }
+
+        STSuggestIndex *updated = [[self class] indexWithDocuments:snapshot
+                                                     indexedFields:indexedFields
+                                                         rankField:rankField
+                                                              path:path
+                                                             error:error];
+        if (updated == nil) {
+            return NO;
+        }
+        if (![updated _load]) {
+            if (error) {
+                *error = [[self class] _errorWithDescription:@"The suggest index couldn't be read" underlyingError:nil];
+            }
+            return NO;
+        }
+
+        // The file was replaced by a rename, queries running on the old mapping finish on it
+        @synchronized(self) {
+            self.data = updated.data;
+            self.types = updated.types;
+            self.indexedFields = updated.indexedFields;
+            self.rankField = updated.rankField;
+        }
+        return YES;
+    }
+}
+
+- (void)unload {
+    @synchronized(self) {
+        self.data = nil;
+        self.types = nil;
+        self.indexedFields = nil;
+        self.rankField = nil;
+    }
+}
+
+#pragma mark - Private
+
++ (NSData *)_fileDataWithDocuments:(NSArray *)documents types:(NSArray *)types indexedFields:(NSArray *)indexedFields rankField:(NSString *)rankField {
+    NSMutableDictionary *metadata = [NSMutableDictionary dictionary];
+    [metadata setObject:types forKey:@"types"];
+    [metadata setObject:(indexedFields ?: @[]) forKey:@"indexed_fields"];
+    if (rankField) {
+        [metadata setObject:rankField forKey:@"rank_field"];
+    }
+    NSData *metadataData = [NSJSONSerialization dataWithJSONObject:metadata options:0 error:NULL];
+    if (metadataData == nil) {
+        return nil;
+    }
+
+    NSMutableData *documentTable = [NSMutableData dataWithCapacity:documents.count * ST_SUGGEST_INDEX_DOCUMENT_SIZE];
+    NSMutableData *documentData = [NSMutableData data];
+    STSuggestIndexBuildNode *root = [[STSuggestIndexBuildNode alloc] init];
+
+    uint32_t documentIndex = 0;
+    for (NSArray *entry in documents) {
+        NSString *type = [entry objectAtIndex:0];
+        NSDictionary *document = [entry objectAtIndex:1];
+        NSData *json = [NSJSONSerialization dataWithJSONObject:document options:0 error:NULL];
+        if (json == nil) {
+            return nil;
+        }
+
+        STSuggestIndexAppendUInt32(documentTable, (uint32_t)documentData.length);
+        STSuggestIndexAppendUInt32(documentTable, (uint32_t)json.length);
+        STSuggestIndexAppendUInt32(documentTable, (uint32_t)[types indexOfObject:type]);
+        [documentData appendData:json];
+
+        for (NSString *word in [self _wordsInDocument:document indexedFields:indexedFields]) {
+            STSuggestIndexBuildNode *node = root;
+            for (NSUInteger i = 0; i < word.length; i++) {
+                unichar c = [word characterAtIndex:i];
+                if (node.children == nil) {
+                    node.children = [NSMutableDictionary dictionary];
+                }
+                STSuggestIndexBuildNode *child = [node.children objectForKey:@(c)];
+                if (child == nil) {
+                    child = [[STSuggestIndexBuildNode alloc] init];
+                    child.character = c;
+                    [node.children setObject:child forKey:@(c)];
+                }
+                node = child;
+            }
+            if (node.postings == nil) {
+                node.postings = [NSMutableData data];
+            }
+            STSuggestIndexAppendUInt32(node.postings, documentIndex);
+        }
+        documentIndex++;
+    }
+
+    [self _computeTopForNode:root];
+
+    // Breadth first so the children of every node end up next to each other
+    NSMutableData *nodes = [NSMutableData data];
+    NSMutableData *tops = [NSMutableData data];
+    NSMutableData *postings = [NSMutableData data];
+    NSMutableArray *queue = [NSMutableArray arrayWithObject:root];
+    NSUInteger nextNodeIndex = 1;
+    for (NSUInteger head = 0; head < queue.count; head++) {
+        STSuggestIndexBuildNode *buildNode = [queue objectAtIndex:head];
+        NSArray *children = [[buildNode.children allValues] sortedArrayUsingComparator:^NSComparisonResult(STSuggestIndexBuildNode *a, STSuggestIndexBuildNode *b) {
+            return (a.character < b.character) ? NSOrderedAscending : (a.character > b.character) ? NSOrderedDescending : NSOrderedSame;
+        }];
+
+        STSuggestIndexNode node;
+        memset(&node, 0, sizeof(node));
+        node.character = buildNode.character;
+        node.childCount = (uint16_t)children.count;
+        node.firstChild = (uint32_t)nextNodeIndex;
+        node.topStart = (uint32_t)(tops.length / sizeof(uint32_t));
+        node.topCount = (uint32_t)(buildNode.top.length / sizeof(uint32_t));
+        node.postingsStart = (uint32_t)(postings.length / sizeof(uint32_t));
+        node.postingsCount = (uint32_t)(buildNode.postings.length / sizeof(uint32_t));
+        [tops appendData:buildNode.top];
+        if (buildNode.postings) {
+            [postings appendData:buildNode.postings];
+        }
+
+        [nodes appendBytes:&node.character length:sizeof(node.character)];
+        [nodes appendBytes:&node.childCount length:sizeof(node.childCount)];
+        STSuggestIndexAppendUInt32(nodes, node.firstChild);
+        STSuggestIndexAppendUInt32(nodes, node.topStart);
+        STSuggestIndexAppendUInt32(nodes, node.topCount);
+        STSuggestIndexAppendUInt32(nodes, node.postingsStart);
+        STSuggestIndexAppendUInt32(nodes, node.postingsCount);
+
+        [queue addObjectsFromArray:children];
+        nextNodeIndex += children.count;
+        // Everything below was copied, let the build tree shrink as we go
+        [queue replaceObjectAtIndex:head withObject:[NSNull null]];
+    }
+
+    uint32_t header[ST_SUGGEST_INDEX_HEADER_FIELDS];
+    header[STSuggestIndexHeaderMagic] = ST_SUGGEST_INDEX_MAGIC;
+    header[STSuggestIndexHeaderVersion] = ST_SUGGEST_INDEX_VERSION;
+    header[STSuggestIndexHeaderDocumentCount] = documentIndex;
+    header[STSuggestIndexHeaderNodeCount] = (uint32_t)queue.count;
+    header[STSuggestIndexHeaderMetadataOffset] = (uint32_t)ST_SUGGEST_INDEX_HEADER_SIZE;
+    header[STSuggestIndexHeaderMetadataLength] = (uint32_t)metadataData.length;
+    // Keep the integer sections 4 byte aligned after the variable length ones
+    header[STSuggestIndexHeaderDocumentTableOffset] = (header[STSuggestIndexHeaderMetadataOffset] + header[STSuggestIndexHeaderMetadataLength] + 3) & ~3u;
+    header[STSuggestIndexHeaderDocumentDataOffset] = header[STSuggestIndexHeaderDocumentTableOffset] + (uint32_t)documentTable.length;
+    header[STSuggestIndexHeaderNodesOffset] = (header[STSuggestIndexHeaderDocumentDataOffset] + (uint32_t)documentData.length + 3) & ~3u;
+    header[STSuggestIndexHeaderTopsOffset] = header[STSuggestIndexHeaderNodesOffset] + (uint32_t)nodes.length;
+    header[STSuggestIndexHeaderPostingsOffset] = header[STSuggestIndexHeaderTopsOffset] + (uint32_t)tops.length;
+    header[STSuggestIndexHeaderFileLength] = header[STSuggestIndexHeaderPostingsOffset] + (uint32_t)postings.length;
+
+    NSMutableData *fileData = [NSMutableData dataWithCapacity:header[STSuggestIndexHeaderFileLength]];
+    [fileData appendBytes:header length:sizeof(header)];
+    [fileData appendData:metadataData];
+    [fileData setLength:header[STSuggestIndexHeaderDocumentTableOffset]];
+    [fileData appendData:documentTable];
+    [fileData appendData:documentData];
+    [fileData setLength:header[STSuggestIndexHeaderNodesOffset]];
+    [fileData appendData:nodes];
+    [fileData appendData:tops];
+    [fileData appendData:postings];
+    return fileData;
+}
+
++ (NSArray *)_rankedDocuments:(NSDictionary *)documentsByType rankField:(NSString *)rankField {
+    NSMutableArray *documents = [NSMutableArray array];
+    for (NSString *type in [[documentsByType allKeys] sortedArrayUsingSelector:@selector(compare:)]) {
+        for (NSDictionary *document in [documentsByType objectForKey:type]) {
+            if ([document isKindOfClass:[NSDictionary class]]) {
+                [documents addObject:@[ type, document ]];
+            }
+        }
+    }
+    if (rankField == nil) {
+        return documents;
+    }
+
+    // Stable, so documents with the same rank keep the snapshot order
+    return [documents sortedArrayWithOptions:NSSortStable usingComparator:^NSComparisonResult(NSArray *a, NSArray *b) {
+        id rankA = [[a objectAtIndex:1] objectForKey:rankField];
+        id rankB = [[b objectAtIndex:1] objectForKey:rankField];
+        double valueA = [rankA isKindOfClass:[NSNumber class]] ? [rankA doubleValue] : 0.0;
+        double valueB = [rankB isKindOfClass:[NSNumber class]] ? [rankB doubleValue] : 0.0;
+        return (valueA > valueB) ? NSOrderedAscending : (valueA < valueB) ? NSOrderedDescending : NSOrderedSame;
+    }];
+}
+
++ (NSArray *)_wordsInDocument:(NSDictionary *)document indexedFields:(NSArray *)indexedFields {
+    NSMutableArray *strings = [NSMutableArray array];
+    for (NSString *field in indexedFields) {
+        [self _addStringsInValue:[document objectForKey:field] toArray:strings];
+    }
+
+    NSMutableOrderedSet *words = [NSMutableOrderedSet orderedSet];
+    for (NSString *s in strings) {
+        [words addObjectsFromArray:STSuggestIndexWords(s)];
+    }
+    return [words array];
+}
+
++ (void)_addStringsInValue:(id)value toArray:(NSMutableArray *)strings {
+    if ([value isKindOfClass:[NSString class]]) {
+        [strings addObject:value];
+    }
+    else if ([value isKindOfClass:[NSArray class]]) {
+        for (id item in value) {
+            if ([item isKindOfClass:[NSString class]]) {
+                [strings addObject:item];
+            }
+        }
+    }
+}
+
++ (void)_computeTopForNode:(STSuggestIndexBuildNode *)node {
+    NSMutableIndexSet *best = [NSMutableIndexSet indexSet];
+
+    const uint32_t *postings = node.postings.bytes;
+    NSUInteger postingsCount = MIN(node.postings.length / sizeof(uint32_t), (NSUInteger)ST_SUGGEST_INDEX_TOP_COUNT);
+    for (NSUInteger i = 0; i < postingsCount; i++) {
+        [best addIndex:postings[i]];
+    }
+
+    for (STSuggestIndexBuildNode *child in [node.children allValues]) {
+        [self _computeTopForNode:child];
+        const uint32_t *childTop = child.top.bytes;
+        NSUInteger childTopCount = child.top.length / sizeof(uint32_t);
+        for (NSUInteger i = 0; i < childTopCount; i++) {
+            [best addIndex:childTop[i]];
+        }
+    }
+
+    NSMutableData *top = [NSMutableData dataWithCapacity:MIN(best.count, (NSUInteger)ST_SUGGEST_INDEX_TOP_COUNT) * sizeof(uint32_t)];
+    [best enumerateIndexesUsingBlock:^(NSUInteger idx, BOOL *stop) {
+        STSuggestIndexAppendUInt32(top, (uint32_t)idx);
+        *stop = (top.length >= ST_SUGGEST_INDEX_TOP_COUNT * sizeof(uint32_t));
+    }];
+    node.top = top;
+}
+
++ (NSError *)_errorWithDescription:(NSString *)description underlyingError:(NSError *)underlyingError {
+    NSMutableDictionary *userInfo = [NSMutableDictionary dictionaryWithObject:description forKey:NSLocalizedDescriptionKey];
+    if (underlyingError) {
+        [userInfo setObject:underlyingError forKey:NSUnderlyingErrorKey];
+    }
+    return [NSError errorWithDomain:STErrorDomain code:STSuggestIndexErrorCode userInfo:userInfo];
+}
+
+- (BOOL)_load {
+    if (self.data) {
+        return YES;
+    }
+    if (self.path == nil) {
+        return NO;
+    }
+
+    NSData *data = [NSData dataWithContentsOfFile:self.path options:NSDataReadingMappedAlways error:NULL];
+    if (data.length < ST_SUGGEST_INDEX_HEADER_SIZE) {
+        return NO;
+    }
+
+    const uint8_t *bytes = data.bytes;
+    if (STSuggestIndexReadUInt32(bytes, STSuggestIndexHeaderMagic * sizeof(uint32_t)) != ST_SUGGEST_INDEX_MAGIC ||
+        STSuggestIndexReadUInt32(bytes, STSuggestIndexHeaderVersion * sizeof(uint32_t)) != ST_SUGGEST_INDEX_VERSION ||
+        STSuggestIndexReadUInt32(bytes, STSuggestIndexHeaderFileLength * sizeof(uint32_t)) != data.length) {
+        return NO;
+    }
+
+    // Every section has to lie inside the file, in the order they are written, before anything is read
+    uint64_t fileLength = data.length;
+    uint32_t documentCount = STSuggestIndexReadUInt32(bytes, STSuggestIndexHeaderDocumentCount * sizeof(uint32_t));
+    uint32_t nodeCount = STSuggestIndexReadUInt32(bytes, STSuggestIndexHeaderNodeCount * sizeof(uint32_t));
+    uint32_t metadataOffset = STSuggestIndexReadUInt32(bytes, STSuggestIndexHeaderMetadataOffset * sizeof(uint32_t));
+    uint32_t metadataLength = STSuggestIndexReadUInt32(bytes, STSuggestIndexHeaderMetadataLength * sizeof(uint32_t));
+    uint32_t documentTableOffset = STSuggestIndexReadUInt32(bytes, STSuggestIndexHeaderDocumentTableOffset * sizeof(uint32_t));
+    uint32_t documentDataOffset = STSuggestIndexReadUInt32(bytes, STSuggestIndexHeaderDocumentDataOffset * sizeof(uint32_t));
+    uint32_t nodesOffset = STSuggestIndexReadUInt32(bytes, STSuggestIndexHeaderNodesOffset * sizeof(uint32_t));
+    uint32_t topsOffset = STSuggestIndexReadUInt32(bytes, STSuggestIndexHeaderTopsOffset * sizeof(uint32_t));
+    uint32_t postingsOffset = STSuggestIndexReadUInt32(bytes, STSuggestIndexHeaderPostingsOffset * sizeof(uint32_t));
+    if (nodeCount == 0 ||
+        metadataOffset < ST_SUGGEST_INDEX_HEADER_SIZE ||
+        !STSuggestIndexRangeFits(metadataOffset, metadataLength, documentTableOffset) ||
+        !STSuggestIndexRangeFits(documentTableOffset, (uint64_t)documentCount * ST_SUGGEST_INDEX_DOCUMENT_SIZE, documentDataOffset) ||
+        documentDataOffset > nodesOffset ||
+        !STSuggestIndexRangeFits(nodesOffset, (uint64_t)nodeCount * ST_SUGGEST_INDEX_NODE_SIZE, topsOffset) ||
+        topsOffset > postingsOffset ||
+        postingsOffset > fileLength) {
+        return NO;
+    }
+    NSData *metadataData = [data subdataWithRange:NSMakeRange(metadataOffset, metadataLength)];
+    NSDictionary *metadata = [NSJSONSerialization JSONObjectWithData:metadataData options:0 error:NULL];
+    if (![metadata isKindOfClass:[NSDictionary class]]) {
+        return NO;
+    }
+
+    self.data = data;
+    self.types = [metadata objectForKey:@"types"];
+    self.indexedFields = [metadata objectForKey:@"indexed_fields"];
+    self.rankField = [metadata objectForKey:@"rank_field"];
+    return YES;
+}
+
+- (STSuggestIndexNode)_nodeAtIndex:(uint32_t)index {
+    const uint8_t *bytes = self.data.bytes;
+    NSUInteger offset = STSuggestIndexReadUInt32(bytes, STSuggestIndexHeaderNodesOffset * sizeof(uint32_t)) + (NSUInteger)index * ST_SUGGEST_INDEX_NODE_SIZE;
+
+    STSuggestIndexNode node;
+    memcpy(&node.character, bytes + offset, sizeof(node.character));
+    memcpy(&node.childCount, bytes + offset + 2, sizeof(node.childCount));
+    node.firstChild = STSuggestIndexReadUInt32(bytes, offset + 4);
+    node.topStart = STSuggestIndexReadUInt32(bytes, offset + 8);
+    node.topCount = STSuggestIndexReadUInt32(bytes, offset + 12);
+    node.postingsStart = STSuggestIndexReadUInt32(bytes, offset + 16);
+    node.postingsCount = STSuggestIndexReadUInt32(bytes, offset + 20);
+    return node;
+}
+
+- (BOOL)_findNode:(STSuggestIndexNode *)node forPrefix:(NSString *)prefix {
+    uint32_t nodeCount = STSuggestIndexReadUInt32(self.data.bytes, STSuggestIndexHeaderNodeCount * sizeof(uint32_t));
+    STSuggestIndexNode current = [self _nodeAtIndex:0];
+    for (NSUInteger i = 0; i < prefix.length; i++) {
+        unichar c = [prefix characterAtIndex:i];
+
+        // Children are sorted by character
+        if (!STSuggestIndexRangeFits(current.firstChild, current.childCount, nodeCount)) {
+            return NO;
+        }
+        uint32_t low = current.firstChild;
+        uint32_t high = current.firstChild + current.childCount;
+        BOOL found = NO;
+        while (low < high) {
+            uint32_t middle = low + (high - low) / 2;
+            STSuggestIndexNode child = [self _nodeAtIndex:middle];
+            if (child.character == c) {
+                current = child;
+                found = YES;
+                break;
+            }
+            else if (child.character < c) {
+                low = middle + 1;
+            }
+            else {
+                high = middle;
+            }
+        }
+        if (!found) {
+            return NO;
+        }
+    }
+    *node = current;
+    return YES;
+}
+
+- (uint32_t)_listValueAtIndex:(uint32_t)index offsetField:(NSUInteger)offsetField {
+    const uint8_t *bytes = self.data.bytes;
+    uint32_t listOffset = STSuggestIndexReadUInt32(bytes, offsetField * sizeof(uint32_t));
+    return STSuggestIndexReadUInt32(bytes, listOffset + (NSUInteger)index * sizeof(uint32_t));
+}
+
+- (BOOL)_listContainsRangeFrom:(uint32_t)start count:(uint32_t)count offsetField:(NSUInteger)offsetField {
+    // Tops end where the postings start, postings end with the file
+    const uint8_t *bytes = self.data.bytes;
+    uint32_t listOffset = STSuggestIndexReadUInt32(bytes, offsetField * sizeof(uint32_t));
+    uint32_t listEnd = (offsetField == STSuggestIndexHeaderTopsOffset) ? STSuggestIndexReadUInt32(bytes, STSuggestIndexHeaderPostingsOffset * sizeof(uint32_t)) : (uint32_t)self.data.length;
+    return STSuggestIndexRangeFits((uint64_t)start * sizeof(uint32_t), (uint64_t)count * sizeof(uint32_t), listEnd - listOffset);
+}
+
+- (NSDictionary *)_documentAtIndex:(uint32_t)index type:(NSString **)type {
+    return STSuggestIndexDocumentAtIndex(self.data, self.types, index, type);
+}
+
+- (BOOL)_document:(NSDictionary *)document matchesWords:(NSArray *)words {
+    NSArray *documentWords = [[self class] _wordsInDocument:document indexedFields:self.indexedFields];
+    for (NSString *word in words) {
+        BOOL matchesWord = NO;
+        for (NSString *documentWord in documentWords) {
+            if ([documentWord hasPrefix:word]) {
+                matchesWord = YES;
+                break;
+            }
+        }
+        if (!matchesWord) {
+            return NO;
+        }
+    }
+    return YES;
+}
+
+- (NSArray *)_candidatesForWords:(NSArray *)words nodes:(STSuggestIndexNode *)nodes {
+    NSMutableIndexSet *candidates = [NSMutableIndexSet indexSet];
+    for (NSUInteger i = 0; i < words.count; i++) {
+        if (![self _listContainsRangeFrom:nodes[i].topStart count:nodes[i].topCount offsetField:STSuggestIndexHeaderTopsOffset]) {
+            continue;
+        }
+        for (uint32_t j = 0; j < nodes[i].topCount; j++) {
+            [candidates addIndex:[self _listValueAtIndex:nodes[i].topStart + j offsetField:STSuggestIndexHeaderTopsOffset]];
+        }
+    }
+
+    if (words.count > 1) {
+        // The best documents of each word may not share any; the postings of the rarest complete word
+        // reach further down the ranking
+        NSUInteger rarest = NSNotFound;
+        for (NSUInteger i = 0; i < words.count; i++) {
+            if (nodes[i].postingsCount > 0 && (rarest == NSNotFound || nodes[i].postingsCount < nodes[rarest].postingsCount)) {
+                rarest = i;
+            }
+        }
+        if (rarest != NSNotFound && [self _listContainsRangeFrom:nodes[rarest].postingsStart count:nodes[rarest].postingsCount offsetField:STSuggestIndexHeaderPostingsOffset]) {
+            uint32_t count = MIN(nodes[rarest].postingsCount, (uint32_t)ST_SUGGEST_INDEX_TOP_COUNT * 8);
+            for (uint32_t j = 0; j < count; j++) {
+                [candidates addIndex:[self _listValueAtIndex:nodes[rarest].postingsStart + j offsetField:STSuggestIndexHeaderPostingsOffset]];
+            }
+        }
+    }
+
+    NSMutableArray *ordered = [NSMutableArray arrayWithCapacity:candidates.count];
+    [candidates enumerateIndexesUsingBlock:^(NSUInteger idx, BOOL *stop) {
+        [ordered addObject:@(idx)];
+    }];
+    return ordered;
+}
+
+@end
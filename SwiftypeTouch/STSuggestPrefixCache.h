@@ -0,0 +1,109 @@
+//
+//  STSuggestPrefixCache.h
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ `STSuggestPrefixCache` answers suggest queries locally when the user extends a prefix whose
+ results are already known to be complete.
+
+ A suggest result is complete when every document type returned fewer records than were
+ requested per page (or the `info` section reports no more results than were returned). Since
+ a longer prefix can only match a subset of the records matched by a shorter one, the result
+ for "swif" can be computed by filtering the complete result for "swi" without asking the server.
+
+ Results are keyed by the request parameters minus the query itself, so the engine, document
+ types, filters and every other parameter have to match for a cached result to be reused. Only
+ extensions of the last word are answered locally. Once the user types a word boundary the
+ server is asked again.
+
+ Records are matched against the fields listed in the request's `search_fields` parameter for
+ their document type. A prefix is only filtered when `search_fields` names the fields of every
+ document type and every record came back with all of them, otherwise the server may have
+ matched a record on a field the cache can't see. Requests whose `fetch_fields` leave out a
+ searched field are therefore always sent to the server.
+
+ @warning Suggest queries must send `search_fields` for the cache to be of any use. Without it only
+ the exact query of a cached result is answered, which `STQueryCache` already does. `STSearchResultsObject`
+ sends it for the document types whose `searchedFieldsForDocumentType:` names fields, as the bundled
+ result objects do.
+
+ A filtered result returned by `resultForQuery:params:` is kept like a result from the server, so the
+ same query and longer prefixes start from it.
+ */
+@interface STSuggestPrefixCache : NSObject
+
+/**
+ Cache shared by all instances of `STAPIClient`
+ */
++ (STSuggestPrefixCache *)sharedCache;
+
+/**
+ Maximum number of complete results kept by the cache.
+
+ The default value is 100.
+ */
+@property (nonatomic, assign) NSUInteger countLimit;
+
+/**
+ Number of times the cache was asked for a result
+ */
+@property (nonatomic, readonly, assign) NSUInteger lookupCount;
+
+/**
+ Number of lookups that were answered by the cache
+ */
+@property (nonatomic, readonly, assign) NSUInteger hitCount;
+
+/**
+ `hitCount` divided by `lookupCount`, or 0 when nothing was looked up yet
+ */
+@property (nonatomic, readonly, assign) double hitRate;
+
+/**
+ Returns the result for a suggest query if it can be answered from a cached complete result.
+
+ @param query The query entered by the user
+ @param params The parameters that would be posted to the server for `query`
+
+ @return The result for `query` in the same format the server would return, or nil
+ */
+- (NSDictionary *)resultForQuery:(NSString *)query params:(NSDictionary *)params;
+
+/**
+ Tells whether `resultForQuery:params:` would answer a query, without counting a lookup or keeping
+ the filtered result.
+
+ @param query The query entered by the user
+ @param params The parameters that would be posted to the server for `query`
+
+ @return `YES` if the query can be answered locally
+ */
+- (BOOL)canAnswerQuery:(NSString *)query params:(NSDictionary *)params;
+
+/**
+ Offers a suggest result received from the server to the cache. Results that are not complete
+ or are not for the first page are ignored.
+
+ @param result The decoded result returned by the server
+ @param query The query the result was requested for
+ @param params The parameters that were posted to the server
+ */
+- (void)storeResult:(NSDictionary *)result forQuery:(NSString *)query params:(NSDictionary *)params;
+
+/**
+ Removes every cached result
+ */
+- (void)removeAllResults;
+
+/**
+ Resets `lookupCount` and `hitCount` to 0
+ */
+- (void)resetStatistics;
+
+@end
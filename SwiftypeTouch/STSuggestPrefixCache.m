@@ -0,0 +1,345 @@
+//
+//  STSuggestPrefixCache.m
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import "STSuggestPrefixCache.h"
+
+#import "NSDictionary+STUtils.h"
+
+@interface STSuggestPrefixCache ()
+
+@property (nonatomic, strong) NSCache *results;
+@property (nonatomic, assign) NSUInteger lookupCount;
+@property (nonatomic, assign) NSUInteger hitCount;
+
+- (NSString *)_normalizedQuery:(NSString *)query;
+- (NSString *)_keyForPrefix:(NSString *)prefix paramsKey:(NSString *)paramsKey;
+- (NSString *)_paramsKey:(NSDictionary *)params;
+- (NSArray *)_wordsInString:(NSString *)string;
+- (BOOL)_isCompleteResult:(NSDictionary *)result perPage:(NSUInteger)perPage;
+- (NSArray *)_searchFieldsForType:(NSString *)type params:(NSDictionary *)params;
+- (BOOL)_fields:(NSArray *)fields areFetchedForType:(NSString *)type params:(NSDictionary *)params;
+- (NSArray *)_searchableStringsForRecord:(NSDictionary *)record fields:(NSArray *)fields;
+- (NSDictionary *)_filterResult:(NSDictionary *)result forQuery:(NSString *)query params:(NSDictionary *)params;
+- (NSDictionary *)_resultForQuery:(NSString *)query params:(NSDictionary *)params keepsFilteredResult:(BOOL)keep;
+
+@end
+
+@implementation STSuggestPrefixCache
+
+#pragma mark - NSObject
+
+- (id)init {
+    self = [super init];
+    if (self) {
+        self.results = [[NSCache alloc] init];
+        self.countLimit = 100;
+    }
+    return self;
+}
+
+#pragma mark - STSuggestPrefixCache
+
++ (STSuggestPrefixCache *)sharedCache {
+    static dispatch_once_t onceToken;
+    static STSuggestPrefixCache *sharedCache = nil;
+    dispatch_once(&onceToken, ^{
+        sharedCache = [[STSuggestPrefixCache alloc] init];
+    });
+    return sharedCache;
+}
+
+- (void)setCountLimit:(NSUInteger)countLimit {
+    _countLimit = countLimit;
+    self.results.countLimit = countLimit;
+}
+
+- (double)hitRate {
+    @synchronized(self) {
+        if (self.lookupCount == 0) {
+            return 0.0;
+        }
+        return (double)self.hitCount / (double)self.lookupCount;
+    }
+}
+
+- (NSDictionary *)resultForQuery:(NSString *)query params:(NSDictionary *)params {
+    // NSCache is thread safe on its own, only the counters need the lock
+    NSDictionary *result = [self _resultForQuery:query params:params keepsFilteredResult:YES];
+    @synchronized(self) {
+        self.lookupCount++;
+        if (result) {
+            self.hitCount++;
+        }
+    }
+    return result;
+}
+
+- (BOOL)canAnswerQuery:(NSString *)query params:(NSDictionary *)params {
+    // Only asks, the result filtered here isn't kept
+    return [self _resultForQuery:query params:params keepsFilteredResult:NO] != nil;
+}
+
+- (void)storeResult:(NSDictionary *)result forQuery:(NSString *)query params:(NSDictionary *)params {
+    if (![result isKindOfClass:[NSDictionary class]] || query == nil) {
+        return;
+    }
+    if ([[params objectForKey:@"page"] integerValue] > 1) {
+        return;
+    }
+    if (![self _isCompleteResult:result perPage:[[params objectForKey:@"per_page"] unsignedIntegerValue]]) {
+        return;
+    }
+
+    NSString *paramsKey = [self _paramsKey:params];
+    if (paramsKey == nil) {
+        return;
+    }
+    [self.results setObject:result forKey:[self _keyForPrefix:[self _normalizedQuery:query] paramsKey:paramsKey]];
+}
+
+- (void)removeAllResults {
+    [self.results removeAllObjects];
+}
+
+- (void)resetStatistics {
+    @synchronized(self) {
+        self.lookupCount = 0;
+        self.hitCount = 0;
+    }
+}
+
+#pragma mark - Private
+
+- (NSDictionary *)_resultForQuery:(NSString *)query params:(NSDictionary *)params keepsFilteredResult:(BOOL)keep {
+    if ([[params objectForKey:@"page"] integerValue] > 1) {
+        return nil;
+    }
+
+    // Parameters that can't be written as JSON have no key
+    NSString *paramsKey = [self _paramsKey:params];
+    if (paramsKey == nil) {
+        return nil;
+    }
+    NSString *normalizedQuery = [self _normalizedQuery:query];
+    NSCharacterSet *nonWordCharacters = [[NSCharacterSet alphanumericCharacterSet] invertedSet];
+
+    for (NSUInteger length = normalizedQuery.length; length > 0; length--) {
+        NSString *extension = [normalizedQuery substringFromIndex:length];
+        // Past a word boundary the server may match differently so stop looking
+        if ([extension rangeOfCharacterFromSet:nonWordCharacters].location != NSNotFound) {
+            break;
+        }
+
+        NSString *prefix = [normalizedQuery substringToIndex:length];
+        NSDictionary *cached = [self.results objectForKey:[self _keyForPrefix:prefix paramsKey:paramsKey]];
+        if (cached == nil) {
+            continue;
+        }
+
+        if (length == normalizedQuery.length) {
+            return cached;
+        }
+
+        NSDictionary *filtered = [self _filterResult:cached forQuery:query params:params];
+        if (filtered && keep) {
+            // The filtered result is complete as well so the same query and longer prefixes can start from it
+            [self.results setObject:filtered forKey:[self _keyForPrefix:normalizedQuery paramsKey:paramsKey]];
+        }
+        return filtered;
+    }
+
+    return nil;
+}
+
+- (NSString *)_normalizedQuery:(NSString *)query {
+    return [query stringByFoldingWithOptions:NSCaseInsensitiveSearch | NSDiacriticInsensitiveSearch locale:nil];
+}
+
+- (NSString *)_keyForPrefix:(NSString *)prefix paramsKey:(NSString *)paramsKey {
+    return [NSString stringWithFormat:@"%@\n%@", paramsKey, prefix];
+}
+
+- (NSString *)_paramsKey:(NSDictionary *)params {
+    NSMutableDictionary *keyParams = [NSMutableDictionary dictionaryWithDictionary:params];
+    [keyParams removeObjectForKey:@"q"];
+    return [keyParams STCanonicalJSONString];
+}
+
+- (NSArray *)_wordsInString:(NSString *)string {
+    NSArray *components = [[self _normalizedQuery:string] componentsSeparatedByCharactersInSet:[[NSCharacterSet alphanumericCharacterSet] invertedSet]];
+    NSMutableArray *words = [NSMutableArray arrayWithCapacity:components.count];
+    for (NSString *component in components) {
+        if (component.length > 0) {
+            [words addObject:component];
+        }
+    }
+    return words;
+}
+
+- (BOOL)_isCompleteResult:(NSDictionary *)result perPage:(NSUInteger)perPage {
+    NSDictionary *records = [result objectForKey:@"records"];
+    if (![records isKindOfClass:[NSDictionary class]] || records.count == 0 || perPage == 0) {
+        return NO;
+    }
+
+    NSDictionary *info = [result objectForKey:@"info"];
+    for (NSString *type in records) {
+        NSArray *typeRecords = [records objectForKey:type];
+        if (![typeRecords isKindOfClass:[NSArray class]]) {
+            return NO;
+        }
+        if (typeRecords.count < perPage) {
+            continue;
+        }
+
+        NSDictionary *typeInfo = [info isKindOfClass:[NSDictionary class]] ? [info objectForKey:type] : nil;
+        NSNumber *total = [typeInfo isKindOfClass:[NSDictionary class]] ? [typeInfo objectForKey:@"total_result_count"] : nil;
+        if (![total isKindOfClass:[NSNumber class]] || [total unsignedIntegerValue] > typeRecords.count) {
+            return NO;
+        }
+    }
+
+    return YES;
+}
+
+- (NSArray *)_searchFieldsForType:(NSString *)type params:(NSDictionary *)params {
+    NSDictionary *searchFields = [params objectForKey:@"search_fields"];
+    if (![searchFields isKindOfClass:[NSDictionary class]]) {
+        return nil;
+    }
+
+    NSArray *typeFields = [searchFields objectForKey:type];
+    if (![typeFields isKindOfClass:[NSArray class]]) {
+        return nil;
+    }
+
+    // Field names may carry a boost, e.g. "title^3"
+    NSMutableArray *fields = [NSMutableArray arrayWithCapacity:typeFields.count];
+    for (NSString *field in typeFields) {
+        if ([field isKindOfClass:[NSString class]]) {
+            [fields addObject:[[field componentsSeparatedByString:@"^"] objectAtIndex:0]];
+        }
+    }
+    return (fields.count > 0) ? fields : nil;
+}
+
+- (BOOL)_fields:(NSArray *)fields areFetchedForType:(NSString *)type params:(NSDictionary *)params {
+    NSDictionary *fetchFields = [params objectForKey:@"fetch_fields"];
+    if (![fetchFields isKindOfClass:[NSDictionary class]]) {
+        return YES;
+    }
+
+    // Types without fetch_fields come back whole
+    NSArray *typeFetchFields = [fetchFields objectForKey:type];
+    if (typeFetchFields == nil) {
+        return YES;
+    }
+    if (![typeFetchFields isKindOfClass:[NSArray class]]) {
+        return NO;
+    }
+    return [[NSSet setWithArray:fields] isSubsetOfSet:[NSSet setWithArray:typeFetchFields]];
+}
+
+- (NSArray *)_searchableStringsForRecord:(NSDictionary *)record fields:(NSArray *)fields {
+    NSMutableArray *strings = [NSMutableArray array];
+    for (NSString *key in fields) {
+        id value = [record objectForKey:key];
+        // A searched field the record came back without may have been the one the server matched on
+        if (value == nil) {
+            return nil;
+        }
+        if ([value isKindOfClass:[NSString class]]) {
+            [strings addObject:value];
+        }
+        else if ([value isKindOfClass:[NSArray class]]) {
+            for (id item in value) {
+                if ([item isKindOfClass:[NSString class]]) {
+                    [strings addObject:item];
+                }
+            }
+        }
+    }
+    return strings;
+}
+
+- (NSDictionary *)_filterResult:(NSDictionary *)result forQuery:(NSString *)query params:(NSDictionary *)params {
+    NSArray *queryWords = [self _wordsInString:query];
+    if (queryWords.count == 0) {
+        return nil;
+    }
+
+    NSDictionary *records = [result objectForKey:@"records"];
+    NSDictionary *info = [result objectForKey:@"info"];
+    NSMutableDictionary *filteredRecords = [NSMutableDictionary dictionaryWithCapacity:records.count];
+    NSMutableDictionary *filteredInfo = [NSMutableDictionary dictionaryWithCapacity:records.count];
+    NSUInteger recordCount = 0;
+
+    for (NSString *type in records) {
+        // Without the searched fields there is no telling which field the server matched a record on
+        NSArray *fields = [self _searchFieldsForType:type params:params];
+        if (fields == nil || ![self _fields:fields areFetchedForType:type params:params]) {
+            return nil;
+        }
+        NSMutableArray *matches = [NSMutableArray array];
+
+        for (NSDictionary *record in [records objectForKey:type]) {
+            if (![record isKindOfClass:[NSDictionary class]]) {
+                return nil;
+            }
+            NSArray *strings = [self _searchableStringsForRecord:record fields:fields];
+            if (strings == nil) {
+                return nil;
+            }
+
+            NSMutableArray *recordWords = [NSMutableArray array];
+            for (NSString *s in strings) {
+                [recordWords addObjectsFromArray:[self _wordsInString:s]];
+            }
+
+            BOOL matchesAllWords = YES;
+            for (NSString *queryWord in queryWords) {
+                BOOL matchesWord = NO;
+                for (NSString *recordWord in recordWords) {
+                    if ([recordWord hasPrefix:queryWord]) {
+                        matchesWord = YES;
+                        break;
+                    }
+                }
+                if (!matchesWord) {
+                    matchesAllWords = NO;
+                    break;
+                }
+            }
+
+            if (matchesAllWords) {
+                [matches addObject:record];
+            }
+        }
+
+        [filteredRecords setObject:matches forKey:type];
+        recordCount += matches.count;
+
+        NSDictionary *typeInfo = [info isKindOfClass:[NSDictionary class]] ? [info objectForKey:type] : nil;
+        NSMutableDictionary *newTypeInfo = [NSMutableDictionary dictionaryWithDictionary:([typeInfo isKindOfClass:[NSDictionary class]] ? typeInfo : @{})];
+        [newTypeInfo setObject:query forKey:@"query"];
+        [newTypeInfo setObject:@(matches.count) forKey:@"total_result_count"];
+        [newTypeInfo setObject:@1 forKey:@"current_page"];
+        [newTypeInfo setObject:@1 forKey:@"num_pages"];
+        [filteredInfo setObject:newTypeInfo forKey:type];
+    }
+
+    NSMutableDictionary *filtered = [NSMutableDictionary dictionaryWithDictionary:result];
+    [filtered setObject:filteredRecords forKey:@"records"];
+    [filtered setObject:filteredInfo forKey:@"info"];
+    if ([result objectForKey:@"record_count"]) {
+        [filtered setObject:@(recordCount) forKey:@"record_count"];
+    }
+    return filtered;
+}
+
+@end
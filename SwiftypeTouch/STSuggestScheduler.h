@@ -0,0 +1,149 @@
+//
+//  STSuggestScheduler.h
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "STAPIClient.h"
+
+/** Why the scheduler sent a suggest query when it did.
+
+ `STSuggestSchedulerDecisionDebounced` - The query was held back to wait for the user to pause typing.
+
+ `STSuggestSchedulerDecisionWordBoundary` - The user finished a word so the query was sent immediately.
+
+ `STSuggestSchedulerDecisionLocalResult` - The client can answer the query from its caches so it was sent immediately.
+
+ `STSuggestSchedulerDecisionDeferred` - Too many suggest queries were in flight, the query waits for one of them to end.
+
+ `STSuggestSchedulerDecisionCanceled` - The pending query was dropped.
+ */
+typedef enum {
+    STSuggestSchedulerDecisionDebounced,
+    STSuggestSchedulerDecisionWordBoundary,
+    STSuggestSchedulerDecisionLocalResult,
+    STSuggestSchedulerDecisionDeferred,
+    STSuggestSchedulerDecisionCanceled
+} STSuggestSchedulerDecision;
+
+@class STSuggestScheduler;
+
+/**
+ Used by `STSuggestScheduler` to send queries and report its decisions.
+ */
+@protocol STSuggestSchedulerDelegate <NSObject>
+
+/**
+ The scheduler decided that the query should be sent now.
+
+ @param scheduler The scheduler that made the decision
+ @param query The text the user entered
+
+ @return Handle of the started query, or nil if no query was started
+ */
+- (STAPIRequest *)suggestScheduler:(STSuggestScheduler *)scheduler fireQuery:(NSString *)query;
+
+@optional
+
+/**
+ Reports every decision the scheduler makes, useful for tuning its parameters.
+
+ @param scheduler The scheduler that made the decision
+ @param decision What the scheduler decided
+ @param query The text the decision applies to
+ @param delay Number of seconds the query is held back. 0 for queries sent immediately.
+ */
+- (void)suggestScheduler:(STSuggestScheduler *)scheduler didDecide:(STSuggestSchedulerDecision)decision forQuery:(NSString *)query delay:(NSTimeInterval)delay;
+
+@end
+
+/**
+ `STSuggestScheduler` decides when the text typed into a search bar turns into a suggest query.
+
+ Instead of a fixed delay after every keystroke the scheduler adapts to the user and the network:
+
+   * The delay follows the user's typing cadence, so a query goes out shortly after the user pauses.
+   * The delay grows with the client's measured `roundTripTime`, so slow networks are not flooded.
+   * Finishing a word, or typing something the client can answer from its caches, sends the query immediately.
+   * No more than `maxInFlightQueries` suggest queries are outstanding. Newer text waits until one of them ends.
+
+ The owner reports the end of every query returned by `suggestScheduler:fireQuery:` with `queryDidEnd:`.
+ */
+@interface STSuggestScheduler : NSObject
+
+/**
+ Client whose round trip time and caches are consulted
+ */
+@property (nonatomic, weak) STAPIClient *client;
+
+/**
+ Receives the queries to send and the scheduler's decisions
+ */
+@property (nonatomic, weak) id <STSuggestSchedulerDelegate> delegate;
+
+/**
+ Shortest delay used when holding back a query.
+
+ The default value is 0.05 seconds.
+ */
+@property (nonatomic, assign) NSTimeInterval minimumDelay;
+
+/**
+ Longest delay used when holding back a query.
+
+ The default value is 0.5 seconds.
+ */
+@property (nonatomic, assign) NSTimeInterval maximumDelay;
+
+/**
+ Maximum number of suggest queries started by the scheduler that may be outstanding at the same time.
+
+ The default value is 1. A value of 0 is treated as 1.
+ */
+@property (nonatomic, assign) NSUInteger maxInFlightQueries;
+
+/**
+ Smoothed number of seconds between the user's keystrokes. 0 until the user typed twice.
+ */
+@property (nonatomic, readonly) NSTimeInterval keystrokeInterval;
+
+/**
+ The most recent decision
+ */
+@property (nonatomic, readonly) STSuggestSchedulerDecision lastDecision;
+
+/**
+ Delay of the most recent decision in seconds
+ */
+@property (nonatomic, readonly) NSTimeInterval lastDelay;
+
+/**
+ Initializes a new `STSuggestScheduler`
+
+ @param client Client whose round trip time and caches are consulted
+ */
+- (id)initWithClient:(STAPIClient *)client;
+
+/**
+ Tells the scheduler the user changed the text. Any query that was not yet sent is replaced.
+
+ @param text The current text
+ */
+- (void)textDidChange:(NSString *)text;
+
+/**
+ Drops the query that was not yet sent, if any. Queries that are already in flight are not affected.
+ */
+- (void)cancel;
+
+/**
+ Tells the scheduler that a query returned by `suggestScheduler:fireQuery:` finished, failed or was canceled.
+
+ @param request Handle of the query
+ */
+- (void)queryDidEnd:(STAPIRequest *)request;
+
+@end
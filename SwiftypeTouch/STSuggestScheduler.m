@@ -0,0 +1,182 @@
+//
+//  STSuggestScheduler.m
+//  SwiftypeTouch
+//
+//
+//  Copyright (c) 2013 Swiftype, Inc. All rights reserved.
+//
+
+#import "STSuggestScheduler.h"
+#import "STAPIRequestTimeline.h"
+
+@interface STSuggestScheduler ()
+
+@property (nonatomic, strong) NSTimer *timer;
+@property (nonatomic, copy) NSString *pendingQuery;
+@property (nonatomic, assign) BOOL deferred;
+@property (nonatomic, strong) NSMutableArray *inFlightRequests;
+@property (nonatomic, strong) NSDate *lastKeystrokeDate;
+@property (nonatomic, assign) NSTimeInterval keystrokeInterval;
+@property (nonatomic, assign) STSuggestSchedulerDecision lastDecision;
+@property (nonatomic, assign) NSTimeInterval lastDelay;
+
+- (void)_recordKeystroke;
+- (NSTimeInterval)_delay;
+- (void)_timerFired:(NSTimer *)timer;
+- (void)_fireOrDefer;
+- (void)_firePendingQuery;
+- (void)_decide:(STSuggestSchedulerDecision)decision forQuery:(NSString *)query delay:(NSTimeInterval)delay;
+- (NSUInteger)_inFlightLimit;
+
+@end
+
+@implementation STSuggestScheduler
+
+#pragma mark - NSObject
+
+- (id)init {
+    return [self initWithClient:nil];
+}
+
+- (void)dealloc {
+    [_timer invalidate];
+}
+
+#pragma mark - STSuggestScheduler
+
+- (id)initWithClient:(STAPIClient *)client {
+    self = [super init];
+    if (self) {
+        self.client = client;
+        self.minimumDelay = 0.05;
+        self.maximumDelay = 0.5;
+        self.maxInFlightQueries = 1;
+        self.inFlightRequests = [NSMutableArray array];
+    }
+    return self;
+}
+
+- (void)textDidChange:(NSString *)text {
+    [self _recordKeystroke];
+
+    [self.timer invalidate];
+    self.timer = nil;
+    self.deferred = NO;
+    self.pendingQuery = text;
+
+    NSString *strippedText = [text stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
+    if (strippedText.length == 0) {
+        self.pendingQuery = nil;
+        [self _decide:STSuggestSchedulerDecisionCanceled forQuery:text delay:0.0];
+        return;
+    }
+
+    unichar lastCharacter = [text characterAtIndex:text.length - 1];
+    if (![[NSCharacterSet alphanumericCharacterSet] characterIsMember:lastCharacter]) {
+        [self _decide:STSuggestSchedulerDecisionWordBoundary forQuery:text delay:0.0];
+        [self _fireOrDefer];
+    }
+    else if ([self.client canAnswerSuggestQueryLocally:text]) {
+        // No network involved so there is no reason to wait or to respect the in-flight limit
+        [self _decide:STSuggestSchedulerDecisionLocalResult forQuery:text delay:0.0];
+        [self _firePendingQuery];
+    }
+    else {
+        NSTimeInterval delay = [self _delay];
+        [self _decide:STSuggestSchedulerDecisionDebounced forQuery:text delay:delay];
+        self.timer = [NSTimer scheduledTimerWithTimeInterval:delay
+                                                      target:self
+                                                    selector:@selector(_timerFired:)
+                                                    userInfo:nil
+                                                     repeats:NO];
+    }
+}
+
+- (void)cancel {
+    [self.timer invalidate];
+    self.timer = nil;
+    self.deferred = NO;
+    if (self.pendingQuery) {
+        [self _decide:STSuggestSchedulerDecisionCanceled forQuery:self.pendingQuery delay:0.0];
+        self.pendingQuery = nil;
+    }
+}
+
+- (void)queryDidEnd:(STAPIRequest *)request {
+    if (request == nil) return;
+
+    [self.inFlightRequests removeObjectIdenticalTo:request];
+    if (self.deferred && self.inFlightRequests.count < [self _inFlightLimit]) {
+        [self _firePendingQuery];
+    }
+}
+
+#pragma mark - Private
+
+- (void)_recordKeystroke {
+    NSDate *now = [NSDate date];
+    if (self.lastKeystrokeDate) {
+        NSTimeInterval interval = [now timeIntervalSinceDate:self.lastKeystrokeDate];
+        // A long pause is not part of the typing rhythm
+        if (interval < self.maximumDelay * 4.0) {
+            if (self.keystrokeInterval == 0.0) {
+                self.keystrokeInterval = interval;
+            }
+            else {
+                self.keystrokeInterval = 0.7 * self.keystrokeInterval + 0.3 * interval;
+            }
+        }
+    }
+    self.lastKeystrokeDate = now;
+}
+
+- (NSTimeInterval)_delay {
+    // Wait a little longer than the typical gap between keystrokes, but at least half a round trip
+    NSTimeInterval typingDelay = (self.keystrokeInterval > 0.0) ? self.keystrokeInterval * 1.5 : self.maximumDelay / 2.0;
+    NSTimeInterval networkDelay = self.client.roundTripTime * 0.5;
+    NSTimeInterval delay = MAX(typingDelay, networkDelay);
+    return MIN(MAX(delay, self.minimumDelay), self.maximumDelay);
+}
+
+- (void)_timerFired:(NSTimer *)timer {
+    self.timer = nil;
+    [self _fireOrDefer];
+}
+
+- (NSUInteger)_inFlightLimit {
+    // At least one query is always let through, or nothing would ever end to release a deferred one
+    return MAX(self.maxInFlightQueries, 1);
+}
+
+- (void)_fireOrDefer {
+    if (self.inFlightRequests.count >= [self _inFlightLimit]) {
+        self.deferred = YES;
+        [self _decide:STSuggestSchedulerDecisionDeferred forQuery:self.pendingQuery delay:0.0];
+        return;
+    }
+    [self _firePendingQuery];
+}
+
+- (void)_firePendingQuery {
+    NSString *query = self.pendingQuery;
+    self.pendingQuery = nil;
+    self.deferred = NO;
+    if (query == nil) return;
+
+    STAPIRequest *request = [self.delegate suggestScheduler:self fireQuery:query];
+    // How long the query waited after the keystroke that produced it
+    request.timeline.debounceDuration = -[self.lastKeystrokeDate timeIntervalSinceNow];
+    if (request && !request.finished) {
+        [self.inFlightRequests addObject:request];
+    }
+}
+
+- (void)_decide:(STSuggestSchedulerDecision)decision forQuery:(NSString *)query delay:(NSTimeInterval)delay {
+    self.lastDecision = decision;
+    self.lastDelay = delay;
+    if ([self.delegate respondsToSelector:@selector(suggestScheduler:didDecide:forQuery:delay:)]) {
+        [self.delegate suggestScheduler:self didDecide:decision forQuery:query delay:delay];
+    }
+}
+
+@end